@@ -63,6 +63,23 @@ struct __packed nvram_item {
 	char data[0];
 };
 
+#ifdef CONFIG_NVRAM_FAST_INDEX
+struct item_index_entry {
+	/* item offset in segment */
+	u16_t offs;
+	u8_t hash;
+	u8_t name_size;
+};
+
+struct item_index {
+	struct item_index_entry *entry;
+	u16_t max_cnt;
+	u16_t cnt;
+	/* some valid items are not indexed, fall back to segment walk */
+	u8_t overflow;
+};
+#endif
+
 struct region_info
 {
 	struct device *storage;
@@ -85,6 +102,10 @@ struct region_info
 	u32_t *seg_item_map;
 	int seg_item_map_size;
 #endif
+
+#ifdef CONFIG_NVRAM_FAST_INDEX
+	struct item_index *item_index;
+#endif
 };
 
 struct region_check_info
@@ -116,6 +137,14 @@ struct region_check_info
 u32_t user_region_item_map[CONFIG_NVRAM_USER_REGION_SEGMENT_SIZE / NVRAM_ITEM_ALIGN_SIZE / 32];
 #endif
 
+#ifdef CONFIG_NVRAM_FAST_INDEX
+static struct item_index_entry user_region_index_entry[CONFIG_NVRAM_FAST_INDEX_ENTRIES];
+static struct item_index user_region_index = {
+	.entry = user_region_index_entry,
+	.max_cnt = CONFIG_NVRAM_FAST_INDEX_ENTRIES,
+};
+#endif
+
 /* user config region */
 struct region_info user_nvram_region = {
 	.name = "User Config",
@@ -127,6 +156,9 @@ struct region_info user_nvram_region = {
 	.seg_item_map = user_region_item_map,
 	.seg_item_map_size = sizeof(user_region_item_map),
 #endif
+#ifdef CONFIG_NVRAM_FAST_INDEX
+	.item_index = &user_region_index,
+#endif
 };
 
 /* factory config region */
@@ -512,6 +544,53 @@ static void item_bitmap_clear_all(unsigned int *seg_item_map, int item_map_size)
 }
 #endif
 
+#ifdef CONFIG_NVRAM_FAST_INDEX
+static void item_index_update(struct item_index *index, int offset, u8_t hash,
+			      u8_t name_size, int is_set)
+{
+	struct item_index_entry *entry;
+	int i;
+
+	if (!index)
+		return;
+
+	if (is_set) {
+		if (index->cnt >= index->max_cnt) {
+			index->overflow = 1;
+			return;
+		}
+
+		entry = &index->entry[index->cnt++];
+		entry->offs = (u16_t)offset;
+		entry->hash = hash;
+		entry->name_size = name_size;
+		return;
+	}
+
+	for (i = 0; i < index->cnt; i++) {
+		if (index->entry[i].offs == offset) {
+			/* order is not kept, move the last entry here */
+			index->entry[i] = index->entry[--index->cnt];
+			return;
+		}
+	}
+}
+
+static void item_index_clear_all(struct item_index *index)
+{
+	if (!index)
+		return;
+
+	index->cnt = 0;
+	index->overflow = 0;
+}
+
+static bool item_index_is_valid(struct item_index *index)
+{
+	return (index && !index->overflow);
+}
+#endif
+
 
 static int item_is_empty(struct nvram_item *item)
 {
@@ -668,17 +747,63 @@ static int item_check_validity(struct region_info *region, int item_offs, struct
 	return ITEM_STATUS_VALID;
 }
 
+#ifdef CONFIG_NVRAM_FAST_INDEX
+static int region_index_find_item(struct region_info *region, const char *name,
+				  u8_t name_size, u8_t hash, struct nvram_item *item)
+{
+	struct item_index *index = region->item_index;
+	struct nvram_item *hdr = (struct nvram_item *)nvram_buf;
+	u32_t item_offs;
+	int i;
+
+	for (i = 0; i < index->cnt; i++) {
+		if (index->entry[i].hash != hash ||
+		    index->entry[i].name_size != name_size)
+			continue;
+
+		item_offs = region->seg_offset + index->entry[i].offs;
+
+		/* read item header and name together */
+		region_read(region, item_offs, nvram_buf,
+			    sizeof(struct nvram_item) + name_size);
+
+		if (hdr->magic != NVRAM_REGION_ITEM_MAGIC ||
+		    hdr->state != NVRAM_ITEM_STATE_VALID ||
+		    hdr->name_size != name_size)
+			continue;
+
+		if (!memcmp(name, &hdr->data[0], name_size)) {
+			memcpy(item, hdr, sizeof(struct nvram_item));
+			return item_offs;
+		}
+	}
+
+	return -ENOENT;
+}
+#endif
+
 static int region_find_item(struct region_info *region, const char *name,
 				struct nvram_item *item)
 {
 	u32_t item_offs;
 	u16_t hash;
 	int32_t offs;
+	int name_size;
 
 	if (!name || !item)
 		return -EINVAL;
 
-	hash = calc_hash(name, strlen(name) + 1);
+	name_size = strlen(name) + 1;
+	hash = calc_hash(name, name_size);
+
+#ifdef CONFIG_NVRAM_FAST_INDEX
+	if (item_index_is_valid(region->item_index)) {
+		if (name_size > NVRAM_MAX_NAME_SIZE)
+			return -ENOENT;
+
+		return region_index_find_item(region, name, name_size, hash, item);
+	}
+#endif
 
 #ifdef CONFIG_NVRAM_FAST_SEARCH
 	offs = item_bitmap_first_offset(region->seg_item_map, region->seg_size);
@@ -699,7 +824,7 @@ static int region_find_item(struct region_info *region, const char *name,
 			goto next;
 		}
 
-		if (item->hash == hash) {
+		if (item->hash == hash && item->name_size == name_size) {
 			/* read config name */
 			region_read(region, item_offs + sizeof(struct nvram_item),
 				nvram_buf, item->name_size);
@@ -815,6 +940,9 @@ int region_copy_seg(struct region_info *region, u32_t new_seg_offset,
 	/* clear item bitmap for new segment */
 	item_bitmap_clear_all(region->seg_item_map, region->seg_item_map_size);
 #endif
+#ifdef CONFIG_NVRAM_FAST_INDEX
+	item_index_clear_all(region->item_index);
+#endif
 
 	item_offs = old_seg_offset + NVRAM_SEG_ITEM_START_OFFSET;
 	new_item_offs = new_seg_offset + NVRAM_SEG_ITEM_START_OFFSET;
@@ -845,6 +973,10 @@ int region_copy_seg(struct region_info *region, u32_t new_seg_offset,
 #ifdef CONFIG_NVRAM_FAST_SEARCH
 			item_bitmap_update(region->seg_item_map,
 				new_item_offs - new_seg_offset, 1);
+#endif
+#ifdef CONFIG_NVRAM_FAST_INDEX
+			item_index_update(region->item_index, new_item_offs - new_seg_offset,
+				item.hash, item.name_size, 1);
 #endif
 			new_item_offs += item_total_size;
 		}
@@ -883,6 +1015,9 @@ static int region_init_new_seg(struct region_info *region, u32_t seg_offset)
 #ifdef CONFIG_NVRAM_FAST_SEARCH
 	item_bitmap_clear_all(region->seg_item_map, region->seg_item_map_size);
 #endif
+#ifdef CONFIG_NVRAM_FAST_INDEX
+	item_index_clear_all(region->item_index);
+#endif
 
 	return 0;
 }
@@ -1009,6 +1144,11 @@ static int region_set(struct region_info *region, const char *name,
 #ifdef CONFIG_NVRAM_FAST_SEARCH
 		item_bitmap_update(region->seg_item_map,
 			region->seg_write_offset - region->seg_offset, 1);
+#endif
+#ifdef CONFIG_NVRAM_FAST_INDEX
+		item_index_update(region->item_index,
+			region->seg_write_offset - region->seg_offset,
+			calc_hash(name, name_len), name_len, 1);
 #endif
 		region->seg_write_offset += new_item_size;
 	}
@@ -1024,6 +1164,10 @@ static int region_set(struct region_info *region, const char *name,
 
 #ifdef CONFIG_NVRAM_FAST_SEARCH
 		item_bitmap_update(region->seg_item_map, old_item_offs - region->seg_offset, 0);
+#endif
+#ifdef CONFIG_NVRAM_FAST_INDEX
+		item_index_update(region->item_index, old_item_offs - region->seg_offset,
+			item.hash, item.name_size, 0);
 #endif
 	}
 
@@ -1192,6 +1336,9 @@ static int region_seg_scan(struct region_info *region, int force_merge)
 #ifdef CONFIG_NVRAM_FAST_SEARCH
 	item_bitmap_clear_all(region->seg_item_map, region->seg_item_map_size);
 #endif
+#ifdef CONFIG_NVRAM_FAST_INDEX
+	item_index_clear_all(region->item_index);
+#endif
 
 	offs = NVRAM_SEG_ITEM_START_OFFSET;
 	item_offs = region->seg_offset + offs;
@@ -1220,11 +1367,18 @@ static int region_seg_scan(struct region_info *region, int force_merge)
 
 #ifdef CONFIG_NVRAM_FAST_SEARCH
                     item_bitmap_update(region->seg_item_map, old_item_offs - region->seg_offset, 0);
+#endif
+#ifdef CONFIG_NVRAM_FAST_INDEX
+                    item_index_update(region->item_index, old_item_offs - region->seg_offset,
+                        old_item.hash, old_item.name_size, 0);
 #endif
     		    }
     		}
 #ifdef CONFIG_NVRAM_FAST_SEARCH
 			item_bitmap_update(region->seg_item_map, offs, 1);
+#endif
+#ifdef CONFIG_NVRAM_FAST_INDEX
+			item_index_update(region->item_index, offs, item.hash, item.name_size, 1);
 #endif
 		} else if (status == ITEM_STATUS_EMPTY) {
 			break;
@@ -114,6 +114,64 @@ void audio_aps_monitor_set_aps(aps_monitor_info_t *handle, uint8_t status, int l
     }
 }
 
+#ifdef CONFIG_AUDIO_APS_JITTER_CTRL
+static aps_monitor_info_t *jitter_aps_handle;
+
+static void audio_aps_jitter_init(aps_monitor_info_t *handle)
+{
+	uint16_t reduce = handle->aps_reduce_water_mark;
+	uint16_t increase = handle->aps_increase_water_mark;
+
+	/* start from the fixed water marks, never aim above them */
+	audio_jitter_init(&handle->jitter, handle->duration,
+		MIN(CONFIG_AUDIO_APS_JITTER_FLOOR_MS, reduce), reduce + (increase - reduce) / 2,
+		increase, handle->aps_min_level, handle->aps_max_level,
+		handle->aps_default_level, (handle->aps_type & APS_TYPE_SOFT) != 0);
+
+	jitter_aps_handle = handle;
+}
+
+static uint16_t audio_aps_monitor_jitter(aps_monitor_info_t *handle, int stream_length)
+{
+	uint8_t level = audio_jitter_update(&handle->jitter, stream_length);
+
+	audio_aps_monitor_set_aps(handle, APS_OPR_SET, level);
+
+	/* same meaning as the water mark states for pcm_monitor_cb */
+	if (level == handle->aps_default_level)
+		handle->aps_status = APS_STATUS_DEFAULT;
+	else if (level > handle->aps_default_level)
+		handle->aps_status = APS_STATUS_INC;
+	else
+		handle->aps_status = APS_STATUS_DEC;
+
+	return handle->jitter.target >> AUDIO_JITTER_Q;
+}
+
+void audio_aps_jitter_dump(void)
+{
+	aps_monitor_info_t *handle = jitter_aps_handle;
+	audio_jitter_t *jit;
+
+	if (!handle) {
+		printk("no aps jitter controller\n");
+		return;
+	}
+
+	jit = &handle->jitter;
+	printk("aps jitter format %d type 0x%x tick %d ms\n",
+		handle->format, handle->aps_type, jit->interval);
+	printk("\tfill %d ms target %d ms (floor %d max %d)%s\n",
+		jit->fill >> AUDIO_JITTER_Q, jit->target >> AUDIO_JITTER_Q,
+		jit->floor, jit->max_target, jit->learn ? " learning" : "");
+	printk("\tjitter %d ms drift %d/%d levels\n",
+		jit->jitter >> AUDIO_JITTER_Q, jit->drift >> AUDIO_JITTER_Q, 1 << AUDIO_JITTER_Q);
+	printk("\tlevel %d (%d-%d default %d) underruns %u\n",
+		handle->current_level, handle->aps_min_level, handle->aps_max_level,
+		handle->aps_default_level, jit->underruns);
+}
+#endif /* CONFIG_AUDIO_APS_JITTER_CTRL */
+
 uint16_t audio_aps_monitor_normal(aps_monitor_info_t *handle, int stream_length, uint8_t aps_max_level, uint8_t aps_min_level, uint8_t aps_level)
 {
 	uint16_t mid_threshold = 0;
@@ -123,6 +181,12 @@ uint16_t audio_aps_monitor_normal(aps_monitor_info_t *handle, int stream_length,
 		return 0;
 	}
 
+#ifdef CONFIG_AUDIO_APS_JITTER_CTRL
+	if (handle->jitter.interval) {
+		return audio_aps_monitor_jitter(handle, stream_length);
+	}
+#endif
+
 	handle->aps_increase_water_mark = audio_policy_get_increase_threshold(handle->format, handle->stream_type);
 	handle->aps_reduce_water_mark = audio_policy_get_reduce_threshold(handle->format, handle->stream_type);
 	diff_threshold = (handle->aps_increase_water_mark - handle->aps_reduce_water_mark);
@@ -1073,6 +1137,13 @@ void* audio_aps_monitor_init(aps_monitor_params_t *aps_monitor_params)
 		return NULL;
 	}
 
+#ifdef CONFIG_AUDIO_APS_JITTER_CTRL
+	/* tws keeps the water marks, both sides have to follow the master */
+	if (handle->need_aps && !aps_monitor_params->tws_observer) {
+		audio_aps_jitter_init(handle);
+	}
+#endif
+
 	return handle;
 }
 
@@ -1112,6 +1183,10 @@ void audio_aps_monitor_deinit(void *handle, int format, void *tws_observer)
 	if (aps_handle) {
 		if (aps_handle->timeline)
 			timeline_remove_listener(aps_handle->timeline, &aps_handle->timeline_listener);
+#ifdef CONFIG_AUDIO_APS_JITTER_CTRL
+		if (jitter_aps_handle == aps_handle)
+			jitter_aps_handle = NULL;
+#endif
 		mem_free(handle);
 	}
 }
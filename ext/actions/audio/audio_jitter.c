@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2020 Actions Semi Co., Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief adaptive jitter buffer controller for aps.
+*/
+
+#include <string.h>
+#include <misc/util.h>
+#include "audio_jitter.h"
+
+/* fill swing is measured over windows of this length */
+#define JITTER_WINDOW_MS	1000
+/* windows the init target is held while the swing is learned */
+#define JITTER_LEARN_WINDOWS	10
+/* a window swing below the estimate pulls it down by 1/2^n */
+#define JITTER_DECAY_SHIFT	8
+/* fill smoothing, 1/2^n of the new sample per tick */
+#define JITTER_FILL_SHIFT	2
+/* fill error in ms worth one level of proportional action */
+#define JITTER_KP_MS		8
+/* fill error x time in ms x ms worth one level of integral action */
+#define JITTER_KI_MS2		(8 * 64000)
+/* fill error in ms below which the integral runs */
+#define JITTER_KI_BAND_MS	32
+
+#define Q			AUDIO_JITTER_Q
+
+static inline s32_t jitter_clamp(s32_t val, s32_t min, s32_t max)
+{
+	return (val < min) ? min : ((val > max) ? max : val);
+}
+
+void audio_jitter_init(audio_jitter_t *jit, u16_t interval, u16_t floor,
+		u16_t init_target, u16_t max_target, u8_t min_level,
+		u8_t max_level, u8_t default_level, bool invert)
+{
+	memset(jit, 0, sizeof(*jit));
+
+	jit->interval = interval ? interval : 1;
+	jit->win_ticks = (JITTER_WINDOW_MS + jit->interval - 1) / jit->interval;
+	jit->win_left = jit->win_ticks;
+
+	jit->floor = floor;
+	jit->max_target = (max_target > floor) ? max_target : floor;
+	init_target = jitter_clamp(init_target, jit->floor, jit->max_target);
+
+	jit->target = (s32_t)init_target << Q;
+	jit->learn = JITTER_LEARN_WINDOWS;
+
+	jit->min_level = min_level;
+	jit->max_level = max_level;
+	jit->default_level = default_level;
+	jit->level = default_level;
+	jit->invert = invert;
+}
+
+static void jitter_window(audio_jitter_t *jit, int fill)
+{
+	s32_t swing;
+
+	if (fill < jit->win_min)
+		jit->win_min = fill;
+	if (fill > jit->win_max)
+		jit->win_max = fill;
+
+	if (--jit->win_left)
+		return;
+
+	/*
+	 * peak hold with a slow release, the previous peak counts too so a
+	 * drop across the window edge is not missed, and the real trough may
+	 * be up to one tick below the sampled one
+	 */
+	swing = (s32_t)(MAX(jit->win_max, jit->prev_max) - jit->win_min + jit->interval) << Q;
+	if (swing > jit->jitter)
+		jit->jitter = swing;
+	else if (!jit->learn)
+		jit->jitter -= (jit->jitter - swing) >> JITTER_DECAY_SHIFT;
+
+	if (jit->learn)
+		jit->learn--;
+
+	jit->prev_max = jit->win_max;
+	jit->win_min = fill;
+	jit->win_max = fill;
+	jit->win_left = jit->win_ticks;
+}
+
+u8_t audio_jitter_update(audio_jitter_t *jit, int fill)
+{
+	s32_t span = (s32_t)(jit->max_target - jit->floor) << Q;
+	s32_t err, out, lvl, min, max, drift;
+
+	fill = jitter_clamp(fill, 0, INT16_MAX);
+
+	if (!jit->primed) {
+		jit->fill = fill << Q;
+		jit->win_min = fill;
+		jit->win_max = fill;
+		jit->prev_max = fill;
+		jit->primed = 1;
+	} else {
+		jit->fill += ((fill << Q) - jit->fill) / (1 << JITTER_FILL_SHIFT);
+	}
+
+	/* ran dry, the swing was underestimated */
+	if (!fill && jit->win_min) {
+		jit->underruns++;
+		jit->jitter += jit->jitter / 2 + (jit->interval << Q);
+	}
+
+	jitter_window(jit, fill);
+
+	jit->jitter = jitter_clamp(jit->jitter, 0, span);
+	if (!jit->learn)
+		jit->target = ((s32_t)jit->floor << Q) + jit->jitter;
+
+	/* PI on the fill error, the integral settles on the drift */
+	err = jit->fill - jit->target;
+	min = (s32_t)(jit->min_level - jit->default_level) << (2 * Q);
+	max = (s32_t)(jit->max_level - jit->default_level) << (2 * Q);
+
+	/*
+	 * integrate only close to the target and while not saturated, so the
+	 * long catch up from the start level does not wind it up
+	 */
+	drift = jit->drift;
+	if (err >= -(JITTER_KI_BAND_MS << Q) && err <= (JITTER_KI_BAND_MS << Q))
+		drift += (s64_t)err * jit->interval * (1 << Q) / JITTER_KI_MS2;
+
+	out = err * (1 << Q) / JITTER_KP_MS + drift;
+	if (out >= min && out <= max)
+		jit->drift = drift;
+	else
+		out = jitter_clamp(out, min, max);
+
+	lvl = (out + (1 << (2 * Q - 1))) >> (2 * Q);
+	if (jit->invert)
+		lvl = -lvl;
+
+	jit->level = jitter_clamp(jit->default_level + lvl,
+			jit->min_level, jit->max_level);
+
+	return jit->level;
+}
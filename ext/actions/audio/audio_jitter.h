@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2020 Actions Semi Co., Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief adaptive jitter buffer controller for aps.
+ *
+ * Estimates the fill level swing caused by packet arrival jitter and the
+ * clock drift between source and sink from the buffered time sampled on
+ * every aps tick, picks the smallest target fill that keeps the swing
+ * clear of the floor, and steers the aps level around the default one
+ * with a PI controller to hold the fill on that target.
+*/
+
+#ifndef __AUDIO_JITTER_H__
+#define __AUDIO_JITTER_H__
+
+#include <stdbool.h>
+#include <zephyr/types.h>
+
+/* estimates are fixed point ms or levels, 8 fractional bits */
+#define AUDIO_JITTER_Q		8
+
+typedef struct {
+	/* aps tick in ms */
+	u16_t interval;
+	/* lowest fill the target may get to, ms */
+	u16_t floor;
+	/* highest target, ms */
+	u16_t max_target;
+	/* ticks per jitter window and ticks left in the current one */
+	u16_t win_ticks;
+	u16_t win_left;
+	/* windows left before the target follows the estimate */
+	u16_t learn;
+
+	u8_t min_level;
+	u8_t max_level;
+	u8_t default_level;
+	/* higher level plays slower (soft resample aps) */
+	u8_t invert:1;
+	u8_t primed:1;
+
+	s16_t win_min;
+	s16_t win_max;
+	s16_t prev_max;
+
+	/* smoothed fill, Q8 ms */
+	s32_t fill;
+	/* peak to peak fill swing, Q8 ms */
+	s32_t jitter;
+	/* target fill, Q8 ms */
+	s32_t target;
+	/* integral action, Q16 levels, cancels the clock drift in steady state */
+	s32_t drift;
+	/* last level asked for */
+	u8_t level;
+	u32_t underruns;
+} audio_jitter_t;
+
+/**
+ * @brief Initialize a jitter buffer controller
+ *
+ * @param jit controller
+ * @param interval aps tick in ms
+ * @param floor lowest target fill in ms
+ * @param init_target target fill in ms until jitter has been measured
+ * @param max_target highest target fill in ms
+ * @param min_level lowest aps level
+ * @param max_level highest aps level
+ * @param default_level aps level playing at the nominal rate
+ * @param invert true if a higher level plays slower
+ */
+void audio_jitter_init(audio_jitter_t *jit, u16_t interval, u16_t floor,
+		u16_t init_target, u16_t max_target, u8_t min_level,
+		u8_t max_level, u8_t default_level, bool invert);
+
+/**
+ * @brief Feed the buffered time of one aps tick
+ *
+ * @param jit controller
+ * @param fill buffered time in ms
+ *
+ * @return aps level to move to
+ */
+u8_t audio_jitter_update(audio_jitter_t *jit, int fill);
+
+#endif /* __AUDIO_JITTER_H__ */
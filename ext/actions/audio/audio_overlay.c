@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2020 Actions Semi Co., Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief one shot pcm overlay mixed into an audio track.
+*/
+
+#include <string.h>
+#include <errno.h>
+#include "audio_overlay.h"
+
+#define Q			AUDIO_OVERLAY_STEP_Q
+
+/* 11, 22 and 44 KHz stand for the 11.025 KHz family */
+static u32_t overlay_rate_hz(u8_t sample_rate)
+{
+	if (sample_rate % 11 == 0)
+		return sample_rate * 11025 / 11;
+
+	return sample_rate * 1000;
+}
+
+static void overlay_clip_step(audio_overlay_t *overlay, audio_overlay_clip_t *clip)
+{
+	u32_t rate = overlay_rate_hz(overlay->sample_rate);
+
+	clip->step = rate ? (u32_t)(((u64_t)overlay_rate_hz(clip->sample_rate) << Q) / rate) : 0;
+}
+
+static inline s16_t overlay_sat(s32_t val)
+{
+	return (val > INT16_MAX) ? INT16_MAX : ((val < INT16_MIN) ? INT16_MIN : val);
+}
+
+void audio_overlay_init(audio_overlay_t *overlay)
+{
+	memset(overlay, 0, sizeof(*overlay));
+}
+
+void audio_overlay_attach(audio_overlay_t *overlay, u8_t sample_rate, u8_t channels)
+{
+	int i;
+
+	overlay->sample_rate = sample_rate;
+	overlay->channels = channels;
+	overlay->clock = 0;
+
+	memset(overlay->voice, 0, sizeof(overlay->voice));
+
+	for (i = 0; i < CONFIG_AUDIO_TRACK_OVERLAY_CLIPS; i++) {
+		if (overlay->clip[i].pcm)
+			overlay_clip_step(overlay, &overlay->clip[i]);
+	}
+}
+
+int audio_overlay_register(audio_overlay_t *overlay, const s16_t *pcm, u32_t samples,
+		u8_t sample_rate, u16_t gain)
+{
+	audio_overlay_clip_t *clip;
+	int i;
+
+	if (!pcm || !samples || !sample_rate)
+		return -EINVAL;
+
+	for (i = 0; i < CONFIG_AUDIO_TRACK_OVERLAY_CLIPS; i++) {
+		clip = &overlay->clip[i];
+		if (clip->pcm)
+			continue;
+
+		clip->pcm = pcm;
+		clip->samples = samples;
+		clip->sample_rate = sample_rate;
+		clip->gain = gain;
+		overlay_clip_step(overlay, clip);
+		return i;
+	}
+
+	return -ENOSPC;
+}
+
+int audio_overlay_unregister(audio_overlay_t *overlay, int clip)
+{
+	int i;
+
+	if (clip < 0 || clip >= CONFIG_AUDIO_TRACK_OVERLAY_CLIPS || !overlay->clip[clip].pcm)
+		return -EINVAL;
+
+	for (i = 0; i < CONFIG_AUDIO_TRACK_OVERLAY_VOICES; i++) {
+		if (overlay->voice[i].clip == clip + 1)
+			overlay->voice[i].clip = 0;
+	}
+
+	memset(&overlay->clip[clip], 0, sizeof(overlay->clip[clip]));
+	return 0;
+}
+
+int audio_overlay_set_gain(audio_overlay_t *overlay, int clip, u16_t gain)
+{
+	if (clip < 0 || clip >= CONFIG_AUDIO_TRACK_OVERLAY_CLIPS || !overlay->clip[clip].pcm)
+		return -EINVAL;
+
+	overlay->clip[clip].gain = gain;
+	return 0;
+}
+
+int audio_overlay_trigger(audio_overlay_t *overlay, int clip, u32_t delay)
+{
+	audio_overlay_voice_t *voice = NULL;
+	int i;
+
+	if (clip < 0 || clip >= CONFIG_AUDIO_TRACK_OVERLAY_CLIPS || !overlay->clip[clip].pcm)
+		return -EINVAL;
+
+	for (i = 0; i < CONFIG_AUDIO_TRACK_OVERLAY_VOICES; i++) {
+		if (!overlay->voice[i].clip) {
+			voice = &overlay->voice[i];
+			break;
+		}
+
+		if (!voice || (s32_t)(overlay->voice[i].start - voice->start) < 0)
+			voice = &overlay->voice[i];
+	}
+
+	if (voice->clip)
+		overlay->steals++;
+
+	voice->clip = clip + 1;
+	voice->start = overlay->clock + delay;
+	voice->idx = 0;
+	voice->frac = 0;
+	overlay->triggers++;
+
+	return 0;
+}
+
+static void overlay_mix_voice(audio_overlay_t *overlay, audio_overlay_voice_t *voice,
+		s16_t *buf, int frames)
+{
+	const audio_overlay_clip_t *clip = &overlay->clip[voice->clip - 1];
+	s32_t offset = (s32_t)(voice->start - overlay->clock);
+	u32_t idx = voice->idx;
+	u32_t frac = voice->frac;
+	s32_t a, b, val;
+	int i = 0;
+
+	if (offset >= frames)
+		return;
+
+	if (offset > 0) {
+		i = offset;
+		buf += i * overlay->channels;
+	}
+
+	for (; i < frames; i++) {
+		if (idx >= clip->samples) {
+			voice->clip = 0;
+			return;
+		}
+
+		/* ramps to silence past the last sample */
+		a = clip->pcm[idx];
+		b = (idx + 1 < clip->samples) ? clip->pcm[idx + 1] : 0;
+		val = a + (((b - a) * (s32_t)(frac >> 1)) >> (Q - 1));
+		val = (val * clip->gain + (1 << 14)) >> 15;
+
+		*buf = overlay_sat(*buf + val);
+		buf++;
+		if (overlay->channels > 1) {
+			*buf = overlay_sat(*buf + val);
+			buf++;
+		}
+
+		frac += clip->step;
+		idx += frac >> Q;
+		frac &= (1 << Q) - 1;
+	}
+
+	voice->idx = idx;
+	voice->frac = frac;
+}
+
+void audio_overlay_mix(audio_overlay_t *overlay, s16_t *buf, int frames)
+{
+	int i;
+
+	if (frames <= 0)
+		return;
+
+	for (i = 0; i < CONFIG_AUDIO_TRACK_OVERLAY_VOICES; i++) {
+		if (overlay->voice[i].clip)
+			overlay_mix_voice(overlay, &overlay->voice[i], buf, frames);
+	}
+
+	overlay->clock += frames;
+}
+
+bool audio_overlay_is_active(audio_overlay_t *overlay)
+{
+	int i;
+
+	for (i = 0; i < CONFIG_AUDIO_TRACK_OVERLAY_VOICES; i++) {
+		if (overlay->voice[i].clip)
+			return true;
+	}
+
+	return false;
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2020 Actions Semi Co., Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief one shot pcm overlay mixed into an audio track.
+ *
+ * Short mono clips, e.g. key tones, are registered once and then started
+ * on the pcm written to the track, at a chosen frame of the track, without
+ * opening an output of their own. Clips of another sample rate are played
+ * back by linear interpolation and added with their gain, saturated.
+*/
+
+#ifndef __AUDIO_OVERLAY_H__
+#define __AUDIO_OVERLAY_H__
+
+#include <stdbool.h>
+#include <zephyr/types.h>
+
+/** Q15 unity clip gain */
+#define AUDIO_OVERLAY_GAIN_UNITY	0x8000
+
+/* clip position step, 16 fractional bits */
+#define AUDIO_OVERLAY_STEP_Q		16
+
+typedef struct {
+	/* mono s16, NULL if the slot is free */
+	const s16_t *pcm;
+	u32_t samples;
+	/* clip frames per track frame, Q16 */
+	u32_t step;
+	u16_t gain;
+	u8_t sample_rate;
+} audio_overlay_clip_t;
+
+typedef struct {
+	/* playing clip + 1, 0 if idle */
+	u8_t clip;
+	/* track frame of the first sample */
+	u32_t start;
+	/* clip position of the next track frame once started */
+	u32_t idx;
+	u16_t frac;
+} audio_overlay_voice_t;
+
+typedef struct {
+	audio_overlay_clip_t clip[CONFIG_AUDIO_TRACK_OVERLAY_CLIPS];
+	audio_overlay_voice_t voice[CONFIG_AUDIO_TRACK_OVERLAY_VOICES];
+	/* track sample rate in KHz and channels */
+	u8_t sample_rate;
+	u8_t channels;
+	/* track frames mixed so far */
+	u32_t clock;
+	u32_t triggers;
+	u32_t steals;
+} audio_overlay_t;
+
+void audio_overlay_init(audio_overlay_t *overlay);
+
+/**
+ * @brief Bind the overlay to the format of a track
+ *
+ * Stops all voices and restarts the frame clock.
+ *
+ * @param sample_rate track sample rate in KHz
+ * @param channels track channels, 1 or 2 interleaved
+ */
+void audio_overlay_attach(audio_overlay_t *overlay, u8_t sample_rate, u8_t channels);
+
+/**
+ * @brief Register a clip, the pcm is kept by reference
+ *
+ * @param pcm mono s16 samples
+ * @param samples number of samples
+ * @param sample_rate clip sample rate in KHz
+ * @param gain Q15 gain, AUDIO_OVERLAY_GAIN_UNITY plays it as is
+ *
+ * @return clip id, -EINVAL or -ENOSPC
+ */
+int audio_overlay_register(audio_overlay_t *overlay, const s16_t *pcm, u32_t samples,
+		u8_t sample_rate, u16_t gain);
+
+/**
+ * @brief Unregister a clip, its voices stop
+ */
+int audio_overlay_unregister(audio_overlay_t *overlay, int clip);
+
+int audio_overlay_set_gain(audio_overlay_t *overlay, int clip, u16_t gain);
+
+/**
+ * @brief Start a clip
+ *
+ * The oldest voice is taken over when all play.
+ *
+ * @param delay track frames after the next mixed one to start at
+ *
+ * @return 0, -EINVAL if the clip is not registered
+ */
+int audio_overlay_trigger(audio_overlay_t *overlay, int clip, u32_t delay);
+
+/**
+ * @brief Add the playing clips to track pcm and advance the clock
+ *
+ * @param buf interleaved s16 track pcm, mixed in place
+ * @param frames track frames in buf
+ */
+void audio_overlay_mix(audio_overlay_t *overlay, s16_t *buf, int frames);
+
+bool audio_overlay_is_active(audio_overlay_t *overlay);
+
+#endif /* __AUDIO_OVERLAY_H__ */
@@ -71,10 +71,21 @@ static int shell_cmd_dump_tracks(int argc, char *argv[])
 	return 0;
 }
 
+#ifdef CONFIG_AUDIO_APS_JITTER_CTRL
+static int shell_cmd_aps_jitter(int argc, char *argv[])
+{
+	audio_aps_jitter_dump();
+	return 0;
+}
+#endif
+
 const struct shell_cmd audio_shell_commands[] = {
 	{"version", shell_cmd_version, "show version of audio module"},
 	{"dumprecord", shell_cmd_dump_records, "dump audio records"},
 	{"dumptrack", shell_cmd_dump_tracks, "dump audio tracks"},
+#ifdef CONFIG_AUDIO_APS_JITTER_CTRL
+	{"apsjitter", shell_cmd_aps_jitter, "dump aps jitter and drift estimates"},
+#endif
 	{NULL, NULL, NULL}
 };
 
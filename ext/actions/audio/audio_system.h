@@ -16,6 +16,10 @@
 #include <timeline.h>
 #include <hrtimer.h>
 #include <media_service.h>
+#include <audio_jitter.h>
+#ifdef CONFIG_AUDIO_TRACK_OVERLAY
+#include <audio_overlay.h>
+#endif
 
 #define MULTI_CH_MODE_2_0 	0
 #define MULTI_CH_MODE_2_1 	1
@@ -114,6 +118,8 @@ struct audio_track_t {
 
 	u16_t pcm_frame_size;
 	u8_t *pcm_frame_buff;
+	/** length of stream data claimed by dma, committed on next dma irq */
+	u16_t claimed_len;
 
 	io_stream_t audio_stream;
 	io_stream_t mix_stream;
@@ -145,6 +151,11 @@ struct audio_track_t {
 	/* mix */
 	void *mix_handle;
 
+#ifdef CONFIG_AUDIO_TRACK_OVERLAY
+	/* one shot clips mixed into the written pcm */
+	audio_overlay_t *overlay;
+#endif
+
 	timeline_t *timeline;
 
     uint64_t samples_filled;
@@ -308,6 +319,9 @@ typedef struct {
     struct hrtimer timer;
 #endif
 	uint32_t aps_time;
+#ifdef CONFIG_AUDIO_APS_JITTER_CTRL
+	audio_jitter_t jitter;
+#endif
 }aps_monitor_info_t;
 
 typedef struct {
@@ -459,6 +473,8 @@ void audio_aps_monitor_tws_deinit(aps_monitor_info_t *handle,void *tws_observer)
 
 int audio_aps_debug_print(void *handle);
 
+void audio_aps_jitter_dump(void);
+
 struct audio_track_t * audio_system_get_track(void);
 
 int audio_system_mutex_lock(void);
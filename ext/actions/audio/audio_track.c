@@ -21,6 +21,7 @@
 #include <assert.h>
 #include <ringbuff_stream.h>
 #include <arithmetic.h>
+#include <pcm_kernel.h>
 
 #include "bluetooth_tws_observer.h"
 
@@ -32,6 +33,10 @@
 #include <logic.h>
 #endif
 
+#ifdef CONFIG_CPU_LOAD_PROFILE
+#include <cpuload_stat.h>
+#endif
+
 #ifdef CONFIG_PLAY_MERGE_TTS
 #include <tts_manager.h>
 #endif
@@ -123,15 +128,12 @@ static int _audio_track_data_mix(struct audio_track_t *handle, s16_t *src_buff,
 			src_buff += track_channels * mix_samples;
 		} else {
 			if (track_channels > 1) {
-				for (int i = 0; i < mix_samples; i++) {
-					*dest_buff++ = (*src_buff++) / 2 + mix_buff[0][i] / 2;
-					*dest_buff++ = (*src_buff++) / 2 + mix_buff[1][i] / 2;
-				}
+				pcm_mix_avg_stereo_s16(dest_buff, src_buff, mix_buff[0], mix_buff[1], mix_samples);
 			} else {
-				for (int i = 0; i < mix_samples; i++) {
-					*dest_buff++ = (*src_buff++) / 2 + mix_buff[0][i] / 2;
-				}
+				pcm_mix_avg_s16(dest_buff, src_buff, mix_buff[0], mix_samples);
 			}
+			dest_buff += track_channels * mix_samples;
+			src_buff += track_channels * mix_samples;
 		}
 
 		handle->res_remain_samples -= mix_samples;
@@ -226,30 +228,14 @@ __ramfunc int _stream_read(struct audio_track_t *audio_track, io_stream_t handle
 	ret = stream_read(audio_track->audio_stream, buf, len);
 	if (ret == len) {
 		if(len != num) {
-			uint32_t *dst = (uint32_t *)buf;
-			uint8_t *src = (uint8_t *)buf;
 			int l32 = num;
 #ifdef CONFIG_DSP_OUTPUT_1_CH_IN_BMS
 			l32 = l32 / 2;
 #endif
-			for (int i = l32 * 3 / 4 - 1, j = l32 / 4 - 1; i >= 0;) {
-				uint32_t v = ((uint32_t)src[i-2])<<8;
-				v |= ((uint32_t)src[i-1])<<16;
-				v |= ((uint32_t)src[i])<<24;
-				i -= 3;
-				dst[j--] = v;
-			}
+			pcm_unpack_24_32((int32_t *)buf, buf, l32 / 4);
 
 #ifdef CONFIG_DSP_OUTPUT_1_CH_IN_BMS
-			{
-				int32_t *dst = (int32_t *)buf;
-				int32_t *src = (int32_t *)buf;
-				for (int i = l32 / 4 - 1, j = l32 * 2 / 4 - 1; i >= 0;) {
-					dst[j--] = src[i];
-					dst[j--] = src[i];
-					i--;
-				}
-			}
+			pcm_upmix_s32((int32_t *)buf, (int32_t *)buf, l32 / 4);
 #endif
 			ret = num;
 		}
@@ -261,16 +247,50 @@ __ramfunc int _stream_read(struct audio_track_t *audio_track, io_stream_t handle
 #endif
 }
 
+#ifdef CONFIG_AUDIO_TRACK_ZERO_COPY
+static __ramfunc bool _audio_track_read_claim(struct audio_track_t *audio_track, uint8_t **buf, int num)
+{
+	unsigned char *data = NULL;
+
+	/* fallback to copy when data wraps at the end of stream buffer */
+	if (stream_read_claim(audio_track->audio_stream, &data, num) != num)
+		return false;
+
+	audio_track->claimed_len = num;
+	*buf = data;
+	return true;
+}
+
+static __ramfunc void _audio_track_read_commit(struct audio_track_t *audio_track)
+{
+	if (audio_track->claimed_len) {
+		stream_read_commit(audio_track->audio_stream, audio_track->claimed_len);
+		audio_track->claimed_len = 0;
+	}
+}
+#endif
+
 __ramfunc int _audio_track_request_more_data(void *handle, uint32_t reason)
 {
 	static uint8_t printk_cnt;
 	struct audio_track_t *audio_track = (struct audio_track_t *)handle;
 	int read_len = audio_track->pcm_frame_size / 2;
-	int stream_length = _stream_get_length(audio_track, audio_track->audio_stream);
+	int stream_length;
 	int ret = 0;
 	bool reload_mode = ((audio_track->channel_mode & AUDIO_DMA_RELOAD_MODE) == AUDIO_DMA_RELOAD_MODE);
 	uint8_t *buf = audio_track->pcm_frame_buff;
 
+#ifdef CONFIG_AUDIO_TRACK_ZERO_COPY
+	/* dma has finished reading the data claimed last time */
+	_audio_track_read_commit(audio_track);
+#endif
+
+	stream_length = _stream_get_length(audio_track, audio_track->audio_stream);
+
+#ifdef CONFIG_CPU_LOAD_PROFILE
+	cpuload_profile_mark(CPULOAD_MARK_AUDIO_REFILL);
+#endif
+
 #ifdef CONFIG_LOGIC_ANALYZER
 	logic_switch(1);
 #endif
@@ -320,6 +340,10 @@ __ramfunc int _audio_track_request_more_data(void *handle, uint32_t reason)
 #endif
 	if (read_len > _stream_get_length(audio_track, audio_track->audio_stream)) {
 		if (!audio_track->flushed) {
+#ifdef CONFIG_CPU_LOAD_PROFILE
+			/* blame the thread which held the cpu since the last refill */
+			cpuload_profile_event(CPULOAD_EVENT_PCM_EMPTY, CPULOAD_MARK_AUDIO_REFILL, stream_length);
+#endif
 			_stream_read(audio_track, audio_track->audio_stream, buf, stream_length);
 			_aduio_track_update_output_samples(audio_track, stream_length);
 			memset(buf + stream_length, 0, read_len - stream_length);
@@ -348,7 +372,17 @@ __ramfunc int _audio_track_request_more_data(void *handle, uint32_t reason)
 	}
 
 
+#ifdef CONFIG_AUDIO_TRACK_ZERO_COPY
+	/**local music refill more frames by pcm_frame_buff, keep copy mode */
+	if (!reload_mode && audio_track->stream_type != AUDIO_STREAM_LOCAL_MUSIC
+		&& _audio_track_read_claim(audio_track, &buf, read_len)) {
+		ret = read_len;
+	} else {
+		ret = _stream_read(audio_track, audio_track->audio_stream, buf, read_len);
+	}
+#else
 	ret = _stream_read(audio_track, audio_track->audio_stream, buf, read_len);
+#endif
 	if (ret != read_len) {
 		memset(buf, 0, read_len);
 		audio_track->fill_cnt += read_len;
@@ -435,8 +469,8 @@ exit:
 
 		/**last frame send more 2 samples */
 		if (audio_track->flushed && _stream_get_length(audio_track, audio_track->audio_stream) == 0) {
-			memset(buf, 0, 8);
-			hal_aout_channel_write_data(audio_track->audio_handle, buf, 8);
+			memset(audio_track->pcm_frame_buff, 0, 8);
+			hal_aout_channel_write_data(audio_track->audio_handle, audio_track->pcm_frame_buff, 8);
 		}
 	}
 	return 0;
@@ -525,6 +559,11 @@ static void _audio_track_stream_observer_notify(void *observer, int readoff, int
 	if (handle->mix_stream && (type == STREAM_NOTIFY_PRE_WRITE)) {
 		_audio_track_data_mix(handle, (s16_t *)buf, num / 2, (s16_t *)buf);
 	}
+#ifdef CONFIG_AUDIO_TRACK_OVERLAY
+	if (handle->overlay && (type == STREAM_NOTIFY_PRE_WRITE)) {
+		audio_overlay_mix(handle->overlay, (s16_t *)buf, num / handle->frame_size);
+	}
+#endif
 	audio_system_mutex_unlock();
 	if (!handle->started
 		&& (type == STREAM_NOTIFY_WRITE)
@@ -1214,6 +1253,38 @@ io_stream_t audio_track_get_mix_stream(struct audio_track_t *handle)
 	return handle->mix_stream;
 }
 
+#ifdef CONFIG_AUDIO_TRACK_OVERLAY
+int audio_track_set_overlay(struct audio_track_t *handle, audio_overlay_t *overlay)
+{
+	assert(handle);
+
+	if (overlay && handle->audio_format != AUDIO_FORMAT_PCM_16_BIT) {
+		return -EINVAL;
+	}
+
+	audio_system_mutex_lock();
+
+	if (overlay && overlay != handle->overlay) {
+		audio_overlay_attach(overlay, handle->sample_rate,
+				(handle->audio_mode != AUDIO_MODE_MONO) ? 2 : 1);
+	}
+
+	handle->overlay = overlay;
+
+	audio_system_mutex_unlock();
+
+	SYS_LOG_INF("overlay %p, sample_rate %d\n", overlay, handle->sample_rate);
+	return 0;
+}
+
+audio_overlay_t *audio_track_get_overlay(struct audio_track_t *handle)
+{
+	assert(handle);
+
+	return handle->overlay;
+}
+#endif
+
 u32_t audio_track_get_output_samples(struct audio_track_t *handle)
 {
 	SYS_IRQ_FLAGS flags;
@@ -120,6 +120,11 @@ int audio_track_compensate_samples(struct audio_track_t *handle, int samples_cnt
 int audio_track_set_mix_stream(struct audio_track_t *handle, io_stream_t mix_stream,
 		u8_t sample_rate, u8_t channels, u8_t stream_type);
 io_stream_t audio_track_get_mix_stream(struct audio_track_t *handle);
+#ifdef CONFIG_AUDIO_TRACK_OVERLAY
+/* mix the clips of overlay into pcm written from now on, NULL to stop */
+int audio_track_set_overlay(struct audio_track_t *handle, audio_overlay_t *overlay);
+audio_overlay_t *audio_track_get_overlay(struct audio_track_t *handle);
+#endif
 int audio_track_set_mute(struct audio_track_t *handle, bool mute);
 int audio_track_set_fade_out(struct audio_track_t *handle, int fade_time);
 int audio_track_get_remain_pcm_samples(struct audio_track_t *handle);
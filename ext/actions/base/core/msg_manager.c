@@ -32,6 +32,9 @@ static sys_slist_t	global_receiver_list;
 
 static bool lock_flag;
 
+/* last listener resolved by name, senders mostly pass the same name literal */
+static struct msg_listener *last_listener;
+
 static struct msg_listener *msg_manager_find_by_name(char *name)
 {
 	int key;
@@ -40,9 +43,15 @@ static struct msg_listener *msg_manager_find_by_name(char *name)
 
 	key = irq_lock();
 
+	listener = last_listener;
+	if (listener && listener->name == name) {
+		goto exit;
+	}
+
 	SYS_SLIST_FOR_EACH_NODE_SAFE(&global_receiver_list, node, tmp) {
 		listener = LISTENER_INFO(node);
 		if (!strcmp(listener->name, name)) {
+			last_listener = listener;
 			goto exit;
 		}
 	}
@@ -119,18 +128,33 @@ exit:
 bool msg_manager_remove_listener(char *name)
 {
 	struct msg_listener *listener = msg_manager_find_by_name(name);
+#ifdef CONFIG_MSG_RECEIVER_QUEUE
+	os_tid_t tid = NULL;
+#endif
 	bool result = false;
 
 	int key = irq_lock();
 
 	if (listener != NULL) {
 		sys_slist_find_and_remove(&global_receiver_list, (sys_snode_t *)listener);
+		if (last_listener == listener) {
+			last_listener = NULL;
+		}
+#ifdef CONFIG_MSG_RECEIVER_QUEUE
+		tid = listener->tid;
+#endif
 		mem_free(listener);
 		result = true;
 		goto exit;
 	}
 exit:
 	irq_unlock(key);
+
+#ifdef CONFIG_MSG_RECEIVER_QUEUE
+	if (result) {
+		os_msg_queue_release(tid);
+	}
+#endif
 	return result;
 }
 
@@ -161,7 +185,9 @@ bool msg_manager_init(void)
 
 bool msg_manager_send_async_msg(char *receiver, struct app_msg *msg)
 {
+#ifndef CONFIG_MSG_RECEIVER_QUEUE
 	int prio;
+#endif
 	bool result = false;
 	os_tid_t target_thread_tid = OS_ANY;
 #ifdef CONFIG_SYS_WAKELOCK
@@ -171,8 +197,11 @@ bool msg_manager_send_async_msg(char *receiver, struct app_msg *msg)
 		SYS_LOG_WRN("msg mng is lock %s \n",receiver);
 	}
 
+#ifndef CONFIG_MSG_RECEIVER_QUEUE
+	/* keep the mailbox post from being preempted */
 	prio = os_thread_priority_get(os_current_get());
 	os_thread_priority_set(os_current_get(), -1);
+#endif
 
 	if (strcmp(receiver, ALL_RECEIVER_NAME)) {
 		target_thread_tid = msg_manager_listener_tid(receiver);
@@ -192,7 +221,9 @@ exit:
 #ifdef CONFIG_SYS_WAKELOCK
 	//sys_wake_unlock(WAKELOCK_MESSAGE);
 #endif
+#ifndef CONFIG_MSG_RECEIVER_QUEUE
 	os_thread_priority_set(os_current_get(), prio);
+#endif
 	return result;
 }
 
@@ -544,6 +544,118 @@ void acts_ringbuf_defrag(struct acts_ringbuf *buf);
  */
 void acts_ringbuf_dump(struct acts_ringbuf *buf, const char *name, const char *line_prefix);
 
+/*
+ * Single producer / single consumer access
+ *
+ * The acts_ringbuf_spsc_* routines need no irq_lock or mutex as long as
+ * there is exactly one producer context and one consumer context, which
+ * may be a thread, an irq handler or the dsp. The producer only writes
+ * tail and the consumer only writes head, each side reads just the low
+ * 32 bit word of the other counter, so a torn 64 bit read cannot happen.
+ * Data is written before tail is published and read before head is
+ * published, with a memory barrier in between.
+ *
+ * Do not mix them with the plain routines on the same ring buffer while
+ * both sides are running.
+ */
+
+/* Up to two contiguous areas, the second one is used when the ring wraps */
+struct acts_ringbuf_span {
+	void *data[2];
+	uint32_t len[2];
+};
+
+/**
+ * @brief Determine data length, consumer side.
+ *
+ * @param buf Address of ring buffer.
+ *
+ * @return Ring buffer data length in elements.
+ */
+uint32_t acts_ringbuf_spsc_length(struct acts_ringbuf *buf);
+
+/**
+ * @brief Determine free space, producer side.
+ *
+ * @param buf Address of ring buffer.
+ *
+ * @return Ring buffer free space in elements.
+ */
+uint32_t acts_ringbuf_spsc_space(struct acts_ringbuf *buf);
+
+/**
+ * @brief Claim free space for writing, wrap included.
+ *
+ * Several claims may be filled and published by one
+ * acts_ringbuf_spsc_put_commit.
+ *
+ * @param[in]  buf Address of ring buffer.
+ * @param[out] span Claimed areas.
+ * @param[in]  size Requested size in elements.
+ *
+ * @return Number of elements claimed, smaller than requested if there is
+ *	   not enough free space.
+ */
+uint32_t acts_ringbuf_spsc_put_claim(struct acts_ringbuf *buf,
+		struct acts_ringbuf_span *span, uint32_t size);
+
+/**
+ * @brief Publish elements written to claimed space.
+ *
+ * @param buf Address of ring buffer.
+ * @param size Number of elements written.
+ *
+ * @retval 0 Successful operation.
+ * @retval -EINVAL Provided @a size exceeds free space in the ring buffer.
+ */
+int acts_ringbuf_spsc_put_commit(struct acts_ringbuf *buf, uint32_t size);
+
+/**
+ * @brief Claim valid data for reading, wrap included.
+ *
+ * @param[in]  buf Address of ring buffer.
+ * @param[out] span Claimed areas.
+ * @param[in]  size Requested size in elements.
+ *
+ * @return Number of elements claimed, smaller than requested if there is
+ *	   not enough data.
+ */
+uint32_t acts_ringbuf_spsc_get_claim(struct acts_ringbuf *buf,
+		struct acts_ringbuf_span *span, uint32_t size);
+
+/**
+ * @brief Release elements read from claimed data.
+ *
+ * @param buf Address of ring buffer.
+ * @param size Number of elements read.
+ *
+ * @retval 0 Successful operation.
+ * @retval -EINVAL Provided @a size exceeds valid elements in the ring buffer.
+ */
+int acts_ringbuf_spsc_get_commit(struct acts_ringbuf *buf, uint32_t size);
+
+/**
+ * @brief Write a ring buffer, producer side.
+ *
+ * @param buf Address of ring buffer.
+ * @param data Address of data, NULL to only advance tail.
+ * @param size Size of data in elements.
+ *
+ * @return @a size if written, or 0 if there is not enough free space.
+ */
+uint32_t acts_ringbuf_spsc_put(struct acts_ringbuf *buf, const void *data, uint32_t size);
+
+/**
+ * @brief Read a ring buffer, consumer side.
+ *
+ * @param buf Address of ring buffer.
+ * @param data Address of data, NULL to only drop.
+ * @param size Size of data in elements.
+ *
+ * @return @a size if read, or 0 if there is not enough data.
+ */
+uint32_t acts_ringbuf_spsc_get(struct acts_ringbuf *buf, void *data, uint32_t size);
+
 #ifdef __cplusplus
 }
 #endif
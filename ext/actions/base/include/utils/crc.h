@@ -12,9 +12,33 @@
 #ifndef __UTILS_CRC_H__
 #define __UTILS_CRC_H__
 
+/**
+ * @brief Generic MSB first CRC16 with augmented initial value
+ *
+ * @param pad non-zero to append the two implicit trailing zero bytes
+ */
 uint16_t utils_crc16(const uint8_t *src, int len, uint16_t polynomial,
 		     uint16_t initial_value, int pad);
 
+/**
+ * @brief CRC16 poly 0x1021, MSB first, e.g. XMODEM when crc starts at 0
+ *
+ * All update routines are incremental: pass the returned value back in
+ * as crc to continue over the next chunk of a stream.
+ */
+uint16_t utils_crc16_ccitt_update(uint16_t crc, const uint8_t *src, int len);
+
+/** @brief CRC16 poly 0x1021 reflected (0x8408), LSB first, e.g. KERMIT */
+uint16_t utils_crc16_ccitt_rev_update(uint16_t crc, const uint8_t *src, int len);
+
+/** @brief CRC16 poly 0x8005 reflected (0xa001), LSB first, e.g. ARC */
+uint16_t utils_crc16_ibm_rev_update(uint16_t crc, const uint8_t *src, int len);
+
+/**
+ * @brief CRC32 (IEEE 802.3), incremental
+ *
+ * @param crc 0 to start, or the value returned for the previous chunk
+ */
 uint32_t utils_crc32(uint32_t crc, const uint8_t *buf, int len);
 
 #endif /* __UTILS_CRC_H__ */
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2019 Actions Semiconductor Co., Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief PCM sample kernels
+ *
+ * Mix, gain and format conversion loops used on the audio refill paths.
+ * Results are bit exact with the plain per sample C loops whatever the
+ * buffer alignment; aligned buffers are processed a 32 bit word at a time.
+ */
+
+#ifndef __UTILS_PCM_KERNEL_H__
+#define __UTILS_PCM_KERNEL_H__
+
+#include <stdint.h>
+
+/** Q15 unity gain for pcm_gain_ramp_s16 */
+#define PCM_GAIN_Q15_UNITY	0x8000
+
+/**
+ * @brief out[i] = a[i] / 2 + b[i] / 2, truncated like C division
+ *
+ * out may be the same buffer as a.
+ */
+void pcm_mix_avg_s16(int16_t *out, const int16_t *a, const int16_t *b, int samples);
+
+/**
+ * @brief Average mix of interleaved stereo a with planar stereo b_l, b_r
+ *
+ * out may be the same buffer as a.
+ */
+void pcm_mix_avg_stereo_s16(int16_t *out, const int16_t *a, const int16_t *b_l,
+			    const int16_t *b_r, int frames);
+
+/**
+ * @brief out[i] = a[i] + b[i], saturated to 16 bit
+ *
+ * out may be the same buffer as a.
+ */
+void pcm_mix_sat_s16(int16_t *out, const int16_t *a, const int16_t *b, int samples);
+
+/**
+ * @brief Apply a linearly ramped Q15 gain in place
+ *
+ * Every sample of a frame is scaled by gain, rounded, then gain moves by
+ * step for the next frame, staying within 0 .. PCM_GAIN_Q15_UNITY.
+ *
+ * @param channels 1 or 2, samples are interleaved
+ *
+ * @return gain for the frame following the buffer
+ */
+int32_t pcm_gain_ramp_s16(int16_t *buf, int frames, int channels,
+			  int32_t gain, int32_t step);
+
+/**
+ * @brief Unpack little endian 24 bit samples to left aligned 32 bit
+ *
+ * out may be the same buffer as in, the conversion runs backwards.
+ */
+void pcm_unpack_24_32(int32_t *out, const uint8_t *in, int samples);
+
+/**
+ * @brief Widen 16 bit samples to left aligned 32 bit
+ *
+ * out may be the same buffer as in, the conversion runs backwards.
+ */
+void pcm_widen_16_32(int32_t *out, const int16_t *in, int samples);
+
+/** @brief Interleave planar l, r into stereo out */
+void pcm_interleave_s16(int16_t *out, const int16_t *l, const int16_t *r, int frames);
+
+/** @brief Split interleaved stereo in into planar l, r */
+void pcm_deinterleave_s16(int16_t *l, int16_t *r, const int16_t *in, int frames);
+
+/**
+ * @brief Duplicate mono samples into both channels of interleaved stereo
+ *
+ * out may be the same buffer as in, the conversion runs backwards.
+ */
+void pcm_upmix_s16(int16_t *out, const int16_t *in, int samples);
+
+/** @brief 32 bit variant of pcm_upmix_s16 */
+void pcm_upmix_s32(int32_t *out, const int32_t *in, int samples);
+
+#endif /* __UTILS_PCM_KERNEL_H__ */
@@ -70,7 +70,8 @@ typedef enum {
 	/** write stream block*/
 	MODE_WRITE_BLOCK = 0x08,
 	/**
-	 * read/write stream block timeout , 1s timeout,
+	 * read/write stream block timeout , 1s timeout by default,
+	 * changed by stream_set_block_timeout,
 	 * if not set this bit ,timeout for forever
      */
 	MODE_BLOCK_TIMEOUT = 0x10,
@@ -112,6 +113,14 @@ typedef struct {
 	/** stream destroy operation Function pointer*/
 	int (*destroy)(io_stream_t handle);
 	void *(*get_ringbuffer)(io_stream_t handle);
+	/** stream read claim operation Function pointer*/
+	int (*read_claim)(io_stream_t handle, unsigned char **buf, int num);
+	/** stream read commit operation Function pointer*/
+	int (*read_commit)(io_stream_t handle, int num);
+	/** stream write claim operation Function pointer*/
+	int (*write_claim)(io_stream_t handle, unsigned char **buf, int num);
+	/** stream write commit operation Function pointer*/
+	int (*write_commit)(io_stream_t handle, int num);
 } stream_ops_t;
 
 /**
@@ -174,6 +183,79 @@ int stream_read(io_stream_t handle, unsigned char *buf, int num);
  */
 int stream_write(io_stream_t handle, unsigned char *buf, int num);
 
+/**
+ * @brief claim data of stream for reading in place
+ *
+ * This routine provides the address of num bytes of continuous data inside
+ * the stream, so the caller can consume them without copying. The data
+ * stays owned by the stream reader until stream_read_commit is called, the
+ * writer can not overwrite it before then.
+ *
+ * Only streams which implement read_claim support this, and streams with
+ * MODE_IN attached streams are not supported, caller must fallback to
+ * stream_read when this routine returns < num.
+ *
+ * @param handle handle of stream
+ * @param buf store the address of claimed data
+ * @param num bytes user want to claim
+ *
+ * @return >=0 the realy claimed data length, smaller than num if data
+ *             not enough or data wraps at the end of buffer.
+ * @return <0  stream not support claim
+ */
+int stream_read_claim(io_stream_t handle, unsigned char **buf, int num);
+
+/**
+ * @brief commit data claimed by stream_read_claim
+ *
+ * This routine releases num bytes of data claimed by stream_read_claim,
+ * the space can be written again after this routine.
+ *
+ * @param handle handle of stream
+ * @param num bytes user consumed, no more than the claimed length
+ *
+ * @return 0 commit success
+ * @return <0  commit failed
+ */
+int stream_read_commit(io_stream_t handle, int num);
+
+/**
+ * @brief claim space of stream for writing in place
+ *
+ * This routine provides the address of num bytes of continuous free space
+ * inside the stream, so the caller can produce data there without copying.
+ * Nothing is visible to the reader until stream_write_commit is called.
+ *
+ * Only streams which implement write_claim support this, and streams with
+ * MODE_OUT attached streams are not supported, caller must fallback to
+ * stream_write when this routine returns < num. It never blocks, so it
+ * may be called from irq context.
+ *
+ * @param handle handle of stream
+ * @param buf store the address of claimed space
+ * @param num bytes user want to claim
+ *
+ * @return >=0 the realy claimed space length, smaller than num if space
+ *             not enough or space wraps at the end of buffer.
+ * @return <0  stream not support claim
+ */
+int stream_write_claim(io_stream_t handle, unsigned char **buf, int num);
+
+/**
+ * @brief commit data written to space claimed by stream_write_claim
+ *
+ * This routine makes num bytes written at the claimed address visible
+ * to the reader.
+ *
+ * @param handle handle of stream
+ * @param buf the claimed address, passed to the write observers
+ * @param num bytes user written, no more than the claimed length
+ *
+ * @return 0 commit success
+ * @return <0  commit failed
+ */
+int stream_write_commit(io_stream_t handle, unsigned char *buf, int num);
+
 /**
  * @brief seek stream
  *
@@ -362,7 +444,22 @@ struct __stream {
 	/** total size*/
 	u32_t total_size;
 
-	os_sem *sync_sem;
+	/** blocked reader wait on it, given when data length reach read_wait_len */
+	os_sem *read_sem;
+	/** blocked writer wait on it, given when free space reach write_wait_len */
+	os_sem *write_sem;
+	/** bytes the blocked reader waiting for, 0 if no reader blocked */
+	u32_t read_wait_len;
+	/** bytes the blocked writer waiting for, 0 if no writer blocked */
+	u32_t write_wait_len;
+	/** write offset the blocked seek waiting for, 0 if no seek blocked */
+	u32_t seek_wait_ofs;
+	/** min data length to wake up blocked reader, 0 means wake as soon as possible */
+	u32_t read_watermark;
+	/** min free space to wake up blocked writer, 0 means wake as soon as possible */
+	u32_t write_watermark;
+	/** deadline in ms of MODE_BLOCK_TIMEOUT */
+	u32_t block_timeout;
 
 	void *observer[2];
 	u8_t  observer_type[2];
@@ -395,6 +492,38 @@ struct __stream {
  */
 int stream_set_cache_size(io_stream_t handle, int size);
 
+/**
+ * @brief set stream block timeout
+ *
+ * This routine provides set the deadline of blocked read and write,
+ * only take effect when stream opened with MODE_BLOCK_TIMEOUT.
+ *
+ * @param handle handle of stream
+ * @param timeout_ms deadline in milliseconds
+ *
+ * @return 0 set success
+ * @return !=0  set failed
+ */
+int stream_set_block_timeout(io_stream_t handle, int timeout_ms);
+
+/**
+ * @brief set stream wakeup watermark
+ *
+ * This routine provides set the watermark of blocked read and write.
+ * blocked reader is woken up when data length reach max(request bytes,
+ * read_watermark), and blocked writer is woken up when free space reach
+ * max(request bytes, write_watermark), so the larger watermark the less
+ * context switch. 0 means wake up as soon as request bytes is available.
+ *
+ * @param handle handle of stream
+ * @param read_watermark data length watermark of blocked reader
+ * @param write_watermark free space watermark of blocked writer
+ *
+ * @return 0 set success
+ * @return !=0  set failed
+ */
+int stream_set_watermark(io_stream_t handle, int read_watermark, int write_watermark);
+
 /**
  * @brief add stream observer
  *
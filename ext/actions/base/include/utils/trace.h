@@ -26,4 +26,6 @@ int trace_irq_print_set(unsigned int irq_enable);
 
 int trace_dma_print_set(unsigned int dma_enable);
 
+int trace_binary_print_set(unsigned int binary_enable);
+
 #endif /* TRACE_H_ */
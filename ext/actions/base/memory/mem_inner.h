@@ -16,7 +16,7 @@ void *mem_pool_malloc(unsigned int num_bytes);
 void mem_pool_free(void *ptr);
 #endif
 
-#ifdef APP_USED_MEM_SLAB
+#ifdef CONFIG_APP_USED_MEM_SLAB
 #define SLAB0_BUSY 		0x01
 #define SLAB1_BUSY 		0x02
 #define ALL_SLAB_BUSY 	0x03
@@ -44,12 +44,46 @@ struct slab_info
 #endif
 };
 
+/* size map granularity, size map is indexed by (size + 7) / 8 */
+#define SLAB_SIZE_MAP_SHIFT		3
+/* addr map page size, addr map is indexed by (addr - base) / 64 */
+#define SLAB_ADDR_MAP_SHIFT		6
+
+/* statistics of one slab size class */
+struct slab_stat
+{
+	uint32_t alloc_cnt;
+	uint32_t fail_cnt;
+	/* total and worst cycles spent in mem_slabs_alloc */
+	uint32_t alloc_cycles;
+	uint32_t max_alloc_cycles;
+	/* total and worst cycles with irq locked, by alloc and free */
+	uint32_t irq_off_cycles;
+	uint32_t max_irq_off_cycles;
+};
+
+/* O(1) lookup tables of slabs, built by slabs_mem_init */
+struct slabs_index
+{
+	/* first fit slab index of each size, indexed by (size + 7) >> SLAB_SIZE_MAP_SHIFT */
+	uint8_t * size_map;
+	uint16_t size_map_num;
+	/* first slab index in each page of slab buffer, indexed by (addr - base) >> SLAB_ADDR_MAP_SHIFT */
+	uint16_t addr_map_num;
+	uint8_t * addr_map;
+	uint32_t base;
+	uint32_t size;
+	struct slab_stat * stat;
+};
+
 struct slabs_info
 {
 	uint16_t slab_num;
 	uint16_t slab_flag;
 	uint8_t * max_used;
 	uint16_t * max_size;
+	/* optional, fallback to linear scan if NULL */
+	struct slabs_index * index;
 	struct slab_info slabs[CONFIG_SLAB_TOTAL_NUM];
 };
 
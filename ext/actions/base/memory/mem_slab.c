@@ -17,6 +17,7 @@
 #include <toolchain.h>
 #include <linker/sections.h>
 #include <string.h>
+#include "mem_inner.h"
 
 struct k_mem_slab mem_slab[CONFIG_SLAB_TOTAL_NUM];
 uint8_t system_max_used[CONFIG_SLAB_TOTAL_NUM];
@@ -40,6 +41,22 @@ sys_slist_t dynamic_slab_list[CONFIG_SLAB_TOTAL_NUM];
 
 char __aligned(4) mem_slab_buffer[SLAB_TOTAL_SIZE];
 
+/* slab8 is the biggest size class */
+#define SLAB_SIZE_MAP_NUM ((CONFIG_SLAB8_BLOCK_SIZE >> SLAB_SIZE_MAP_SHIFT) + 1)
+#define SLAB_ADDR_MAP_NUM ((SLAB_TOTAL_SIZE + (1 << SLAB_ADDR_MAP_SHIFT) - 1) >> SLAB_ADDR_MAP_SHIFT)
+
+static uint8_t system_size_map[SLAB_SIZE_MAP_NUM];
+static uint8_t system_addr_map[SLAB_ADDR_MAP_NUM];
+static struct slab_stat system_slab_stat[CONFIG_SLAB_TOTAL_NUM];
+
+static struct slabs_index system_slab_index = {
+	.size_map = system_size_map,
+	.size_map_num = SLAB_SIZE_MAP_NUM,
+	.addr_map = system_addr_map,
+	.addr_map_num = SLAB_ADDR_MAP_NUM,
+	.stat = system_slab_stat,
+};
+
 
 #define SLAB0_BLOCK_OFF 0
 
@@ -81,6 +98,7 @@ const struct  slabs_info sys_slab =
 	.max_used = system_max_used,
 	.max_size = system_max_size,
 	.slab_flag = SYSTEM_MEM_SLAB,
+	.index = &system_slab_index,
 	.slabs = {
 			 {
 				.slab = &mem_slab[0],
@@ -174,10 +192,39 @@ const struct  slabs_info sys_slab =
 			}
 };
 
+static inline uint32_t slab_end_addr(struct slabs_info * slabs, int slab_index)
+{
+	return (uint32_t)slabs->slabs[slab_index].slab_base +
+			slabs->slabs[slab_index].block_size *
+			slabs->slabs[slab_index].block_num;
+}
+
 static int find_slab_by_addr(struct slabs_info * slabs, void * addr)
 {
 	int i = 0;
 	int target_slab_index = slabs->slab_num;
+	struct slabs_index *index = slabs->index;
+
+	if (index) {
+		uint32_t offset = (uint32_t)addr - index->base;
+
+		if (offset >= index->size)
+			return slabs->slab_num;
+
+		/* one page may hold the tail of several small slabs */
+		for (i = index->addr_map[offset >> SLAB_ADDR_MAP_SHIFT];
+				i < slabs->slab_num; i++) {
+			if (slab_end_addr(slabs, i) > (uint32_t)addr)
+				break;
+		}
+
+		if (i < slabs->slab_num
+			&& (uint32_t)slabs->slabs[i].slab_base <= (uint32_t)addr) {
+			target_slab_index = i;
+		}
+		return target_slab_index;
+	}
+
 	for (i = 0 ; i < slabs->slab_num; i++) {
 		if ((uint32_t)slabs->slabs[i].slab_base <= (uint32_t)addr
 			&& (uint32_t)((uint32_t)slabs->slabs[i].slab_base +
@@ -197,7 +244,6 @@ static void* malloc_from_stable_slab(struct slabs_info * slabs,int slab_index)
 		if(!k_mem_slab_alloc(
 					slabs->slabs[slab_index].slab,
 					&block_ptr, K_NO_WAIT)) {
-			memset(block_ptr, 0, slabs->slabs[slab_index].block_size);
 			if (slabs->max_used[slab_index] <
 				k_mem_slab_num_used_get(slabs->slabs[slab_index].slab))	{
 				slabs->max_used[slab_index] =
@@ -224,22 +270,21 @@ static void* malloc_from_stable_slab(struct slabs_info * slabs,int slab_index)
 	return block_ptr;
 }
 
-static bool free_to_stable_slab(struct slabs_info *slabs, void * ptr)
+/* returns the slab index, slabs->slab_num if ptr is not in a slab */
+static int free_to_stable_slab(struct slabs_info *slabs, void * ptr)
 {
 	int slab_index = find_slab_by_addr(slabs, ptr);
 	if (slab_index >= 0 && slab_index < slabs->slab_num) {
-		memset(ptr,
-				0, slabs->slabs[slab_index].block_size);
-
+		/* block is cleared by allocator, not here */
 		k_mem_slab_free(slabs->slabs[slab_index].slab,
 						&ptr);
 	#ifdef DEBUG
 		SYS_LOG_DBG("mem_free to stable slab %d "
 						": ptr %p ",slab_index, ptr);
 	#endif
-		return true;
+		return slab_index;
 	}
-	return false;
+	return slabs->slab_num;
 }
 
 #ifdef CONFIG_USED_DYNAMIC_SLAB
@@ -404,6 +449,7 @@ begin_new_daynamic_slab:
 	new_slab = (struct dynamic_slab_info *)malloc_from_stable_slab(slabs, 0);
 
 	if (new_slab != NULL) {
+		memset(new_slab, 0, sizeof(*new_slab));
 		new_slab->base_addr = base_addr;
 	} else {
 		SYS_LOG_ERR("slab 0 is small, can't mem_malloc dynamic_slab_node");
@@ -458,6 +504,25 @@ static int find_from_dynamic_slab(struct slabs_info *slabs, int slab_index)
 }
 #endif
 
+static int find_first_fit_slab(struct slabs_info *slabs, unsigned int num_bytes)
+{
+	struct slabs_index *index = slabs->index;
+	uint32_t size_index = (num_bytes + (1 << SLAB_SIZE_MAP_SHIFT) - 1) >> SLAB_SIZE_MAP_SHIFT;
+	int i;
+
+	if (index) {
+		if (size_index >= index->size_map_num)
+			return slabs->slab_num;
+		return index->size_map[size_index];
+	}
+
+	for (i = 0; i < slabs->slab_num; i++) {
+		if (slabs->slabs[i].block_size >= num_bytes)
+			break;
+	}
+	return i;
+}
+
 static int find_slab_index(struct slabs_info *slabs, unsigned int num_bytes)
 {
 	uint8_t i = 0;
@@ -466,7 +531,8 @@ static int find_slab_index(struct slabs_info *slabs, unsigned int num_bytes)
 
 	uint8_t flag=1;
 
-	for(i = 0; i < slabs->slab_num; i++) {
+	/* size classes are sorted, start from the first fit directly */
+	for(i = find_first_fit_slab(slabs, num_bytes); i < slabs->slab_num; i++) {
 		if (slabs->slabs[i].block_size >= num_bytes) {
 			target_slab_index = i;
 			if (first_fit_slab == slabs->slab_num) {
@@ -553,9 +619,47 @@ static void dump_mem_hex(struct slabs_info *slabs, int slab_index)
 
 }
 
+/* alloc and free keep irq locked from start_cycles on */
+static uint32_t slabs_irq_off_update(struct slabs_info * slabs, int slab_index,
+					uint32_t start_cycles)
+{
+	struct slab_stat *stat = &slabs->index->stat[slab_index];
+	uint32_t cycles = k_cycle_get_32() - start_cycles;
+
+	stat->irq_off_cycles += cycles;
+	if (stat->max_irq_off_cycles < cycles)
+		stat->max_irq_off_cycles = cycles;
+
+	return cycles;
+}
+
+static void slabs_stat_update(struct slabs_info * slabs, int slab_index,
+					bool success, uint32_t start_cycles)
+{
+	struct slab_stat *stat;
+	uint32_t cycles;
+
+	if (!slabs->index || slab_index >= slabs->slab_num)
+		return;
+
+	stat = &slabs->index->stat[slab_index];
+	cycles = slabs_irq_off_update(slabs, slab_index, start_cycles);
+
+	if (success) {
+		stat->alloc_cnt++;
+	} else {
+		stat->fail_cnt++;
+	}
+
+	stat->alloc_cycles += cycles;
+	if (stat->max_alloc_cycles < cycles)
+		stat->max_alloc_cycles = cycles;
+}
+
 void * mem_slabs_malloc(struct slabs_info * slabs, unsigned int num_bytes)
 {
 	void * block_ptr = NULL;
+	uint32_t start_cycles = k_cycle_get_32();
 	unsigned int key = irq_lock();
 	int slab_index = find_slab_index(slabs, num_bytes);
 
@@ -576,7 +680,6 @@ void * mem_slabs_malloc(struct slabs_info * slabs, unsigned int num_bytes)
 	block_ptr = malloc_from_dynamic_slab(slabs, slab_index);
 	if(block_ptr != NULL)
 	{
-		memset(block_ptr, 0, num_bytes);
 		goto END;
 	}
 #endif
@@ -593,18 +696,30 @@ END:
 	SYS_LOG_INF("Memory allocation num_bytes %d : block_ptr %p slab_index %d",
 				num_bytes, block_ptr, slab_index);
 #endif
+	if (slab_index >= slabs->slab_num)
+		slab_index = find_first_fit_slab(slabs, num_bytes);
+	slabs_stat_update(slabs, slab_index, block_ptr != NULL, start_cycles);
+	irq_unlock(key);
+
 	if(block_ptr == NULL)
 	{
 //		dump_stack();
 		SYS_LOG_ERR("Memory allocation failed , num_bytes %d ", num_bytes);
 	}
-	irq_unlock(key);
+	else
+	{
+		/* only the requested bytes, and out of irq lock */
+		memset(block_ptr, 0, num_bytes);
+	}
+
 	return block_ptr;
 }
 
 void mem_slabs_free(struct slabs_info * slabs, void *ptr)
 {
+	uint32_t start_cycles = k_cycle_get_32();
 	unsigned int key = irq_lock();
+	int slab_index = slabs->slab_num;
 
 #ifdef DEBUG
 	SYS_LOG_DBG("Memory Free  ptr %p begin",ptr);
@@ -621,7 +736,8 @@ void mem_slabs_free(struct slabs_info * slabs, void *ptr)
 			goto exit;
 		}
 #endif
-		if(!free_to_stable_slab(slabs, ptr))
+		slab_index = free_to_stable_slab(slabs, ptr);
+		if(slab_index >= slabs->slab_num)
 		{
 		#ifdef DEBUG
 			dump_stack();
@@ -638,9 +754,41 @@ void mem_slabs_free(struct slabs_info * slabs, void *ptr)
 		SYS_LOG_ERR("Memory Free ERR NULL ");
 	}
 exit:
+	if (slabs->index && slab_index < slabs->slab_num)
+		slabs_irq_off_update(slabs, slab_index, start_cycles);
 	irq_unlock(key);
 }
 
+static void slabs_index_init(struct slabs_info * slabs)
+{
+	struct slabs_index *index = slabs->index;
+	uint32_t page_addr;
+	int i, j;
+
+	if (!index)
+		return;
+
+	/* size map: the first slab which block size fits */
+	for (i = 0, j = 0; i < index->size_map_num; i++) {
+		while (j < slabs->slab_num &&
+			slabs->slabs[j].block_size < (i << SLAB_SIZE_MAP_SHIFT))
+			j++;
+		index->size_map[i] = j;
+	}
+
+	/* addr map: the first slab which ends after the page start */
+	index->base = (uint32_t)slabs->slabs[0].slab_base;
+	index->size = slab_end_addr(slabs, slabs->slab_num - 1) - index->base;
+	for (i = 0, j = 0; i < index->addr_map_num; i++) {
+		page_addr = index->base + (i << SLAB_ADDR_MAP_SHIFT);
+		while (j < slabs->slab_num && slab_end_addr(slabs, j) <= page_addr)
+			j++;
+		index->addr_map[i] = j;
+	}
+
+	memset(index->stat, 0, sizeof(struct slab_stat) * slabs->slab_num);
+}
+
 void slabs_mem_init(struct slabs_info * slabs)
 {
 	for(int i = 0 ; i < slabs->slab_num; i++)
@@ -653,6 +801,8 @@ void slabs_mem_init(struct slabs_info * slabs)
 		sys_slist_init(slabs->slabs[i].dynamic_slab_list);
 #endif
 	}
+
+	slabs_index_init(slabs);
 }
 
 void mem_slabs_dump(struct slabs_info * slabs, int index)
@@ -691,6 +841,19 @@ void mem_slabs_dump(struct slabs_info * slabs, int index)
 			k_mem_slab_num_free_get(slabs->slabs[i].slab),
 			slabs->max_used[i], slabs->max_size[i]);
 	}
+	if (slabs->index) {
+		for(int i = 0 ; i < slabs->slab_num; i++)
+		{
+			struct slab_stat *stat = &slabs->index->stat[i];
+
+			printk(" mem slab %d : alloc %6u, fail %4u, avg cycles %4u, max cycles %4u,"
+				" irq off cycles %8u, max %4u\n",
+				i, stat->alloc_cnt, stat->fail_cnt,
+				stat->alloc_cnt ? stat->alloc_cycles / stat->alloc_cnt : 0,
+				stat->max_alloc_cycles,
+				stat->irq_off_cycles, stat->max_irq_off_cycles);
+		}
+	}
 #ifdef CONFIG_USED_DYNAMIC_SLAB
 	for(int i = 0 ; i < slabs->slab_num; i++)
 	{
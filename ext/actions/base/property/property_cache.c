@@ -6,6 +6,11 @@
 
 /**
  * @file property cache interface
+ *
+ * Write-back cache in front of nvram config. Repeated sets of the same key
+ * only touch RAM; dirty items are written back in one pass when requested,
+ * when they have been idle for CONFIG_PROPERTY_CACHE_FLUSH_DELAY_MS, or
+ * when evicted (least recently used, clean items first).
  */
  #include <os_common_api.h>
 #include <string.h>
@@ -20,86 +25,208 @@
 #endif
 #include <logging/sys_log.h>
 
-#define MAX_NVRAM_ITEM_CACHE_NUM 20
+#define MAX_NVRAM_ITEM_CACHE_NUM	CONFIG_PROPERTY_CACHE_ITEM_NUM
+#define MAX_NVRAM_ITEM_NAME_SIZE	CONFIG_PROPERTY_CACHE_NAME_SIZE
+
+#define PROPERTY_CACHE_HASH_SIZE	16
+/* bucket and chain links store item index + 1, 0 ends the chain */
+#define PROPERTY_CACHE_IDX_NONE		0
 
 struct cahce_item_data {
-	char *name;
+	char name[MAX_NVRAM_ITEM_NAME_SIZE];
 	char *data;
-	uint32_t data_len:16;
-	uint32_t used_flag:2;
-	uint32_t flush_req:1;
+	uint16_t data_len;
+	uint16_t data_cap;
+	/* last access stamp, for lru eviction */
+	uint32_t access_stamp;
+	/* uptime of the last modification */
+	uint32_t dirty_time;
+	uint8_t hash;
+	/* next item in the same hash bucket */
+	uint8_t next;
+	uint8_t used_flag:1;
+	uint8_t dirty:1;
+	uint8_t flush_req:1;
 };
 
 OS_MUTEX_DEFINE(nvram_cache_mutex);
 
 static struct cahce_item_data globle_property_cache[MAX_NVRAM_ITEM_CACHE_NUM];
+static uint8_t property_cache_bucket[PROPERTY_CACHE_HASH_SIZE];
+static uint32_t property_cache_stamp;
+
+static uint8_t property_cache_hash(const char *name)
+{
+	uint8_t hash = 0;
+
+	while (*name)
+		hash = (hash << 1) + (hash >> 7) + (uint8_t)(*name++);
 
+	return hash;
+}
 
-static struct cahce_item_data *find_property_cache(const char *name)
+static void property_cache_touch(struct cahce_item_data *item)
 {
-	int i;
-	struct cahce_item_data *item = NULL;
+	item->access_stamp = ++property_cache_stamp;
+}
 
-	for (i = 0; i < MAX_NVRAM_ITEM_CACHE_NUM; i++) {
-		item = &globle_property_cache[i];
-		if (item->used_flag && !strcmp(item->name, name)) {
-			SYS_LOG_DBG(" %d %s\n", i, item->name);
+static struct cahce_item_data *find_property_cache(const char *name, uint8_t hash)
+{
+	struct cahce_item_data *item;
+	uint8_t idx;
+
+	idx = property_cache_bucket[hash % PROPERTY_CACHE_HASH_SIZE];
+	while (idx != PROPERTY_CACHE_IDX_NONE) {
+		item = &globle_property_cache[idx - 1];
+		if (item->hash == hash && !strcmp(item->name, name)) {
+			SYS_LOG_DBG(" %d %s\n", idx - 1, item->name);
+			property_cache_touch(item);
 			return item;
 		}
+		idx = item->next;
 	}
+
 	return NULL;
 }
 
-static struct cahce_item_data *get_property_cache(const char *name, int len)
+static void unlink_property_cache(struct cahce_item_data *item)
 {
-	int i;
-	struct cahce_item_data *item = NULL;
+	uint8_t *pidx = &property_cache_bucket[item->hash % PROPERTY_CACHE_HASH_SIZE];
+	uint8_t idx = item - globle_property_cache + 1;
 
-	for (i = 0; i < MAX_NVRAM_ITEM_CACHE_NUM; i++) {
-		item = &globle_property_cache[i];
-		if (!item->used_flag) {
-			item->name = mem_malloc(strlen(name) + 1);
-			if (!item->name) {
-				item = NULL;
-				goto exit;
-			}
-			memset(item->name, 0, strlen(name) + 1);
-			if (len == 0) {
-				item->data = NULL;
-				goto exit;
-			}
-			item->data = mem_malloc(len);
-			if (!item->data) {
-				mem_free(item->name);
-				item = NULL;
-				goto exit;
-			}
-			memset(item->data, 0, len);
-exit:
-			return item;
+	while (*pidx != PROPERTY_CACHE_IDX_NONE) {
+		if (*pidx == idx) {
+			*pidx = item->next;
+			break;
 		}
+		pidx = &globle_property_cache[*pidx - 1].next;
 	}
-	return NULL;
+
+	item->next = PROPERTY_CACHE_IDX_NONE;
+}
+
+static int write_back_property_cache(struct cahce_item_data *item)
+{
+	int ret;
+
+	ret = nvram_config_set(item->name, item->data_len ? item->data : NULL, item->data_len);
+	if (!ret) {
+		item->dirty = 0;
+		item->flush_req = 0;
+	} else {
+		SYS_LOG_ERR("%s write back failed %d", item->name, ret);
+	}
+
+	return ret;
 }
 
 static int put_property_cache(struct cahce_item_data *item)
 {
 	if (item) {
+		if (item->used_flag) {
+			unlink_property_cache(item);
+		}
 		if (item->data) {
 			mem_free(item->data);
 		}
-		if (item->name) {
-			mem_free(item->name);
-		}
 		item->data = NULL;
-		item->name = NULL;
 		item->used_flag = 0;
 		item->data_len = 0;
+		item->data_cap = 0;
+		item->dirty = 0;
 		item->flush_req = 0;
 	}
 	return 0;
 }
 
+static struct cahce_item_data *evict_property_cache(void)
+{
+	struct cahce_item_data *item, *victim = NULL;
+	int i;
+
+	/* least recently used clean item first, dirty items cost a flash write */
+	for (i = 0; i < MAX_NVRAM_ITEM_CACHE_NUM; i++) {
+		item = &globle_property_cache[i];
+		if (!victim || (victim->dirty && !item->dirty) ||
+		    (victim->dirty == item->dirty &&
+		     (int32_t)(item->access_stamp - victim->access_stamp) < 0)) {
+			victim = item;
+		}
+	}
+
+	if (victim->dirty && write_back_property_cache(victim)) {
+		return NULL;
+	}
+
+	put_property_cache(victim);
+
+	return victim;
+}
+
+static struct cahce_item_data *get_property_cache(const char *name, uint8_t hash)
+{
+	struct cahce_item_data *item = NULL;
+	uint8_t *bucket;
+	int i;
+
+	for (i = 0; i < MAX_NVRAM_ITEM_CACHE_NUM; i++) {
+		if (!globle_property_cache[i].used_flag) {
+			item = &globle_property_cache[i];
+			break;
+		}
+	}
+
+	if (!item) {
+		item = evict_property_cache();
+		if (!item)
+			return NULL;
+	}
+
+	strcpy(item->name, name);
+	item->hash = hash;
+	item->used_flag = 1;
+
+	bucket = &property_cache_bucket[hash % PROPERTY_CACHE_HASH_SIZE];
+	item->next = *bucket;
+	*bucket = item - globle_property_cache + 1;
+
+	property_cache_touch(item);
+
+	return item;
+}
+
+static int update_property_cache(struct cahce_item_data *item, bool is_new,
+				 const void *data, int len)
+{
+	if (!is_new && (item->data_len == len) &&
+	    (!len || !memcmp(item->data, data, len))) {
+		/* same value, nothing to write back */
+		return 0;
+	}
+
+	if (len > item->data_cap) {
+		char *new_data = mem_malloc(len);
+
+		if (!new_data)
+			return -ENOMEM;
+
+		if (item->data)
+			mem_free(item->data);
+
+		item->data = new_data;
+		item->data_cap = len;
+	}
+
+	if (len)
+		memcpy(item->data, data, len);
+	item->data_len = len;
+
+	item->dirty = 1;
+	item->dirty_time = os_uptime_get_32();
+
+	return 0;
+}
+
 int property_cache_get(const char *name, void *data, int len)
 {
 	int read_len = 0;
@@ -107,7 +234,7 @@ int property_cache_get(const char *name, void *data, int len)
 
 	os_mutex_lock(&nvram_cache_mutex, OS_FOREVER);
 
-	item = find_property_cache(name);
+	item = find_property_cache(name, property_cache_hash(name));
 
 	/**read from nvram cache */
 	if (item) {
@@ -116,7 +243,7 @@ int property_cache_get(const char *name, void *data, int len)
 		} else {
 			read_len = item->data_len;
 		}
-		if (item->data) {
+		if (read_len) {
 			memcpy(data, item->data, read_len);
 		}
 	} else {
@@ -133,6 +260,8 @@ int property_cache_get(const char *name, void *data, int len)
 int property_cache_set(const char *name, const void *data, int len)
 {
 	int ret = 0;
+	uint8_t hash;
+	bool is_new = false;
 	struct cahce_item_data *item = NULL;
 
 	if (!name || (data && len <= 0)) {
@@ -147,48 +276,20 @@ int property_cache_set(const char *name, const void *data, int len)
 
 	os_mutex_lock(&nvram_cache_mutex, OS_FOREVER);
 
-	item = find_property_cache(name);
-	/**write to old nvram cache */
-	if (item) {
-		if (!data) {
-			if (item->data) {
-				mem_free(item->data);
-				item->data = NULL;
-				item->data_len = 0;
-			}
-			goto exit;
-		}
+	hash = property_cache_hash(name);
 
-		if (item->data_len == len) {
-			memcpy(item->data, data, len);
-			ret = 0;
-		} else {
-			void *old_data = item->data;
-
-			item->data = mem_malloc(len);
-			if (!item->data)
-				goto exit;
-			memcpy(item->data, data, len);
-			item->data_len = len;
-			ret = 0;
-			if (old_data)
-				mem_free(old_data);
-		}
-		goto exit;
+	item = find_property_cache(name, hash);
+	if (!item && strlen(name) < MAX_NVRAM_ITEM_NAME_SIZE) {
+		item = get_property_cache(name, hash);
+		is_new = true;
 	}
 
-	/**write to new nvram cache */
-	item = get_property_cache(name, len);
+	/**write to nvram cache, coalesced with pending changes of the same key */
 	if (item) {
-		/** new item */
-		memcpy(item->name, name, strlen(name));
-		if (item->data) {
-			memcpy(item->data, data, len);
-		}
-		item->data_len = len;
-		item->used_flag = 1;
-		ret = 0;
-		goto exit;
+		if (!update_property_cache(item, is_new, data, len))
+			goto exit;
+
+		put_property_cache(item);
 	}
 
 	/** direct write to nvram*/
@@ -211,10 +312,9 @@ int property_cache_flush(const char *name)
 	for (i = 0; i < MAX_NVRAM_ITEM_CACHE_NUM; i++) {
 		item = &globle_property_cache[i];
 		if (item->used_flag &&
-	     ((!name) || memcmp(item->name, name, strlen(name)) == 0)) {
-			if (!nvram_config_set(item->name, item->data, item->data_len)) {
+	     ((!name) || strncmp(item->name, name, strlen(name)) == 0)) {
+			if (!item->dirty || !write_back_property_cache(item)) {
 				put_property_cache(item);
-				item->flush_req = false;
 			}
 		}
 	}
@@ -234,8 +334,8 @@ int property_cache_flush_req(const char *name)
 
 	for (i = 0; i < MAX_NVRAM_ITEM_CACHE_NUM; i++) {
 		item = &globle_property_cache[i];
-		if (item->used_flag &&
-	     ((!name) || memcmp(item->name, name, strlen(name)) == 0)) {
+		if (item->used_flag && item->dirty &&
+	     ((!name) || strncmp(item->name, name, strlen(name)) == 0)) {
 			item->flush_req = true;
 		}
 	}
@@ -248,29 +348,39 @@ int property_cache_flush_req(const char *name)
 
 int property_cache_flush_req_deal(void)
 {
-	int i;
+	int i, cnt = 0;
+	uint32_t now;
 	struct cahce_item_data *item = NULL;
 
 	os_mutex_lock(&nvram_cache_mutex, OS_FOREVER);
 
+	now = os_uptime_get_32();
+
+	/* write back requested items and items idle for the coalescing window together */
 	for (i = 0; i < MAX_NVRAM_ITEM_CACHE_NUM; i++) {
 		item = &globle_property_cache[i];
-		if (item->used_flag && item->flush_req) {
-			if (!nvram_config_set(item->name, item->data, item->data_len)) {
-				put_property_cache(item);
-			}
-			item->flush_req = false;
+		if (!item->used_flag || !item->dirty)
+			continue;
+
+		if (item->flush_req ||
+		    (now - item->dirty_time) >= CONFIG_PROPERTY_CACHE_FLUSH_DELAY_MS) {
+			if (!write_back_property_cache(item))
+				cnt++;
 		}
 	}
 
 	os_mutex_unlock(&nvram_cache_mutex);
 
-	SYS_LOG_INF("flush ok\n");
+	if (cnt) {
+		SYS_LOG_INF("flush %d items\n", cnt);
+	}
 	return 0;
 }
 
 int property_cache_init(void)
 {
 	memset(globle_property_cache, 0, sizeof(globle_property_cache));
+	memset(property_cache_bucket, 0, sizeof(property_cache_bucket));
+	property_cache_stamp = 0;
 	return 0;
 }
@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2020 Actions Semiconductor Co., Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief Lock free single producer / single consumer ring buffer access
+ *
+ * head and tail stay 64 bit for the layout shared with the dsp, but the
+ * length is always below 2^32, so the peer counter is only read by its
+ * low word and differences are taken modulo 2^32. The owner keeps its
+ * full 64 bit counter for the modulo offset of non power of 2 buffers.
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <acts_ringbuf.h>
+
+#ifdef __csky__
+#define spsc_barrier()	__asm__ volatile ("sync" ::: "memory")
+#else
+#define spsc_barrier()	__sync_synchronize()
+#endif
+
+typedef uint32_t __attribute__((__may_alias__)) spsc_word_t;
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define SPSC_LO		1
+#else
+#define SPSC_LO		0
+#endif
+#define SPSC_HI		(1 - SPSC_LO)
+
+static inline uint32_t spsc_load_peer(const uint64_t *cnt)
+{
+	return ((const volatile spsc_word_t *)cnt)[SPSC_LO];
+}
+
+static inline uint64_t spsc_load_own(const uint64_t *cnt)
+{
+	const volatile spsc_word_t *w = (const volatile spsc_word_t *)cnt;
+
+	return ((uint64_t)w[SPSC_HI] << 32) | w[SPSC_LO];
+}
+
+static inline void spsc_store_own(uint64_t *cnt, uint64_t val)
+{
+	volatile spsc_word_t *w = (volatile spsc_word_t *)cnt;
+
+	/* the peer only looks at the low word, which goes last */
+	w[SPSC_HI] = (uint32_t)(val >> 32);
+	w[SPSC_LO] = (uint32_t)val;
+}
+
+static uint32_t spsc_span(struct acts_ringbuf *buf, uint64_t pos,
+		uint32_t size, struct acts_ringbuf_span *span)
+{
+	uint32_t offset = buf->mask ? (pos & buf->mask) : (pos % buf->size);
+	uint32_t len = min_t(uint32_t, buf->size - offset, size);
+
+	span->data[0] = (void *)(buf->cpu_ptr + ACTS_RINGBUF_SIZE8(offset));
+	span->len[0] = len;
+	span->data[1] = (void *)(buf->cpu_ptr);
+	span->len[1] = size - len;
+
+	return size;
+}
+
+uint32_t acts_ringbuf_spsc_length(struct acts_ringbuf *buf)
+{
+	return spsc_load_peer(&buf->tail) - (uint32_t)spsc_load_own(&buf->head);
+}
+
+uint32_t acts_ringbuf_spsc_space(struct acts_ringbuf *buf)
+{
+	return buf->size - ((uint32_t)spsc_load_own(&buf->tail) - spsc_load_peer(&buf->head));
+}
+
+uint32_t acts_ringbuf_spsc_put_claim(struct acts_ringbuf *buf,
+		struct acts_ringbuf_span *span, uint32_t size)
+{
+	uint32_t space = acts_ringbuf_spsc_space(buf);
+
+	/* consumer reads of the freed space complete before it is rewritten */
+	spsc_barrier();
+
+	if (size > space)
+		size = space;
+
+	return spsc_span(buf, spsc_load_own(&buf->tail), size, span);
+}
+
+int acts_ringbuf_spsc_put_commit(struct acts_ringbuf *buf, uint32_t size)
+{
+	uint64_t tail = spsc_load_own(&buf->tail);
+
+	if (size > acts_ringbuf_spsc_space(buf))
+		return -EINVAL;
+
+	/* data is visible before the new tail */
+	spsc_barrier();
+	spsc_store_own(&buf->tail, tail + size);
+	return 0;
+}
+
+uint32_t acts_ringbuf_spsc_get_claim(struct acts_ringbuf *buf,
+		struct acts_ringbuf_span *span, uint32_t size)
+{
+	uint32_t len = acts_ringbuf_spsc_length(buf);
+
+	/* data is not read ahead of the tail it belongs to */
+	spsc_barrier();
+
+	if (size > len)
+		size = len;
+
+	return spsc_span(buf, spsc_load_own(&buf->head), size, span);
+}
+
+int acts_ringbuf_spsc_get_commit(struct acts_ringbuf *buf, uint32_t size)
+{
+	uint64_t head = spsc_load_own(&buf->head);
+
+	if (size > acts_ringbuf_spsc_length(buf))
+		return -EINVAL;
+
+	/* reads are done before the space is handed back */
+	spsc_barrier();
+	spsc_store_own(&buf->head, head + size);
+	return 0;
+}
+
+uint32_t acts_ringbuf_spsc_put(struct acts_ringbuf *buf, const void *data, uint32_t size)
+{
+	struct acts_ringbuf_span span;
+
+	if (acts_ringbuf_spsc_put_claim(buf, &span, size) < size)
+		return 0;
+
+	if (data) {
+		memcpy(span.data[0], data, ACTS_RINGBUF_SIZE8(span.len[0]));
+		if (span.len[1])
+			memcpy(span.data[1], (const uint8_t *)data + ACTS_RINGBUF_SIZE8(span.len[0]),
+					ACTS_RINGBUF_SIZE8(span.len[1]));
+	}
+
+	acts_ringbuf_spsc_put_commit(buf, size);
+	return size;
+}
+
+uint32_t acts_ringbuf_spsc_get(struct acts_ringbuf *buf, void *data, uint32_t size)
+{
+	struct acts_ringbuf_span span;
+
+	if (acts_ringbuf_spsc_get_claim(buf, &span, size) < size)
+		return 0;
+
+	if (data) {
+		memcpy(data, span.data[0], ACTS_RINGBUF_SIZE8(span.len[0]));
+		if (span.len[1])
+			memcpy((uint8_t *)data + ACTS_RINGBUF_SIZE8(span.len[0]), span.data[1],
+					ACTS_RINGBUF_SIZE8(span.len[1]));
+	}
+
+	acts_ringbuf_spsc_get_commit(buf, size);
+	return size;
+}
@@ -10,6 +10,9 @@
 #include <fs_manager.h>
 #include <stdio.h>
 #include <stdlib.h>
+#ifdef CONFIG_PLIST_INDEX
+#include <crc.h>
+#endif
 
 #define MAX_DIR_LEVEL 9
 #define FULL_PATH_LEN (MAX_URL_LEN + 2)
@@ -18,6 +21,13 @@
 #define MAX_SUPPORT_FILE_CNT 10000
 #define FAT16_FAR_CLUST 0xfffffff1
 
+#ifdef CONFIG_PLIST_INDEX
+/* hidden file in topdir, skipped by the scan like other dot names */
+#define PLIST_INDEX_FILE ".plist.idx"
+#define PLIST_INDEX_MAGIC 0x58494c50 /* "PLIX" */
+#define PLIST_INDEX_VERSION 1
+#endif
+
 struct  folder_info_t {
 #if CONFIG_SUPPORT_FILE_FULL_NAME
 	uint32_t far_cluster;		/*exfat direntry no farthor cluster*/
@@ -39,8 +49,42 @@ struct play_list_t {
 	uint16_t csize;			/* Cluster size [sectors] */
 	const char *topdir;
 	int (*match_fn)(const char *path, int is_dir);
+#ifdef CONFIG_PLIST_INDEX
+	uint8_t from_index : 1;	/*loaded from the index file*/
+	uint8_t index_dirty : 1;	/*folder counts fixed since loaded*/
+	uint16_t max_level;
+	/*folders whose file count has been checked against the disk*/
+	uint8_t folder_checked[(CONFIG_PLIST_SUPPORT_FOLDER_CNT + 7) / 8];
+#endif
+};
+
+#ifdef CONFIG_PLIST_INDEX
+/*
+ * Index file layout: head followed by CONFIG_PLIST_SUPPORT_FOLDER_CNT
+ * folder_info_t. The file size never changes once created, so rewriting
+ * it does not change the free cluster count used to validate it.
+ */
+struct plist_index_head {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t folder_info_size;
+	uint16_t folder_cnt;
+	uint16_t file_cnt;
+	uint16_t max_level;
+	uint16_t csize;
+	uint32_t root_cluster;
+	uint32_t total_clst;
+	uint32_t free_clst;
+	uint32_t match_fn;
+	uint32_t crc;
 };
 
+#define PLIST_INDEX_FILE_SIZE (sizeof(struct plist_index_head) \
+		+ CONFIG_PLIST_SUPPORT_FOLDER_CNT * sizeof(struct folder_info_t))
+
+static int plist_index_save(struct play_list_t *plist);
+#endif
+
 static struct play_list_t *play_list = NULL;
 
 struct file_iterator_data {
@@ -98,6 +142,10 @@ static int file_iterator_destroy(struct iterator *iter)
 	mem_free(data);
 
 	if (play_list) {
+	#ifdef CONFIG_PLIST_INDEX
+		if (play_list->index_dirty)
+			plist_index_save(play_list);
+	#endif
 		for (i = 0; i < CONFIG_PLIST_SUPPORT_FOLDER_CNT; i++) {
 			if (play_list->folder_info[i]) {
 				mem_free(play_list->folder_info[i]);
@@ -218,6 +266,91 @@ static void calc_next_folder_playlist_info(struct play_list_t *plist, uint8_t ad
 			plist->folder_info[plist->folder_seq_num]->cur_cluster);
 	}
 }
+#ifdef CONFIG_PLIST_INDEX
+static uint16_t plist_folder_file_base(struct play_list_t *plist, uint8_t folder_seq)
+{
+	uint16_t sum_file = 0;
+	int i;
+
+	for (i = 0; i < folder_seq; i++)
+		sum_file += plist->folder_info[i]->dir_file_count;
+
+	return sum_file;
+}
+
+/*
+ * Folders loaded from the index are recounted on first access. A changed
+ * count is fixed in place and written back when the iterator is destroyed.
+ */
+static int plist_index_check_folder(struct play_list_t *plist)
+{
+	struct folder_info_t *folder = plist->folder_info[plist->folder_seq_num];
+	uint8_t *checked = &plist->folder_checked[plist->folder_seq_num / 8];
+	uint8_t bit = 1 << (plist->folder_seq_num % 8);
+	fs_dir_t *zdp = NULL;
+	struct fs_dirent *entry = NULL;
+	uint16_t count = 0;
+	int res = -ENOMEM;
+
+	if (!plist->from_index || (*checked & bit))
+		return 0;
+
+	zdp = mem_malloc(sizeof(fs_dir_t));
+	entry = mem_malloc(sizeof(struct fs_dirent));
+	if (!zdp || !entry)
+		goto exit;
+
+	res = fs_opendir_cluster(zdp, plist->topdir, folder->cur_cluster, 0);
+	if (res) {
+		SYS_LOG_ERR("fs_opendir failed (res=%d)\n", res);
+		goto exit;
+	}
+
+	do {
+		memset(entry, 0, sizeof(struct fs_dirent));
+		res = fs_readdir(zdp, entry);
+		if (res || entry->name[0] == 0)
+			break;
+		if (entry->name[0] != '.' && plist->match_fn
+			&& entry->type == FS_DIR_ENTRY_FILE && plist->match_fn(entry->name, 0))
+			count++;
+	} while (1);
+	fs_closedir(zdp);
+
+	if (res) {
+		SYS_LOG_ERR("fs_readdir failed (res=%d)\n", res);
+		goto exit;
+	}
+
+	*checked |= bit;
+
+	if (count != folder->dir_file_count) {
+		SYS_LOG_WRN("folder %d file count %d -> %d\n",
+			plist->folder_seq_num, folder->dir_file_count, count);
+		plist->sum_file_count = plist->sum_file_count - folder->dir_file_count + count;
+		folder->dir_file_count = count;
+		plist->index_dirty = 1;
+
+		if (!count) {
+			res = -ENOENT;
+			goto exit;
+		}
+
+		if (plist->dir_file_seq_num > count)
+			plist->dir_file_seq_num = count;
+		plist->file_seq_num = plist_folder_file_base(plist, plist->folder_seq_num)
+			+ plist->dir_file_seq_num;
+	}
+
+exit:
+	if (zdp)
+		mem_free(zdp);
+	if (entry)
+		mem_free(entry);
+	return res;
+}
+#endif
+
 //source:SN60~B.MP3/SNA0~ROOTDI~1/,dest=SD:
 //SD:SNA0~ROOTDI~1/SN60~B.MP3
 #if CONFIG_SUPPORT_FILE_FULL_NAME
@@ -255,6 +388,12 @@ static int file_dirname_get(struct play_list_t *plist, struct iterator *iter)
 	if (!path_buff || !zdp || !entry || !plist->dir_file_seq_num)
 		goto exit;
 
+#ifdef CONFIG_PLIST_INDEX
+	res = plist_index_check_folder(plist);
+	if (res)
+		goto exit;
+#endif
+
 	/*read file name*/
 	res = fs_opendir_cluster(zdp, plist->topdir, plist->folder_info[plist->folder_seq_num]->cur_cluster, 0);
 	if (!res) {
@@ -267,7 +406,8 @@ static int file_dirname_get(struct play_list_t *plist, struct iterator *iter)
 				goto exit;
 			}
 			/* filter out unmatch directory or file */
-			if (plist->match_fn && entry->type == FS_DIR_ENTRY_FILE && plist->match_fn(entry->name, 0))
+			if (entry->name[0] != '.' && plist->match_fn
+				&& entry->type == FS_DIR_ENTRY_FILE && plist->match_fn(entry->name, 0))
 				times++;
 		} while (times < plist->dir_file_seq_num);
 		strcpy(path_buff + strlen(path_buff), entry->name);
@@ -375,6 +515,12 @@ static int file_dirname_get(struct play_list_t *plist, struct iterator *iter)
 	if (!zdp || !entry || !plist->dir_file_seq_num)
 		goto exit;
 
+#ifdef CONFIG_PLIST_INDEX
+	res = plist_index_check_folder(plist);
+	if (res)
+		goto exit;
+#endif
+
 	/*read file name*/
 	dp = &(zdp->dp);
 	res = fs_opendir_cluster(zdp, plist->topdir, plist->folder_info[plist->folder_seq_num]->cur_cluster, 0);
@@ -388,7 +534,8 @@ static int file_dirname_get(struct play_list_t *plist, struct iterator *iter)
 				goto exit;
 			}
 			/* filter out unmatch directory or file */
-			if (plist->match_fn && entry->type == FS_DIR_ENTRY_FILE && plist->match_fn(entry->name, 0))
+			if (entry->name[0] != '.' && plist->match_fn
+				&& entry->type == FS_DIR_ENTRY_FILE && plist->match_fn(entry->name, 0))
 				times++;
 		} while (times < plist->dir_file_seq_num);
 		SYS_LOG_INF("file name:%s\n", entry->name);
@@ -773,6 +920,318 @@ exit:
 
 }
 
+#ifdef CONFIG_PLIST_INDEX
+static char *plist_index_path(struct play_list_t *plist)
+{
+	int len = strlen(plist->topdir);
+	char *path = mem_malloc(len + sizeof(PLIST_INDEX_FILE) + 1);
+
+	if (!path)
+		return NULL;
+
+	strcpy(path, plist->topdir);
+	if (path[len - 1] != ':' && path[len - 1] != '/')
+		path[len++] = '/';
+	strcpy(path + len, PLIST_INDEX_FILE);
+
+	return path;
+}
+
+static int plist_index_fill_head(struct play_list_t *plist, struct plist_index_head *head)
+{
+	struct fs_statvfs stat;
+	int res;
+
+	res = fs_statvfs(plist->topdir, &stat);
+	if (res)
+		return res;
+
+	memset(head, 0, sizeof(*head));
+	head->magic = PLIST_INDEX_MAGIC;
+	head->version = PLIST_INDEX_VERSION;
+	head->folder_info_size = sizeof(struct folder_info_t);
+	head->folder_cnt = plist->sum_folder_count + 1;
+	head->file_cnt = plist->sum_file_count;
+	head->max_level = plist->max_level;
+	head->csize = plist->csize;
+	head->root_cluster = plist->folder_info[0]->cur_cluster;
+	head->total_clst = stat.f_blocks;
+	head->free_clst = stat.f_bfree;
+	head->match_fn = (uint32_t)(uintptr_t)plist->match_fn;
+
+	return 0;
+}
+
+static int plist_index_save(struct play_list_t *plist)
+{
+	struct plist_index_head *head = NULL;
+	fs_file_t *zfp = NULL;
+	char *path = NULL;
+	uint8_t *buf = NULL;
+	int res = -ENOMEM;
+	int i;
+
+	buf = mem_malloc(PLIST_INDEX_FILE_SIZE);
+	zfp = mem_malloc(sizeof(fs_file_t));
+	path = plist_index_path(plist);
+	if (!buf || !zfp || !path)
+		goto exit;
+
+	memset(buf, 0, PLIST_INDEX_FILE_SIZE);
+	head = (struct plist_index_head *)buf;
+	for (i = 0; i <= plist->sum_folder_count; i++) {
+		memcpy(buf + sizeof(*head) + i * sizeof(struct folder_info_t),
+			plist->folder_info[i], sizeof(struct folder_info_t));
+	}
+
+	/* body first with an invalid head, this may allocate the file */
+	res = fs_open(zfp, path);
+	if (res)
+		goto exit;
+	res = fs_write(zfp, buf, PLIST_INDEX_FILE_SIZE);
+	fs_close(zfp);
+	if (res != PLIST_INDEX_FILE_SIZE) {
+		res = -EIO;
+		goto exit;
+	}
+
+	/* then the head, the free cluster count now includes the index file */
+	res = plist_index_fill_head(plist, head);
+	if (res)
+		goto exit;
+	head->crc = utils_crc32(0, buf + sizeof(*head), PLIST_INDEX_FILE_SIZE - sizeof(*head));
+
+	res = fs_open(zfp, path);
+	if (res)
+		goto exit;
+	res = fs_write(zfp, head, sizeof(*head));
+	fs_close(zfp);
+	if (res != sizeof(*head)) {
+		res = -EIO;
+		goto exit;
+	}
+
+	/* hidden on a PC as well, this does not change the free clusters */
+	if (fs_chmod(path, AM_HID, AM_HID))
+		SYS_LOG_WRN("hide %s failed\n", path);
+
+	plist->index_dirty = 0;
+	res = 0;
+	SYS_LOG_INF("save %s folder %d file %d\n", path, head->folder_cnt, head->file_cnt);
+
+exit:
+	if (res)
+		SYS_LOG_WRN("save index failed (res=%d)\n", res);
+	if (buf)
+		mem_free(buf);
+	if (zfp)
+		mem_free(zfp);
+	if (path)
+		mem_free(path);
+	return res;
+}
+
+static int plist_index_load(struct play_list_t *plist)
+{
+	struct plist_index_head *head = NULL;
+	struct fs_statvfs stat;
+	struct fs_dirent *entry = NULL;
+	fs_file_t *zfp = NULL;
+	char *path = NULL;
+	uint8_t *buf = NULL;
+	int res = -ENOMEM;
+	int i;
+
+	buf = mem_malloc(PLIST_INDEX_FILE_SIZE);
+	zfp = mem_malloc(sizeof(fs_file_t));
+	entry = mem_malloc(sizeof(struct fs_dirent));
+	path = plist_index_path(plist);
+	if (!buf || !zfp || !entry || !path)
+		goto exit;
+
+	/* fs_open creates missing files */
+	res = fs_stat(path, entry);
+	if (res || entry->size < PLIST_INDEX_FILE_SIZE) {
+		res = -ENOENT;
+		goto exit;
+	}
+
+	res = fs_open(zfp, path);
+	if (res)
+		goto exit;
+	res = fs_read(zfp, buf, PLIST_INDEX_FILE_SIZE);
+	fs_close(zfp);
+	if (res != PLIST_INDEX_FILE_SIZE) {
+		res = -EIO;
+		goto exit;
+	}
+
+	res = -EINVAL;
+	head = (struct plist_index_head *)buf;
+	if (head->magic != PLIST_INDEX_MAGIC
+		|| head->version != PLIST_INDEX_VERSION
+		|| head->folder_info_size != sizeof(struct folder_info_t)
+		|| head->folder_cnt == 0
+		|| head->folder_cnt > CONFIG_PLIST_SUPPORT_FOLDER_CNT
+		|| head->max_level != plist->max_level
+		|| head->csize != plist->csize
+		|| head->root_cluster != plist->folder_info[0]->cur_cluster
+		|| head->match_fn != (uint32_t)(uintptr_t)plist->match_fn) {
+		SYS_LOG_INF("index mismatch\n");
+		goto exit;
+	}
+
+	if (head->crc != utils_crc32(0, buf + sizeof(*head), PLIST_INDEX_FILE_SIZE - sizeof(*head))) {
+		SYS_LOG_WRN("index crc error\n");
+		goto exit;
+	}
+
+	/* any file or folder added, removed or resized changes the free clusters */
+	if (fs_statvfs(plist->topdir, &stat)
+		|| stat.f_blocks != head->total_clst || stat.f_bfree != head->free_clst) {
+		SYS_LOG_INF("disk changed\n");
+		goto exit;
+	}
+
+	for (i = 0; i < head->folder_cnt; i++) {
+		memcpy(plist->folder_info[i], buf + sizeof(*head) + i * sizeof(struct folder_info_t),
+			sizeof(struct folder_info_t));
+	}
+
+	plist->sum_folder_count = head->folder_cnt - 1;
+	plist->sum_file_count = head->file_cnt;
+	plist->file_seq_num = 0;
+	plist->folder_seq_num = 0;
+	plist->dir_file_seq_num = 0;
+	plist->from_index = 1;
+	plist->index_dirty = 0;
+	memset(plist->folder_checked, 0, sizeof(plist->folder_checked));
+	res = 0;
+
+exit:
+	if (buf)
+		mem_free(buf);
+	if (zfp)
+		mem_free(zfp);
+	if (entry)
+		mem_free(entry);
+	if (path)
+		mem_free(path);
+	return res;
+}
+
+/* find the breakpoint file in its folder instead of during the scan */
+static int plist_index_set_cursor(struct play_list_t *plist, const struct file_iterator_cursor *cursor)
+{
+	uint32_t cursor_cluster = 0;
+	uint16_t times = 0;
+	fs_dir_t *zdp = NULL;
+	struct fs_dirent *entry = NULL;
+#if CONFIG_SUPPORT_FILE_FULL_NAME
+	char *dir = NULL;
+	char *name = NULL;
+#else
+	uint32_t cursor_blk_ofs = 0;
+	uint32_t cursor_file_size = 0;
+#endif
+	int res = -ENOMEM;
+	int i;
+
+	if (!cursor || !cursor->path)
+		return 0;
+
+	zdp = mem_malloc(sizeof(fs_dir_t));
+	entry = mem_malloc(sizeof(struct fs_dirent));
+	if (!zdp || !entry)
+		goto exit;
+
+#if CONFIG_SUPPORT_FILE_FULL_NAME
+	/* split into parent dir and file name, keeping the drive colon */
+	dir = mem_malloc(strlen(cursor->path) + 2);
+	if (!dir)
+		goto exit;
+
+	strcpy(dir, cursor->path);
+	name = strrchr(dir, '/');
+	if (!name)
+		name = strrchr(dir, ':');
+	if (!name) {
+		res = -EINVAL;
+		goto exit;
+	}
+	memmove(name + 2, name + 1, strlen(name + 1) + 1);
+	name[1] = 0;
+	if (name[0] == '/')
+		name[0] = 0;
+	name += 2;
+
+	res = fs_opendir(zdp, dir);
+	if (res)
+		goto exit;
+	cursor_cluster = zdp->dp.clust;
+	fs_closedir(zdp);
+#else
+	res = get_cursor_info(cursor->path, &cursor_cluster, &cursor_blk_ofs, &cursor_file_size);
+	if (res)
+		goto exit;
+#endif
+
+	for (i = 0; i <= plist->sum_folder_count; i++) {
+		if (plist->folder_info[i]->cur_cluster == cursor_cluster)
+			break;
+	}
+
+	res = -ENOENT;
+	if (i > plist->sum_folder_count || !plist->folder_info[i]->dir_file_count)
+		goto exit;
+
+	res = fs_opendir_cluster(zdp, plist->topdir, cursor_cluster, 0);
+	if (res)
+		goto exit;
+
+	do {
+		memset(entry, 0, sizeof(struct fs_dirent));
+		res = fs_readdir(zdp, entry);
+		if (res || entry->name[0] == 0) {
+			res = -ENOENT;
+			break;
+		}
+		if (entry->name[0] == '.' || !plist->match_fn
+			|| entry->type != FS_DIR_ENTRY_FILE || !plist->match_fn(entry->name, 0))
+			continue;
+
+		times++;
+	#if CONFIG_SUPPORT_FILE_FULL_NAME
+		if (!strcmp(entry->name, name))
+			break;
+	#else
+		if (zdp->dp.blk_ofs == cursor_blk_ofs && (uint32_t)(entry->size) == cursor_file_size)
+			break;
+	#endif
+	} while (times < plist->folder_info[i]->dir_file_count);
+	fs_closedir(zdp);
+
+	if (!res && times) {
+		plist->folder_seq_num = i;
+		plist->dir_file_seq_num = times;
+		plist->file_seq_num = plist_folder_file_base(plist, i) + times;
+		SYS_LOG_INF("cur file_seq_num=%d,dir_file_seq_num=%d,folder_seq_num=%d\n",
+			plist->file_seq_num, plist->dir_file_seq_num, plist->folder_seq_num);
+	}
+
+exit:
+	if (zdp)
+		mem_free(zdp);
+	if (entry)
+		mem_free(entry);
+#if CONFIG_SUPPORT_FILE_FULL_NAME
+	if (dir)
+		mem_free(dir);
+#endif
+	return res;
+}
+#endif
+
 static const char *file_iterator_scan_disk(struct play_list_t *plist, struct iterator *iter, const void *param)
 {
 	struct file_iterator_data *data = iter->data;
@@ -958,6 +1417,22 @@ static int file_iterator_update_playlist(struct play_list_t *plist, struct itera
 
 	file_iterator_playlist_init(plist, data, param);
 
+#ifdef CONFIG_PLIST_INDEX
+	plist->from_index = 0;
+	plist->index_dirty = 0;
+	plist->max_level = data->max_level;
+#if CONFIG_SYS_LOG_DEFAULT_LEVEL >= 3
+	uint32_t load_begin = k_cycle_get_32();
+#endif
+	if (!plist_index_load(plist)) {
+		plist_index_set_cursor(plist, ((const struct file_iterator_param *)param)->cursor);
+	#if CONFIG_SYS_LOG_DEFAULT_LEVEL >= 3
+		SYS_LOG_INF("load index case %u us \n", (k_cycle_get_32() - load_begin)/24);
+	#endif
+		return 0;
+	}
+#endif
+
 	res = _back_to_topdir(data);
 	if (res)
 		return res;
@@ -970,6 +1445,10 @@ static int file_iterator_update_playlist(struct play_list_t *plist, struct itera
 	SYS_LOG_INF("scan disk case %u us \n", (k_cycle_get_32() - begin)/24);
 #endif
 
+#ifdef CONFIG_PLIST_INDEX
+	plist_index_save(plist);
+#endif
+
 	return res;
 }
 
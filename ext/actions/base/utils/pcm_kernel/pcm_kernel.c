@@ -0,0 +1,394 @@
+/*
+ * Copyright (c) 2019 Actions Semiconductor Co., Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file pcm kernel interface
+ *
+ * The word versions load and store two 16 bit samples (or 4 packed 24 bit
+ * samples as 3 words) per access and fall back to the per sample loops for
+ * heads, tails and buffers whose alignments differ. The per sample loops
+ * alone are built with CONFIG_UTILS_PCM_KERNEL_GENERIC or on big endian.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linker/section_tags.h>
+#include <pcm_kernel.h>
+
+#if !defined(CONFIG_UTILS_PCM_KERNEL_GENERIC) && \
+	(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define PCM_KERNEL_WORD
+#endif
+
+/* word accesses to sample buffers */
+typedef uint32_t __attribute__((__may_alias__)) pcm_word_t;
+
+#define PCM_MISALIGN(p)		((uintptr_t)(p) & 3)
+
+/* low and high sample of a word, low comes first in memory */
+#define PCM_LO16(w)		((int32_t)(int16_t)(w))
+#define PCM_HI16(w)		((int32_t)(w) >> 16)
+#define PCM_PACK16(lo, hi)	(((uint32_t)(lo) & 0xffff) | ((uint32_t)(hi) << 16))
+
+static inline int32_t pcm_sat16(int32_t v)
+{
+	if (v > INT16_MAX)
+		return INT16_MAX;
+	if (v < INT16_MIN)
+		return INT16_MIN;
+	return v;
+}
+
+static inline int32_t pcm_gain_q15(int32_t v, int32_t gain)
+{
+	return (v * gain + (1 << 14)) >> 15;
+}
+
+__ramfunc void pcm_mix_avg_s16(int16_t *out, const int16_t *a, const int16_t *b, int samples)
+{
+#ifdef PCM_KERNEL_WORD
+	if (samples > 0 && PCM_MISALIGN(out) == PCM_MISALIGN(a) &&
+	    PCM_MISALIGN(out) == PCM_MISALIGN(b)) {
+		const pcm_word_t *wa, *wb;
+		pcm_word_t *wo;
+
+		if (PCM_MISALIGN(out)) {
+			*out++ = *a++ / 2 + *b++ / 2;
+			samples--;
+		}
+
+		wo = (pcm_word_t *)out;
+		wa = (const pcm_word_t *)a;
+		wb = (const pcm_word_t *)b;
+		for (; samples >= 2; samples -= 2) {
+			uint32_t va = *wa++, vb = *wb++;
+
+			*wo++ = PCM_PACK16(PCM_LO16(va) / 2 + PCM_LO16(vb) / 2,
+					   PCM_HI16(va) / 2 + PCM_HI16(vb) / 2);
+		}
+
+		out = (int16_t *)wo;
+		a = (const int16_t *)wa;
+		b = (const int16_t *)wb;
+	}
+#endif
+
+	while (samples-- > 0)
+		*out++ = *a++ / 2 + *b++ / 2;
+}
+
+__ramfunc void pcm_mix_avg_stereo_s16(int16_t *out, const int16_t *a, const int16_t *b_l,
+				      const int16_t *b_r, int frames)
+{
+#ifdef PCM_KERNEL_WORD
+	if (frames > 0 && !PCM_MISALIGN(out) && !PCM_MISALIGN(a) &&
+	    PCM_MISALIGN(b_l) == PCM_MISALIGN(b_r)) {
+		const pcm_word_t *wa, *wl, *wr;
+		pcm_word_t *wo;
+
+		if (PCM_MISALIGN(b_l)) {
+			*out++ = *a++ / 2 + *b_l++ / 2;
+			*out++ = *a++ / 2 + *b_r++ / 2;
+			frames--;
+		}
+
+		/* two frames: a0 = (L0, R0), a1 = (L1, R1), l = (L0, L1), r = (R0, R1) */
+		wo = (pcm_word_t *)out;
+		wa = (const pcm_word_t *)a;
+		wl = (const pcm_word_t *)b_l;
+		wr = (const pcm_word_t *)b_r;
+		for (; frames >= 2; frames -= 2) {
+			uint32_t a0 = wa[0], a1 = wa[1], l = *wl++, r = *wr++;
+
+			wo[0] = PCM_PACK16(PCM_LO16(a0) / 2 + PCM_LO16(l) / 2,
+					   PCM_HI16(a0) / 2 + PCM_LO16(r) / 2);
+			wo[1] = PCM_PACK16(PCM_LO16(a1) / 2 + PCM_HI16(l) / 2,
+					   PCM_HI16(a1) / 2 + PCM_HI16(r) / 2);
+			wa += 2;
+			wo += 2;
+		}
+
+		out = (int16_t *)wo;
+		a = (const int16_t *)wa;
+		b_l = (const int16_t *)wl;
+		b_r = (const int16_t *)wr;
+	}
+#endif
+
+	while (frames-- > 0) {
+		*out++ = *a++ / 2 + *b_l++ / 2;
+		*out++ = *a++ / 2 + *b_r++ / 2;
+	}
+}
+
+__ramfunc void pcm_mix_sat_s16(int16_t *out, const int16_t *a, const int16_t *b, int samples)
+{
+#ifdef PCM_KERNEL_WORD
+	if (samples > 0 && PCM_MISALIGN(out) == PCM_MISALIGN(a) &&
+	    PCM_MISALIGN(out) == PCM_MISALIGN(b)) {
+		const pcm_word_t *wa, *wb;
+		pcm_word_t *wo;
+
+		if (PCM_MISALIGN(out)) {
+			*out++ = pcm_sat16(*a++ + *b++);
+			samples--;
+		}
+
+		wo = (pcm_word_t *)out;
+		wa = (const pcm_word_t *)a;
+		wb = (const pcm_word_t *)b;
+		for (; samples >= 2; samples -= 2) {
+			uint32_t va = *wa++, vb = *wb++;
+
+			*wo++ = PCM_PACK16(pcm_sat16(PCM_LO16(va) + PCM_LO16(vb)),
+					   pcm_sat16(PCM_HI16(va) + PCM_HI16(vb)));
+		}
+
+		out = (int16_t *)wo;
+		a = (const int16_t *)wa;
+		b = (const int16_t *)wb;
+	}
+#endif
+
+	while (samples-- > 0)
+		*out++ = pcm_sat16(*a++ + *b++);
+}
+
+static inline int32_t pcm_gain_next(int32_t gain, int32_t step)
+{
+	gain += step;
+	if (gain < 0)
+		return 0;
+	if (gain > PCM_GAIN_Q15_UNITY)
+		return PCM_GAIN_Q15_UNITY;
+	return gain;
+}
+
+__ramfunc int32_t pcm_gain_ramp_s16(int16_t *buf, int frames, int channels,
+				    int32_t gain, int32_t step)
+{
+	int ch;
+
+	/* unity gain leaves samples unchanged */
+	if (gain == PCM_GAIN_Q15_UNITY && step >= 0)
+		return gain;
+
+#ifdef PCM_KERNEL_WORD
+	if (!PCM_MISALIGN(buf) && (channels == 1 || channels == 2)) {
+		pcm_word_t *w = (pcm_word_t *)buf;
+		int32_t gain1;
+		uint32_t v;
+
+		if (channels == 2) {
+			for (; frames > 0; frames--) {
+				v = *w;
+				*w++ = PCM_PACK16(pcm_gain_q15(PCM_LO16(v), gain),
+						  pcm_gain_q15(PCM_HI16(v), gain));
+				gain = pcm_gain_next(gain, step);
+			}
+		} else {
+			for (; frames >= 2; frames -= 2) {
+				v = *w;
+				gain1 = pcm_gain_next(gain, step);
+				*w++ = PCM_PACK16(pcm_gain_q15(PCM_LO16(v), gain),
+						  pcm_gain_q15(PCM_HI16(v), gain1));
+				gain = pcm_gain_next(gain1, step);
+			}
+		}
+
+		buf = (int16_t *)w;
+	}
+#endif
+
+	while (frames-- > 0) {
+		for (ch = 0; ch < channels; ch++, buf++)
+			*buf = pcm_gain_q15(*buf, gain);
+		gain = pcm_gain_next(gain, step);
+	}
+
+	return gain;
+}
+
+__ramfunc void pcm_unpack_24_32(int32_t *out, const uint8_t *in, int samples)
+{
+	const uint8_t *src;
+
+#ifdef PCM_KERNEL_WORD
+	if (!PCM_MISALIGN(out) && !PCM_MISALIGN(in)) {
+		const pcm_word_t *w;
+
+		/* top samples outside the last group of 4 */
+		for (; samples & 3; samples--) {
+			src = in + (samples - 1) * 3;
+			out[samples - 1] = (uint32_t)src[0] << 8 |
+					   (uint32_t)src[1] << 16 | (uint32_t)src[2] << 24;
+		}
+
+		/* 4 samples in 3 words: s0 s0 s0 s1 | s1 s1 s2 s2 | s2 s3 s3 s3 */
+		for (; samples > 0; samples -= 4) {
+			uint32_t w0, w1, w2;
+
+			w = (const pcm_word_t *)(in + (samples - 4) * 3);
+			w0 = w[0];
+			w1 = w[1];
+			w2 = w[2];
+			out[samples - 4] = w0 << 8;
+			out[samples - 3] = ((w0 >> 16) & 0xff00) | (w1 << 16);
+			out[samples - 2] = ((w1 >> 8) & 0xffff00) | (w2 << 24);
+			out[samples - 1] = w2 & 0xffffff00;
+		}
+
+		return;
+	}
+#endif
+
+	for (; samples > 0; samples--) {
+		src = in + (samples - 1) * 3;
+		out[samples - 1] = (uint32_t)src[0] << 8 |
+				   (uint32_t)src[1] << 16 | (uint32_t)src[2] << 24;
+	}
+}
+
+__ramfunc void pcm_widen_16_32(int32_t *out, const int16_t *in, int samples)
+{
+#ifdef PCM_KERNEL_WORD
+	if (!PCM_MISALIGN(out) && !PCM_MISALIGN(in)) {
+		if (samples & 1) {
+			samples--;
+			out[samples] = (uint32_t)in[samples] << 16;
+		}
+
+		/* two samples per word, loaded before the two stores */
+		for (; samples > 0; samples -= 2) {
+			uint32_t v = *(const pcm_word_t *)(in + samples - 2);
+
+			out[samples - 1] = v & 0xffff0000;
+			out[samples - 2] = v << 16;
+		}
+
+		return;
+	}
+#endif
+
+	for (; samples > 0; samples--)
+		out[samples - 1] = (uint32_t)in[samples - 1] << 16;
+}
+
+__ramfunc void pcm_interleave_s16(int16_t *out, const int16_t *l, const int16_t *r, int frames)
+{
+#ifdef PCM_KERNEL_WORD
+	if (frames > 0 && !PCM_MISALIGN(out) && PCM_MISALIGN(l) == PCM_MISALIGN(r)) {
+		const pcm_word_t *wl, *wr;
+		pcm_word_t *wo;
+
+		if (PCM_MISALIGN(l)) {
+			*out++ = *l++;
+			*out++ = *r++;
+			frames--;
+		}
+
+		wo = (pcm_word_t *)out;
+		wl = (const pcm_word_t *)l;
+		wr = (const pcm_word_t *)r;
+		for (; frames >= 2; frames -= 2) {
+			uint32_t vl = *wl++, vr = *wr++;
+
+			wo[0] = (vl & 0xffff) | (vr << 16);
+			wo[1] = (vl >> 16) | (vr & 0xffff0000);
+			wo += 2;
+		}
+
+		out = (int16_t *)wo;
+		l = (const int16_t *)wl;
+		r = (const int16_t *)wr;
+	}
+#endif
+
+	while (frames-- > 0) {
+		*out++ = *l++;
+		*out++ = *r++;
+	}
+}
+
+__ramfunc void pcm_deinterleave_s16(int16_t *l, int16_t *r, const int16_t *in, int frames)
+{
+#ifdef PCM_KERNEL_WORD
+	if (frames > 0 && !PCM_MISALIGN(in) && PCM_MISALIGN(l) == PCM_MISALIGN(r)) {
+		const pcm_word_t *wi;
+		pcm_word_t *wl, *wr;
+
+		if (PCM_MISALIGN(l)) {
+			*l++ = *in++;
+			*r++ = *in++;
+			frames--;
+		}
+
+		wi = (const pcm_word_t *)in;
+		wl = (pcm_word_t *)l;
+		wr = (pcm_word_t *)r;
+		for (; frames >= 2; frames -= 2) {
+			uint32_t v0 = wi[0], v1 = wi[1];
+
+			*wl++ = (v0 & 0xffff) | (v1 << 16);
+			*wr++ = (v0 >> 16) | (v1 & 0xffff0000);
+			wi += 2;
+		}
+
+		in = (const int16_t *)wi;
+		l = (int16_t *)wl;
+		r = (int16_t *)wr;
+	}
+#endif
+
+	while (frames-- > 0) {
+		*l++ = *in++;
+		*r++ = *in++;
+	}
+}
+
+__ramfunc void pcm_upmix_s16(int16_t *out, const int16_t *in, int samples)
+{
+#ifdef PCM_KERNEL_WORD
+	if (!PCM_MISALIGN(out) && !PCM_MISALIGN(in)) {
+		pcm_word_t *wo = (pcm_word_t *)out;
+
+		if (samples & 1) {
+			samples--;
+			out[samples * 2] = out[samples * 2 + 1] = in[samples];
+		}
+
+		for (; samples > 0; samples -= 2) {
+			uint32_t v = *(const pcm_word_t *)(in + samples - 2);
+
+			wo[samples - 1] = (v >> 16) | (v & 0xffff0000);
+			wo[samples - 2] = (v & 0xffff) | (v << 16);
+		}
+
+		return;
+	}
+#endif
+
+	for (; samples > 0; samples--)
+		out[samples * 2 - 1] = out[samples * 2 - 2] = in[samples - 1];
+}
+
+__ramfunc void pcm_upmix_s32(int32_t *out, const int32_t *in, int samples)
+{
+#ifdef PCM_KERNEL_WORD
+	/* two samples per iteration, both loaded before the four stores */
+	for (; samples >= 2; samples -= 2) {
+		int32_t v0 = in[samples - 2], v1 = in[samples - 1];
+
+		out[samples * 2 - 1] = v1;
+		out[samples * 2 - 2] = v1;
+		out[samples * 2 - 3] = v0;
+		out[samples * 2 - 4] = v0;
+	}
+#endif
+
+	for (; samples > 0; samples--)
+		out[samples * 2 - 1] = out[samples * 2 - 2] = in[samples - 1];
+}
@@ -23,9 +23,61 @@ typedef struct {
 	fs_file_t fp;
 	/** mutex used for sync*/
 	os_mutex lock;
-
+#ifdef CONFIG_FAT_FILESYSTEM_FASTSEEK
+	/** cluster link map of read only streams */
+	u32_t *cltbl;
+#endif
 } file_stream_info_t;
 
+#ifdef CONFIG_FAT_FILESYSTEM_FASTSEEK
+/* enough for files of up to 3 fragments */
+#define FSTREAM_CLTBL_INIT_SIZE 8
+
+static void fstream_fastseek_enable(file_stream_info_t *info)
+{
+	u32_t tbl_size = FSTREAM_CLTBL_INIT_SIZE;
+	int res;
+
+	info->cltbl = mem_malloc(tbl_size * sizeof(u32_t));
+	if (!info->cltbl)
+		return;
+
+	res = fs_fastseek_enable(&info->fp, info->cltbl, tbl_size);
+	if (res == -ENOMEM) {
+		/* fragmented file, retry with the size the link map needs */
+		tbl_size = info->cltbl[0];
+		mem_free(info->cltbl);
+		info->cltbl = NULL;
+
+		if (tbl_size > CONFIG_FAT_FILESYSTEM_FASTSEEK_TBL_SIZE) {
+			SYS_LOG_INF("link map %d too big, no fast seek\n", tbl_size);
+			return;
+		}
+
+		info->cltbl = mem_malloc(tbl_size * sizeof(u32_t));
+		if (!info->cltbl)
+			return;
+
+		res = fs_fastseek_enable(&info->fp, info->cltbl, tbl_size);
+	}
+
+	if (res) {
+		SYS_LOG_WRN("fast seek failed %d\n", res);
+		mem_free(info->cltbl);
+		info->cltbl = NULL;
+	}
+}
+
+static void fstream_fastseek_disable(file_stream_info_t *info)
+{
+	if (info->cltbl) {
+		fs_fastseek_disable(&info->fp);
+		mem_free(info->cltbl);
+		info->cltbl = NULL;
+	}
+}
+#endif
+
 
 int fstream_open(io_stream_t handle, stream_mode mode)
 {
@@ -51,6 +103,14 @@ int fstream_open(io_stream_t handle, stream_mode mode)
 		handle->wofs = handle->total_size;
 	}
 
+#ifdef CONFIG_FAT_FILESYSTEM_FASTSEEK
+	/* read only streams never extend the file */
+	fstream_fastseek_disable(info);
+	if ((handle->mode & MODE_IN_OUT) == MODE_IN) {
+		fstream_fastseek_enable(info);
+	}
+#endif
+
 	SYS_LOG_INF("handle %p total_size %d mode %x \n",handle, handle->total_size, mode);
 	return 0;
 }
@@ -255,6 +315,13 @@ int fstream_destroy(io_stream_t handle)
 		SYS_LOG_ERR("close failed %d\n", res);
 	}
 
+#ifdef CONFIG_FAT_FILESYSTEM_FASTSEEK
+	if (info->cltbl) {
+		mem_free(info->cltbl);
+		info->cltbl = NULL;
+	}
+#endif
+
 	os_mutex_unlock(&info->lock);
 
 	mem_free(info);
@@ -334,6 +401,8 @@ int fstream_init(io_stream_t handle, void *param)
 		return -ENOMEM;
 	}
 
+	memset(info, 0, sizeof(file_stream_info_t));
+
 	if (file_name_has_cluster(file_name, &dir, &cluster, &blk_ofs)) {
 		res = fs_open_cluster(&info->fp, dir, cluster, blk_ofs);
 		if (res) {
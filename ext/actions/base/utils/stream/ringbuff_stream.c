@@ -54,6 +54,32 @@ static int ringbuff_stream_read(io_stream_t handle, unsigned char *buf, int len)
 	return ret;
 }
 
+static int ringbuff_stream_read_claim(io_stream_t handle, unsigned char **buf, int len)
+{
+	ringbuff_info_t *info = (ringbuff_info_t *)handle->data;
+
+	if (!info)
+		return -EACCES;
+
+	return acts_ringbuf_get_claim(info->buf, (void **)buf, len);
+}
+
+static int ringbuff_stream_read_commit(io_stream_t handle, int len)
+{
+	int ret = 0;
+	ringbuff_info_t *info = (ringbuff_info_t *)handle->data;
+
+	if (!info)
+		return -EACCES;
+
+	ret = acts_ringbuf_get_finish(info->buf, len);
+
+	handle->rofs = info->buf->head;
+	handle->wofs = info->buf->tail;
+
+	return ret;
+}
+
 static int ringbuff_stream_write(io_stream_t handle, unsigned char *buf, int len)
 {
 	int ret = 0;
@@ -78,6 +104,32 @@ static int ringbuff_stream_write(io_stream_t handle, unsigned char *buf, int len
 	return ret;
 }
 
+static int ringbuff_stream_write_claim(io_stream_t handle, unsigned char **buf, int len)
+{
+	ringbuff_info_t *info = (ringbuff_info_t *)handle->data;
+
+	if (!info)
+		return -EACCES;
+
+	return acts_ringbuf_put_claim(info->buf, (void **)buf, len);
+}
+
+static int ringbuff_stream_write_commit(io_stream_t handle, int len)
+{
+	int ret = 0;
+	ringbuff_info_t *info = (ringbuff_info_t *)handle->data;
+
+	if (!info)
+		return -EACCES;
+
+	ret = acts_ringbuf_put_finish(info->buf, len);
+
+	handle->rofs = info->buf->head;
+	handle->wofs = info->buf->tail;
+
+	return ret;
+}
+
 static int ringbuff_stream_get_length(io_stream_t handle)
 {
 	ringbuff_info_t *info = (ringbuff_info_t *)handle->data;
@@ -186,6 +238,10 @@ const stream_ops_t ringbuff_stream_ops = {
 	.close = ringbuff_stream_close,
 	.destroy = ringbuff_stream_destroy,
 	.get_ringbuffer = ringbuff_stream_get_ringbuf,
+	.read_claim = ringbuff_stream_read_claim,
+	.read_commit = ringbuff_stream_read_commit,
+	.write_claim = ringbuff_stream_write_claim,
+	.write_commit = ringbuff_stream_write_commit,
 };
 
 io_stream_t ringbuff_stream_create(struct acts_ringbuf *param)
@@ -270,6 +326,10 @@ const stream_ops_t ringbuff_stream_ops_ext = {
 	.close = ringbuff_stream_close,
 	.destroy = ringbuff_stream_destroy_ext,
 	.get_ringbuffer = ringbuff_stream_get_ringbuf,
+	.read_claim = ringbuff_stream_read_claim,
+	.read_commit = ringbuff_stream_read_commit,
+	.write_claim = ringbuff_stream_write_claim,
+	.write_commit = ringbuff_stream_write_commit,
 };
 
 io_stream_t ringbuff_stream_create_ext(void *ring_buff, uint32_t ring_buff_size)
@@ -18,6 +18,14 @@
 #include <ringbuff_stream.h>
 #include "stream_internal.h"
 
+/** default deadline of MODE_BLOCK_TIMEOUT */
+#define STREAM_BLOCK_TIMEOUT_MS		(1000)
+/**
+ * max sleep slice of a blocked reader/writer, only to catch the data
+ * changed out of stream api, such as dsp writes the ringbuff directly.
+ */
+#define STREAM_BLOCK_POLL_MS		(50)
+
 static bool _stream_check_handle_state(io_stream_t handle, uint8_t need_state)
 {
 	if (handle == NULL) {
@@ -34,6 +42,84 @@ static bool _stream_check_handle_state(io_stream_t handle, uint8_t need_state)
 	return true;
 }
 
+/**
+ * wait until at least num bytes readable (or writable) or deadline reached,
+ * the opposite side wakes us up as soon as the wait length is reached.
+ */
+static int _stream_wait(io_stream_t handle, bool readable, int num)
+{
+	os_sem *sem = readable ? handle->read_sem : handle->write_sem;
+	u32_t start_time = os_uptime_get_32();
+	s32_t wait_time;
+	s32_t remain_time;
+	int wait_len;
+	int ret = 0;
+
+	if (!sem) {
+		return -EPERM;
+	}
+
+	if (readable) {
+		wait_len = MAX(num, handle->read_watermark);
+		handle->read_wait_len = MIN(wait_len, handle->total_size ? handle->total_size : wait_len);
+	} else {
+		wait_len = MAX(num, handle->write_watermark);
+		handle->write_wait_len = MIN(wait_len, handle->total_size ? handle->total_size : wait_len);
+	}
+
+	while ((readable ? stream_get_length(handle) : stream_get_space(handle)) < num) {
+		if (readable && handle->write_finished) {
+			break;
+		}
+
+		wait_time = STREAM_BLOCK_POLL_MS;
+		if (handle->mode & MODE_BLOCK_TIMEOUT) {
+			remain_time = handle->block_timeout - (s32_t)(os_uptime_get_32() - start_time);
+			if (remain_time <= 0) {
+				ret = -ETIMEDOUT;
+				break;
+			}
+			wait_time = MIN(wait_time, remain_time);
+		}
+
+		os_sem_take(sem, wait_time);
+		if (!_stream_check_handle_state(handle, STATE_OPEN)) {
+			ret = -ENOSYS;
+			break;
+		}
+	}
+
+	if (readable) {
+		handle->read_wait_len = 0;
+	} else {
+		handle->write_wait_len = 0;
+	}
+
+	return ret;
+}
+
+/**
+ * wake up the blocked reader once data length reach its wait length,
+ * or the blocked seek once the write offset reach its target.
+ */
+static void _stream_wakeup_reader(io_stream_t handle)
+{
+	if (handle->read_sem && (handle->write_finished ||
+		(handle->read_wait_len && stream_get_length(handle) >= handle->read_wait_len) ||
+		(handle->seek_wait_ofs && handle->wofs >= handle->seek_wait_ofs))) {
+		os_sem_give(handle->read_sem);
+	}
+}
+
+/** wake up the blocked writer once free space reach its wait length */
+static void _stream_wakeup_writer(io_stream_t handle)
+{
+	if (handle->write_sem && handle->write_wait_len
+		&& stream_get_space(handle) >= handle->write_wait_len) {
+		os_sem_give(handle->write_sem);
+	}
+}
+
 io_stream_t stream_create(const stream_ops_t  *ops, void *init_param)
 {
 	int ret = 0;
@@ -89,11 +175,22 @@ int stream_open(io_stream_t handle, stream_mode mode)
 	}
 
 	if((mode & (MODE_READ_BLOCK | MODE_WRITE_BLOCK))){
-		handle->sync_sem = mem_malloc(sizeof(os_sem));
-		if (!handle->sync_sem) {
-			return -ENOMEM;
+		/* reopen after close reuses the semaphores */
+		if (!handle->read_sem) {
+			handle->read_sem = mem_malloc(sizeof(os_sem) * 2);
+			if (!handle->read_sem) {
+				return -ENOMEM;
+			}
+			handle->write_sem = handle->read_sem + 1;
+		}
+		os_sem_init(handle->read_sem, 0, 1);
+		os_sem_init(handle->write_sem, 0, 1);
+		handle->read_wait_len = 0;
+		handle->write_wait_len = 0;
+		handle->seek_wait_ofs = 0;
+		if (!handle->block_timeout) {
+			handle->block_timeout = STREAM_BLOCK_TIMEOUT_MS;
 		}
-		os_sem_init(handle->sync_sem, 0, 1);
 		handle->write_finished = 0;
 	}
 
@@ -107,7 +204,6 @@ int stream_read(io_stream_t handle, unsigned char *buf,int num)
 {
 	int i;
 	int brw;
-	int try_cnt = 0;
 
 	if (!_stream_check_handle_state(handle,STATE_OPEN)) {
 		return -ENOSYS;
@@ -118,21 +214,13 @@ int stream_read(io_stream_t handle, unsigned char *buf,int num)
 	}
 
 	if ((handle->mode & MODE_READ_BLOCK)) {
-		while (stream_get_length(handle) < num) {
-			if((handle->mode & MODE_BLOCK_TIMEOUT)){
-				if (try_cnt ++ > 20) {
-					SYS_LOG_INF("time out 1s");
-					handle->write_finished = 1;
-					return 0;
-				}
-			}
-			os_sem_take(handle->sync_sem, 50);
-			if(!_stream_check_handle_state(handle,STATE_OPEN)) {
-				return -ENOSYS;
-			}
-			if (handle->write_finished) {
-				break;
-			}
+		brw = _stream_wait(handle, true, num);
+		if (brw == -ETIMEDOUT) {
+			SYS_LOG_INF("time out %dms", handle->block_timeout);
+			handle->write_finished = 1;
+			return 0;
+		} else if (brw) {
+			return brw;
 		}
 	}
 
@@ -143,9 +231,7 @@ int stream_read(io_stream_t handle, unsigned char *buf,int num)
 		return brw;
 	}
 
-	if (handle->sync_sem) {
-		os_sem_give(handle->sync_sem);
-	}
+	_stream_wakeup_writer(handle);
 
 	if (!os_is_in_isr()) {
 		os_mutex_lock(&handle->attach_lock, OS_FOREVER);
@@ -182,6 +268,62 @@ int stream_read(io_stream_t handle, unsigned char *buf,int num)
 	return brw;
 }
 
+int stream_read_claim(io_stream_t handle, unsigned char **buf, int num)
+{
+	int i;
+
+	if (!_stream_check_handle_state(handle,STATE_OPEN)) {
+		return -ENOSYS;
+	}
+
+	if (!(handle->mode & MODE_IN)) {
+		return -EPERM;
+	}
+
+	if (!handle->ops->read_claim || !handle->ops->read_commit) {
+		return -ENOTSUP;
+	}
+
+	/** attached stream need a copy of read data, not support in place read */
+	for (i = 0; i < ARRAY_SIZE(handle->attach_stream); i++) {
+		if (handle->attach_stream[i] && handle->attach_mode[i] == MODE_IN)
+			return -ENOTSUP;
+	}
+
+	return handle->ops->read_claim(handle, buf, num);
+}
+
+int stream_read_commit(io_stream_t handle, int num)
+{
+	int i;
+	int brw;
+
+	if (!_stream_check_handle_state(handle,STATE_OPEN)) {
+		return -ENOSYS;
+	}
+
+	if (!handle->ops->read_commit) {
+		return -ENOTSUP;
+	}
+
+	brw = handle->ops->read_commit(handle, num);
+	if (brw < 0) {
+		SYS_LOG_DBG("commit failed [%d]\n", brw);
+		return brw;
+	}
+
+	_stream_wakeup_writer(handle);
+
+	for (i = 0; i < ARRAY_SIZE(handle->observer_notify); i++) {
+		if (handle->observer_notify[i] && (handle->observer_type[i] & STREAM_NOTIFY_READ)) {
+			handle->observer_notify[i](handle->observer[i], handle->rofs,
+				handle->wofs, handle->total_size, NULL, num, STREAM_NOTIFY_READ);
+		}
+	}
+
+	return 0;
+}
+
 int stream_seek(io_stream_t handle, int offset,seek_dir origin)
 {
 	int i;
@@ -215,13 +357,17 @@ int stream_seek(io_stream_t handle, int offset,seek_dir origin)
 		return -1;
 	}
 
-	if ((handle->mode & MODE_IN_OUT) == MODE_IN_OUT) {
+	if ((handle->mode & MODE_IN_OUT) == MODE_IN_OUT && handle->read_sem) {
+		/* the writer wakes us up once it has written up to target_off */
+		handle->seek_wait_ofs = target_off;
 		while (target_off > handle->wofs) {
-			os_sem_take(handle->sync_sem, 50);
+			os_sem_take(handle->read_sem, STREAM_BLOCK_POLL_MS);
 			if(!_stream_check_handle_state(handle,STATE_OPEN)) {
+				handle->seek_wait_ofs = 0;
 				return -ENOSYS;
 			}
 		}
+		handle->seek_wait_ofs = 0;
 	}
 
 	brw = handle->ops->seek(handle, target_off, SEEK_DIR_BEG);
@@ -261,11 +407,74 @@ int stream_tell(io_stream_t handle)
 	return brw;
 }
 
+int stream_write_claim(io_stream_t handle, unsigned char **buf, int num)
+{
+	int i;
+
+	if (!_stream_check_handle_state(handle,STATE_OPEN)) {
+		return -ENOSYS;
+	}
+
+	if (!(handle->mode & MODE_OUT)) {
+		return -EPERM;
+	}
+
+	if (!handle->ops->write_claim || !handle->ops->write_commit) {
+		return -ENOTSUP;
+	}
+
+	/** attached stream need a copy of written data, not support in place write */
+	for (i = 0; i < ARRAY_SIZE(handle->attach_stream); i++) {
+		if (handle->attach_stream[i] && handle->attach_mode[i] == MODE_OUT)
+			return -ENOTSUP;
+	}
+
+	return handle->ops->write_claim(handle, buf, num);
+}
+
+int stream_write_commit(io_stream_t handle, unsigned char *buf, int num)
+{
+	int i;
+	int brw;
+
+	if (!_stream_check_handle_state(handle,STATE_OPEN)) {
+		return -ENOSYS;
+	}
+
+	if (!handle->ops->write_commit) {
+		return -ENOTSUP;
+	}
+
+	/** data is in place already, but not visible to the reader yet */
+	for (i = 0; i < ARRAY_SIZE(handle->observer_notify); i++) {
+		if (handle->observer_notify[i] && (handle->observer_type[i] & STREAM_NOTIFY_PRE_WRITE)) {
+			handle->observer_notify[i](handle->observer[i], handle->rofs,
+				handle->wofs, handle->total_size, buf, num, STREAM_NOTIFY_PRE_WRITE);
+		}
+	}
+
+	brw = handle->ops->write_commit(handle, num);
+	if (brw < 0) {
+		SYS_LOG_DBG("commit failed [%d]\n", brw);
+		return brw;
+	}
+
+	_stream_wakeup_reader(handle);
+
+	for (i = 0; i < ARRAY_SIZE(handle->observer_notify); i++) {
+		if (handle->observer_notify[i] && (handle->observer_type[i] & STREAM_NOTIFY_WRITE)) {
+			handle->observer_notify[i](handle->observer[i], handle->rofs,
+				handle->wofs, handle->total_size, buf, num, STREAM_NOTIFY_WRITE);
+		}
+	}
+
+	return 0;
+}
+
 int stream_write(io_stream_t handle, unsigned char *buf, int num)
 {
 	int brw;
 	int i;
-	int try_cnt = 0;
 
 	if (!_stream_check_handle_state(handle,STATE_OPEN)) {
 		return -ENOSYS;
@@ -276,18 +485,13 @@ int stream_write(io_stream_t handle, unsigned char *buf, int num)
 	}
 
 	if ((handle->mode & MODE_WRITE_BLOCK)) {
-		while (stream_get_space(handle) < num) {
-			if ((handle->mode & MODE_BLOCK_TIMEOUT)) {
-				if (try_cnt ++ > 20) {
-					SYS_LOG_INF("time out 1s");
-					handle->write_finished = 1;
-					return 0;
-				}
-			}
-			os_sem_take(handle->sync_sem, 50);
-			if(!_stream_check_handle_state(handle,STATE_OPEN)) {
-				return -ENOSYS;
-			}
+		brw = _stream_wait(handle, false, num);
+		if (brw == -ETIMEDOUT) {
+			SYS_LOG_INF("time out %dms", handle->block_timeout);
+			handle->write_finished = 1;
+			return 0;
+		} else if (brw) {
+			return brw;
 		}
 	}
 
@@ -308,9 +512,7 @@ int stream_write(io_stream_t handle, unsigned char *buf, int num)
 		handle->write_finished = 1;
 	}
 
-	if (handle->sync_sem)
-		os_sem_give(handle->sync_sem);
-
+	_stream_wakeup_reader(handle);
 
 	if (!os_is_in_isr()) {
 		os_mutex_lock(&handle->attach_lock, OS_FOREVER);
@@ -386,9 +588,10 @@ int stream_close(io_stream_t handle)
 		SYS_LOG_ERR("close failed [%d]\n", res);
 	}
 
-	if (handle->sync_sem) {
+	if (handle->read_sem) {
 		handle->write_finished = 1;
-		os_sem_give(handle->sync_sem);
+		os_sem_give(handle->read_sem);
+		os_sem_give(handle->write_sem);
 	}
 	handle->state = STATE_CLOSE;
 	return res;
@@ -410,8 +613,8 @@ int stream_destroy(io_stream_t handle)
 		}
 	}
 
-	if (handle->sync_sem)
-		mem_free(handle->sync_sem);
+	if (handle->read_sem)
+		mem_free(handle->read_sem);
 
 	mem_free(handle);
 	return res;
@@ -494,6 +697,27 @@ exit:
 	return brw;
 }
 
+int stream_set_block_timeout(io_stream_t handle, int timeout_ms)
+{
+	if (handle == NULL || timeout_ms <= 0) {
+		return -EINVAL;
+	}
+
+	handle->block_timeout = timeout_ms;
+	return 0;
+}
+
+int stream_set_watermark(io_stream_t handle, int read_watermark, int write_watermark)
+{
+	if (handle == NULL || read_watermark < 0 || write_watermark < 0) {
+		return -EINVAL;
+	}
+
+	handle->read_watermark = read_watermark;
+	handle->write_watermark = write_watermark;
+	return 0;
+}
+
 int stream_set_observer(io_stream_t handle, void * observer, stream_observer_notify notify, uint8_t type)
 {
 	int i;
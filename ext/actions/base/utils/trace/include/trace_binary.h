@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2020 Actions Semiconductor Co., Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief deferred format binary trace
+ *
+ * printk stores the format string address, a timestamp and the raw
+ * arguments of a message in a word ring, the text is made later by a
+ * low priority thread or on the PC. Strings outside the image rom are
+ * copied in, the ones inside are kept by address like the format. A
+ * format outside the image rom is printed as text right away.
+ *
+ * On the wire a message is a frame
+ *
+ *   TRACE_BINARY_SYNC, payload len (u8),
+ *   format address (u32 le), timestamp delta in cycles (varint),
+ *   one varint per argument word, zigzag for %d/%i,
+ *   NUL terminated copies of the %s arguments sent as 0
+ *
+ * a frame with format address 0 carries the count of dropped messages.
+ * Plain text in between, sync mode output and hex dumps, is 7 bit so the
+ * decoder (scripts/support/actions/trace_decode.py) passes it through.
+ */
+
+#ifndef TRACE_BINARY_H_
+#define TRACE_BINARY_H_
+
+#include <zephyr/types.h>
+#include <stdarg.h>
+#include <stdbool.h>
+
+#define TRACE_BINARY_SYNC		0xA5
+
+/* argument words and copied string bytes a message may take */
+#define TRACE_BINARY_MAX_ARGS		16
+#define TRACE_BINARY_MAX_STR		64
+
+/* head words: length and counts, timestamp, format */
+#define TRACE_BINARY_HEAD_WORDS		3
+#define TRACE_BINARY_REC_WORDS		(TRACE_BINARY_HEAD_WORDS + \
+					 TRACE_BINARY_MAX_ARGS + TRACE_BINARY_MAX_STR / 4)
+#define TRACE_BINARY_FRAME_SIZE		(2 + 4 + 5 + TRACE_BINARY_MAX_ARGS * 5 + \
+					 TRACE_BINARY_MAX_STR)
+
+struct trace_binary {
+	/* word ring, size is a power of 2 */
+	u32_t *buf;
+	u32_t size;
+	u32_t head;
+	u32_t tail;
+
+	/* strings in [rom_start, rom_end) are not copied */
+	u32_t rom_start;
+	u32_t rom_end;
+
+	u32_t drops;
+	u32_t last_timestamp;
+};
+
+/**
+ * @brief set up an empty ring
+ *
+ * @param size ring size in words, a power of 2
+ */
+void trace_binary_init(struct trace_binary *tb, u32_t *buf, u32_t size,
+		u32_t rom_start, u32_t rom_end);
+
+static inline bool trace_binary_in_rom(struct trace_binary *tb, const void *p)
+{
+	return (uintptr_t)p >= tb->rom_start && (uintptr_t)p < tb->rom_end;
+}
+
+/**
+ * @brief store a message into a record
+ *
+ * The format is kept by address, it has to be in the image rom.
+ *
+ * @param rec TRACE_BINARY_REC_WORDS words
+ *
+ * @return record length in words, -EINVAL if fmt is not in the image rom
+ */
+int trace_binary_encode(struct trace_binary *tb, u32_t *rec, u32_t timestamp,
+		const char *fmt, va_list args);
+
+/**
+ * @brief append a record, caller serializes ring access
+ *
+ * @return 0 on success, -ENOSPC if dropped
+ */
+int trace_binary_put(struct trace_binary *tb, const u32_t *rec);
+
+/**
+ * @brief take the oldest record, caller serializes ring access
+ *
+ * @return record length in words, 0 if the ring is empty
+ */
+int trace_binary_get(struct trace_binary *tb, u32_t *rec);
+
+static inline u32_t trace_binary_used(struct trace_binary *tb)
+{
+	return tb->tail - tb->head;
+}
+
+/**
+ * @brief make the wire frame of a record
+ *
+ * The timestamp is a delta from the last frame, frames have to be made
+ * and sent by one flusher at a time, in ring order.
+ *
+ * @param out TRACE_BINARY_FRAME_SIZE bytes
+ *
+ * @return frame length
+ */
+int trace_binary_frame(struct trace_binary *tb, const u32_t *rec, u8_t *out);
+
+/**
+ * @brief make the wire frame reporting dropped messages
+ */
+int trace_binary_drop_frame(u32_t drops, u8_t *out);
+
+/**
+ * @brief format a record to text
+ *
+ * @return text length, without the NUL
+ */
+int trace_binary_render(const u32_t *rec, char *out, int size);
+
+#endif /* TRACE_BINARY_H_ */
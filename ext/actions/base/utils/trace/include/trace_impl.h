@@ -50,7 +50,7 @@ typedef struct
     uint8_t panic:1;
 	uint8_t cdc_mode:1;
 	uint8_t lowpower_mode:1;
-	uint8_t reserved:1;
+	uint8_t binary:1;
     uint32_t caller;
     cbuf_dma_t dma_setting;
 
@@ -0,0 +1,461 @@
+/*
+ * Copyright (c) 2020 Actions Semiconductor Co., Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief deferred format binary trace
+ *
+ * Record layout in the ring, in words:
+ *
+ *   words (bits 0-7), argument words (8-15), string bytes (16-23)
+ *   timestamp
+ *   format address
+ *   argument words
+ *   copied strings, padded to a word
+ */
+
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <misc/printk.h>
+#include <trace_binary.h>
+
+#ifdef CONFIG_TRACE_BINARY
+
+enum {
+	BIN_END,
+	/* literal, %% or unknown conversion */
+	BIN_NONE,
+	BIN_INT,
+	BIN_SINT,
+	BIN_LL,
+	BIN_PTR,
+	BIN_DBL,
+	BIN_STR,
+};
+
+struct bin_conv {
+	const char *start;
+	const char *end;
+	u8_t type;
+	/* '*' width and precision, an int argument each */
+	u8_t stars;
+};
+
+/* find the next conversion from p on, returns where to go on from */
+static const char *bin_next(const char *p, struct bin_conv *conv)
+{
+	int longs = 0;
+
+	p = strchr(p, '%');
+	if (!p) {
+		conv->type = BIN_END;
+		return NULL;
+	}
+
+	conv->start = p++;
+	conv->stars = 0;
+
+	for (;; p++) {
+		switch (*p) {
+		case '-':
+		case '+':
+		case ' ':
+		case '#':
+		case '.':
+		case '0' ... '9':
+		case 'h':
+			continue;
+		case '*':
+			conv->stars++;
+			continue;
+		case 'l':
+		case 'z':
+			longs++;
+			continue;
+		case 'd':
+		case 'i':
+			conv->type = (longs > 1 || (longs && sizeof(long) > 4)) ? BIN_LL : BIN_SINT;
+			break;
+		case 'u':
+		case 'x':
+		case 'X':
+		case 'o':
+			conv->type = (longs > 1 || (longs && sizeof(long) > 4)) ? BIN_LL : BIN_INT;
+			break;
+		case 'c':
+			conv->type = BIN_INT;
+			break;
+		case 'p':
+			conv->type = BIN_PTR;
+			break;
+		case 's':
+			conv->type = BIN_STR;
+			break;
+		case 'f':
+		case 'e':
+		case 'g':
+		case 'E':
+		case 'G':
+			conv->type = BIN_DBL;
+			break;
+		case '\0':
+			conv->type = BIN_END;
+			return NULL;
+		default:
+			conv->type = BIN_NONE;
+			break;
+		}
+
+		conv->end = ++p;
+		return p;
+	}
+}
+
+/* argument words taken by a conversion */
+static inline int bin_words(struct bin_conv *conv)
+{
+	switch (conv->type) {
+	case BIN_NONE:
+		return conv->stars;
+	case BIN_LL:
+	case BIN_DBL:
+		return conv->stars + 2;
+	default:
+		return conv->stars + 1;
+	}
+}
+
+void trace_binary_init(struct trace_binary *tb, u32_t *buf, u32_t size,
+		u32_t rom_start, u32_t rom_end)
+{
+	memset(tb, 0, sizeof(*tb));
+
+	tb->buf = buf;
+	tb->size = size;
+	tb->rom_start = rom_start;
+	tb->rom_end = rom_end;
+}
+
+int trace_binary_encode(struct trace_binary *tb, u32_t *rec, u32_t timestamp,
+		const char *fmt, va_list args)
+{
+	u32_t *arg = rec + TRACE_BINARY_HEAD_WORDS;
+	/* strings are gathered past the largest argument list, moved down last */
+	char *str = (char *)(arg + TRACE_BINARY_MAX_ARGS);
+	struct bin_conv conv;
+	const char *p = fmt, *s;
+	int nargs = 0, str_len = 0, len, i;
+	u64_t ll;
+	double d;
+
+	/* rendered later from its address */
+	if (!trace_binary_in_rom(tb, fmt))
+		return -EINVAL;
+
+	while ((p = bin_next(p, &conv)) != NULL) {
+		if (conv.type == BIN_NONE && !conv.stars)
+			continue;
+
+		/* too many, the rest is rendered as is */
+		if (nargs + bin_words(&conv) > TRACE_BINARY_MAX_ARGS)
+			break;
+
+		for (i = 0; i < conv.stars; i++)
+			arg[nargs++] = va_arg(args, int);
+
+		switch (conv.type) {
+		case BIN_INT:
+		case BIN_SINT:
+			arg[nargs++] = va_arg(args, int);
+			break;
+		case BIN_LL:
+			ll = va_arg(args, long long);
+			arg[nargs++] = (u32_t)ll;
+			arg[nargs++] = (u32_t)(ll >> 32);
+			break;
+		case BIN_DBL:
+			d = va_arg(args, double);
+			memcpy(&arg[nargs], &d, 8);
+			nargs += 2;
+			break;
+		case BIN_PTR:
+			arg[nargs++] = (u32_t)(uintptr_t)va_arg(args, void *);
+			break;
+		case BIN_STR:
+			s = va_arg(args, const char *);
+			if (s && trace_binary_in_rom(tb, s)) {
+				arg[nargs++] = (u32_t)(uintptr_t)s;
+				break;
+			}
+
+			/* not in the image, copied, truncated if need be */
+			arg[nargs++] = 0;
+			if (!s)
+				s = "(null)";
+
+			if (str_len < TRACE_BINARY_MAX_STR) {
+				len = strnlen(s, TRACE_BINARY_MAX_STR - str_len - 1);
+				memcpy(str + str_len, s, len);
+				str[str_len + len] = '\0';
+				str_len += len + 1;
+			}
+			break;
+		}
+	}
+
+	if (str_len)
+		memmove(arg + nargs, str, str_len);
+
+	len = TRACE_BINARY_HEAD_WORDS + nargs + (str_len + 3) / 4;
+
+	rec[0] = len | (nargs << 8) | (str_len << 16);
+	rec[1] = timestamp;
+	rec[2] = (u32_t)(uintptr_t)fmt;
+
+	return len;
+}
+
+int trace_binary_put(struct trace_binary *tb, const u32_t *rec)
+{
+	u32_t words = rec[0] & 0xff;
+	u32_t mask = tb->size - 1;
+	u32_t i;
+
+	if (tb->size - (tb->tail - tb->head) < words) {
+		tb->drops++;
+		return -ENOSPC;
+	}
+
+	for (i = 0; i < words; i++)
+		tb->buf[(tb->tail + i) & mask] = rec[i];
+
+	tb->tail += words;
+
+	return 0;
+}
+
+int trace_binary_get(struct trace_binary *tb, u32_t *rec)
+{
+	u32_t mask = tb->size - 1;
+	u32_t words, i;
+
+	if (tb->tail == tb->head)
+		return 0;
+
+	words = tb->buf[tb->head & mask] & 0xff;
+	for (i = 0; i < words; i++)
+		rec[i] = tb->buf[(tb->head + i) & mask];
+
+	tb->head += words;
+
+	return words;
+}
+
+static u8_t *bin_varint(u8_t *out, u32_t val)
+{
+	while (val >= 0x80) {
+		*out++ = val | 0x80;
+		val >>= 7;
+	}
+
+	*out++ = val;
+
+	return out;
+}
+
+static u8_t *bin_le32(u8_t *out, u32_t val)
+{
+	out[0] = val;
+	out[1] = val >> 8;
+	out[2] = val >> 16;
+	out[3] = val >> 24;
+
+	return out + 4;
+}
+
+static inline u32_t bin_zigzag(u32_t val)
+{
+	return (val << 1) ^ -(val >> 31);
+}
+
+int trace_binary_frame(struct trace_binary *tb, const u32_t *rec, u8_t *out)
+{
+	const u32_t *arg = rec + TRACE_BINARY_HEAD_WORDS;
+	int nargs = (rec[0] >> 8) & 0xff;
+	int str_len = (rec[0] >> 16) & 0xff;
+	const char *p = (const char *)(uintptr_t)rec[2];
+	struct bin_conv conv;
+	u8_t *d = out + 2;
+	int i, n = 0;
+
+	d = bin_le32(d, rec[2]);
+	d = bin_varint(d, rec[1] - tb->last_timestamp);
+	tb->last_timestamp = rec[1];
+
+	while (n < nargs && (p = bin_next(p, &conv)) != NULL) {
+		for (i = 0; i < conv.stars; i++)
+			d = bin_varint(d, bin_zigzag(arg[n++]));
+
+		switch (conv.type) {
+		case BIN_NONE:
+			break;
+		case BIN_SINT:
+			d = bin_varint(d, bin_zigzag(arg[n++]));
+			break;
+		case BIN_LL:
+		case BIN_DBL:
+			d = bin_varint(d, arg[n++]);
+			d = bin_varint(d, arg[n++]);
+			break;
+		default:
+			d = bin_varint(d, arg[n++]);
+			break;
+		}
+	}
+
+	memcpy(d, arg + nargs, str_len);
+	d += str_len;
+
+	out[0] = TRACE_BINARY_SYNC;
+	out[1] = d - out - 2;
+
+	return d - out;
+}
+
+int trace_binary_drop_frame(u32_t drops, u8_t *out)
+{
+	u8_t *d = out + 2;
+
+	d = bin_le32(d, 0);
+	d = bin_varint(d, 0);
+	d = bin_varint(d, drops);
+
+	out[0] = TRACE_BINARY_SYNC;
+	out[1] = d - out - 2;
+
+	return d - out;
+}
+
+static int bin_append(char *out, int size, int len, const char *s, int n)
+{
+	if (n > size - 1 - len)
+		n = size - 1 - len;
+
+	memcpy(out + len, s, n);
+
+	return len + n;
+}
+
+/* copy a conversion with its '*' replaced by the argument values */
+static int bin_spec(struct bin_conv *conv, const u32_t *arg, char *spec, int size)
+{
+	const char *s;
+	int len = 0;
+
+	for (s = conv->start; s < conv->end && len < size - 1; s++) {
+		if (*s == '*')
+			len += snprintk(spec + len, size - len, "%d", (int)*arg++);
+		else
+			spec[len++] = *s;
+	}
+
+	if (len >= size - 1)
+		return -EINVAL;
+
+	spec[len] = '\0';
+
+	return 0;
+}
+
+int trace_binary_render(const u32_t *rec, char *out, int size)
+{
+	const u32_t *arg = rec + TRACE_BINARY_HEAD_WORDS;
+	int nargs = (rec[0] >> 8) & 0xff;
+	int str_len = (rec[0] >> 16) & 0xff;
+	const char *str = (const char *)(arg + nargs);
+	const char *p = (const char *)(uintptr_t)rec[2];
+	const char *next, *s;
+	struct bin_conv conv;
+	char spec[24];
+	int len = 0, n = 0, str_offs = 0, ret;
+	double d;
+
+	if (size <= 0)
+		return 0;
+
+	while ((next = bin_next(p, &conv)) != NULL) {
+		len = bin_append(out, size, len, p, conv.start - p);
+		p = next;
+
+		if (conv.end - conv.start == 2 && conv.start[1] == '%') {
+			len = bin_append(out, size, len, "%", 1);
+			continue;
+		}
+
+		/* unknown or out of arguments, left as it is */
+		if (conv.type == BIN_NONE || n + bin_words(&conv) > nargs ||
+		    bin_spec(&conv, arg + n, spec, sizeof(spec))) {
+			len = bin_append(out, size, len, conv.start, conv.end - conv.start);
+			if (n + bin_words(&conv) > nargs) {
+				n = nargs;
+				continue;
+			}
+
+			n += bin_words(&conv);
+			/* keep the copied strings in step */
+			if (conv.type == BIN_STR && !arg[n - 1] && str_offs < str_len)
+				str_offs += strlen(str + str_offs) + 1;
+			continue;
+		}
+
+		n += conv.stars;
+
+		switch (conv.type) {
+		case BIN_LL:
+			ret = snprintk(out + len, size - len, spec,
+					arg[n] | ((long long)arg[n + 1] << 32));
+			n += 2;
+			break;
+		case BIN_DBL:
+			memcpy(&d, &arg[n], 8);
+			ret = snprintk(out + len, size - len, spec, d);
+			n += 2;
+			break;
+		case BIN_PTR:
+			ret = snprintk(out + len, size - len, spec, (void *)(uintptr_t)arg[n++]);
+			break;
+		case BIN_STR:
+			if (arg[n]) {
+				s = (const char *)(uintptr_t)arg[n];
+			} else if (str_offs < str_len) {
+				s = str + str_offs;
+				str_offs += strlen(s) + 1;
+			} else {
+				s = "";
+			}
+			n++;
+			ret = snprintk(out + len, size - len, spec, s);
+			break;
+		default:
+			ret = snprintk(out + len, size - len, spec, arg[n++]);
+			break;
+		}
+
+		if (ret > size - 1 - len)
+			ret = size - 1 - len;
+		if (ret > 0)
+			len += ret;
+	}
+
+	len = bin_append(out, size, len, p, strlen(p));
+	out[len] = '\0';
+
+	return len;
+}
+
+#endif /* CONFIG_TRACE_BINARY */
@@ -32,6 +32,10 @@
 #ifdef CONFIG_TRACE_FILE
 #include <trace_file.h>
 #endif
+#ifdef CONFIG_TRACE_BINARY
+#include <trace_binary.h>
+#include <linker/linker-defs.h>
+#endif
 
 #include <os_common_api.h>
 
@@ -608,12 +612,12 @@ void trace_monitor(trace_ctx_t * trace_ctx)
 
 static uint8_t digits[] = "0123456789abcdef";
 
-static void get_time_prefix(char *num_str)
+static void get_time_prefix(char *num_str, uint32_t cycles)
 {
     uint32_t number;
     uint8_t num_len, ch;
 
-    number = k_cycle_get_32() / 24;
+    number = cycles / 24;
 
     num_str[13] = ' ';
     num_str[12] = ']';
@@ -648,7 +652,7 @@ int vprintk_sub(const char *fmt, va_list args)
 	ret = 0;
 
 #ifdef CONFIG_TRACE_TIME_FREFIX
-	get_time_prefix(p_buf);
+	get_time_prefix(p_buf, k_cycle_get_32());
 	p_buf += 14;
 	size -= 14;
 	ret += 14;
@@ -666,6 +670,135 @@ int vprintk_sub(const char *fmt, va_list args)
 
 }
 
+#ifdef CONFIG_TRACE_BINARY
+
+#define TRACE_BINARY_STACK_SIZE  1024
+
+static struct _k_thread_stack_element __aligned(STACK_ALIGN) trace_binary_stack[TRACE_BINARY_STACK_SIZE];
+static uint32_t trace_binary_buffer[CONFIG_TRACE_BINARY_BUFFER_SIZE / 4];
+static struct trace_binary trace_bin;
+static os_sem trace_binary_sem;
+/* set while a flush runs, frames must leave in ring order */
+static atomic_t trace_binary_flushing;
+
+static int trace_binary_vprintk(const char *fmt, va_list args)
+{
+    uint32_t rec[TRACE_BINARY_REC_WORDS];
+    int words, flags;
+
+    words = trace_binary_encode(&trace_bin, rec, k_cycle_get_32(), fmt, args);
+
+    flags = irq_lock();
+    trace_binary_put(&trace_bin, rec);
+    irq_unlock(flags);
+
+    /* the thread polls, it is only woken up early when the ring fills up */
+    if (trace_binary_used(&trace_bin) > ARRAY_SIZE(trace_binary_buffer) / 2) {
+        os_sem_give(&trace_binary_sem);
+    }
+
+    return words * 4;
+}
+
+/*
+ * move the ring out to the trace sinks, from the thread or before sync output;
+ * an isr or thread preempting a flush leaves the ring to it, a second flusher
+ * would send frames out of order and break the timestamp deltas
+ */
+static void trace_binary_flush(trace_ctx_t * trace_ctx)
+{
+    uint32_t rec[TRACE_BINARY_REC_WORDS];
+#ifdef CONFIG_TRACE_BINARY_HOST_DECODE
+    uint8_t out[TRACE_BINARY_FRAME_SIZE];
+#else
+    char out[TRACE_TEMP_BUF_SIZE];
+#endif
+    uint32_t drops;
+    int len, flags;
+
+    if (!atomic_cas(&trace_binary_flushing, 0, 1)) {
+        return;
+    }
+
+    while (1) {
+        flags = irq_lock();
+        len = trace_binary_get(&trace_bin, rec);
+        drops = 0;
+        if (!len) {
+            drops = trace_bin.drops;
+            trace_bin.drops = 0;
+        }
+        irq_unlock(flags);
+
+        if (!len && !drops) {
+            break;
+        }
+
+#ifdef CONFIG_TRACE_BINARY_HOST_DECODE
+        if (len) {
+            len = trace_binary_frame(&trace_bin, rec, out);
+        } else {
+            len = trace_binary_drop_frame(drops, out);
+        }
+#else
+        if (len) {
+            len = 0;
+#ifdef CONFIG_TRACE_TIME_FREFIX
+            get_time_prefix(out, rec[1]);
+            len = 14;
+#endif
+            len += trace_binary_render(rec, out + len, sizeof(out) - len);
+        } else {
+            len = snprintk(out, sizeof(out), "<%d logs dropped>\n", drops);
+        }
+#endif
+
+        trace_output((const unsigned char *)out, len, trace_ctx);
+    }
+
+    atomic_clear(&trace_binary_flushing);
+}
+
+static void trace_binary_thread(void *p1, void *p2, void *p3)
+{
+    while (1) {
+        os_sem_take(&trace_binary_sem, CONFIG_TRACE_BINARY_FLUSH_MS);
+        trace_binary_flush(get_trace_ctx());
+    }
+}
+
+static void trace_binary_start(trace_ctx_t * trace_ctx)
+{
+    trace_binary_init(&trace_bin, trace_binary_buffer, ARRAY_SIZE(trace_binary_buffer),
+                      (uint32_t)_image_rom_start, (uint32_t)_image_rom_end);
+
+    os_sem_init(&trace_binary_sem, 0, UINT_MAX);
+
+    os_thread_create((char *)trace_binary_stack, TRACE_BINARY_STACK_SIZE,
+                     trace_binary_thread, NULL, NULL, NULL,
+                     K_LOWEST_APPLICATION_THREAD_PRIO, 0, OS_NO_WAIT);
+
+    trace_ctx->binary = 1;
+}
+
+int trace_binary_print_set(unsigned int binary_enable)
+{
+    int old_binary_enable;
+
+    trace_ctx_t *trace_ctx = get_trace_ctx();
+
+    old_binary_enable = trace_ctx->binary;
+
+    trace_ctx->binary = binary_enable ? 1 : 0;
+
+    if (!binary_enable) {
+        trace_binary_flush(trace_ctx);
+    }
+
+    return old_binary_enable;
+}
+#endif
+
 int vprintk(const char *fmt, va_list args)
 {
 #ifdef CONFIG_USE_ROM_TRACING
@@ -710,6 +843,17 @@ int vprintk(const char *fmt, va_list args)
 	trace_dsp_debug_data();
 #endif
 
+#ifdef CONFIG_TRACE_BINARY
+    if (trace_ctx->binary) {
+        if (trace_ctx->trace_mode != TRACE_MODE_CPU && trace_binary_in_rom(&trace_bin, fmt)) {
+            return trace_binary_vprintk(fmt, args);
+        }
+
+        /* sync output or a format built at run time, what is queued goes first */
+        trace_binary_flush(trace_ctx);
+    }
+#endif
+
 #ifndef CONFIG_USE_ROM_LOG
 	return vprintk_sub(fmt, args);
 #else
@@ -810,6 +954,9 @@ void trace_init(void)
 
     __printk_hook_install(trace_out);
 
+#ifdef CONFIG_TRACE_BINARY
+    trace_binary_start(trace_ctx);
+#endif
 
 #ifdef TRACE_TEST
     trace_test_init();
@@ -440,6 +440,43 @@ int print_test_config(int key)
         ret = 1;
     }
 
+#ifdef CONFIG_TRACE_BINARY
+    if (key == (0x4000000|KEY_NEXTSONG)) {
+        trace_binary_bench();
+        ret = 1;
+    }
+#endif
+
     return ret;
 }
-#endif
\ No newline at end of file
+#endif
+
+#ifdef CONFIG_TRACE_BINARY
+#define TRACE_BENCH_COUNT 32
+
+/* cycles per printk call, formatted at the call site vs deferred binary */
+void trace_binary_bench(void)
+{
+    uint32_t start, cycles[2];
+    int i, mode, old_binary;
+
+    old_binary = trace_binary_print_set(0);
+
+    for (mode = 0; mode < 2; mode++) {
+        trace_binary_print_set(mode);
+        //Let the output of the last round drain.
+        k_sleep(200);
+
+        start = k_cycle_get_32();
+        for (i = 0; i < TRACE_BENCH_COUNT; i++) {
+            printk("bench %d: vol %d addr 0x%08x %s\n", i, -i, i << 12, "a2dp");
+        }
+        cycles[mode] = (k_cycle_get_32() - start) / TRACE_BENCH_COUNT;
+    }
+
+    trace_binary_print_set(old_binary);
+    k_sleep(200);
+
+    printk("printk cycles per call: text %u, binary %u\n", cycles[0], cycles[1]);
+}
+#endif
@@ -22,4 +22,8 @@ void trace_test_init(void);
 void trace_test_config(int key);
 #endif
 
+#ifdef CONFIG_TRACE_BINARY
+void trace_binary_bench(void);
+#endif
+
 #endif
\ No newline at end of file
@@ -36,6 +36,31 @@ XzDecode (
     uint32_t* OutputSize
     );
 
+/*!
+ * @brief          Decompresses a raw LZMA2 stream from InputBuffer into
+ *                 OutputBuffer.
+ *
+ * @detail         Same as XzDecode for the LZMA2 chunks of a block, without the
+ *                 XZ stream and block headers, index and footer around them.
+ *                 The stream must end with the LZMA2 end marker.
+ *
+ * @param[in]      InputBuffer - A fully formed buffer containing the stream.
+ * @param[in]      InputSize - The size of the input buffer.
+ * @param[in]      OutputBuffer - A fully allocated buffer to receive the output.
+ * @param[in,out]  OutputSize - On input, the size of the buffer. On output, the
+ *                 size of the decompressed result.
+ *
+ * @return         true - The input buffer was fully decompressed.
+ *                 false - A failure occurred during the decompression process.
+ */
+bool
+Lz2Decode (
+    const uint8_t* InputBuffer,
+    uint32_t InputSize,
+    uint8_t* OutputBuffer,
+    uint32_t* OutputSize
+    );
+
 /*!
  * @brief          Returns if the last call to XzDecode resulted in an integrity
  *                 error.
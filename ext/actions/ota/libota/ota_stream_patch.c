@@ -0,0 +1,334 @@
+/*
+ * Copyright (c) 2020 Actions Semiconductor Co., Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief OTA streaming file patch
+ */
+
+#define SYS_LOG_LEVEL 3
+#define SYS_LOG_DOMAIN "otalib"
+#include <logging/sys_log.h>
+
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <crc.h>
+#include <minlzma.h>
+#include "ota_stream_patch.h"
+
+static inline u32_t stream_patch_unit(struct ota_stream_patch *sp)
+{
+	return sp->flag_use_crc ? OTA_STREAM_PATCH_CRC_UNIT : OTA_STREAM_PATCH_UNIT;
+}
+
+/* storage offset of a new file data offset */
+static inline u32_t stream_patch_storage_offs(struct ota_stream_patch *sp, u32_t offs)
+{
+	return offs / OTA_STREAM_PATCH_UNIT * stream_patch_unit(sp) + offs % OTA_STREAM_PATCH_UNIT;
+}
+
+/* same crc16 as the hpatch writer of ota_file_patch.c */
+static u16_t stream_patch_crc16(const u8_t *buf)
+{
+	u16_t crc = utils_crc16_ccitt_rev_update(0xffff, buf, OTA_STREAM_PATCH_UNIT);
+	u16_t v = 0;
+	int i;
+
+	for (i = 0; i < 16; i++) {
+		v = (v << 1) | (crc & 0x1);
+		crc >>= 1;
+	}
+
+	return (v >> 8) | (v << 8);
+}
+
+int ota_stream_patch_probe(const u8_t *data)
+{
+	u32_t magic = data[0] | (data[1] << 8) | (data[2] << 16) | ((u32_t)data[3] << 24);
+
+	return (magic == OTA_STREAM_PATCH_MAGIC);
+}
+
+static int stream_patch_flush(struct ota_stream_patch *sp)
+{
+	u32_t unit = stream_patch_unit(sp);
+	u32_t drop = 0;
+	int err;
+
+	/*
+	 * units below the resume point are on flash already, one straddling
+	 * it is partly erased and gets written whole, reprogramming the same
+	 * data on the rest of it
+	 */
+	while (drop + unit <= sp->wbuf_len && sp->wbuf_offs + drop + unit <= sp->skip_offs)
+		drop += unit;
+
+	if (drop < sp->wbuf_len) {
+		err = sp->write(sp->ctx, sp->wbuf_offs + drop, sp->wbuf + drop, sp->wbuf_len - drop);
+		if (err) {
+			SYS_LOG_ERR("write failed, offs 0x%x", sp->wbuf_offs + drop);
+			return -EIO;
+		}
+	}
+
+	sp->wbuf_offs += sp->wbuf_len;
+	sp->wbuf_len = 0;
+
+	if (sp->wbuf_offs > sp->done_offs)
+		sp->done_offs = sp->wbuf_offs;
+
+	return 0;
+}
+
+static int stream_patch_close_unit(struct ota_stream_patch *sp)
+{
+	u16_t crc;
+
+	if (sp->flag_use_crc) {
+		crc = stream_patch_crc16(sp->wbuf + sp->wbuf_len - OTA_STREAM_PATCH_UNIT);
+		sp->wbuf[sp->wbuf_len++] = crc & 0xff;
+		sp->wbuf[sp->wbuf_len++] = crc >> 8;
+	}
+
+	sp->unit_pos = 0;
+
+	if (sp->wbuf_len == OTA_STREAM_PATCH_WRITE_UNITS * stream_patch_unit(sp))
+		return stream_patch_flush(sp);
+
+	return 0;
+}
+
+/* new data is old + diff, or data as is if old is NULL */
+static int stream_patch_emit(struct ota_stream_patch *sp, const u8_t *old,
+		const u8_t *data, u32_t size)
+{
+	u32_t len, i;
+	u8_t *dst;
+	int err;
+
+	while (size > 0) {
+		len = OTA_STREAM_PATCH_UNIT - sp->unit_pos;
+		if (len > size)
+			len = size;
+
+		dst = sp->wbuf + sp->wbuf_len;
+		if (old) {
+			for (i = 0; i < len; i++)
+				dst[i] = old[i] + data[i];
+			old += len;
+		} else {
+			memcpy(dst, data, len);
+		}
+
+		data += len;
+		size -= len;
+		sp->wbuf_len += len;
+		sp->unit_pos += len;
+		sp->new_offs += len;
+
+		if (sp->unit_pos == OTA_STREAM_PATCH_UNIT) {
+			err = stream_patch_close_unit(sp);
+			if (err)
+				return err;
+		}
+	}
+
+	return 0;
+}
+
+static int stream_patch_varint(const u8_t **p, const u8_t *end, u32_t *val)
+{
+	u32_t v = 0;
+	int shift;
+
+	for (shift = 0; *p < end && shift < 32; shift += 7) {
+		v |= (u32_t)(**p & 0x7f) << shift;
+		if (!(*(*p)++ & 0x80)) {
+			*val = v;
+			return 0;
+		}
+	}
+
+	return -EINVAL;
+}
+
+static int stream_patch_apply(struct ota_stream_patch *sp, const u8_t *diff, u32_t size)
+{
+	const u8_t *end = diff + size;
+	u32_t seg_end, old_pos = 0;
+	u32_t seek, add, ins;
+	int err;
+
+	seg_end = sp->new_offs + sp->hdr.seg_size;
+	if (seg_end > sp->hdr.new_size)
+		seg_end = sp->hdr.new_size;
+
+	while (sp->new_offs < seg_end) {
+		if (stream_patch_varint(&diff, end, &seek) ||
+		    stream_patch_varint(&diff, end, &add) ||
+		    stream_patch_varint(&diff, end, &ins))
+			return -EINVAL;
+
+		/* zigzag */
+		old_pos += (seek >> 1) ^ -(seek & 0x1);
+
+		if (old_pos > sp->hdr.old_size || add > sp->hdr.old_size - old_pos ||
+		    add > seg_end - sp->new_offs || ins > seg_end - sp->new_offs - add ||
+		    add + ins > end - diff)
+			return -EINVAL;
+
+		err = stream_patch_emit(sp, sp->old_data + old_pos, diff, add);
+		if (!err)
+			err = stream_patch_emit(sp, NULL, diff + add, ins);
+		if (err)
+			return err;
+
+		diff += add + ins;
+		old_pos += add;
+	}
+
+	if (diff != end)
+		return -EINVAL;
+
+	/* the file tail is padded to a whole unit */
+	if (sp->new_offs == sp->hdr.new_size && sp->unit_pos) {
+		memset(sp->wbuf + sp->wbuf_len, 0, OTA_STREAM_PATCH_UNIT - sp->unit_pos);
+		sp->wbuf_len += OTA_STREAM_PATCH_UNIT - sp->unit_pos;
+		err = stream_patch_close_unit(sp);
+		if (err)
+			return err;
+	}
+
+	return stream_patch_flush(sp);
+}
+
+static int stream_patch_segment(struct ota_stream_patch *sp)
+{
+	uint32_t size = sp->window_size;
+	int err;
+
+	if (!Lz2Decode(sp->in_buf, sp->seg_len, sp->window, &size)) {
+		SYS_LOG_ERR("seg %d: lzma2 decode failed", sp->seg);
+		return -EINVAL;
+	}
+
+	err = stream_patch_apply(sp, sp->window, size);
+	if (err) {
+		SYS_LOG_ERR("seg %d: apply failed %d, new offs 0x%x", sp->seg, err, sp->new_offs);
+		return err;
+	}
+
+	sp->seg++;
+	sp->seg_len = 0;
+	sp->seg_in = 0;
+
+	return 0;
+}
+
+int ota_stream_patch_feed(struct ota_stream_patch *sp, const u8_t *data, u32_t size)
+{
+	u32_t len;
+	int err;
+
+	while (size > 0 && !ota_stream_patch_is_done(sp)) {
+		if (sp->seg_in < 4) {
+			sp->seg_len |= (u32_t)*data << (8 * sp->seg_in);
+			len = 1;
+
+			if (++sp->seg_in == 4 && (!sp->seg_len || sp->seg_len > sp->in_buf_size)) {
+				SYS_LOG_ERR("seg %d: bad length 0x%x", sp->seg, sp->seg_len);
+				return -EINVAL;
+			}
+		} else {
+			len = sp->seg_len - (sp->seg_in - 4);
+			if (len > size)
+				len = size;
+
+			memcpy(sp->in_buf + sp->seg_in - 4, data, len);
+			sp->seg_in += len;
+		}
+
+		data += len;
+		size -= len;
+		sp->patch_offs += len;
+
+		if (sp->seg_in > 4 && sp->seg_in - 4 == sp->seg_len) {
+			err = stream_patch_segment(sp);
+			if (err)
+				return err;
+		}
+	}
+
+	return 0;
+}
+
+int ota_stream_patch_open(struct ota_stream_patch *sp, u32_t start_offs)
+{
+	struct ota_stream_patch_header *hdr = &sp->hdr;
+	u32_t offs;
+	u8_t buf[4];
+	int err;
+
+	err = sp->read(sp->ctx, 0, (u8_t *)hdr, sizeof(*hdr));
+	if (err)
+		return -EIO;
+
+	if (hdr->magic != OTA_STREAM_PATCH_MAGIC || hdr->version != OTA_STREAM_PATCH_VERSION ||
+	    hdr->header_crc != utils_crc32(0, (const u8_t *)hdr, offsetof(struct ota_stream_patch_header, header_crc))) {
+		SYS_LOG_ERR("bad header");
+		return -EINVAL;
+	}
+
+	if (hdr->header_size < sizeof(*hdr) || !hdr->seg_size ||
+	    hdr->seg_size % OTA_STREAM_PATCH_UNIT ||
+	    hdr->seg_num != (hdr->new_size + hdr->seg_size - 1) / hdr->seg_size) {
+		SYS_LOG_ERR("bad segments, size 0x%x num %d", hdr->seg_size, hdr->seg_num);
+		return -EINVAL;
+	}
+
+	if (hdr->max_diff > sp->window_size || hdr->max_lzma > sp->in_buf_size) {
+		SYS_LOG_ERR("window 0x%x/0x%x, lzma 0x%x/0x%x", hdr->max_diff,
+			sp->window_size, hdr->max_lzma, sp->in_buf_size);
+		return -ENOMEM;
+	}
+
+	/* the diff only makes sense against the very file it was made from */
+	if (hdr->old_size > sp->old_size ||
+	    hdr->old_crc != utils_crc32(0, sp->old_data, hdr->old_size)) {
+		SYS_LOG_ERR("old file mismatch");
+		return -EINVAL;
+	}
+
+	/* resume from the segment holding the first erased byte */
+	offs = start_offs / stream_patch_unit(sp) * OTA_STREAM_PATCH_UNIT;
+	sp->seg = offs / hdr->seg_size;
+	sp->seg_len = 0;
+	sp->seg_in = 0;
+	sp->new_offs = sp->seg * hdr->seg_size;
+	sp->skip_offs = start_offs;
+	sp->done_offs = start_offs;
+	sp->wbuf_offs = stream_patch_storage_offs(sp, sp->new_offs);
+	sp->wbuf_len = 0;
+	sp->unit_pos = 0;
+
+	if (ota_stream_patch_is_done(sp)) {
+		sp->patch_offs = 0;
+		return 0;
+	}
+
+	err = sp->read(sp->ctx, hdr->header_size + sp->seg * 4, buf, 4);
+	if (err)
+		return -EIO;
+
+	sp->patch_offs = buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((u32_t)buf[3] << 24);
+
+	SYS_LOG_INF("new 0x%x, %d segs of 0x%x, start seg %d patch offs 0x%x",
+		hdr->new_size, hdr->seg_num, hdr->seg_size, sp->seg, sp->patch_offs);
+
+	return 0;
+}
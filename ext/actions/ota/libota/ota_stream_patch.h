@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2020 Actions Semiconductor Co., Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief OTA streaming file patch interface
+ *
+ * A stream patch (build_ota_patch.py -s) is a header, a table of segment
+ * record offsets and one record per seg_size bytes of the new file. A
+ * record is the u32 length of a raw LZMA2 stream, then the stream, which
+ * decodes to a list of
+ *
+ *   seek (zigzag varint), add len (varint), insert len (varint),
+ *   add len bytes added to the old file from the seek position on,
+ *   insert len bytes copied as is
+ *
+ * with the old file position starting at 0 in each segment. Records are
+ * applied one at a time as they arrive, decoded into a fixed window that
+ * is the LZMA2 dictionary too, and the result goes straight to storage.
+ */
+
+#ifndef __OTA_STREAM_PATCH_H__
+#define __OTA_STREAM_PATCH_H__
+
+#include <zephyr/types.h>
+
+#define OTA_STREAM_PATCH_MAGIC		0x48435053	/* "SPCH" */
+#define OTA_STREAM_PATCH_VERSION	1
+
+/* data bytes per unit, crc partitions store a crc16 after each */
+#define OTA_STREAM_PATCH_UNIT		0x20
+#define OTA_STREAM_PATCH_CRC_UNIT	0x22
+/* units staged per storage write */
+#define OTA_STREAM_PATCH_WRITE_UNITS	8
+
+struct ota_stream_patch_header {
+	u32_t magic;
+	u16_t version;
+	/* offset of the segment table */
+	u16_t header_size;
+
+	u32_t old_size;
+	u32_t old_crc;
+	u32_t new_size;
+
+	/* new file bytes per segment, multiple of the unit */
+	u32_t seg_size;
+	u32_t seg_num;
+	/* largest decoded and compressed segment */
+	u32_t max_diff;
+	u32_t max_lzma;
+
+	/* crc32 of the fields above */
+	u32_t header_crc;
+} __attribute__((packed));
+
+/* random read of the patch file */
+typedef int (*ota_stream_patch_read_t)(void *ctx, u32_t offs, u8_t *buf, u32_t size);
+/* write at a storage offset of the new file */
+typedef int (*ota_stream_patch_write_t)(void *ctx, u32_t offs, const u8_t *buf, u32_t size);
+
+struct ota_stream_patch {
+	/* set up by the caller */
+	void *ctx;
+	ota_stream_patch_read_t read;
+	ota_stream_patch_write_t write;
+
+	const u8_t *old_data;
+	u32_t old_size;
+
+	/* compressed segment */
+	u8_t *in_buf;
+	u32_t in_buf_size;
+	/* decoded segment, also the LZMA2 dictionary */
+	u8_t *window;
+	u32_t window_size;
+
+	u32_t flag_use_crc:1;
+
+	struct ota_stream_patch_header hdr;
+
+	/* patch file offset of the next byte to feed */
+	u32_t patch_offs;
+
+	u32_t seg;
+	/* length field, then compressed bytes of the current record */
+	u32_t seg_len;
+	u32_t seg_in;
+
+	/* new file data produced */
+	u32_t new_offs;
+	/* storage offsets below are already programmed */
+	u32_t skip_offs;
+	/* storage offsets below are written, for the breakpoint */
+	u32_t done_offs;
+
+	/* storage offset and length of wbuf, data bytes in its last unit */
+	u32_t wbuf_offs;
+	u32_t wbuf_len;
+	u32_t unit_pos;
+	u8_t wbuf[OTA_STREAM_PATCH_CRC_UNIT * OTA_STREAM_PATCH_WRITE_UNITS];
+};
+
+/**
+ * @brief check the magic of a patch file
+ *
+ * @param data first 4 bytes of the patch file
+ *
+ * @return 1 if it is a stream patch
+ */
+int ota_stream_patch_probe(const u8_t *data);
+
+/**
+ * @brief check the patch against the old file and find where to start
+ *
+ * @param sp patch with the caller fields set up
+ * @param start_offs storage offset of the new file from which on the
+ *        partition is erased, 0 unless resuming from a breakpoint
+ *
+ * @return 0 on success, patch_offs is the first patch file byte to feed
+ */
+int ota_stream_patch_open(struct ota_stream_patch *sp, u32_t start_offs);
+
+/**
+ * @brief apply the next bytes of the patch file
+ *
+ * @return 0 on success, else negative errno
+ */
+int ota_stream_patch_feed(struct ota_stream_patch *sp, const u8_t *data, u32_t size);
+
+static inline int ota_stream_patch_is_done(struct ota_stream_patch *sp)
+{
+	return sp->seg >= sp->hdr.seg_num;
+}
+
+#endif /* __OTA_STREAM_PATCH_H__ */
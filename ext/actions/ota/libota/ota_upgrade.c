@@ -29,10 +29,12 @@
 #include "ota_manifest.h"
 #include "ota_breakpoint.h"
 #include "ota_file_patch.h"
+#include "ota_stream_patch.h"
 #include <os_common_api.h>
 #include <logging/sys_log.h>
 #include <acts_ringbuf.h>
 #define OTA_ERASE_ALIGN_SIZE		4096
+#define OTA_ERASE_AHEAD_BLOCK_SIZE	0x10000
 #define OTA_DATA_BUFFER_SIZE		1024
 
 #define OTA_MANIFESET_FILE_NAME		"ota.xml"
@@ -119,6 +121,16 @@ struct ota_upgrade_info {
 	uint16_t xfer_time;
 	uint32_t temp_image_offset;
 	const char *public_key;
+
+	/* writer stage timings */
+	uint32_t rx_wait_time;
+	uint32_t crc_time;
+	uint32_t erase_ahead_time;
+	uint32_t erase_idle_cnt;
+
+	/* pending erase range of the file being written, storage address */
+	uint32_t erase_offset;
+	uint32_t erase_end;
 };
 
 static int ota_update_state(struct ota_upgrade_info *ota, enum ota_state state)
@@ -809,6 +821,61 @@ static int ota_calc_write_seg_size(struct ota_upgrade_info *ota)
 
 
 
+static void ota_erase_ahead_init(struct ota_upgrade_info *ota,
+			     const struct partition_entry *part, int start_offset)
+{
+	/* same range as ota_partition_erase_part(), erased while writing */
+	ota->erase_offset = ROUND_DOWN(part->offset + start_offset, OTA_ERASE_ALIGN_SIZE);
+	ota->erase_end = ota->erase_offset + ROUND_UP(part->size - start_offset, OTA_ERASE_ALIGN_SIZE);
+
+	SYS_LOG_INF("erase ahead 0x%x ~ 0x%x", ota->erase_offset, ota->erase_end);
+}
+
+static int ota_erase_ahead_step(struct ota_upgrade_info *ota, uint32_t size)
+{
+	uint32_t start_time;
+	int err;
+
+	if (size > ota->erase_end - ota->erase_offset)
+		size = ota->erase_end - ota->erase_offset;
+
+	start_time = k_uptime_get_32();
+	err = ota_storage_erase(ota->storage, ota->erase_offset, size);
+	ota->erase_ahead_time += k_uptime_get_32() - start_time;
+	if (err) {
+		SYS_LOG_ERR("erase failed, offs 0x%x", ota->erase_offset);
+		return -EIO;
+	}
+
+	ota->erase_offset += size;
+
+	return 0;
+}
+
+/* erase pending blocks until end (storage address) is covered */
+static int ota_erase_ahead(struct ota_upgrade_info *ota, uint32_t end)
+{
+	int err;
+
+	while (ota->erase_offset < ota->erase_end && ota->erase_offset < end) {
+		/* up to the next 64KB boundary, so the storage can use block erase */
+		err = ota_erase_ahead_step(ota,
+			ROUND_UP(ota->erase_offset + 1, OTA_ERASE_AHEAD_BLOCK_SIZE) - ota->erase_offset);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+/* one sector while waiting for rx data, a block erase would stall the ring */
+static int ota_erase_ahead_idle(struct ota_upgrade_info *ota)
+{
+	ota->erase_idle_cnt++;
+
+	return ota_erase_ahead_step(ota, OTA_ERASE_ALIGN_SIZE);
+}
+
 static int ota_write_file_partition(struct ota_upgrade_info *ota, struct ota_file *file, uint32_t offs, uint8_t *data, uint32_t size)
 {
 	int ret = 0;
@@ -869,7 +936,7 @@ static int ota_write_file_normal(struct ota_upgrade_info *ota, struct ota_file *
 	unsigned int offs;
 	int img_file_offset;
 	int ret = 0, seg_size, file_len, wlen, in_size;
-	uint32_t start_time, consume_time;
+	uint32_t start_time, consume_time, stage_time;
 	bool is_record = false;
 	bool no_wait = false;
 
@@ -909,7 +976,22 @@ static int ota_write_file_normal(struct ota_upgrade_info *ota, struct ota_file *
 
 	while (wlen > 0) {
 		if (!no_wait) {
-			os_sem_take(&rx_info->rx_get_sem, OS_FOREVER);
+			ret = os_sem_take(&rx_info->rx_get_sem, OS_NO_WAIT);
+			if (ret && ota->erase_offset < ota->erase_end) {
+				/* no data yet, erase ahead while the link fills the ring buffer */
+				if (ota_erase_ahead_idle(ota)) {
+					ota_rx_stop(ota);
+					return -EIO;
+				}
+				continue;
+			}
+
+			if (ret) {
+				stage_time = k_uptime_get_32();
+				os_sem_take(&rx_info->rx_get_sem, OS_FOREVER);
+				ota->rx_wait_time += k_uptime_get_32() - stage_time;
+			}
+
 			if (rx_info->rx_errno) {
 				ota_rx_stop(ota);
 				ota_breakpoint_update_file_state(bp, file, OTA_BP_FILE_STATE_WRITING, offs, 1);
@@ -951,9 +1033,13 @@ static int ota_write_file_normal(struct ota_upgrade_info *ota, struct ota_file *
 			return -EAGAIN;
 		}
 
+		stage_time = k_uptime_get_32();
 		rx_info->file_crc = utils_crc32(rx_info->file_crc, rx_info->in_buf, in_size);
+		ota->crc_time += k_uptime_get_32() - stage_time;
 
-		ret = ota_write_file_partition(ota, file, offs, rx_info->in_buf, in_size);
+		ret = ota_erase_ahead(ota, file->offset + offs + in_size);
+		if (!ret)
+			ret = ota_write_file_partition(ota, file, offs, rx_info->in_buf, in_size);
 		if (ret) {
 			ota_rx_stop(ota);
 			return -EIO;
@@ -963,6 +1049,12 @@ static int ota_write_file_normal(struct ota_upgrade_info *ota, struct ota_file *
 		wlen -= in_size;
 	}
 
+	/* rest of the partition after the file */
+	if (ota_erase_ahead(ota, ota->erase_end)) {
+		ota_rx_stop(ota);
+		return -EIO;
+	}
+
 	consume_time = k_uptime_get_32() - start_time;
 
 	SYS_LOG_INF("%s(%d KB), cost %d ms, %d KB/s", file->name, file_len / 1024,
@@ -975,10 +1067,220 @@ static int ota_write_file_normal(struct ota_upgrade_info *ota, struct ota_file *
 	return 0;
 }
 
+#ifdef CONFIG_OTA_STREAM_PATCH
+/* decoded segment of a stream patch */
+static __ota_bss uint8_t ota_patch_window[CONFIG_OTA_STREAM_PATCH_WINDOW];
+
+struct ota_stream_patch_writer {
+	struct ota_stream_patch sp;
+	struct ota_upgrade_info *ota;
+	struct ota_file *file;
+	const struct partition_entry *part;
+	int img_file_offset;
+};
+
+static __ota_bss struct ota_stream_patch_writer ota_patch_writer;
+
+static int ota_is_stream_patch_file(struct ota_upgrade_info *ota, struct ota_file *file)
+{
+	uint8_t magic[4];
+	int img_file_offset;
+
+	img_file_offset = ota_image_get_file_offset(ota->img, file->name);
+	if (img_file_offset < 0)
+		return 0;
+
+	if (ota_image_read(ota->img, img_file_offset, magic, sizeof(magic)))
+		return 0;
+
+	return ota_stream_patch_probe(magic);
+}
+
+static int ota_stream_patch_read(void *ctx, u32_t offs, u8_t *buf, u32_t size)
+{
+	struct ota_stream_patch_writer *pw = ctx;
+
+	return ota_image_read(pw->ota->img, pw->img_file_offset + offs, buf, size);
+}
+
+static int ota_stream_patch_write(void *ctx, u32_t offs, const u8_t *buf, u32_t size)
+{
+	struct ota_stream_patch_writer *pw = ctx;
+	struct ota_upgrade_info *ota = pw->ota;
+	uint32_t addr = pw->file->offset + offs;
+	uint32_t unit;
+	int err;
+
+	if (offs + size > pw->part->size) {
+		SYS_LOG_ERR("write exceeds partition, offs 0x%x", offs);
+		return -EINVAL;
+	}
+
+	err = ota_erase_ahead(ota, addr + size);
+	if (err)
+		return err;
+
+	if (!(pw->part->flag & PARTITION_FLAG_ENABLE_ENCRYPTION))
+		return ota_storage_write(ota->storage, addr, (uint8_t *)buf, size);
+
+	/* encrypted, one unit per write as in ota_file_patch.c */
+	unit = pw->sp.flag_use_crc ? OTA_STREAM_PATCH_CRC_UNIT : OTA_STREAM_PATCH_UNIT;
+	for (; size > 0; size -= unit) {
+		err = ota_storage_write(ota->storage, addr | 0x80000000, (uint8_t *)buf, unit);
+		if (err)
+			return err;
+
+		addr += unit;
+		buf += unit;
+	}
+
+	return 0;
+}
+
+static int ota_write_file_by_stream_patch(struct ota_upgrade_info *ota, struct ota_file *file, int start_file_offs)
+{
+	struct ota_stream_patch_writer *pw = &ota_patch_writer;
+	struct ota_stream_patch *sp = &pw->sp;
+	struct ota_breakpoint *bp = &ota->bp;
+	struct ota_rx_info *rx_info = &ota->rx_info;
+	const struct partition_entry *part;
+	void *mapping_addr, *data;
+	uint32_t start_time, consume_time, stage_time, bp_offs;
+	int ret, patch_file_size, wlen, in_size;
+
+	SYS_LOG_INF("%s offset 0x%x bpoffs 0x%x", file->name, file->offset, start_file_offs);
+
+	start_time = k_uptime_get_32();
+
+	part = partition_get_part(file->file_id);
+	if (part == NULL)
+		return -EINVAL;
+
+	memset(pw, 0x0, sizeof(struct ota_stream_patch_writer));
+
+	pw->ota = ota;
+	pw->file = file;
+	pw->part = part;
+	pw->img_file_offset = ota_image_get_file_offset(ota->img, file->name);
+	patch_file_size = ota_image_get_file_length(ota->img, file->name);
+
+	mapping_addr = soc_memctrl_create_temp_mapping(part->file_offset, part->flag & PARTITION_FLAG_ENABLE_CRC);
+
+	sp->ctx = pw;
+	sp->read = ota_stream_patch_read;
+	sp->write = ota_stream_patch_write;
+	sp->old_data = mapping_addr;
+	sp->old_size = part->size;
+	sp->in_buf = rx_info->in_buf;
+	sp->in_buf_size = rx_info->in_bufsize;
+	sp->window = ota_patch_window;
+	sp->window_size = sizeof(ota_patch_window);
+	sp->flag_use_crc = (part->flag & PARTITION_FLAG_ENABLE_CRC) ? 1 : 0;
+
+	ret = ota_stream_patch_open(sp, start_file_offs);
+	if (ret)
+		goto out;
+
+	if (ota_stream_patch_is_done(sp))
+		goto done;
+
+	/* the breakpoint only moves on with data that is on flash */
+	bp_offs = sp->done_offs;
+	ota_breakpoint_update_file_state(bp, file, OTA_BP_FILE_STATE_WRITING, bp_offs, 1);
+
+	wlen = patch_file_size - sp->patch_offs;
+
+	ota_rx_start(ota, pw->img_file_offset + sp->patch_offs, wlen,
+		ota_calc_write_seg_size(ota), file->file_id, true);
+
+	/* bytes past the last segment are taken and ignored, so rx runs out */
+	while (wlen > 0) {
+		ret = os_sem_take(&rx_info->rx_get_sem, OS_NO_WAIT);
+		if (ret && ota->erase_offset < ota->erase_end) {
+			/* no data yet, erase ahead while the link fills the ring buffer */
+			ret = ota_erase_ahead_idle(ota);
+			if (ret)
+				break;
+			continue;
+		}
+
+		if (ret) {
+			stage_time = k_uptime_get_32();
+			os_sem_take(&rx_info->rx_get_sem, OS_FOREVER);
+			ota->rx_wait_time += k_uptime_get_32() - stage_time;
+			ret = 0;
+		}
+
+		/* decoded in place, the ring buffer is not copied out */
+		while ((in_size = acts_ringbuf_get_claim(&rx_info->rbuf, &data, wlen)) > 0) {
+			ret = ota_stream_patch_feed(sp, data, in_size);
+
+			acts_ringbuf_get_finish(&rx_info->rbuf, in_size);
+			os_sem_give(&rx_info->rx_put_sem);
+
+			if (ret)
+				break;
+
+			wlen -= in_size;
+
+			if (sp->done_offs != bp_offs) {
+				bp_offs = sp->done_offs;
+				ota_breakpoint_update_file_state(bp, file, OTA_BP_FILE_STATE_WRITING, bp_offs, 0);
+			}
+		}
+
+		if (ret)
+			break;
+
+		if (rx_info->rx_errno) {
+			ota_breakpoint_update_file_state(bp, file, OTA_BP_FILE_STATE_WRITING, sp->done_offs, 1);
+			ret = rx_info->rx_errno;
+			break;
+		}
+	}
+
+	ota_rx_stop(ota);
+
+	if (!ret && !ota_stream_patch_is_done(sp)) {
+		SYS_LOG_ERR("patch truncated, seg %d/%d", sp->seg, sp->hdr.seg_num);
+		ret = -EINVAL;
+	}
+
+done:
+	/* rest of the partition after the file */
+	if (!ret)
+		ret = ota_erase_ahead(ota, ota->erase_end);
+
+out:
+	soc_memctrl_clear_temp_mapping(mapping_addr);
+
+	if (ret) {
+		SYS_LOG_ERR("%s failed %d, done offs 0x%x", file->name, ret, sp->done_offs);
+		return ret;
+	}
+
+	consume_time = k_uptime_get_32() - start_time + 1;
+	SYS_LOG_INF("%s(%d KB, patch %d KB), cost %d ms, %d KB/s", file->name, sp->hdr.new_size / 1024,
+		patch_file_size / 1024, consume_time, sp->hdr.new_size / consume_time);
+
+	return 0;
+}
+#endif /* CONFIG_OTA_STREAM_PATCH */
+
 static int ota_write_file(struct ota_upgrade_info *ota, struct ota_file *file, int start_file_offs)
 {
 #ifdef CONFIG_OTA_FILE_PATCH
+#ifdef CONFIG_OTA_STREAM_PATCH
+	/* erased on the fly, resumable */
+	if (ota_is_patch_fw(ota) && ota_is_stream_patch_file(ota, file))
+		return ota_write_file_by_stream_patch(ota, file, start_file_offs);
+#endif
+
 	if (ota_is_patch_fw(ota)) {
+		/* patch writer expects the partition to be clean */
+		if (ota_erase_ahead(ota, ota->erase_end))
+			return -EIO;
+
 		return ota_write_file_by_patch(ota, file, start_file_offs);
 	} else {
 #endif
@@ -996,6 +1298,10 @@ static int ota_write_and_verify_file(struct ota_upgrade_info *ota,
 	int bp_file_state, start_write_offset = 0;
 	int err = 0, cur_storage_id, need_erase = 0;
 
+	/* nothing left to erase ahead unless this file needs it */
+	ota->erase_offset = 0;
+	ota->erase_end = 0;
+
 	bp_file_state = ota_breakpoint_get_file_state(bp, file->file_id);
 
 	SYS_LOG_INF("%s: file_id %d, bp_file_state %d", file->name, file->file_id, bp_file_state);
@@ -1051,7 +1357,11 @@ static int ota_write_and_verify_file(struct ota_upgrade_info *ota,
 			erase_offset = ROUND_DOWN(file->offset + start_write_offset, OTA_ERASE_ALIGN_SIZE);
 			start_write_offset = erase_offset - file->offset;
 
+#ifdef CONFIG_OTA_ERASE_AHEAD
+			ota_erase_ahead_init(ota, part, erase_offset - part->offset);
+#else
 			ota_partition_erase_part(ota, part, erase_offset - part->offset, false);
+#endif
 
 			SYS_LOG_INF("write_offset from 0x%x to 0x%x", bp->cur_file_write_offset, start_write_offset);
 			bp->cur_file_write_offset = start_write_offset;
@@ -1794,6 +2104,8 @@ static void ota_upgrade_dump_time_performance(struct ota_upgrade_info *ota)
 {
 	ota_storage_time_statistics(ota->storage);
 	printk("ota xfer time %d ms\n", ota->xfer_time);
+	printk("ota writer: rx wait %d ms, crc %d ms, erase ahead %d ms (%d idle blocks)\n",
+		ota->rx_wait_time, ota->crc_time, ota->erase_ahead_time, ota->erase_idle_cnt);
 }
 
 int ota_upgrade_check(struct ota_upgrade_info *ota, struct ota_upgrade_check_param *param)
@@ -535,6 +535,23 @@ XzDecode (
     return true;
 }
 
+bool
+Lz2Decode (
+    const uint8_t* InputBuffer,
+    uint32_t InputSize,
+    uint8_t* OutputBuffer,
+    uint32_t* OutputSize
+    )
+{
+    //
+    // Raw LZMA2 chunks without the XZ container. The output buffer is still
+    // the dictionary, so match distances are bounded by its size.
+    //
+    BfInitialize(InputBuffer, InputSize);
+    DtInitialize(OutputBuffer, *OutputSize, 0);
+    return Lz2DecodeStream(OutputSize, false);
+}
+
 bool
 XzChecksumError (
     void
@@ -28,6 +28,7 @@
 #include <usb_hid_inner.h>
 #include <usb_audio_inner.h>
 #include <usb_audio_hal.h>
+#include <usb_audio_out.h>
 #include <energy_statistics.h>
 #ifdef CONFIG_PROPERTY
 #include <property_manager.h>
@@ -61,6 +62,7 @@ struct usb_audio_info {
 	uint32_t last_out_packet_count;
 	uint32_t out_packet_count;
 	uint32_t last_diff_num;
+	struct usb_audio_out_stats out_stats;
 };
 
 static struct usb_audio_info *usb_audio;
@@ -205,39 +207,6 @@ static int _usb_audio_check_stream(short *pcm_data, u32_t samples)
 	return 0;
 }
 
-static int _usb_stream_write(io_stream_t handle, unsigned char *buf, int num)
-{
-	int32_t *buffer = (int32_t *)usb_audio->download_buf;
-	int16_t *pbuf = (int16_t *)buf;
-	int j = 0;
-
-	if(USB_AudioSinkBitDepthGet() == 24)
-	{
-		for (int i = 0; i+3 <= num; )
-		{
-			int32_t v = ((int32_t)buf[i++])<<8;
-			v |= ((int32_t)buf[i++])<<16;
-			v |= ((int32_t)buf[i++])<<24;
-			buffer[j++] = v;
-		}
-
-		return stream_write(handle, (unsigned char *)buffer, num * 4 / 3);
-	}
-	else if(USB_AudioSinkBitDepthGet() == 16)
-	{
-		for (int i = 0; i < num/2; i++)
-		{
-			buffer[i] = (int32_t)pbuf[i] << 16;
-		}
-
-		return stream_write(handle, (unsigned char *)buffer, num * 2);
-	}
-	else
-	{
-		return stream_write(handle, buf, num);
-	}
-}
-
 /*
  * Interrupt Context
  */
@@ -274,24 +243,22 @@ static void _usb_audio_in_ep_complete(u8_t ep,
 static void _usb_audio_out_ep_complete(u8_t ep,
 	enum usb_dc_ep_cb_status_code cb_status)
 {
-	u32_t read_byte, res;
-
-	u8_t ISOC_out_Buf[MAX_DOWNLOAD_PACKET];
+	u32_t start = k_cycle_get_32();
+	int res;
 
 	/* Out transaction on this EP, data is available for read */
 	if (USB_EP_DIR_IS_OUT(ep) && cb_status == USB_DC_EP_DATA_OUT) {
-		res = usb_audio_device_ep_read(ISOC_out_Buf,
-				sizeof(ISOC_out_Buf), &read_byte);
-		if (!res && read_byte != 0) {
+		/* read and widened in the download stream, download_buf if it wraps */
+		res = usb_audio_out_packet(usb_audio->usound_download_stream,
+				USB_AudioSinkBitDepthGet(), usb_audio->download_buf,
+				MAX_DOWNLOAD_PACKET, &usb_audio->out_stats);
+		if (res > 0) {
 			usb_audio->out_packet_count++;
-			_usb_audio_check_stream((short *)ISOC_out_Buf, read_byte / 2);
-			if (usb_audio->usound_download_stream) {
-				res = _usb_stream_write(usb_audio->usound_download_stream, ISOC_out_Buf, read_byte);
-				if (res != read_byte) {
-					SYS_LOG_DBG("%d", res);
-				}
-			}
+			/* pcm is in the stream already, only the state is checked */
+			_usb_audio_check_stream(NULL, res / 2);
 		}
+
+		usb_audio_out_isr_time(&usb_audio->out_stats, k_cycle_get_32() - start);
 	}
 }
 
@@ -344,6 +311,7 @@ int usb_audio_set_stream(io_stream_t stream)
 		usb_audio->last_out_packet_count = 0;
 		usb_audio->out_packet_count = 0;
 		usb_audio->last_diff_num = 0;
+		memset(&usb_audio->out_stats, 0, sizeof(usb_audio->out_stats));
 	}
 
 	if(usb_audio){
@@ -491,8 +459,8 @@ int usb_audio_init(usb_audio_event_callback cb)
 		return -ENOMEM;
 	}
 
-	/* The uac has a maximum depth of 24 bits */
-	usb_audio->download_buf = mem_malloc(MAX_DOWNLOAD_PACKET * 2);
+	/* The uac has a maximum depth of 24 bits, widened to 32 bits for the stream */
+	usb_audio->download_buf = mem_malloc(usb_audio_out_widened(16, MAX_DOWNLOAD_PACKET));
 
 	if (!usb_audio->download_buf) {
 		mem_free(usb_audio->usb_audio_play_load);
@@ -505,6 +473,7 @@ int usb_audio_init(usb_audio_event_callback cb)
 	usb_audio->play_state = 0;
 	usb_audio->zero_frame_cnt = 0;
 	usb_audio->out_packet_count = 0;
+	memset(&usb_audio->out_stats, 0, sizeof(usb_audio->out_stats));
 
 	audio_cur_level = audio_system_get_current_volume(AUDIO_STREAM_USOUND);
 	audio_cur_level = audio_cur_level*16/audio_policy_get_volume_level();
@@ -617,3 +586,19 @@ uint32_t usb_audio_out_packet_size(void)
 {
 	return MAX_DOWNLOAD_PACKET;
 }
+
+void usb_audio_dump_out_stats(void)
+{
+	struct usb_audio_out_stats *stats;
+
+	if (!usb_audio) {
+		return;
+	}
+
+	stats = &usb_audio->out_stats;
+	printk("usb audio out: %u in place, %u bounced, %u dropped\n",
+		stats->in_place, stats->bounced, stats->dropped);
+	printk("isr cycles: last %u, max %u, avg %u\n",
+		stats->isr_cycles_last, stats->isr_cycles_max,
+		stats->isr_packets ? (u32_t)(stats->isr_cycles_sum / stats->isr_packets) : 0);
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2020 Actions Semi Co., Ltd.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file usb audio OUT packet path
+ *
+ * Interrupt Context
+ */
+
+#include <string.h>
+#include <stream.h>
+#include <pcm_kernel.h>
+#include <usb/class/usb_audio.h>
+
+#include "usb_audio_out.h"
+
+/* packet at the start of buf, samples end up in the whole widened size */
+static void usb_audio_out_widen(u8_t bit_depth, u8_t *buf, u32_t len)
+{
+	if (bit_depth == 24)
+		pcm_unpack_24_32((int32_t *)buf, buf, len / 3);
+	else if (bit_depth == 16)
+		pcm_widen_16_32((int32_t *)buf, (int16_t *)buf, len / 2);
+}
+
+int usb_audio_out_packet(io_stream_t stream, u8_t bit_depth, u8_t *bounce,
+		u32_t max_packet, struct usb_audio_out_stats *stats)
+{
+	u32_t max_len = usb_audio_out_widened(bit_depth, max_packet);
+	u32_t read_byte = 0, len;
+	u8_t *buf;
+	int res;
+
+	/* largest packet fits, nothing is visible to the reader until commit */
+	if (stream && stream_write_claim(stream, &buf, max_len) == max_len) {
+		res = usb_audio_device_ep_read(buf, max_packet, &read_byte);
+		if (res || !read_byte)
+			return res;
+
+		usb_audio_out_widen(bit_depth, buf, read_byte);
+		stream_write_commit(stream, buf, usb_audio_out_widened(bit_depth, read_byte));
+		stats->in_place++;
+		return read_byte;
+	}
+
+	/* the stream wraps or is short of space */
+	res = usb_audio_device_ep_read(bounce, max_packet, &read_byte);
+	if (res || !read_byte || !stream)
+		return res ? res : read_byte;
+
+	usb_audio_out_widen(bit_depth, bounce, read_byte);
+	len = usb_audio_out_widened(bit_depth, read_byte);
+	if (stream_write(stream, bounce, len) == len)
+		stats->bounced++;
+	else
+		stats->dropped++;
+
+	return read_byte;
+}
+
+void usb_audio_out_isr_time(struct usb_audio_out_stats *stats, u32_t cycles)
+{
+	stats->isr_cycles_last = cycles;
+	if (cycles > stats->isr_cycles_max)
+		stats->isr_cycles_max = cycles;
+
+	stats->isr_cycles_sum += cycles;
+	stats->isr_packets++;
+}
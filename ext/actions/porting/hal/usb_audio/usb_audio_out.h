@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2020 Actions Semi Co., Ltd.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file usb audio OUT packet path
+ */
+
+#ifndef __USB_AUDIO_OUT_H__
+#define __USB_AUDIO_OUT_H__
+
+#include <zephyr/types.h>
+#include <stream.h>
+
+struct usb_audio_out_stats {
+	/* packets read and widened inside the stream */
+	u32_t in_place;
+	/* packets widened in the bounce buffer, then written to the stream */
+	u32_t bounced;
+	/* packets the stream had no room for */
+	u32_t dropped;
+	/* cycles of the OUT endpoint irq, per packet */
+	u32_t isr_cycles_last;
+	u32_t isr_cycles_max;
+	u32_t isr_packets;
+	u64_t isr_cycles_sum;
+};
+
+/**
+ * @brief Bytes a packet of len bytes takes in the stream, widened to 32 bit
+ */
+static inline u32_t usb_audio_out_widened(u8_t bit_depth, u32_t len)
+{
+	if (bit_depth == 24)
+		return len / 3 * 4;
+	if (bit_depth == 16)
+		return len / 2 * 4;
+
+	return len;
+}
+
+/**
+ * @brief Read one packet from the OUT endpoint into stream
+ *
+ * The packet is read straight into space claimed in stream and widened to
+ * left aligned 32 bit samples there. When the stream can not give that
+ * space in one piece, it is read and widened in bounce, then written.
+ *
+ * @param stream stream to write, NULL to only drain the endpoint
+ * @param bounce buffer of usb_audio_out_widened(bit_depth, max_packet) bytes
+ *
+ * @return bytes read from the endpoint, <0 on read error
+ */
+int usb_audio_out_packet(io_stream_t stream, u8_t bit_depth, u8_t *bounce,
+		u32_t max_packet, struct usb_audio_out_stats *stats);
+
+/**
+ * @brief Account one OUT endpoint irq of cycles
+ */
+void usb_audio_out_isr_time(struct usb_audio_out_stats *stats, u32_t cycles);
+
+#endif /* __USB_AUDIO_OUT_H__ */
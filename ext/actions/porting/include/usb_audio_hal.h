@@ -28,4 +28,7 @@ int usb_audio_upload_stream_set(io_stream_t stream);
 uint32_t usb_audio_out_packet_count(void);
 uint32_t usb_audio_out_packet_size(void);
 
+/* in place / bounced / dropped packets and OUT irq cycles */
+void usb_audio_dump_out_stats(void);
+
 #endif
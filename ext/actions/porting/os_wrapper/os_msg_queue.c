@@ -0,0 +1,483 @@
+/*
+ * Copyright (c) 2019 Actions Semiconductor Co., Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file per receiver message queue
+ *
+ * Replaces the global mailbox: every receiver thread owns a fifo of pending
+ * messages and a counting semaphore, async messages come from a free list
+ * pool. Posting and taking a message are O(1) and only hold irq_lock around
+ * the list update, a receiver never walks messages of other receivers.
+ */
+
+#include "os_common_api.h"
+#include "msg_manager.h"
+#include "string.h"
+#include <kernel.h>
+#include <atomic.h>
+
+#include <logging/sys_log.h>
+
+/** message pool */
+struct msg_info
+{
+	sys_snode_t node;
+	os_tid_t sender_tid;
+	os_tid_t receiver_tid;
+	/* allocated from the pool, sync messages live on the sender stack */
+	u8_t pooled:1;
+	u8_t busy:1;
+#ifdef CONFIG_MESSAGE_DEBUG
+	char *sender;
+	char *receiver;
+#endif
+	struct app_msg msg;
+};
+
+/** pending messages of one receiver thread */
+struct msg_queue
+{
+	os_tid_t tid;
+	sys_slist_t pending;
+	struct k_sem pending_sem;
+	atomic_t depth;
+};
+
+__in_section_unique(MBOX_MSGS_BSS) static struct msg_info msg_pool_buff[CONFIG_NUM_MBOX_ASYNC_MSGS];
+
+static sys_slist_t msg_free_list;
+static atomic_t msg_free_num;
+
+static struct msg_queue msg_queues[CONFIG_MSG_RECEIVER_QUEUE_NUM];
+/* last resolved receiver, most senders talk to the same thread in a row */
+static struct msg_queue *msg_queue_last;
+
+static void msg_pool_info_dump(void)
+{
+#ifdef CONFIG_MESSAGE_DEBUG
+
+	extern u32_t mem_is_pool_data(u32_t addr);
+
+	struct msg_info *msg_content;
+	struct app_msg *msg;
+
+	for (u8_t i = 0; i < CONFIG_NUM_MBOX_ASYNC_MSGS; i++) {
+		msg_content = &msg_pool_buff[i];
+		if (!msg_content->busy)
+			continue;
+
+		msg = &msg_content->msg;
+		printk("msg: %d\n", i);
+		printk("--sender %s\n", msg_content->sender);
+		printk("--receiver %s\n", msg_content->receiver);
+		printk("--type 0x%x\n", msg->type);
+		printk("--cmd 0x%x\n", msg->cmd);
+		printk("--content 0x%x\n\n", msg->value);
+		if(mem_is_pool_data((u32_t)msg->ptr)){
+			print_buffer(msg->ptr, 1, 16, 16, -1);
+		}
+	}
+
+	for (u8_t i = 0; i < CONFIG_MSG_RECEIVER_QUEUE_NUM; i++) {
+		if (msg_queues[i].tid) {
+			printk("queue %p: %d pending\n", msg_queues[i].tid,
+				(int)atomic_get(&msg_queues[i].depth));
+		}
+	}
+#endif
+}
+
+static struct msg_info *msg_pool_get_free_msg_info(void)
+{
+	struct msg_info *result = NULL;
+	sys_snode_t *node;
+	int key;
+
+	key = irq_lock();
+	node = sys_slist_get(&msg_free_list);
+	if (node) {
+		atomic_dec(&msg_free_num);
+	}
+	irq_unlock(key);
+
+	if (node) {
+		result = CONTAINER_OF(node, struct msg_info, node);
+		memset(&result->msg, 0, sizeof(struct app_msg));
+		result->pooled = 1;
+		result->busy = 1;
+	} else {
+		msg_pool_info_dump();
+		SYS_LOG_WRN("msg is full %d\n", CONFIG_NUM_MBOX_ASYNC_MSGS);
+	}
+
+	return result;
+}
+
+static void msg_pool_put_msg_info(struct msg_info *msg_content)
+{
+	int key;
+
+	if (!msg_content->pooled) {
+		return;
+	}
+
+	msg_content->busy = 0;
+
+	key = irq_lock();
+	sys_slist_prepend(&msg_free_list, &msg_content->node);
+	atomic_inc(&msg_free_num);
+	irq_unlock(key);
+}
+
+int msg_pool_get_free_msg_num(void)
+{
+	return (int)atomic_get(&msg_free_num);
+}
+
+/* must be called with irq locked */
+static struct msg_queue *msg_queue_find_locked(os_tid_t tid, bool create)
+{
+	struct msg_queue *queue = msg_queue_last;
+	struct msg_queue *free_queue = NULL;
+
+	if (queue && queue->tid == tid) {
+		return queue;
+	}
+
+	for (u8_t i = 0; i < CONFIG_MSG_RECEIVER_QUEUE_NUM; i++) {
+		queue = &msg_queues[i];
+		if (queue->tid == tid) {
+			msg_queue_last = queue;
+			return queue;
+		}
+		if (!queue->tid && !free_queue) {
+			free_queue = queue;
+		}
+	}
+
+	if (!create || !free_queue) {
+		return NULL;
+	}
+
+	free_queue->tid = tid;
+	sys_slist_init(&free_queue->pending);
+	k_sem_reset(&free_queue->pending_sem);
+	atomic_set(&free_queue->depth, 0);
+	msg_queue_last = free_queue;
+
+	return free_queue;
+}
+
+/* OS_ANY: deliver to the first registered receiver */
+static struct msg_queue *msg_queue_any_locked(void)
+{
+	for (u8_t i = 0; i < CONFIG_MSG_RECEIVER_QUEUE_NUM; i++) {
+		if (msg_queues[i].tid) {
+			return &msg_queues[i];
+		}
+	}
+
+	return NULL;
+}
+
+static int msg_queue_post(os_tid_t receiver, struct msg_info *msg_content)
+{
+	struct msg_queue *queue;
+	int key;
+
+	msg_content->sender_tid = os_current_get();
+
+	key = irq_lock();
+
+	if (receiver == OS_ANY) {
+		queue = msg_queue_any_locked();
+	} else {
+		queue = msg_queue_find_locked(receiver, true);
+	}
+
+	if (queue) {
+		msg_content->receiver_tid = queue->tid;
+		sys_slist_append(&queue->pending, &msg_content->node);
+		atomic_inc(&queue->depth);
+	}
+
+	irq_unlock(key);
+
+	if (!queue) {
+		SYS_LOG_ERR("no msg queue for %p\n", receiver);
+		return -ENOSPC;
+	}
+
+	k_sem_give(&queue->pending_sem);
+
+	return 0;
+}
+
+/* drop messages already taken off a queue, wake up blocked sync senders */
+static void msg_queue_drop_list(sys_slist_t *list)
+{
+	struct msg_info *msg_content;
+	sys_snode_t *node;
+
+	while ((node = sys_slist_get(list)) != NULL) {
+		msg_content = CONTAINER_OF(node, struct msg_info, node);
+		if (msg_content->pooled) {
+			msg_pool_put_msg_info(msg_content);
+		} else if (msg_content->msg.sync_sem) {
+			os_sem_give(msg_content->msg.sync_sem);
+		}
+	}
+}
+
+static int msg_queue_remove(struct msg_queue *queue, os_msg_match msg_match, sys_slist_t *removed)
+{
+	struct msg_info *msg_content;
+	sys_snode_t *node, *tmp, *prev = NULL;
+	int count = 0;
+	int key;
+
+	key = irq_lock();
+
+	SYS_SLIST_FOR_EACH_NODE_SAFE(&queue->pending, node, tmp) {
+		msg_content = CONTAINER_OF(node, struct msg_info, node);
+		if (!msg_match || msg_match(&msg_content->msg,
+				msg_content->receiver_tid, msg_content->sender_tid)) {
+			sys_slist_remove(&queue->pending, prev, node);
+			sys_slist_append(removed, node);
+			atomic_dec(&queue->depth);
+			count++;
+		} else {
+			prev = node;
+		}
+	}
+
+	irq_unlock(key);
+
+	/* keep the semaphore count in step, a late give is absorbed by receive */
+	for (int i = 0; i < count; i++) {
+		k_sem_take(&queue->pending_sem, K_NO_WAIT);
+	}
+
+	return count;
+}
+
+static void os_sync_msg_callback(struct app_msg* msg, int result, void* not_used)
+{
+	if (msg->sync_sem) {
+#ifdef CONFIG_MESSAGE_DEBUG
+		printk("--(%s->%s)-- %s %d: type_id %d, msg_id %d, e_time %u\n",
+				"",
+				msg_manager_get_current(),
+				__func__, __LINE__,
+				msg->type,
+				msg->cmd,
+				k_uptime_get_32());
+#endif
+
+		os_sem_give(msg->sync_sem);
+	}
+}
+
+int os_send_sync_msg(void *receiver, void *msg, int msg_size)
+{
+	struct msg_info msg_content;
+	struct k_sem sync_sem;
+	int ret;
+
+	__ASSERT(!_is_in_isr(),"send messag in isr");
+
+	memset(&msg_content, 0, sizeof(msg_content));
+	memcpy(&msg_content.msg, msg, msg_size);
+
+	msg_content.msg.callback = os_sync_msg_callback;
+	msg_content.msg.sync_sem = &sync_sem;
+	k_sem_init(&sync_sem, 0, UINT_MAX);
+
+	ret = msg_queue_post((os_tid_t)receiver, &msg_content);
+	if (ret) {
+		return ret;
+	}
+
+	os_sem_take(&sync_sem, OS_FOREVER);
+
+	return 0;
+}
+
+int os_send_async_msg(void *receiver, void *msg, int msg_size)
+{
+	struct msg_info *msg_content;
+	int ret;
+
+	__ASSERT(!_is_in_isr(),"send messag in isr");
+
+	msg_content = msg_pool_get_free_msg_info();
+
+	if(!msg_content) {
+		SYS_LOG_ERR("msg_content is NULL ... ");
+		return -ENOMEM;
+	}
+
+	memcpy(&msg_content->msg, msg, msg_size);
+#ifdef CONFIG_MESSAGE_DEBUG
+	msg_content->receiver = msg_manager_get_name_by_tid((int)receiver);
+	msg_content->sender = msg_manager_get_name_by_tid((int)os_current_get());
+	if(msg_content->sender == NULL)
+	{
+		msg_content->sender = (char *)os_current_get();
+	}
+#endif
+
+	ret = msg_queue_post((os_tid_t)receiver, msg_content);
+	if (ret) {
+		msg_pool_put_msg_info(msg_content);
+	}
+
+	return ret;
+}
+
+int os_receive_msg(void *msg, int msg_size,int timeout)
+{
+	struct msg_info *msg_content;
+	struct msg_queue *queue;
+	sys_snode_t *node;
+	int key;
+
+	key = irq_lock();
+	queue = msg_queue_find_locked(os_current_get(), true);
+	irq_unlock(key);
+
+	if (!queue) {
+		SYS_LOG_ERR("no msg queue for %p\n", os_current_get());
+		return -ENOSPC;
+	}
+
+	do {
+		if (k_sem_take(&queue->pending_sem, timeout)) {
+			return -ETIMEDOUT;
+		}
+
+		key = irq_lock();
+		node = sys_slist_get(&queue->pending);
+		if (node) {
+			atomic_dec(&queue->depth);
+		}
+		irq_unlock(key);
+	} while (!node && timeout == OS_FOREVER);
+
+	if (!node) {
+		return -ETIMEDOUT;
+	}
+
+	msg_content = CONTAINER_OF(node, struct msg_info, node);
+
+	/* copy msg out, sync sender stays blocked until the callback */
+	memcpy(msg, &msg_content->msg, msg_size);
+
+	msg_pool_put_msg_info(msg_content);
+
+	return 0;
+}
+
+void os_msg_clean(void)
+{
+	sys_slist_t removed;
+
+	sys_slist_init(&removed);
+
+	for (u8_t i = 0; i < CONFIG_MSG_RECEIVER_QUEUE_NUM; i++) {
+		if (msg_queues[i].tid) {
+			msg_queue_remove(&msg_queues[i], NULL, &removed);
+		}
+	}
+
+	msg_queue_drop_list(&removed);
+}
+
+int os_get_pending_msg_cnt(void)
+{
+	struct msg_queue *queue;
+	int key;
+
+	key = irq_lock();
+	queue = msg_queue_find_locked(os_current_get(), false);
+	irq_unlock(key);
+
+	return queue ? (int)atomic_get(&queue->depth) : 0;
+}
+
+void os_msg_queue_release(os_tid_t tid)
+{
+	struct msg_queue *queue;
+	sys_slist_t removed;
+	int key;
+
+	sys_slist_init(&removed);
+
+	key = irq_lock();
+
+	queue = msg_queue_find_locked(tid, false);
+	if (queue) {
+		removed = queue->pending;
+		sys_slist_init(&queue->pending);
+		atomic_set(&queue->depth, 0);
+		queue->tid = NULL;
+		if (msg_queue_last == queue) {
+			msg_queue_last = NULL;
+		}
+	}
+
+	irq_unlock(key);
+
+	if (!sys_slist_is_empty(&removed)) {
+		SYS_LOG_WRN("drop pending msg of %p\n", tid);
+	}
+
+	msg_queue_drop_list(&removed);
+}
+
+void os_msg_init(void)
+{
+	sys_slist_init(&msg_free_list);
+
+	for (u8_t i = 0 ; i < CONFIG_NUM_MBOX_ASYNC_MSGS; i++) {
+		msg_pool_buff[i].pooled = 1;
+		msg_pool_buff[i].busy = 0;
+		sys_slist_append(&msg_free_list, &msg_pool_buff[i].node);
+	}
+	atomic_set(&msg_free_num, CONFIG_NUM_MBOX_ASYNC_MSGS);
+
+	for (u8_t i = 0 ; i < CONFIG_MSG_RECEIVER_QUEUE_NUM; i++) {
+		msg_queues[i].tid = NULL;
+		sys_slist_init(&msg_queues[i].pending);
+		k_sem_init(&msg_queues[i].pending_sem, 0, UINT_MAX);
+		atomic_set(&msg_queues[i].depth, 0);
+	}
+	msg_queue_last = NULL;
+}
+
+int os_msg_delete(os_msg_match msg_match)
+{
+	sys_slist_t removed;
+	int count = 0;
+
+	if (!msg_match) {
+		return 0;
+	}
+
+	sys_slist_init(&removed);
+
+	os_sched_lock();
+	for (u8_t i = 0; i < CONFIG_MSG_RECEIVER_QUEUE_NUM; i++) {
+		if (msg_queues[i].tid) {
+			count += msg_queue_remove(&msg_queues[i], msg_match, &removed);
+		}
+	}
+	os_sched_unlock();
+
+	msg_queue_drop_list(&removed);
+
+	return count;
+}
@@ -51,6 +51,8 @@ int os_thread_create(char *stack, size_t stack_size,
 
 /**message function*/
 
+#ifndef CONFIG_MSG_RECEIVER_QUEUE
+
 K_MBOX_DEFINE(global_mailbox);
 
 /** message pool */
@@ -320,6 +322,8 @@ int os_msg_delete(os_msg_match msg_match)
 	return ret;
 }
 
+#endif /* CONFIG_MSG_RECEIVER_QUEUE */
+
 static bool low_latency_mode = true;
 
 int system_check_low_latencey_mode(void)
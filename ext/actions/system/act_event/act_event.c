@@ -96,6 +96,13 @@ void act_event_data_handler(act_event_ctrl_t *ctrl)
 			continue;
         }
 
+#ifdef CONFIG_ACT_EVENT_PACKED_LOG
+        if (cbuf_read(&ctrl->rbuf, (uint8_t *)&event_msg.timestamp, sizeof(event_msg.timestamp)) != sizeof(event_msg.timestamp)) {
+			printk("read timestamp err\n");
+			continue;
+        }
+#endif
+
         act_event_get_arg_info(&event_msg, &arg_num, &arg_bytes);
 
         if (arg_num){
@@ -219,7 +226,11 @@ int act_event_data_send(uint32_t pack_data, ...)
 
 	event_msg.head.check_bits = act_event_count_not_zero_bits(*pdata, 27);
 
-	act_event_put_data((void *)&event_msg, j + sizeof(event_message_head_t));
+#ifdef CONFIG_ACT_EVENT_PACKED_LOG
+	event_msg.timestamp = k_uptime_get_32();
+#endif
+
+	act_event_put_data((void *)&event_msg, j + offsetof(event_message_t, arg_value));
 
 	return 0;
 
@@ -372,6 +383,41 @@ int act_event_syslog_transfer(int log_type, int (*traverse_cb)(uint8_t *data, ui
     return traverse_len;
 }
 
+#ifdef CONFIG_ACT_EVENT_PACKED_LOG
+uint32_t act_event_get_time(void)
+{
+	return act_event_output_get_time(k_uptime_get_32());
+}
+
+int act_event_syslog_query(int log_type, uint32_t from, uint32_t to, const char *module_name,
+		int (*traverse_cb)(uint8_t *data, uint32_t max_len))
+{
+	int traverse_len;
+	int module_id = -1;
+    /* Print buffer */
+    char print_buf[CONFIG_ACT_EVENT_LINEBUF_SIZE];
+	if(traverse_cb == NULL)
+		return 0;
+
+	if(!act_event_ctrl.enable){
+		printk("act_event disabled\n");
+		return 0;
+	}
+
+	if(module_name){
+		module_id = act_event_module_id_get(module_name);
+		if(module_id < 0){
+			return -EINVAL;
+		}
+	}
+
+	g_bt_cb = traverse_cb;
+    traverse_len = act_event_output_query(from, to, module_id, act_event_bt_callback, print_buf, sizeof(print_buf));
+	g_bt_cb = NULL;
+    return traverse_len;
+}
+#endif
+
 int act_event_set_level_filter(const char *module_name, uint32_t dynamic_level)
 {
     int  id;
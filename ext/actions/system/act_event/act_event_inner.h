@@ -44,6 +44,10 @@ typedef struct {
 typedef struct
 {
 	event_message_head_t head;
+#ifdef CONFIG_ACT_EVENT_PACKED_LOG
+	/* uptime in ms when sent */
+	uint32_t timestamp;
+#endif
 	uint8_t arg_value[MAX_EVENT_ARG_NUM * 4];
 }__packed event_message_t;
 
@@ -102,6 +106,13 @@ int act_event_output_traverse(int (*traverse_cb)(uint8_t *data, uint32_t max_len
 
 int act_event_output_clear(void);
 
+#ifdef CONFIG_ACT_EVENT_PACKED_LOG
+int act_event_output_query(uint32_t from, uint32_t to, int module_id,
+        int (*traverse_cb)(uint8_t *data, uint32_t max_len), uint8_t *buf, uint32_t len);
+
+uint32_t act_event_output_get_time(uint32_t uptime);
+#endif
+
 size_t act_event_strnlen(const char *s, size_t maxlen);
 
 unsigned int act_event_count_not_zero_bits(unsigned int val, unsigned int bits);
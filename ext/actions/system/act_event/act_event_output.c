@@ -1,6 +1,9 @@
 #include "act_event_inner.h"
 #include "flash_buffer.h"
 #include <debug/ramdump.h>
+#ifdef CONFIG_ACT_EVENT_PACKED_LOG
+#include "act_event_pack.h"
+#endif
 
 #ifdef CONFIG_ACT_EVENT_OUTPUT_USER
 static act_event_backend_callback_t user_backend_cb;
@@ -15,6 +18,9 @@ struct flash_log_ctx
     struct flash_buffer_ctx *event_flash_buffer;
     cbuf_t rbuf;
     uint8_t cache_buffer[CACHE_BUFFER_SIZE];
+#ifdef CONFIG_ACT_EVENT_PACKED_LOG
+    struct act_event_pack pack;
+#endif
 };
 
 static struct flash_log_ctx flash_log;
@@ -54,6 +60,10 @@ int act_event_output_init(act_event_callback_t event_cb)
         return -EIO;
     }
 
+#ifdef CONFIG_ACT_EVENT_PACKED_LOG
+    act_event_pack_init(&ctx->pack, ctx->event_flash_buffer, &ctx->rbuf);
+#endif
+
     return 0;
 }
 
@@ -166,6 +176,95 @@ uint32_t act_event_process_linebuf(event_message_t *log_msg, char *log_buffer, u
     return curr_index;
 }
 
+#ifdef CONFIG_ACT_EVENT_PACKED_LOG
+static uint32_t act_event_process_record_linebuf(const act_event_record_t *record, char *log_buffer, uint32_t buffer_size)
+{
+    uint32_t curr_index;
+	int i;
+
+	curr_index = snprintk(log_buffer, buffer_size,
+							"[%u.%03u][%s][%c] evt: 0x%x%s",
+							record->time / 1000, record->time % 1000,
+							act_event_source_name_get(record->module_id),
+							(record->level < ACT_EVENT_LEVEL_MAX) ? act_event_level_info[record->level] : '?',
+							record->event_id, record->arg_num ? " arg:" : "");
+
+	for(i = 0; i < record->arg_num && curr_index < buffer_size; i++){
+		curr_index += snprintk(log_buffer + curr_index, buffer_size - curr_index,
+								i ? " 0x%x" : "0x%x", record->args[i]);
+	}
+
+	if(curr_index < buffer_size){
+		curr_index += snprintk(log_buffer + curr_index, buffer_size - curr_index, "\n");
+	}
+
+    return MIN(curr_index, buffer_size - 1);
+}
+
+struct act_event_query_ctx
+{
+    int (*traverse_cb)(uint8_t *data, uint32_t max_len);
+    uint8_t *buf;
+    uint32_t len;
+    uint32_t total_len;
+};
+
+static int act_event_query_record(const act_event_record_t *record, void *user_data)
+{
+    struct act_event_query_ctx *query = user_data;
+    int line_size;
+
+    if(record->module_id >= act_event_ctrl.event_module_cnt) {
+        return 0;
+    }
+
+    line_size = act_event_process_record_linebuf(record, (char *)query->buf, query->len);
+
+    if(query->traverse_cb) {
+        query->traverse_cb(query->buf, line_size);
+    }
+
+    query->total_len += line_size;
+
+    return 0;
+}
+
+int act_event_output_query(uint32_t from, uint32_t to, int module_id,
+        int (*traverse_cb)(uint8_t *data, uint32_t max_len), uint8_t *buf, uint32_t len)
+{
+    struct flash_log_ctx *ctx = &flash_log;
+    struct flash_buffer_ctx *buffer_ctx = flash_buffer_get(ctx, ACT_EVENT_FILE_ID);
+    struct act_event_query_ctx query;
+    int ret;
+
+    if (!buf || !len || !buffer_ctx) {
+        printk("query %p %x %p\n", buf, len, buffer_ctx);
+        return 0;
+    }
+
+	if(!act_event_ctrl.enable){
+		printk("act_event disabled\n");
+		return 0;
+	}
+
+    query.traverse_cb = traverse_cb;
+    query.buf = buf;
+    query.len = len;
+    query.total_len = 0;
+
+    ret = act_event_pack_query(&ctx->pack, from, to, module_id, act_event_query_record, &query);
+    if (ret < 0) {
+        return ret;
+    }
+
+    return query.total_len;
+}
+
+uint32_t act_event_output_get_time(uint32_t uptime)
+{
+    return act_event_pack_time(&flash_log.pack, uptime);
+}
+#endif
 
 int act_event_output_data_traverse(struct flash_buffer_ctx *buffer_ctx, int (*traverse_cb)(uint8_t *data, uint32_t max_len), uint8_t *buf, uint32_t len)
 {
@@ -273,7 +372,11 @@ int act_event_output_traverse(int (*traverse_cb)(uint8_t *data, uint32_t max_len
 		return 0;
 	}
 
+#ifdef CONFIG_ACT_EVENT_PACKED_LOG
+    traverse_len = act_event_output_query(0, UINT32_MAX, -1, traverse_cb, buf, len);
+#else
     traverse_len = act_event_output_data_traverse(buffer_ctx, traverse_cb, buf, len);
+#endif
 
     return traverse_len;
 }
@@ -316,7 +419,11 @@ int act_event_output_clear(void)
 	}
 
     if (buffer_ctx) {
+#ifdef CONFIG_ACT_EVENT_PACKED_LOG
+        act_event_pack_clear(&ctx->pack);
+#else
         flash_buffer_clear(buffer_ctx);
+#endif
 
         return 0;
     } else {
@@ -338,6 +445,24 @@ size_t act_event_strnlen(const char *s, size_t maxlen)
 
 
 
+#ifdef CONFIG_ACT_EVENT_PACKED_LOG
+static uint32_t act_event_output_pack_write(struct flash_log_ctx *ctx, event_message_t *log_msg)
+{
+	act_event_record_t record;
+	uint32_t arg_num;
+
+	record.time = act_event_pack_time(&ctx->pack, log_msg->timestamp);
+	record.module_id = log_msg->head.module_id;
+	record.event_id = log_msg->head.event_id;
+	record.level = log_msg->head.level + 1;
+
+	act_event_get_arg_value(log_msg, &arg_num, record.args);
+	record.arg_num = arg_num;
+
+	return act_event_pack_write(&ctx->pack, &record);
+}
+#endif
+
 static uint32_t act_event_output_data_write(event_message_t *log_msg, uint8_t *data, uint32_t len)
 {
     struct flash_log_ctx *ctx = &flash_log;
@@ -352,6 +477,10 @@ static uint32_t act_event_output_data_write(event_message_t *log_msg, uint8_t *d
 		return 0;
 	}
 
+#ifdef CONFIG_ACT_EVENT_PACKED_LOG
+	return act_event_output_pack_write(ctx, log_msg);
+#endif
+
     if (len > free_space) {
 	    flash_buffer_sync(buffer_ctx, NULL);
     }
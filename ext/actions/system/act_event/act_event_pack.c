@@ -0,0 +1,523 @@
+/*
+ * Copyright (c) 2020 Actions Semiconductor Co., Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief packed, time indexed act_event flash log
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <misc/util.h>
+#include "act_event_pack.h"
+
+#define SECTOR_SIZE     (ACT_EVENT_PACK_SECTOR_SIZE)
+#define INDEX_SIZE      (sizeof(act_event_pack_index_t))
+#define READ_WIN_SIZE   (32)
+
+struct pack_reader
+{
+    struct flash_buffer_ctx *flash;
+    /* log bytes on flash and in all */
+    uint32_t flash_end;
+    uint32_t end;
+    /* log bytes after flash_end, still in the buffer */
+    uint8_t tail[4];
+    uint32_t win_pos;
+    uint32_t win_len;
+    uint32_t win[READ_WIN_SIZE / 4];
+};
+
+static uint32_t pack_write_buf[FLASH_WRITE_PAGE_SIZE / 4];
+
+static const uint8_t pack_zeros[ACT_EVENT_PACK_MAX_RECORD];
+
+static inline uint32_t pack_module_bit(uint8_t module_id)
+{
+    return 1u << (module_id & 31);
+}
+
+static uint32_t pack_log_end(struct act_event_pack *pack)
+{
+    return ef_log_get_used_size(pack->flash) + cbuf_get_used_space(pack->rbuf);
+}
+
+int act_event_pack_drain(struct flash_buffer_ctx *flash, cbuf_t *rbuf)
+{
+    uint32_t len, total_len = 0;
+
+    while (1) {
+        len = cbuf_get_used_space(rbuf) & ~3;
+        if (len > sizeof(pack_write_buf)) {
+            len = sizeof(pack_write_buf);
+        }
+
+        if (!len || cbuf_read(rbuf, pack_write_buf, len) != len) {
+            break;
+        }
+
+        if (flash->flush_enable) {
+            ef_log_write(flash, pack_write_buf, len);
+        }
+
+        total_len += len;
+    }
+
+    return total_len;
+}
+
+static void pack_put(struct act_event_pack *pack, const void *data, uint32_t len)
+{
+    if (cbuf_get_free_space(pack->rbuf) < len) {
+        act_event_pack_drain(pack->flash, pack->rbuf);
+    }
+
+    cbuf_write(pack->rbuf, (void *)data, len);
+}
+
+/* the sector being written is full: put it on flash and record its modules */
+static void pack_close_sector(struct act_event_pack *pack)
+{
+    uint32_t mask_inv = ~pack->module_mask;
+    uint32_t pending = cbuf_get_used_space(pack->rbuf);
+    uint32_t used;
+
+    /* the sector end is word aligned, nothing stays behind */
+    if (act_event_pack_drain(pack->flash, pack->rbuf) == pending && pack->flash->flush_enable) {
+        /* the oldest sector may have been erased to make room */
+        used = ef_log_get_used_size(pack->flash);
+        if (used && used % SECTOR_SIZE == 0) {
+            ef_log_program(pack->flash, used - SECTOR_SIZE, &mask_inv, sizeof(mask_inv));
+        }
+    }
+
+    pack->module_mask = 0;
+}
+
+static void pack_open_sector(struct act_event_pack *pack, uint32_t base_time, uint32_t first_off)
+{
+    act_event_pack_index_t index;
+
+    index.module_mask_inv = 0xffffffff;
+    index.base_time = base_time;
+    index.first_off = first_off;
+    index.version = ACT_EVENT_PACK_VERSION;
+    index.reserved = 0;
+
+    pack_put(pack, &index, sizeof(index));
+}
+
+/*
+ * Append the bytes of a record, starting it if head is set, time is the
+ * time of the record. An index is put at each sector start on the way.
+ */
+static void pack_append(struct act_event_pack *pack, const uint8_t *data, uint32_t len,
+        bool head, uint32_t time, uint32_t module_bit)
+{
+    uint32_t end, off, copy_len;
+
+    while (len) {
+        end = pack_log_end(pack);
+        off = end % SECTOR_SIZE;
+
+        if (off == 0) {
+            if (end) {
+                pack_close_sector(pack);
+            }
+
+            if (head) {
+                pack_open_sector(pack, pack->last_time, 0);
+            } else {
+                pack_open_sector(pack, time, len);
+            }
+
+            off = INDEX_SIZE;
+        }
+
+        if (head) {
+            pack->module_mask |= module_bit;
+            head = false;
+        }
+
+        copy_len = MIN(len, SECTOR_SIZE - off);
+        pack_put(pack, data, copy_len);
+
+        data += copy_len;
+        len -= copy_len;
+    }
+}
+
+static uint32_t pack_encode(const act_event_record_t *record, uint32_t delta, uint8_t *buf)
+{
+    uint32_t val = (delta << 3) | (record->level & 0x7);
+    uint32_t arg, len = 0, bitmap_idx;
+    uint8_t bitmap = 0;
+    int i;
+
+    do {
+        buf[len] = val & 0x7f;
+        val >>= 7;
+        if (val) {
+            buf[len] |= 0x80;
+        }
+        len++;
+    } while (val);
+
+    buf[len++] = record->module_id;
+    buf[len++] = record->event_id;
+    bitmap_idx = len++;
+
+    /* as act_event_data_send() packs them */
+    for (i = 0; i < record->arg_num && i < MAX_EVENT_ARG_NUM; i++) {
+        arg = record->args[i];
+        if (arg <= 0xff) {
+            buf[len++] = (uint8_t)arg;
+            bitmap |= (1 << (i << 1));
+        } else if (arg <= 0xffff) {
+            buf[len++] = (uint8_t)arg;
+            buf[len++] = (uint8_t)(arg >> 8);
+            bitmap |= (2 << (i << 1));
+        } else {
+            buf[len++] = (uint8_t)arg;
+            buf[len++] = (uint8_t)(arg >> 8);
+            buf[len++] = (uint8_t)(arg >> 16);
+            buf[len++] = (uint8_t)(arg >> 24);
+            bitmap |= (3 << (i << 1));
+        }
+    }
+
+    buf[bitmap_idx] = bitmap;
+
+    return len;
+}
+
+int act_event_pack_write(struct act_event_pack *pack, const act_event_record_t *record)
+{
+    uint8_t buf[ACT_EVENT_PACK_MAX_RECORD];
+    uint32_t delta = 0, len;
+
+    if ((int32_t)(record->time - pack->last_time) > 0) {
+        delta = MIN(record->time - pack->last_time, ACT_EVENT_PACK_MAX_DELTA);
+    }
+
+    len = pack_encode(record, delta, buf);
+
+    pack_append(pack, buf, len, true, pack->last_time + delta, pack_module_bit(record->module_id));
+
+    pack->last_time += delta;
+
+    return len;
+}
+
+static void pack_reader_init(struct pack_reader *r, struct flash_buffer_ctx *flash, uint32_t flash_end)
+{
+    r->flash = flash;
+    r->flash_end = flash_end;
+    r->end = flash_end;
+    r->win_pos = 0;
+    r->win_len = 0;
+}
+
+/* byte at log index pos, -1 past the end */
+static int pack_read_raw(struct pack_reader *r, uint32_t pos)
+{
+    size_t size;
+
+    if (pos >= r->end) {
+        return -1;
+    }
+
+    if (pos >= r->flash_end) {
+        return r->tail[pos - r->flash_end];
+    }
+
+    if (pos < r->win_pos || pos >= r->win_pos + r->win_len) {
+        r->win_pos = pos & ~3;
+        r->win_len = 0;
+
+        size = MIN(READ_WIN_SIZE, r->flash_end - r->win_pos);
+        if (ef_log_read(r->flash, r->win_pos, r->win, &size) != EF_NO_ERR) {
+            return -1;
+        }
+
+        r->win_len = size;
+    }
+
+    return ((uint8_t *)r->win)[pos - r->win_pos];
+}
+
+/* next record byte, the sector indexes are stepped over */
+static int pack_read_byte(struct pack_reader *r, uint32_t *pos)
+{
+    int val = pack_read_raw(r, *pos);
+
+    if (val >= 0) {
+        (*pos)++;
+        if (*pos % SECTOR_SIZE == 0) {
+            *pos += INDEX_SIZE;
+        }
+    }
+
+    return val;
+}
+
+static int pack_read_index(struct pack_reader *r, uint32_t sector, act_event_pack_index_t *index)
+{
+    uint8_t *buf = (uint8_t *)index;
+    int i, val;
+
+    for (i = 0; i < INDEX_SIZE; i++) {
+        val = pack_read_raw(r, sector * SECTOR_SIZE + i);
+        if (val < 0) {
+            return -ENODATA;
+        }
+        buf[i] = val;
+    }
+
+    if (index->version != ACT_EVENT_PACK_VERSION || index->reserved ||
+        index->first_off >= SECTOR_SIZE - INDEX_SIZE) {
+        return -EIO;
+    }
+
+    return 0;
+}
+
+/*
+ * Decode the record at *pos. At the end of the log returns -ENODATA with
+ * the bytes missing to a record cut short in *missing, what was read of
+ * it is kept.
+ */
+static int pack_decode(struct pack_reader *r, uint32_t *pos, act_event_record_t *record,
+        uint32_t *delta, uint32_t *missing)
+{
+    uint32_t val = 0, arg_bytes = 0, size;
+    int i, j, shift = 0, byte;
+    uint8_t bitmap;
+
+    memset(record, 0, sizeof(*record));
+    *delta = 0;
+    *missing = 0;
+
+    do {
+        byte = pack_read_byte(r, pos);
+        if (byte < 0) {
+            /* a zero ends the varint, then the ids and an empty bitmap */
+            *missing = shift ? 4 : 0;
+            return -ENODATA;
+        }
+
+        if (shift > 28) {
+            return -EIO;
+        }
+
+        val |= (byte & 0x7f) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+
+    *delta = val >> 3;
+    record->level = val & 0x7;
+
+    if ((byte = pack_read_byte(r, pos)) < 0) {
+        *missing = 3;
+        return -ENODATA;
+    }
+    record->module_id = byte;
+
+    if ((byte = pack_read_byte(r, pos)) < 0) {
+        *missing = 2;
+        return -ENODATA;
+    }
+    record->event_id = byte;
+
+    if ((byte = pack_read_byte(r, pos)) < 0) {
+        *missing = 1;
+        return -ENODATA;
+    }
+    bitmap = byte;
+
+    for (i = 0; i < MAX_EVENT_ARG_NUM; i++) {
+        size = (bitmap >> (i << 1)) & 0x3;
+        if (!size) {
+            break;
+        }
+        arg_bytes += (size == 3) ? 4 : size;
+    }
+
+    for (i = 0; i < MAX_EVENT_ARG_NUM; i++) {
+        size = (bitmap >> (i << 1)) & 0x3;
+        if (!size) {
+            break;
+        }
+
+        if (size == 3) {
+            size = 4;
+        }
+
+        for (j = 0; j < size; j++) {
+            if ((byte = pack_read_byte(r, pos)) < 0) {
+                *missing = arg_bytes;
+                return -ENODATA;
+            }
+            record->args[i] |= (uint32_t)byte << (j << 3);
+            arg_bytes--;
+        }
+
+        record->arg_num++;
+    }
+
+    return 0;
+}
+
+int act_event_pack_init(struct act_event_pack *pack, struct flash_buffer_ctx *flash, cbuf_t *rbuf)
+{
+    struct pack_reader r;
+    act_event_pack_index_t index;
+    act_event_record_t record;
+    uint32_t pos, sector, used, delta, missing;
+    int ret;
+
+    memset(pack, 0, sizeof(*pack));
+    pack->flash = flash;
+    pack->rbuf = rbuf;
+
+    used = ef_log_get_used_size(flash);
+    if (!used) {
+        return 0;
+    }
+
+    pack_reader_init(&r, flash, used);
+
+    /* resume from the last sector */
+    sector = (used - 1) / SECTOR_SIZE;
+    if (pack_read_index(&r, 0, &index) || pack_read_index(&r, sector, &index)) {
+        goto clean;
+    }
+
+    pack->last_time = index.base_time;
+    pos = sector * SECTOR_SIZE + INDEX_SIZE + index.first_off;
+
+    while ((ret = pack_decode(&r, &pos, &record, &delta, &missing)) == 0) {
+        pack->last_time += delta;
+        pack->module_mask |= pack_module_bit(record.module_id);
+    }
+
+    if (ret != -ENODATA) {
+        goto clean;
+    }
+
+    if (missing) {
+        /* the record cut by a power loss, complete it with what was read */
+        pack->last_time += delta;
+        pack->module_mask |= pack_module_bit(record.module_id);
+        pack_append(pack, pack_zeros, missing, false, pack->last_time, 0);
+    }
+
+    pack->time_base = pack->last_time;
+
+    return 0;
+
+clean:
+    /* not a packed log */
+    ef_log_clean(flash);
+    return 0;
+}
+
+void act_event_pack_clear(struct act_event_pack *pack)
+{
+    ef_log_clean(pack->flash);
+    cbuf_reset(pack->rbuf);
+    pack->module_mask = 0;
+}
+
+int act_event_pack_query(struct act_event_pack *pack, uint32_t from, uint32_t to, int module_id,
+        act_event_pack_query_cb_t cb, void *user_data)
+{
+    struct pack_reader r;
+    act_event_pack_index_t index, next;
+    act_event_record_t record;
+    uint32_t sector, sectors, pos, limit, time, last, delta, missing, tail;
+    int ret, found = 0;
+
+    act_event_pack_drain(pack->flash, pack->rbuf);
+
+    pack_reader_init(&r, pack->flash, ef_log_get_used_size(pack->flash));
+
+    tail = cbuf_get_used_space(pack->rbuf);
+    if (tail <= sizeof(r.tail) && cbuf_prepare_read(pack->rbuf, r.tail, tail) == tail) {
+        r.end += tail;
+    }
+
+    if (!r.end) {
+        return 0;
+    }
+
+    sectors = (r.end + SECTOR_SIZE - 1) / SECTOR_SIZE;
+
+    if (pack_read_index(&r, 0, &index)) {
+        return -EIO;
+    }
+
+    for (sector = 0; sector < sectors; sector++) {
+        /* records of a sector are timed from its base to the next base */
+        if (index.base_time > to) {
+            break;
+        }
+
+        last = pack->last_time;
+        if (sector + 1 < sectors) {
+            ret = pack_read_index(&r, sector + 1, &next);
+            if (ret == -EIO) {
+                return ret;
+            } else if (!ret) {
+                last = next.base_time;
+            } else {
+                sectors = sector + 1;
+            }
+        }
+
+        if (last < from || (module_id >= 0 && index.module_mask_inv != 0xffffffff &&
+                (index.module_mask_inv & pack_module_bit(module_id)))) {
+            pack->sectors_skipped++;
+            index = next;
+            continue;
+        }
+
+        pack->sectors_read++;
+
+        time = index.base_time;
+        pos = sector * SECTOR_SIZE + INDEX_SIZE + index.first_off;
+        limit = (sector + 1) * SECTOR_SIZE;
+
+        while (pos < limit) {
+            ret = pack_decode(&r, &pos, &record, &delta, &missing);
+            if (ret == -EIO) {
+                return ret;
+            } else if (ret) {
+                break;
+            }
+
+            time += delta;
+            if (time > to) {
+                return found;
+            }
+
+            if (time < from || (module_id >= 0 && record.module_id != module_id)) {
+                continue;
+            }
+
+            record.time = time;
+            found++;
+
+            if (cb && cb(&record, user_data)) {
+                return found;
+            }
+        }
+
+        index = next;
+    }
+
+    return found;
+}
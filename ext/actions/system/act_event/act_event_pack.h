@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2020 Actions Semiconductor Co., Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief packed, time indexed act_event flash log
+ *
+ * Every record is a varint of the ms since the previous record and the
+ * level, the module and event ids, the arg_bitmap and the args in as many
+ * bytes as the bitmap says. Records follow each other without padding,
+ * across sector ends. Each sector starts with an index giving the time
+ * before its first record, where that record starts and, once the sector
+ * is full, the modules it holds, so a query only decodes the sectors of
+ * its window and module.
+ */
+
+#ifndef __ACT_EVENT_PACK_H
+#define __ACT_EVENT_PACK_H
+
+#include "flash_buffer.h"
+#include "easyflash/easyflash.h"
+
+#define ACT_EVENT_PACK_VERSION        (0x5A)
+
+/* log bytes of a sector, index included */
+#define ACT_EVENT_PACK_SECTOR_SIZE    (EF_LOG_SECTOR_DATA_SIZE)
+
+/* largest record: 5 bytes varint, ids, bitmap and 4 byte args */
+#define ACT_EVENT_PACK_MAX_RECORD     (5 + 3 + MAX_EVENT_ARG_NUM * 4)
+
+/* record time delta is clipped to 29 bits, the next sector index resyncs it */
+#define ACT_EVENT_PACK_MAX_DELTA      (0x1fffffff)
+
+typedef struct
+{
+    /* ~mask of (1 << (module_id % 32)) of the records starting in the sector,
+     * left erased until the sector is full */
+    uint32_t module_mask_inv;
+    /* time of the last record starting before the first one of the sector */
+    uint32_t base_time;
+    /* bytes from the end of the index to the first record of the sector */
+    uint16_t first_off;
+    uint8_t version;
+    uint8_t reserved;
+} __packed act_event_pack_index_t;
+
+typedef struct
+{
+    /* log time, ms of power on time counted over reboots */
+    uint32_t time;
+    uint8_t module_id;
+    uint8_t event_id;
+    uint8_t level;
+    uint8_t arg_num;
+    uint32_t args[MAX_EVENT_ARG_NUM];
+} act_event_record_t;
+
+struct act_event_pack
+{
+    struct flash_buffer_ctx *flash;
+    /* packed bytes not on flash yet */
+    cbuf_t *rbuf;
+
+    /* log time at boot and of the last record */
+    uint32_t time_base;
+    uint32_t last_time;
+    /* modules starting a record in the sector being written */
+    uint32_t module_mask;
+
+    /* sectors decoded and skipped by queries */
+    uint32_t sectors_read;
+    uint32_t sectors_skipped;
+};
+
+/* return non zero to stop the query */
+typedef int (*act_event_pack_query_cb_t)(const act_event_record_t *record, void *user_data);
+
+/**
+ * @brief resume the packed log found on flash
+ *
+ * A log of another format is cleared. A record cut by a power loss is
+ * completed with zero bytes so records appended after it decode.
+ *
+ * @return 0
+ */
+int act_event_pack_init(struct act_event_pack *pack, struct flash_buffer_ctx *flash, cbuf_t *rbuf);
+
+/**
+ * @brief log time of an uptime of this boot
+ */
+static inline uint32_t act_event_pack_time(struct act_event_pack *pack, uint32_t uptime)
+{
+    return pack->time_base + uptime;
+}
+
+/**
+ * @brief append a record, record->time not before the last one
+ */
+int act_event_pack_write(struct act_event_pack *pack, const act_event_record_t *record);
+
+/**
+ * @brief move whole words of packed bytes to flash
+ *
+ * Up to 3 bytes stay in the buffer until more records complete the word.
+ *
+ * @return bytes moved
+ */
+int act_event_pack_drain(struct flash_buffer_ctx *flash, cbuf_t *rbuf);
+
+/**
+ * @brief erase the log, the log time goes on
+ */
+void act_event_pack_clear(struct act_event_pack *pack);
+
+/**
+ * @brief find the records of a time window
+ *
+ * @param from first log time of the window
+ * @param to last log time of the window
+ * @param module_id module of the records, -1 for any
+ * @param cb called for each record in time order
+ *
+ * @return number of records found, or -EIO if the log is corrupted
+ */
+int act_event_pack_query(struct act_event_pack *pack, uint32_t from, uint32_t to, int module_id,
+        act_event_pack_query_cb_t cb, void *user_data);
+
+#endif
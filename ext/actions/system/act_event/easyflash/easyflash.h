@@ -81,9 +81,14 @@ uint32_t ef_get_bak_app_start_addr(void);
 
 #ifdef EF_USING_LOG
 
+/* sector header size and log bytes each sector holds */
+#define EF_LOG_SECTOR_HEADER_SIZE      12
+#define EF_LOG_SECTOR_DATA_SIZE        (EF_ERASE_MIN_SIZE - EF_LOG_SECTOR_HEADER_SIZE)
+
 /* ef_log.c */
 EfErrCode ef_log_read(struct flash_buffer_ctx *ctx, size_t index, uint32_t *log, size_t *read_size);
 EfErrCode ef_log_write(struct flash_buffer_ctx *ctx, const uint32_t *log, size_t size);
+EfErrCode ef_log_program(struct flash_buffer_ctx *ctx, size_t index, const uint32_t *log, size_t size);
 EfErrCode ef_log_clean(struct flash_buffer_ctx *ctx);
 size_t ef_log_get_used_size(struct flash_buffer_ctx *ctx);
 #endif
@@ -38,7 +38,7 @@
 #define LOG_SECTOR_MAGIC_EMPTY         0xFFFFFFFF
 #define LOG_SECTOR_MAGIC               0xEF30EF30
 /* sector header size, includes the sector magic code and status magic code */
-#define LOG_SECTOR_HEADER_SIZE         12
+#define LOG_SECTOR_HEADER_SIZE         EF_LOG_SECTOR_HEADER_SIZE
 /* sector header word size,what is equivalent to the total number of sectors header index */
 #define LOG_SECTOR_HEADER_WORD_SIZE    3
 
@@ -736,6 +736,31 @@ exit:
     return result;
 }
 
+/**
+ * Program words of already written log which were left erased (all 0xFF).
+ * The log end is not moved.
+ *
+ * @param index index of the first word, must be in one sector
+ * @param log the words to program
+ * @param size bytes size
+ *
+ * @return result
+ */
+EfErrCode ef_log_program(struct flash_buffer_ctx *ctx, size_t index, const uint32_t *log, size_t size) {
+    EF_ASSERT(index % 4 == 0);
+    EF_ASSERT(size % 4 == 0);
+
+    if (!init_ok) {
+        return EF_ENV_INIT_FAILED;
+    }
+
+    if (index + size > ef_log_get_used_size(ctx)) {
+        return EF_WRITE_ERR;
+    }
+
+    return ef_port_write(ctx->storage_dev, log_index2addr(ctx, index), log, size);
+}
+
 /**
  * Get next flash sector address.The log total sector like ring buffer which implement by flash.
  *
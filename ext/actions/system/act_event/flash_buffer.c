@@ -6,6 +6,9 @@
 #include <flash.h>
 #include <linker/linker-defs.h>
 #include "easyflash/easyflash.h"
+#ifdef CONFIG_ACT_EVENT_PACKED_LOG
+#include "act_event_pack.h"
+#endif
 
 #define FLASH_WRITE_MIN_SIZE  (4)
 
@@ -120,6 +123,11 @@ int flash_buffer_sync(struct flash_buffer_ctx *ctx, struct flash_buffer_ctx *run
 	if(cur_ctx == NULL)
 		return 0;
 
+#ifdef CONFIG_ACT_EVENT_PACKED_LOG
+	/* packed records are not padded, a partial word waits for the next ones */
+	return act_event_pack_drain(cur_ctx, cur_ctx->rbuf);
+#endif
+
     total_len = 0;
     while (1) {
 		write_size = cbuf_get_used_space(cur_ctx->rbuf);
@@ -112,6 +112,16 @@ bool input_manager_islock(void);
  * @return false set failed.
  */
 bool input_manager_filter_key_itself(void);
+
+#ifdef CONFIG_INPUT_KEY_GESTURE
+/**
+ * @brief get the time of the last key event
+ *
+ * @return uptime in ms the last reported key gesture happened at,
+ *  earlier than its report by the work queue latency.
+ */
+u32_t input_manager_get_key_stamp(void);
+#endif
 /**
  * @} end defgroup input_manager_apis
  */
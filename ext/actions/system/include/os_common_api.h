@@ -1044,6 +1044,11 @@ void os_msg_init(void);
 typedef int (*os_msg_match)(void *msg,k_tid_t target_thread,k_tid_t source_thread);
 int os_msg_delete(os_msg_match msg_match);
 
+#ifdef CONFIG_MSG_RECEIVER_QUEUE
+/** drop the message queue of a receiver thread which stops receiving */
+void os_msg_queue_release(os_tid_t tid);
+#endif
+
 bool os_is_in_isr(void);
 
 os_work_q *os_get_user_work_queue(void);
@@ -50,7 +50,7 @@ void sys_monitor_deinit(void);
 /**
  * @cond INTERNAL_HIDDEN
  */
-#define MAX_MONITOR_WORK_NUM 5
+#define MAX_MONITOR_WORK_NUM 6
 
 /**
  * @brief system monitor work handle
@@ -202,6 +202,22 @@ int tts_manager_process_ui_event(int ui_event);
 int tts_manager_process_ui_event_at_time(int ui_event, uint64_t bt_clk);
 #endif
 
+#ifdef CONFIG_TTS_PCM_CACHE
+/**
+ * @brief hint that the tts of an ui event is about to be played
+ *
+ * This routine keeps the decoded tts of the ui event from being the next
+ * evicted from the tts cache, call it when the event is likely,
+ * e.g. volume up close to the max.
+ *
+ * @param ui_event ui event id
+ *
+ * @return 0 if the tts is cached.
+ * @return -ENOENT if not, it is cached when played.
+ */
+int tts_manager_prefetch_ui_event(int ui_event);
+#endif
+
 /**
  * @brief tts manager register tts config
  *
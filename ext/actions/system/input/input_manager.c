@@ -21,6 +21,9 @@
 #include <sys_event.h>
 #include <property_manager.h>
 #include <ats.h>
+#ifdef CONFIG_INPUT_KEY_GESTURE
+#include "key_gesture.h"
+#endif
 
 #define MAX_KEY_SUPPORT			10
 #define MAX_HOLD_KEY_SUPPORT        5
@@ -32,6 +35,10 @@
 #define SUPER_LONG_PRESS_10S_TIMER         166   /* time */
 #define QUICKLY_CLICK_DURATION 500 /* ms */
 #define KEY_EVENT_CANCEL_DURATION 50 /* ms */
+#define HOLD_KEY_DELAY 800 /* ms */
+#define HOLD_KEY_PERIOD 200 /* ms */
+/* adckey reports a key down again every 3 polls of 20 ms */
+#define KEY_SCAN_PERIOD 60 /* ms */
 
 struct input_manager_info {
 	struct k_delayed_work work_item;
@@ -46,6 +53,11 @@ struct input_manager_info {
 	bool input_manager_lock;
 	bool key_hold;
 	bool filter_itself;   /* filter all key event after current key event*/
+#ifdef CONFIG_INPUT_KEY_GESTURE
+	struct k_delayed_work gesture_work;
+	key_gesture_t gesture;
+	u32_t gesture_stamp;
+#endif
 };
 
 
@@ -65,47 +77,55 @@ static u32_t diable_key[10];
 #endif
 struct input_manager_info *input_manager;
 
-void report_key_event(struct k_work *work)
+static void report_key_value(u32_t key_value)
 {
-	struct input_manager_info *input = CONTAINER_OF(work, struct input_manager_info, work_item);
-
 	if (input_manager->filter_itself) {
-		if ((input->report_key_value & KEY_TYPE_SHORT_UP)
-			|| (input->report_key_value & KEY_TYPE_DOUBLE_CLICK)
-			|| (input->report_key_value & KEY_TYPE_TRIPLE_CLICK)
-			|| (input->report_key_value & KEY_TYPE_LONG_UP)) {
+		if ((key_value & KEY_TYPE_SHORT_UP)
+			|| (key_value & KEY_TYPE_DOUBLE_CLICK)
+			|| (key_value & KEY_TYPE_TRIPLE_CLICK)
+			|| (key_value & KEY_TYPE_LONG_UP)) {
 			input_manager->filter_itself = false;
 		}
 
 		return;
 	}
 
-#ifdef CONFIG_INPUT_DEV_ACTS_ADC_SR
-	if (input->press_type == EV_SR) {
-		sys_event_report_srinput(&input->report_key_value);
-		return ;
-	}
-#endif
-
-	input->click_num = 0;
 #ifdef CONFIG_BUILD_PROJECT_HM_DEMAND_CODE
 	extern void tts_manager_disable_keycode_check(void);
 	tts_manager_disable_keycode_check();
 	for(int i = 0; i < 10;i++){
-		if((diable_key[i]) && (diable_key[i] == (input->report_key_value&~(KEY_TYPE_SHORT_UP | KEY_TYPE_SHORT_LONG_UP)))){
-			SYS_LOG_ERR("key is diable %x %x\n",diable_key[i],(input->report_key_value&~(KEY_TYPE_SHORT_UP | KEY_TYPE_SHORT_LONG_UP)));
+		if((diable_key[i]) && (diable_key[i] == (key_value&~(KEY_TYPE_SHORT_UP | KEY_TYPE_SHORT_LONG_UP)))){
+			SYS_LOG_ERR("key is diable %x %x\n",diable_key[i],(key_value&~(KEY_TYPE_SHORT_UP | KEY_TYPE_SHORT_LONG_UP)));
 			return ;
 		}
 	}
 #endif	
 	if(ats_get_enter_key_check_record() == false){
 		SYS_LOG_INF("----> sys_event_report_input\n");
-		sys_event_report_input(input->report_key_value);
+		sys_event_report_input(key_value);
 	}
 	else{
 		SYS_LOG_INF("----> sys_event_report_input_ats\n");
-		sys_event_report_input_ats(input->report_key_value);
+		sys_event_report_input_ats(key_value);
+	}
+}
+
+void report_key_event(struct k_work *work)
+{
+	struct input_manager_info *input = CONTAINER_OF(work, struct input_manager_info, work_item);
+
+	if (!input_manager->filter_itself) {
+	#ifdef CONFIG_INPUT_DEV_ACTS_ADC_SR
+		if (input->press_type == EV_SR) {
+			sys_event_report_srinput(&input->report_key_value);
+			return ;
+		}
+	#endif
+
+		input->click_num = 0;
 	}
+
+	report_key_value(input->report_key_value);
 }
 
 static bool is_support_hold(int key_code)
@@ -139,6 +159,22 @@ void key_event_handle(struct device *dev, struct input_value *val)
 		return;
 	}
 
+#ifdef CONFIG_INPUT_KEY_GESTURE
+	if (val->value != KEY_VALUE_DOWN && val->value != KEY_VALUE_UP)
+		return;
+
+	if (val->value == KEY_VALUE_DOWN && val->code != input_manager->press_code) {
+		input_manager->press_code = val->code;
+		input_manager->filter_itself = false;
+	}
+
+	/* classified in the work, from the time the driver saw the key */
+	if (key_gesture_input(&input_manager->gesture, val->code,
+			val->value == KEY_VALUE_DOWN, k_uptime_get_32())) {
+		os_delayed_work_submit(&input_manager->gesture_work, 0);
+	}
+	return;
+#endif
 
 	// SYS_LOG_INF("Totti debnug:%s:%d; val=0x%x\n", __func__, __LINE__, val->code);
 
@@ -216,7 +252,7 @@ void key_event_handle(struct device *dev, struct input_value *val)
 					input_manager->press_type = KEY_TYPE_LONG_DOWN;
 					if (is_support_hold(input_manager->press_code)) {
 						input_manager->key_hold = true;
-						os_delayed_work_submit(&input_manager->hold_key_work, 800);
+						os_delayed_work_submit(&input_manager->hold_key_work, HOLD_KEY_DELAY);
 					}
 					need_report = true;
 				}
@@ -309,7 +345,7 @@ static void check_hold_key(struct k_work *work)
 
 	msg.type = MSG_KEY_INPUT;
 	if (input_manager->key_hold) {
-		os_delayed_work_submit(&input_manager->hold_key_work, 200);
+		os_delayed_work_submit(&input_manager->hold_key_work, HOLD_KEY_PERIOD);
 
 		if (!input_manager_islock()) {
 			msg.value = KEY_TYPE_HOLD | input_manager->press_code;
@@ -376,6 +412,132 @@ void sr_event_handle(struct device *dev, struct input_value *val)
 }
 #endif
 
+#ifdef CONFIG_INPUT_KEY_GESTURE
+static key_gesture_cfg_t gesture_cfg[1 + MAX_HOLD_KEY_SUPPORT + MAX_MUTIPLE_CLICK_KEY_SUPPORT];
+
+#ifdef KEY_GESTURE_COMBO
+static const key_gesture_combo_t gesture_combo[] = KEY_GESTURE_COMBO;
+#endif
+
+static void gesture_report(void *user_data, u32_t key_value, u32_t stamp)
+{
+	struct app_msg msg = {0};
+
+	input_manager->gesture_stamp = stamp;
+
+	if (input_manager->event_cb) {
+		input_manager->event_cb(key_value, EV_KEY);
+	}
+
+	if (input_manager_islock()) {
+		SYS_LOG_INF("input manager locked");
+		return;
+	}
+
+	if (key_value & (KEY_TYPE_HOLD | KEY_TYPE_HOLD_UP)) {
+		if (input_manager->filter_itself) {
+			if (key_value & KEY_TYPE_HOLD_UP)
+				input_manager->filter_itself = false;
+			return;
+		}
+
+		msg.type = MSG_KEY_INPUT;
+		msg.value = key_value;
+		send_async_msg("main", &msg);
+		return;
+	}
+
+	if (!os_is_free_msg_enough()) {
+		SYS_LOG_INF("drop input msg ... %d", msg_pool_get_free_msg_num());
+		return;
+	}
+
+	SYS_LOG_DBG("key 0x%x at %u, %u ms late", key_value, stamp, k_uptime_get_32() - stamp);
+	input_manager->report_key_value = key_value;
+	report_key_value(key_value);
+}
+
+static void gesture_work_handler(struct k_work *work)
+{
+	s32_t delay = key_gesture_process(&input_manager->gesture, k_uptime_get_32());
+	unsigned int key;
+
+	/* a resubmit would cancel the work submitted for a new edge */
+	key = irq_lock();
+	if (key_gesture_pending(&input_manager->gesture))
+		delay = 0;
+	if (delay >= 0)
+		os_delayed_work_submit(&input_manager->gesture_work, delay);
+	irq_unlock(key);
+}
+
+static key_gesture_cfg_t *gesture_cfg_get(int *num, u16_t code)
+{
+	key_gesture_cfg_t *cfg;
+	int i;
+
+	for (i = 0; i < *num; i++) {
+		if (gesture_cfg[i].code == code)
+			return &gesture_cfg[i];
+	}
+
+	/* the same long press stages as the key scan counts */
+	cfg = &gesture_cfg[(*num)++];
+	cfg->code = code;
+	cfg->stage_ms[0] = LONG_PRESS_TIMER * KEY_SCAN_PERIOD;
+	cfg->stage_ms[1] = SUPER_LONG_PRESS_TIMER * KEY_SCAN_PERIOD;
+	cfg->stage_ms[2] = SUPER_LONG_PRESS_5S_TIMER * KEY_SCAN_PERIOD;
+	cfg->stage_ms[3] = SUPER_LONG_PRESS_10S_TIMER * KEY_SCAN_PERIOD;
+
+	return cfg;
+}
+
+static void gesture_init(void)
+{
+	const key_gesture_combo_t *combo = NULL;
+	key_gesture_cfg_t *cfg;
+	int num = 0, combo_num = 0;
+	int i;
+
+	memset(gesture_cfg, 0, sizeof(gesture_cfg));
+	gesture_cfg_get(&num, 0);
+
+	for (i = 0; i < MAX_HOLD_KEY_SUPPORT; i++) {
+		if (!support_hold_key[i])
+			continue;
+
+		cfg = gesture_cfg_get(&num, support_hold_key[i]);
+		cfg->hold_ms = cfg->stage_ms[0] + HOLD_KEY_DELAY;
+		cfg->repeat_ms = HOLD_KEY_PERIOD;
+	}
+
+#ifdef CONFIG_INPUT_MUTIPLE_CLICK
+	for (i = 0; i < MAX_MUTIPLE_CLICK_KEY_SUPPORT; i++) {
+		if (!support_mutiple_key[i])
+			continue;
+
+		cfg = gesture_cfg_get(&num, support_mutiple_key[i]);
+		cfg->click_ms = QUICKLY_CLICK_DURATION;
+		cfg->max_clicks = 3;
+	}
+#endif
+
+#ifdef KEY_GESTURE_COMBO
+	combo = gesture_combo;
+	combo_num = ARRAY_SIZE(gesture_combo);
+#endif
+
+	key_gesture_init(&input_manager->gesture, gesture_cfg, num, combo, combo_num,
+			gesture_report, NULL);
+	os_delayed_work_init(&input_manager->gesture_work, gesture_work_handler);
+}
+
+u32_t input_manager_get_key_stamp(void)
+{
+	return input_manager->gesture_stamp;
+}
+#endif
+
 static struct input_manager_info global_input_manager;
 
 /*init manager*/
@@ -391,6 +553,10 @@ bool input_manager_init(event_trigger event_cb)
 
 	input_manager->event_cb = event_cb;
 
+#ifdef CONFIG_INPUT_KEY_GESTURE
+	gesture_init();
+#endif
+
 	if (!key_device_open(&key_event_handle, "adckey")) {
 		SYS_LOG_ERR("adckey devices open failed");
 		return false;
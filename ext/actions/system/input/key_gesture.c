@@ -0,0 +1,387 @@
+/*
+ * Copyright (c) 2020 Actions Semiconductor Co., Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file key gesture engine
+ */
+
+#include <kernel.h>
+#include <string.h>
+#include "key_gesture.h"
+
+enum {
+	SLOT_IDLE,
+	SLOT_DOWN,
+	/* released, waiting for another click */
+	SLOT_GAP,
+};
+
+static const u32_t stage_type[KEY_GESTURE_STAGES] = {
+	KEY_TYPE_LONG_DOWN,
+	KEY_TYPE_LONG,
+	KEY_TYPE_LONG5S,
+	KEY_TYPE_LONG10S,
+};
+
+static const u32_t click_type[] = {
+	KEY_TYPE_SHORT_UP,
+	KEY_TYPE_DOUBLE_CLICK,
+	KEY_TYPE_TRIPLE_CLICK,
+};
+
+static inline bool time_before(u32_t a, u32_t b)
+{
+	return (s32_t)(a - b) < 0;
+}
+
+static const key_gesture_cfg_t *gesture_cfg(key_gesture_t *gesture, u16_t code)
+{
+	const key_gesture_cfg_t *def = NULL;
+	int i;
+
+	for (i = 0; i < gesture->cfg_num; i++) {
+		if (gesture->cfg[i].code == code)
+			return &gesture->cfg[i];
+
+		if (!gesture->cfg[i].code)
+			def = &gesture->cfg[i];
+	}
+
+	return def;
+}
+
+static int gesture_max_clicks(const key_gesture_cfg_t *cfg)
+{
+	if (!cfg->click_ms || cfg->max_clicks < 1)
+		return 1;
+
+	return MIN(cfg->max_clicks, ARRAY_SIZE(click_type));
+}
+
+static void gesture_emit(key_gesture_t *gesture, key_gesture_slot_t *slot, u32_t type, u32_t stamp)
+{
+	gesture->emit(gesture->user_data, type | slot->code, stamp);
+}
+
+static key_gesture_slot_t *gesture_find(key_gesture_t *gesture, u16_t code)
+{
+	key_gesture_slot_t *slot;
+	int i;
+
+	for (i = 0; i < CONFIG_INPUT_KEY_GESTURE_SLOTS; i++) {
+		slot = &gesture->slot[i];
+		if (slot->state != SLOT_IDLE && (slot->member[0] == code || slot->member[1] == code))
+			return slot;
+	}
+
+	return NULL;
+}
+
+/* earliest of the next long stage and the next HOLD of a key down */
+static void gesture_arm(key_gesture_slot_t *slot)
+{
+	const key_gesture_cfg_t *cfg = slot->cfg;
+
+	slot->timer = 0;
+
+	if (slot->stage < KEY_GESTURE_STAGES && cfg->stage_ms[slot->stage]) {
+		slot->deadline = slot->press + cfg->stage_ms[slot->stage];
+		slot->timer = 1;
+	}
+
+	if (cfg->hold_ms && !slot->hold_end) {
+		if (!slot->timer || time_before(slot->next_hold, slot->deadline))
+			slot->deadline = slot->next_hold;
+		slot->timer = 1;
+	}
+}
+
+static void gesture_start(key_gesture_slot_t *slot, u32_t stamp)
+{
+	slot->state = SLOT_DOWN;
+	slot->press = stamp;
+	slot->stage = 0;
+	slot->holding = 0;
+	slot->hold_end = 0;
+	slot->next_hold = stamp + slot->cfg->hold_ms;
+	gesture_arm(slot);
+}
+
+static void gesture_expire(key_gesture_t *gesture, key_gesture_slot_t *slot)
+{
+	const key_gesture_cfg_t *cfg = slot->cfg;
+	u32_t at = slot->deadline;
+
+	if (slot->state == SLOT_GAP) {
+		slot->state = SLOT_IDLE;
+		slot->timer = 0;
+		gesture_emit(gesture, slot, click_type[slot->clicks - 1], slot->release);
+		return;
+	}
+
+	if (slot->stage < KEY_GESTURE_STAGES && cfg->stage_ms[slot->stage] &&
+		slot->press + cfg->stage_ms[slot->stage] == at) {
+		/* a long press after clicks ends them */
+		if (slot->stage == 0 && slot->clicks) {
+			gesture_emit(gesture, slot, click_type[slot->clicks - 1], slot->release);
+			slot->clicks = 0;
+		}
+
+		gesture_emit(gesture, slot, stage_type[slot->stage], at);
+		slot->stage++;
+	}
+
+	if (cfg->hold_ms && !slot->hold_end && slot->next_hold == at) {
+		gesture_emit(gesture, slot, KEY_TYPE_HOLD, at);
+		slot->holding = 1;
+
+		if (cfg->repeat_ms)
+			slot->next_hold += cfg->repeat_ms;
+		else
+			slot->hold_end = 1;
+	}
+
+	gesture_arm(slot);
+}
+
+/* expire the deadlines up to stamp, in time order */
+static void gesture_run_timers(key_gesture_t *gesture, u32_t stamp)
+{
+	key_gesture_slot_t *slot, *first;
+	int i;
+
+	while (1) {
+		first = NULL;
+
+		for (i = 0; i < CONFIG_INPUT_KEY_GESTURE_SLOTS; i++) {
+			slot = &gesture->slot[i];
+			if (slot->state == SLOT_IDLE || !slot->timer || time_before(stamp, slot->deadline))
+				continue;
+
+			if (!first || time_before(slot->deadline, first->deadline))
+				first = slot;
+		}
+
+		if (!first)
+			break;
+
+		gesture_expire(gesture, first);
+	}
+}
+
+static bool gesture_combo(key_gesture_t *gesture, u16_t code, u32_t stamp)
+{
+	const key_gesture_combo_t *combo;
+	const key_gesture_cfg_t *cfg;
+	key_gesture_slot_t *slot;
+	u16_t other;
+	int i;
+
+	for (i = 0; i < gesture->combo_num; i++) {
+		combo = &gesture->combo[i];
+		if (combo->member[0] == code)
+			other = combo->member[1];
+		else if (combo->member[1] == code)
+			other = combo->member[0];
+		else
+			continue;
+
+		/* the other key alone, down for less than the window, nothing reported yet */
+		slot = gesture_find(gesture, other);
+		if (!slot || slot->state != SLOT_DOWN || slot->member[0] != slot->member[1] ||
+			slot->stage || slot->holding || slot->clicks ||
+			time_before(slot->press + combo->window_ms, stamp))
+			continue;
+
+		cfg = gesture_cfg(gesture, combo->code);
+		if (!cfg)
+			continue;
+
+		slot->cfg = cfg;
+		slot->code = combo->code;
+		slot->member[0] = other;
+		slot->member[1] = code;
+		gesture_start(slot, stamp);
+		return true;
+	}
+
+	return false;
+}
+
+static void gesture_press(key_gesture_t *gesture, u16_t code, u32_t stamp)
+{
+	const key_gesture_cfg_t *cfg;
+	key_gesture_slot_t *slot = gesture_find(gesture, code);
+	int i;
+
+	if (slot) {
+		/* one more click, or the key reported again while down */
+		if (slot->state == SLOT_GAP)
+			gesture_start(slot, stamp);
+		return;
+	}
+
+	if (gesture_combo(gesture, code, stamp))
+		return;
+
+	cfg = gesture_cfg(gesture, code);
+	if (!cfg)
+		return;
+
+	for (i = 0; i < CONFIG_INPUT_KEY_GESTURE_SLOTS; i++) {
+		slot = &gesture->slot[i];
+		if (slot->state != SLOT_IDLE)
+			continue;
+
+		slot->cfg = cfg;
+		slot->code = code;
+		slot->member[0] = code;
+		slot->member[1] = code;
+		slot->clicks = 0;
+		gesture_start(slot, stamp);
+		return;
+	}
+
+	gesture->slot_drops++;
+}
+
+static void gesture_release(key_gesture_t *gesture, u16_t code, u32_t stamp)
+{
+	key_gesture_slot_t *slot = gesture_find(gesture, code);
+
+	if (!slot || slot->state != SLOT_DOWN)
+		return;
+
+	slot->state = SLOT_IDLE;
+	slot->timer = 0;
+
+	if (slot->stage >= 2) {
+		gesture_emit(gesture, slot, KEY_TYPE_LONG_UP, stamp);
+	} else if (slot->stage == 1) {
+		gesture_emit(gesture, slot, KEY_TYPE_SHORT_LONG_UP, stamp);
+	} else if (++slot->clicks < gesture_max_clicks(slot->cfg)) {
+		slot->state = SLOT_GAP;
+		slot->release = stamp;
+		slot->deadline = stamp + slot->cfg->click_ms;
+		slot->timer = 1;
+	} else {
+		gesture_emit(gesture, slot, click_type[slot->clicks - 1], stamp);
+	}
+
+	if (slot->holding)
+		gesture_emit(gesture, slot, KEY_TYPE_HOLD_UP, stamp);
+}
+
+void key_gesture_init(key_gesture_t *gesture, const key_gesture_cfg_t *cfg, int cfg_num,
+		const key_gesture_combo_t *combo, int combo_num,
+		key_gesture_emit_t emit, void *user_data)
+{
+	memset(gesture, 0, sizeof(*gesture));
+
+	gesture->cfg = cfg;
+	gesture->cfg_num = cfg_num;
+	gesture->combo = combo;
+	gesture->combo_num = combo_num;
+	gesture->emit = emit;
+	gesture->user_data = user_data;
+}
+
+bool key_gesture_input(key_gesture_t *gesture, u16_t code, bool down, u32_t stamp)
+{
+	key_gesture_edge_t *edge;
+	unsigned int key;
+	int i;
+
+	key = irq_lock();
+
+	/* a key reported down again while still queued down adds nothing */
+	for (i = 1; down && i <= gesture->edge_cnt; i++) {
+		edge = &gesture->edge[(gesture->edge_wr + CONFIG_INPUT_KEY_GESTURE_EDGES - i) %
+				CONFIG_INPUT_KEY_GESTURE_EDGES];
+		if (edge->code != code)
+			continue;
+
+		if (edge->down) {
+			irq_unlock(key);
+			return false;
+		}
+		break;
+	}
+
+	if (gesture->edge_cnt < CONFIG_INPUT_KEY_GESTURE_EDGES) {
+		edge = &gesture->edge[gesture->edge_wr];
+		edge->stamp = stamp;
+		edge->code = code;
+		edge->down = down;
+
+		gesture->edge_wr = (gesture->edge_wr + 1) % CONFIG_INPUT_KEY_GESTURE_EDGES;
+		gesture->edge_cnt++;
+	} else {
+		gesture->edge_drops++;
+	}
+
+	irq_unlock(key);
+
+	return true;
+}
+
+s32_t key_gesture_process(key_gesture_t *gesture, u32_t now)
+{
+	key_gesture_edge_t edge;
+	key_gesture_slot_t *slot;
+	u32_t deadline = 0;
+	bool armed = false;
+	unsigned int key;
+	int i;
+
+	while (1) {
+		key = irq_lock();
+		if (!gesture->edge_cnt) {
+			irq_unlock(key);
+			break;
+		}
+
+		edge = gesture->edge[gesture->edge_rd];
+		gesture->edge_rd = (gesture->edge_rd + 1) % CONFIG_INPUT_KEY_GESTURE_EDGES;
+		gesture->edge_cnt--;
+		irq_unlock(key);
+
+		/* what happened before the edge comes first */
+		gesture_run_timers(gesture, edge.stamp);
+
+		if (edge.down)
+			gesture_press(gesture, edge.code, edge.stamp);
+		else
+			gesture_release(gesture, edge.code, edge.stamp);
+	}
+
+	gesture_run_timers(gesture, now);
+
+	for (i = 0; i < CONFIG_INPUT_KEY_GESTURE_SLOTS; i++) {
+		slot = &gesture->slot[i];
+		if (slot->state == SLOT_IDLE || !slot->timer)
+			continue;
+
+		if (!armed || time_before(slot->deadline, deadline))
+			deadline = slot->deadline;
+		armed = true;
+	}
+
+	return armed ? (s32_t)(deadline - now) : -1;
+}
+
+void key_gesture_reset(key_gesture_t *gesture)
+{
+	unsigned int key;
+
+	key = irq_lock();
+	gesture->edge_rd = 0;
+	gesture->edge_wr = 0;
+	gesture->edge_cnt = 0;
+	irq_unlock(key);
+
+	memset(gesture->slot, 0, sizeof(gesture->slot));
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2020 Actions Semiconductor Co., Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file key gesture engine
+ *
+ * Key edges are queued with the time they were seen by the key driver,
+ * then classified into key_type_e events from those times only: long
+ * press stages, hold repeat, N clicks and two key combos, as configured
+ * per key code. All gesture timing runs off the earliest pending
+ * deadline, so one timer drives every key and events keep the time
+ * they happened at, however late the timer runs.
+ */
+
+#ifndef __KEY_GESTURE_H__
+#define __KEY_GESTURE_H__
+
+#include <zephyr/types.h>
+#include <input_manager.h>
+
+#ifndef CONFIG_INPUT_KEY_GESTURE_SLOTS
+#define CONFIG_INPUT_KEY_GESTURE_SLOTS	4
+#endif
+
+#ifndef CONFIG_INPUT_KEY_GESTURE_EDGES
+#define CONFIG_INPUT_KEY_GESTURE_EDGES	8
+#endif
+
+/* long press stages, reported as LONG_DOWN, LONG, LONG5S and LONG10S */
+#define KEY_GESTURE_STAGES		4
+
+typedef struct {
+	/* key code, 0 for the keys not in the table */
+	u16_t code;
+	/* gap after a release to press again for one more click, 0 single click */
+	u16_t click_ms;
+	/* clicks ending the gesture at once, 1 to 3 */
+	u8_t max_clicks;
+	/* first HOLD after the press, 0 if the key does not hold */
+	u16_t hold_ms;
+	/* HOLD period after the first one, 0 for a single HOLD */
+	u16_t repeat_ms;
+	/* press time of each long stage, 0 to stop at the previous one */
+	u16_t stage_ms[KEY_GESTURE_STAGES];
+} key_gesture_cfg_t;
+
+/* both keys pressed within window_ms act as key code */
+typedef struct {
+	u16_t member[2];
+	u16_t code;
+	u16_t window_ms;
+} key_gesture_combo_t;
+
+/* key_value is a key_type_e | code, stamp the time the gesture happened */
+typedef void (*key_gesture_emit_t)(void *user_data, u32_t key_value, u32_t stamp);
+
+typedef struct {
+	u32_t stamp;
+	u16_t code;
+	u8_t down;
+} key_gesture_edge_t;
+
+typedef struct {
+	const key_gesture_cfg_t *cfg;
+	u8_t state;
+	/* long stages reported */
+	u8_t stage;
+	u8_t clicks;
+	/* HOLD reported, no more HOLD to come */
+	u8_t holding : 1;
+	u8_t hold_end : 1;
+	/* deadline set */
+	u8_t timer : 1;
+	u16_t code;
+	/* keys of a combo */
+	u16_t member[2];
+	u32_t press;
+	u32_t release;
+	u32_t next_hold;
+	u32_t deadline;
+} key_gesture_slot_t;
+
+typedef struct {
+	const key_gesture_cfg_t *cfg;
+	const key_gesture_combo_t *combo;
+	u8_t cfg_num;
+	u8_t combo_num;
+	key_gesture_emit_t emit;
+	void *user_data;
+
+	key_gesture_slot_t slot[CONFIG_INPUT_KEY_GESTURE_SLOTS];
+
+	/* edges from the key driver, filled in irq context */
+	key_gesture_edge_t edge[CONFIG_INPUT_KEY_GESTURE_EDGES];
+	u8_t edge_rd;
+	u8_t edge_wr;
+	u8_t edge_cnt;
+
+	u32_t edge_drops;
+	u32_t slot_drops;
+} key_gesture_t;
+
+/**
+ * @brief Set up the engine, the tables are kept by reference
+ */
+void key_gesture_init(key_gesture_t *gesture, const key_gesture_cfg_t *cfg, int cfg_num,
+		const key_gesture_combo_t *combo, int combo_num,
+		key_gesture_emit_t emit, void *user_data);
+
+/**
+ * @brief Queue a key edge, callable from the key driver callback
+ *
+ * A key held down may be reported again, only its first down counts.
+ *
+ * @param stamp uptime in ms of the edge
+ *
+ * @return false if the edge adds nothing to the queued ones
+ */
+bool key_gesture_input(key_gesture_t *gesture, u16_t code, bool down, u32_t stamp);
+
+/**
+ * @brief Classify the queued edges and the deadlines up to now
+ *
+ * Events are emitted in the order they happened.
+ *
+ * @return ms until the next deadline, -1 if none
+ */
+s32_t key_gesture_process(key_gesture_t *gesture, u32_t now);
+
+/**
+ * @brief Whether edges wait to be processed, call with irq locked
+ */
+static inline bool key_gesture_pending(key_gesture_t *gesture)
+{
+	return gesture->edge_cnt != 0;
+}
+
+/**
+ * @brief Drop the gestures in progress, no more event is emitted for them
+ */
+void key_gesture_reset(key_gesture_t *gesture);
+
+#endif /* __KEY_GESTURE_H__ */
@@ -22,6 +22,7 @@
 #include <sys_monitor.h>
 #include <power_manager.h>
 #include <property_manager.h>
+#include <sys_event.h>
 #ifdef CONFIG_PLAYTTS
 #include <tts_manager.h>
 #endif
@@ -62,6 +63,16 @@ int system_restore_factory_config(void)
 	return 0;
 }
 
+#ifdef CONFIG_PROPERTY_CACHE
+static int _sys_property_flush_work_handle(void)
+{
+	/* write back idle dirty properties in one batch */
+	property_flush_req_deal();
+
+	return SYS_EVENT_NONE;
+}
+#endif
+
 void system_pre_init(void)
 {
 	msg_manager_init();
@@ -76,6 +87,10 @@ void system_init(void)
 
 	sys_monitor_init();
 
+#ifdef CONFIG_PROPERTY_CACHE
+	sys_monitor_add_work(_sys_property_flush_work_handle);
+#endif
+
 #ifdef CONFIG_ESD_MANAGER
 	esd_manager_init();
 #endif
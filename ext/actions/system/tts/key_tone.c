@@ -27,6 +27,12 @@ struct key_tone_manager_t {
 	struct audio_track_t *keytone_track;
 	os_delayed_work play_work;
 	os_delayed_work stop_work;
+#ifdef CONFIG_AUDIO_TRACK_OVERLAY
+	/* key tone mixed into the running track */
+	audio_overlay_t overlay;
+	int tone_clip;
+	os_delayed_work overlay_work;
+#endif
 };
 
 static struct key_tone_manager_t key_tone_manager;
@@ -126,9 +132,8 @@ static void _keytone_manager_stop_work(os_work *work)
 	audio_system_mutex_unlock();
 }
 
-int key_tone_play(void)
+static int _key_tone_play_track(struct key_tone_manager_t *manager)
 {
-	struct key_tone_manager_t *manager = &key_tone_manager;
 #ifdef CONFIG_SYS_IRQ_LOCK
 	SYS_IRQ_FLAGS flags;
 
@@ -147,6 +152,75 @@ int key_tone_play(void)
 	return 0;
 }
 
+#ifdef CONFIG_AUDIO_TRACK_OVERLAY
+static int _key_tone_overlay_play(struct key_tone_manager_t *manager)
+{
+	struct audio_track_t *track;
+	int res = -ENODEV;
+
+	audio_system_mutex_lock();
+
+	track = audio_system_get_track();
+	if (track && track != manager->keytone_track) {
+		if (audio_track_get_overlay(track) != &manager->overlay) {
+			res = audio_track_set_overlay(track, &manager->overlay);
+		} else {
+			res = 0;
+		}
+
+		if (!res) {
+			res = audio_overlay_trigger(&manager->overlay, manager->tone_clip, 0);
+		}
+	}
+
+	audio_system_mutex_unlock();
+	return res;
+}
+
+static void _keytone_manager_overlay_work(os_work *work)
+{
+	struct key_tone_manager_t *manager = &key_tone_manager;
+
+	/* no track to mix into, play it on a track of its own */
+	if (_key_tone_overlay_play(manager)) {
+		_key_tone_play_track(manager);
+	}
+}
+
+static void _key_tone_overlay_init(struct key_tone_manager_t *manager)
+{
+	struct buffer_t buffer;
+
+	audio_overlay_init(&manager->overlay);
+	os_delayed_work_init(&manager->overlay_work, _keytone_manager_overlay_work);
+
+	manager->tone_clip = -ENOENT;
+	if (sd_fmap("keytone.pcm", (void **)&buffer.base, &buffer.length) != 0) {
+		return;
+	}
+
+	/* 8 KHz mono s16, the format it is played with on its own track */
+	manager->tone_clip = audio_overlay_register(&manager->overlay, (s16_t *)buffer.base,
+			buffer.length / 2, 8, AUDIO_OVERLAY_GAIN_UNITY);
+
+	SYS_LOG_INF("clip %d %d\n", manager->tone_clip, buffer.length);
+}
+#endif
+
+int key_tone_play(void)
+{
+	struct key_tone_manager_t *manager = &key_tone_manager;
+
+#ifdef CONFIG_AUDIO_TRACK_OVERLAY
+	if (manager->tone_clip >= 0 && !manager->key_tone_cnt) {
+		os_delayed_work_submit(&manager->overlay_work, OS_NO_WAIT);
+		return 0;
+	}
+#endif
+
+	return _key_tone_play_track(manager);
+}
+
 int key_tone_manager_init(void)
 {
 	memset(&key_tone_manager, 0, sizeof(struct key_tone_manager_t));
@@ -154,6 +228,10 @@ int key_tone_manager_init(void)
 	os_delayed_work_init(&key_tone_manager.play_work, _keytone_manager_play_work);
 	os_delayed_work_init(&key_tone_manager.stop_work, _keytone_manager_stop_work);
 
+#ifdef CONFIG_AUDIO_TRACK_OVERLAY
+	_key_tone_overlay_init(&key_tone_manager);
+#endif
+
 	return 0;
 }
 
@@ -27,6 +27,11 @@
 #ifdef CONFIG_SOC_DVFS_DYNAMIC_LEVEL
 #include <soc_dvfs.h>
 #endif
+
+#ifdef CONFIG_TTS_PCM_CACHE
+#include <audio_track.h>
+#include "tts_pcm_cache.h"
+#endif
 #ifndef SYS_LOG_DOMAIN
 #define SYS_LOG_DOMAIN "TTS"
 #endif
@@ -52,6 +57,9 @@ struct tts_item_t {
 	uint8_t tts_mode;
 	uint8_t tts_mix_mode;
 	uint8_t tele_num_index;
+#ifdef CONFIG_TTS_PCM_CACHE
+	uint32_t event_cycles;
+#endif
 	char tts_file_name[0];
 };
 #else
@@ -62,6 +70,9 @@ struct tts_item_t {
 	io_stream_t tts_stream;
 	uint8_t tts_mode;
 	uint8_t tts_mix_mode;
+#ifdef CONFIG_TTS_PCM_CACHE
+	uint32_t event_cycles;
+#endif
 	uint8_t tts_file_name[0];
 };
 #endif
@@ -86,6 +97,18 @@ struct tts_manager_ctx_t {
 #else
 	os_delayed_work stop_work;
 #endif
+#ifdef CONFIG_TTS_PCM_CACHE
+	struct tts_pcm_cache pcm_cache;
+	/* current prompt played from the cache */
+	struct tts_pcm_cache_entry *cache_play;
+	struct acts_ringbuf *cache_ring;
+	struct audio_track_t *cache_track;
+	struct thread_timer cache_timer;
+	/* current prompt decoded into the cache */
+	struct tts_pcm_cache_entry *cache_fill;
+	struct acts_ringbuf *fill_ring;
+	uint32_t fill_done:1;
+#endif
 };
 static int _current_tts_is_vol_max;
 static struct tts_manager_ctx_t *tts_manager_ctx;
@@ -196,6 +219,77 @@ exit:
 	return stream;
 }
 
+#ifdef CONFIG_TTS_PCM_CACHE
+static const uint8_t tts_cache_dump_tag = MEDIA_DATA_TAG_DECODE_OUT1;
+
+/* cached prompts go straight to a track, tws synced ones need the player */
+static bool _tts_cache_usable(struct tts_manager_ctx_t *tts_ctx, struct tts_item_t *tts_item)
+{
+	if (tts_ctx->tts_config->tts_storage_media != TTS_SOTRAGE_SDFS ||
+		(tts_item->tts_mode & TTS_MIX_MODE_WITH_TRACK))
+		return false;
+
+#ifdef CONFIG_TWS_UI_EVENT_SYNC
+	if (tts_item->bt_clk != UINT64_MAX)
+		return false;
+#endif
+
+	return true;
+}
+
+static uint32_t _tts_cache_latency_us(struct tts_item_t *tts_item)
+{
+	return SYS_CLOCK_HW_CYCLES_TO_NS(k_cycle_get_32() - tts_item->event_cycles) / 1000;
+}
+
+static void _tts_cache_play_end(struct tts_manager_ctx_t *tts_ctx)
+{
+	thread_timer_stop(&tts_ctx->cache_timer);
+
+	if (acts_ringbuf_is_empty(tts_ctx->cache_ring)) {
+		audio_track_flush(tts_ctx->cache_track);
+	} else {
+		audio_track_set_fade_out(tts_ctx->cache_track, 10);
+		os_sleep(15);
+	}
+
+	audio_track_stop(tts_ctx->cache_track);
+	audio_track_destory(tts_ctx->cache_track);
+	acts_ringbuf_destroy_ext(tts_ctx->cache_ring);
+	tts_pcm_cache_put(&tts_ctx->pcm_cache, tts_ctx->cache_play);
+
+	tts_ctx->cache_track = NULL;
+	tts_ctx->cache_ring = NULL;
+	tts_ctx->cache_play = NULL;
+}
+
+static void _tts_cache_fill_end(struct tts_manager_ctx_t *tts_ctx, void *player_handle)
+{
+	struct tts_pcm_cache_entry *entry = tts_ctx->cache_fill;
+	uint32_t len;
+
+	if (player_handle)
+		media_player_dump_data(player_handle, 1, &tts_cache_dump_tag, NULL);
+
+	/* nothing is read from the ring, the pcm is at the entry start */
+	len = acts_ringbuf_length(tts_ctx->fill_ring);
+	acts_ringbuf_destroy_ext(tts_ctx->fill_ring);
+
+	/* interrupted, or maybe longer than the ring */
+	if (!tts_ctx->fill_done || len == entry->size) {
+		tts_pcm_cache_remove(&tts_ctx->pcm_cache, entry);
+	} else {
+		tts_pcm_cache_commit(&tts_ctx->pcm_cache, entry, len);
+		SYS_LOG_INF("cached %s %d, used %d hits %d misses %d", entry->name, len,
+			tts_ctx->pcm_cache.used, tts_ctx->pcm_cache.hits, tts_ctx->pcm_cache.misses);
+	}
+
+	tts_ctx->fill_ring = NULL;
+	tts_ctx->cache_fill = NULL;
+	tts_ctx->fill_done = 0;
+}
+#endif
+
 static void _tts_remove_current_node(struct tts_manager_ctx_t *tts_ctx)
 {
 	struct tts_item_t *tts_item;
@@ -206,6 +300,15 @@ static void _tts_remove_current_node(struct tts_manager_ctx_t *tts_ctx)
 	tts_item  = tts_ctx->tts_curr;
 
 	SYS_LOG_INF("%s\n", tts_item->tts_file_name);
+#ifdef CONFIG_TTS_PCM_CACHE
+	if (tts_ctx->cache_track)
+		_tts_cache_play_end(tts_ctx);
+	if (tts_ctx->cache_play)
+		tts_pcm_cache_put(&tts_ctx->pcm_cache, tts_ctx->cache_play);
+	tts_ctx->cache_play = NULL;
+	if (tts_ctx->cache_fill)
+		_tts_cache_fill_end(tts_ctx, tts_item->player_handle);
+#endif
 	if (tts_item->player_handle) {
 		SYS_LOG_INF("tts player: %d\n", tts_player_count--);
 		media_player_fade_out(tts_item->player_handle, 10);
@@ -324,6 +427,10 @@ static void _tts_manager_play_event_notify(uint32_t event, void *data, uint32_t
 
 	switch (event) {
 	case PLAYBACK_EVENT_STOP_COMPLETE:
+	#ifdef CONFIG_TTS_PCM_CACHE
+		tts_ctx->fill_done = 1;
+	#endif
+		/* fall through */
 	case PLAYBACK_EVENT_STOP_ERROR:
 	#ifdef CONFIG_SOC_DVFS_DYNAMIC_LEVEL
 		if(tts_ctx->dvfs_set) {
@@ -355,6 +462,106 @@ static void _tts_manager_play_event_notify(uint32_t event, void *data, uint32_t
 	}
 }
 
+#ifdef CONFIG_TTS_PCM_CACHE
+static void _tts_cache_track_callback(uint8_t event, void *user_data)
+{
+
+}
+
+static void _tts_cache_timer_handle(struct thread_timer *ttimer, void *expiry_fn_arg)
+{
+	struct tts_manager_ctx_t *tts_ctx = _tts_get_ctx();
+
+	os_mutex_lock(&tts_ctx->tts_mutex, OS_FOREVER);
+
+	/* all pcm handed to the track, it drains on stop */
+	if (tts_ctx->cache_ring && acts_ringbuf_is_empty(tts_ctx->cache_ring)) {
+		thread_timer_stop(&tts_ctx->cache_timer);
+		_tts_manager_trigger_stop_tts(tts_ctx);
+	}
+
+	os_mutex_unlock(&tts_ctx->tts_mutex);
+}
+
+/* take the prompt from the cache, the play goes without stream and player */
+static bool _tts_cache_lookup(struct tts_manager_ctx_t *tts_ctx, struct tts_item_t *tts_item)
+{
+	if (!_tts_cache_usable(tts_ctx, tts_item))
+		return false;
+
+	tts_ctx->cache_play = tts_pcm_cache_get(&tts_ctx->pcm_cache, tts_item->tts_file_name);
+
+	return tts_ctx->cache_play != NULL;
+}
+
+static int _tts_start_cached(struct tts_manager_ctx_t *tts_ctx, struct tts_item_t *tts_item)
+{
+	struct tts_pcm_cache_entry *entry = tts_ctx->cache_play;
+
+	audio_system_set_output_sample_rate(48);
+
+	tts_ctx->cache_ring = acts_ringbuf_init_ext(entry->pcm, entry->len);
+	if (!tts_ctx->cache_ring)
+		goto err;
+
+	acts_ringbuf_fill_none(tts_ctx->cache_ring, entry->len);
+
+	tts_ctx->cache_track = audio_track_create(AUDIO_STREAM_TTS, entry->sample_rate,
+				AUDIO_FORMAT_PCM_16_BIT, AUDIO_MODE_MONO, tts_ctx->cache_ring,
+				_tts_cache_track_callback, tts_ctx);
+	if (!tts_ctx->cache_track) {
+		acts_ringbuf_destroy_ext(tts_ctx->cache_ring);
+		tts_ctx->cache_ring = NULL;
+		goto err;
+	}
+
+	audio_track_start(tts_ctx->cache_track);
+	thread_timer_start_prio(&tts_ctx->cache_timer, 10, 10, app_manager_get_apptid(CONFIG_SYS_APP_NAME));
+
+	SYS_LOG_INF("%s cached, start %d us", tts_item->tts_file_name, _tts_cache_latency_us(tts_item));
+	return 0;
+
+err:
+	SYS_LOG_WRN("no track");
+	_tts_remove_current_node(tts_ctx);
+	return -2;
+}
+
+/* decode the prompt into a new entry while it plays */
+static void _tts_cache_fill_prepare(struct tts_manager_ctx_t *tts_ctx, struct tts_item_t *tts_item,
+		media_init_param_t *init_param)
+{
+	struct tts_pcm_cache_entry *entry;
+
+	if (!_tts_cache_usable(tts_ctx, tts_item))
+		return;
+
+	entry = tts_pcm_cache_reserve(&tts_ctx->pcm_cache, tts_item->tts_file_name,
+			CONFIG_TTS_PCM_CACHE_MAX_PROMPT, init_param->sample_rate);
+	if (!entry)
+		return;
+
+	tts_ctx->fill_ring = acts_ringbuf_init_ext(entry->pcm, entry->size);
+	if (!tts_ctx->fill_ring) {
+		tts_pcm_cache_remove(&tts_ctx->pcm_cache, entry);
+		return;
+	}
+
+	tts_ctx->cache_fill = entry;
+	tts_ctx->fill_done = 0;
+	init_param->dumpable = 1;
+}
+
+static void _tts_cache_fill_start(struct tts_manager_ctx_t *tts_ctx, struct tts_item_t *tts_item)
+{
+	if (!tts_ctx->cache_fill)
+		return;
+
+	if (media_player_dump_data(tts_item->player_handle, 1, &tts_cache_dump_tag, &tts_ctx->fill_ring))
+		_tts_cache_fill_end(tts_ctx, NULL);
+}
+#endif
+
 static int _tts_start_play(struct tts_item_t *tts_item,io_stream_t tts_stream)
 {
 	struct tts_manager_ctx_t *tts_ctx = _tts_get_ctx();
@@ -368,6 +575,11 @@ static int _tts_start_play(struct tts_item_t *tts_item,io_stream_t tts_stream)
 
 	tts_item->tts_stream = tts_stream;
 
+#ifdef CONFIG_TTS_PCM_CACHE
+	if (tts_ctx->cache_play)
+		return _tts_start_cached(tts_ctx, tts_item);
+#endif
+
 #ifdef CONFIG_SOC_DVFS_DYNAMIC_LEVEL
 	if(!tts_ctx->dvfs_set) {
 		tts_ctx->dvfs_set = 1;
@@ -399,6 +611,10 @@ static int _tts_start_play(struct tts_item_t *tts_item,io_stream_t tts_stream)
 	init_param.support_tws = (tts_item->bt_clk == UINT64_MAX) ? 0 : 1;
 #endif
 
+#ifdef CONFIG_TTS_PCM_CACHE
+	_tts_cache_fill_prepare(tts_ctx, tts_item, &init_param);
+#endif
+
 	tts_item->player_handle = media_player_open(&init_param);
 	if (!tts_item->player_handle) {
 		SYS_LOG_WRN("no player");
@@ -419,8 +635,15 @@ static int _tts_start_play(struct tts_item_t *tts_item,io_stream_t tts_stream)
     }
 #endif
 
+#ifdef CONFIG_TTS_PCM_CACHE
+	_tts_cache_fill_start(tts_ctx, tts_item);
+#endif
+
 	SYS_LOG_INF("tts player: %d\n", tts_player_count++);
 	media_player_play(tts_item->player_handle);
+#ifdef CONFIG_TTS_PCM_CACHE
+	SYS_LOG_INF("%s decoded, start %d us", tts_item->tts_file_name, _tts_cache_latency_us(tts_item));
+#endif
 
 	if(tts_item->tts_mode & TTS_MIX_MODE_WITH_TRACK){
 		media_player_trigger_audio_track_start(tts_item->player_handle);
@@ -488,9 +711,16 @@ int tts_manager_play_process(void)
 
 	if (!tts_item->tts_mix_mode){
 
-		io_stream_t tts_stream = _tts_create_stream(tts_item);
+		io_stream_t tts_stream = NULL;
+		bool cached = false;
+
+#ifdef CONFIG_TTS_PCM_CACHE
+		cached = _tts_cache_lookup(tts_ctx, tts_item);
+#endif
+		if (!cached)
+			tts_stream = _tts_create_stream(tts_item);
 
-		if(tts_stream){
+		if(tts_stream || cached){
 			_tts_event_nodify(TTS_EVENT_START_PLAY, 1);
 			if (!memcmp(tts_item->tts_file_name,"vol_max.pcm",11)) {
 				_current_tts_is_vol_max = 1;
@@ -539,6 +769,9 @@ static struct tts_item_t *_tts_create_item(uint8_t *tts_name, uint32_t mode, uin
 	}
 
 	memset(item, 0, size);
+#ifdef CONFIG_TTS_PCM_CACHE
+	item->event_cycles = k_cycle_get_32();
+#endif
 	item->bt_clk = bt_clk;
 	item->tts_mode = mode;
 	strcpy(item->tts_file_name, tts_name);
@@ -560,6 +793,9 @@ static struct tts_item_t *_tts_create_item(uint8_t *tts_name, uint32_t mode)
 		goto exit;
 	}
 	memset(item, 0, sizeof(struct tts_item_t) + strlen(tts_name));
+#ifdef CONFIG_TTS_PCM_CACHE
+	item->event_cycles = k_cycle_get_32();
+#endif
 	item->tts_mode = mode;
 	strcpy(item->tts_file_name, tts_name);
 
@@ -1050,6 +1286,25 @@ int tts_manager_process_ui_event(int ui_event)
 	}
 }
 
+#ifdef CONFIG_TTS_PCM_CACHE
+int tts_manager_prefetch_ui_event(int ui_event)
+{
+	uint8_t *tts_file_name = NULL;
+	uint32_t mode = 0;
+	struct tts_manager_ctx_t *tts_ctx = _tts_get_ctx();
+	int res;
+
+	if (tts_manager_find_tts(ui_event, &mode, &tts_file_name))
+		return -ENOENT;
+
+	os_mutex_lock(&tts_ctx->tts_mutex, OS_FOREVER);
+	res = tts_pcm_cache_touch(&tts_ctx->pcm_cache, tts_file_name);
+	os_mutex_unlock(&tts_ctx->tts_mutex);
+
+	return res;
+}
+#endif
+
 #ifdef CONFIG_TWS_UI_EVENT_SYNC
 int tts_manager_play_at_time(uint8_t *tts_name, uint32_t mode, uint64_t bt_clk, char *pattern)
 {
@@ -1138,6 +1393,11 @@ int tts_manager_init(void)
 	os_delayed_work_init(&tts_manager_ctx->stop_work, _tts_manager_stop_work);
 #endif
 
+#ifdef CONFIG_TTS_PCM_CACHE
+	tts_pcm_cache_init(&tts_manager_ctx->pcm_cache, CONFIG_TTS_PCM_CACHE_SIZE);
+	thread_timer_init(&tts_manager_ctx->cache_timer, _tts_cache_timer_handle, NULL);
+#endif
+
 	tts_manager_register_tts_config(&tts_config);
 
 #ifdef CONFIG_PLAY_KEYTONE
@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2020 Actions Semiconductor Co., Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief decoded tts prompt cache
+ */
+
+#include <zephyr/types.h>
+#include <string.h>
+#include <errno.h>
+#include <mem_manager.h>
+#include "tts_pcm_cache.h"
+
+void tts_pcm_cache_init(struct tts_pcm_cache *cache, u32_t budget)
+{
+	memset(cache, 0, sizeof(*cache));
+
+	cache->budget = budget;
+}
+
+static struct tts_pcm_cache_entry *pcm_cache_find(struct tts_pcm_cache *cache, const char *name)
+{
+	struct tts_pcm_cache_entry *entry;
+	int i;
+
+	for (i = 0; i < CONFIG_TTS_PCM_CACHE_ENTRIES; i++) {
+		entry = &cache->entry[i];
+		if (entry->state != TTS_PCM_CACHE_FREE &&
+		    !strncmp(entry->name, name, TTS_PCM_CACHE_NAME_LEN))
+			return entry;
+	}
+
+	return NULL;
+}
+
+static void pcm_cache_free(struct tts_pcm_cache *cache, struct tts_pcm_cache_entry *entry)
+{
+	mem_free(entry->pcm);
+	cache->used -= entry->size;
+
+	memset(entry, 0, sizeof(*entry));
+}
+
+/* least recently used ready entry nobody plays */
+static struct tts_pcm_cache_entry *pcm_cache_victim(struct tts_pcm_cache *cache)
+{
+	struct tts_pcm_cache_entry *entry, *victim = NULL;
+	int i;
+
+	for (i = 0; i < CONFIG_TTS_PCM_CACHE_ENTRIES; i++) {
+		entry = &cache->entry[i];
+		if (entry->state != TTS_PCM_CACHE_READY || entry->users)
+			continue;
+
+		if (!victim || (s32_t)(entry->stamp - victim->stamp) < 0)
+			victim = entry;
+	}
+
+	return victim;
+}
+
+struct tts_pcm_cache_entry *tts_pcm_cache_get(struct tts_pcm_cache *cache, const char *name)
+{
+	struct tts_pcm_cache_entry *entry = pcm_cache_find(cache, name);
+
+	if (!entry || entry->state != TTS_PCM_CACHE_READY) {
+		cache->misses++;
+		return NULL;
+	}
+
+	cache->hits++;
+	entry->users++;
+	entry->stamp = ++cache->clock;
+
+	return entry;
+}
+
+void tts_pcm_cache_put(struct tts_pcm_cache *cache, struct tts_pcm_cache_entry *entry)
+{
+	if (entry->users)
+		entry->users--;
+}
+
+int tts_pcm_cache_touch(struct tts_pcm_cache *cache, const char *name)
+{
+	struct tts_pcm_cache_entry *entry = pcm_cache_find(cache, name);
+
+	if (!entry || entry->state != TTS_PCM_CACHE_READY)
+		return -ENOENT;
+
+	entry->stamp = ++cache->clock;
+
+	return 0;
+}
+
+struct tts_pcm_cache_entry *tts_pcm_cache_reserve(struct tts_pcm_cache *cache,
+		const char *name, u32_t size, u8_t sample_rate)
+{
+	struct tts_pcm_cache_entry *entry = NULL, *victim;
+	int i;
+
+	if (strlen(name) >= TTS_PCM_CACHE_NAME_LEN || !size || size > cache->budget ||
+	    pcm_cache_find(cache, name))
+		return NULL;
+
+	for (;;) {
+		for (i = 0; i < CONFIG_TTS_PCM_CACHE_ENTRIES; i++) {
+			if (cache->entry[i].state == TTS_PCM_CACHE_FREE) {
+				entry = &cache->entry[i];
+				break;
+			}
+		}
+
+		if (entry && cache->used + size <= cache->budget)
+			break;
+
+		victim = pcm_cache_victim(cache);
+		if (!victim)
+			return NULL;
+
+		pcm_cache_free(cache, victim);
+		cache->evictions++;
+	}
+
+	entry->pcm = mem_malloc(size);
+	if (!entry->pcm)
+		return NULL;
+
+	strcpy(entry->name, name);
+	entry->size = size;
+	entry->len = 0;
+	entry->sample_rate = sample_rate;
+	entry->users = 0;
+	entry->state = TTS_PCM_CACHE_FILLING;
+	cache->used += size;
+
+	return entry;
+}
+
+void tts_pcm_cache_commit(struct tts_pcm_cache *cache, struct tts_pcm_cache_entry *entry,
+		u32_t len)
+{
+	u8_t *pcm;
+
+	if (!len || len > entry->size) {
+		pcm_cache_free(cache, entry);
+		return;
+	}
+
+	/* give back what the decode did not take */
+	if (len < entry->size) {
+		pcm = mem_malloc(len);
+		if (pcm) {
+			memcpy(pcm, entry->pcm, len);
+			mem_free(entry->pcm);
+			entry->pcm = pcm;
+			cache->used -= entry->size - len;
+			entry->size = len;
+		}
+	}
+
+	entry->len = len;
+	entry->state = TTS_PCM_CACHE_READY;
+	entry->stamp = ++cache->clock;
+}
+
+void tts_pcm_cache_remove(struct tts_pcm_cache *cache, struct tts_pcm_cache_entry *entry)
+{
+	pcm_cache_free(cache, entry);
+}
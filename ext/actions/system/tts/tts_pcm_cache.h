@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2020 Actions Semiconductor Co., Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief decoded tts prompt cache
+ *
+ * Keeps the decoder output of recently played prompts, by name, within a
+ * byte budget. The least recently used prompt not being played is evicted
+ * when a new one does not fit. An entry is reserved at its largest size
+ * while the prompt is decoded and shrunk to what was decoded on commit.
+ */
+
+#ifndef __TTS_PCM_CACHE_H__
+#define __TTS_PCM_CACHE_H__
+
+#include <zephyr/types.h>
+
+#define TTS_PCM_CACHE_NAME_LEN		24
+
+enum {
+	TTS_PCM_CACHE_FREE,
+	TTS_PCM_CACHE_FILLING,
+	TTS_PCM_CACHE_READY,
+};
+
+struct tts_pcm_cache_entry {
+	char name[TTS_PCM_CACHE_NAME_LEN];
+	u8_t *pcm;
+	/* bytes allocated and bytes of pcm */
+	u32_t size;
+	u32_t len;
+	u8_t state;
+	u8_t sample_rate;
+	/* players of the entry, it is not evicted while set */
+	u8_t users;
+	u32_t stamp;
+};
+
+struct tts_pcm_cache {
+	struct tts_pcm_cache_entry entry[CONFIG_TTS_PCM_CACHE_ENTRIES];
+	u32_t budget;
+	u32_t used;
+	u32_t clock;
+
+	u32_t hits;
+	u32_t misses;
+	u32_t evictions;
+};
+
+void tts_pcm_cache_init(struct tts_pcm_cache *cache, u32_t budget);
+
+/**
+ * @brief find a decoded prompt and take a user reference on it
+ *
+ * @return entry, NULL if the prompt is not cached
+ */
+struct tts_pcm_cache_entry *tts_pcm_cache_get(struct tts_pcm_cache *cache, const char *name);
+
+void tts_pcm_cache_put(struct tts_pcm_cache *cache, struct tts_pcm_cache_entry *entry);
+
+/**
+ * @brief mark a prompt as most recently used
+ *
+ * @return 0 if the prompt is cached, else -ENOENT
+ */
+int tts_pcm_cache_touch(struct tts_pcm_cache *cache, const char *name);
+
+/**
+ * @brief reserve an entry to decode a prompt into
+ *
+ * @param size largest pcm size of the prompt
+ * @param sample_rate pcm sample rate in KHz
+ *
+ * @return entry in filling state, NULL if the prompt is cached or being
+ *         filled, or size does not fit even after eviction
+ */
+struct tts_pcm_cache_entry *tts_pcm_cache_reserve(struct tts_pcm_cache *cache,
+		const char *name, u32_t size, u8_t sample_rate);
+
+/**
+ * @brief make a filled entry available
+ *
+ * @param len bytes of pcm decoded
+ */
+void tts_pcm_cache_commit(struct tts_pcm_cache *cache, struct tts_pcm_cache_entry *entry,
+		u32_t len);
+
+/**
+ * @brief drop an entry, filled or not
+ */
+void tts_pcm_cache_remove(struct tts_pcm_cache *cache, struct tts_pcm_cache_entry *entry);
+
+#endif /* __TTS_PCM_CACHE_H__ */
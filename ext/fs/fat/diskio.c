@@ -183,7 +183,9 @@ DRESULT disk_ioctl (
 	switch (cmd) {
 	case CTRL_SYNC:
 	#ifdef CONFIG_DISKIO_CACHE
-		diskio_cache_flush(disk);
+		if (diskio_cache_flush(disk) != 0) {
+			ret = RES_ERROR;
+		}
 	#endif
 		if(disk->op->ioctl(disk, DISK_IOCTL_CTRL_SYNC, buff) != 0) {
 			ret = RES_ERROR;
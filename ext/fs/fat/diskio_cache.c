@@ -1,3 +1,12 @@
+/**
+ * @file disk io cache
+ *
+ * N-way set associative sector cache in front of the disk drivers. Lines
+ * are CONFIG_DISKIO_CACHE_LINE_SIZE bytes aligned to their size, dirty
+ * lines are written back on eviction or sync, and sequential reads queue
+ * asynchronous read-ahead of the following lines on the cache thread.
+ */
+
 #include <diskio.h>
 #include <disk_access.h>
 #include <ffconf.h>
@@ -12,27 +21,45 @@
 #include <logging/sys_log.h>
 
 #define DISKIO_TIMEOUT OS_FOREVER
-#define DISKIO_CACHE_POOL_NUM 1
-#define DISKIO_CACHE_POOL_SIZE 2048
+#define DISKIO_CACHE_WAYS CONFIG_DISKIO_CACHE_WAYS
+#define DISKIO_CACHE_SETS CONFIG_DISKIO_CACHE_SETS
+#define DISKIO_CACHE_POOL_NUM (DISKIO_CACHE_WAYS * DISKIO_CACHE_SETS)
+#define DISKIO_CACHE_POOL_SIZE CONFIG_DISKIO_CACHE_LINE_SIZE
+#define DISKIO_CACHE_MAX_DISK _VOLUMES
+
+#ifdef CONFIG_DISKIO_CACHE_READ_AHEAD
+#define DISKIO_CACHE_READ_AHEAD_LINES CONFIG_DISKIO_CACHE_READ_AHEAD_LINES
+#else
+#define DISKIO_CACHE_READ_AHEAD_LINES 0
+#endif
 
 static char __in_section_unique(diskio.cache.stack) __aligned(STACK_ALIGN) diskio_cache_thread_stack[1152];
 
+/* protects cache lines and per disk state */
 OS_MUTEX_DEFINE(diskio_cache_mutex);
+/* serializes disk driver accesses, never taken before diskio_cache_mutex */
+OS_MUTEX_DEFINE(diskio_io_mutex);
 
 struct  diskio_cache_item {
 	u32_t cache_valid:1;
+	/* line is being loaded by the cache thread */
 	u32_t busy_flag:1;
 	u32_t write_valid:1;
 	u32_t err_flag:1;
-	u32_t disk_type:8;
+	/* loaded by read-ahead, not accessed yet */
+	u32_t prefetch:1;
+	/* invalidated while loading, drop when the load completes */
+	u32_t stale:1;
 	u32_t cache_sector;
+	u32_t access_stamp;
 	struct disk_info *disk;
-	u8_t  cache_data[DISKIO_CACHE_POOL_SIZE];
+	u8_t  cache_data[DISKIO_CACHE_POOL_SIZE] __aligned(4);
 };
 
 enum {
 	REQ_FLUSH,
 	REQ_LOAD,
+	REQ_PREFETCH,
 };
 
 
@@ -41,90 +68,280 @@ struct  diskio_cache_req {
 	struct disk_info *req_disk;
 	u8_t  req_type;
 	u32_t req_sector;
+	int req_ret;
 	os_sem req_sem;
 };
 
+struct  diskio_cache_disk_state {
+	struct disk_info *disk;
+	/* first sector of the line touched by the last cached read */
+	u32_t last_line;
+	u8_t prefetch_pending;
+	struct diskio_cache_stat stat;
+};
+
 struct  diskio_cache_context {
 	os_fifo cache_req_fifo;
 	u8_t terminal:1;
 	u8_t inited:1;
-	u8_t cache_index;
 	u32_t thread_id;
+	u32_t access_stamp;
+	struct  diskio_cache_disk_state disk_state[DISKIO_CACHE_MAX_DISK];
 	struct  diskio_cache_item cache_pool[DISKIO_CACHE_POOL_NUM];
 };
 
 struct  diskio_cache_context diskio_cache __in_section_unique(diskio.cache.pool);
 
-static struct  diskio_cache_item *_diskio_find_cache_item(struct disk_info *disk, DWORD sector, UINT count)
+static inline u32_t _diskio_line_sectors(struct disk_info *disk)
 {
-	struct  diskio_cache_item *cache_item = NULL;
-	u8_t cace_sector_cnt = DISKIO_CACHE_POOL_SIZE / disk->sector_size;
+	return DISKIO_CACHE_POOL_SIZE / disk->sector_size;
+}
 
-	for (int i = 0; i < DISKIO_CACHE_POOL_NUM; i++) {
-		if (diskio_cache.cache_pool[i].cache_sector <= sector
-			&& diskio_cache.cache_pool[i].disk == disk
-			&& diskio_cache.cache_pool[i].cache_sector + cace_sector_cnt >= sector + count
-			&& diskio_cache.cache_pool[i].cache_valid == 1){
-			cache_item = &diskio_cache.cache_pool[i];
+static inline u32_t _diskio_line_start(struct disk_info *disk, DWORD sector)
+{
+	return sector - sector % _diskio_line_sectors(disk);
+}
+
+/* sectors of the line on the disk, the last line of the volume is clipped */
+static inline u32_t _diskio_line_count(struct disk_info *disk, u32_t line_sector)
+{
+	u32_t cace_sector_cnt = _diskio_line_sectors(disk);
+
+	if (disk->sector_cnt
+		&& line_sector + cace_sector_cnt > disk->sector_offset + disk->sector_cnt) {
+		cace_sector_cnt = disk->sector_offset + disk->sector_cnt - line_sector;
+	}
+
+	return cace_sector_cnt;
+}
+
+static inline struct  diskio_cache_item *_diskio_cache_set(struct disk_info *disk, u32_t line_sector)
+{
+	u32_t set = (line_sector / _diskio_line_sectors(disk)) % DISKIO_CACHE_SETS;
+
+	return &diskio_cache.cache_pool[set * DISKIO_CACHE_WAYS];
+}
+
+static struct  diskio_cache_disk_state *_diskio_disk_state(struct disk_info *disk)
+{
+	struct  diskio_cache_disk_state *state = NULL;
+
+	for (int i = 0; i < DISKIO_CACHE_MAX_DISK; i++) {
+		if (diskio_cache.disk_state[i].disk == disk) {
+			return &diskio_cache.disk_state[i];
+		}
+		if (!state && !diskio_cache.disk_state[i].disk) {
+			state = &diskio_cache.disk_state[i];
+		}
+	}
+
+	if (state) {
+		memset(state, 0, sizeof(*state));
+		state->disk = disk;
+		state->last_line = (u32_t)-1;
+	}
+
+	return state;
+}
+
+/* find line, including lines still being loaded */
+static struct  diskio_cache_item *_diskio_find_line(struct disk_info *disk, u32_t line_sector)
+{
+	struct  diskio_cache_item *cache_item = _diskio_cache_set(disk, line_sector);
+
+	for (int i = 0; i < DISKIO_CACHE_WAYS; i++, cache_item++) {
+		if ((cache_item->cache_valid || cache_item->busy_flag)
+			&& cache_item->disk == disk
+			&& cache_item->cache_sector == line_sector) {
+			return cache_item;
 		}
 	}
 
-	return cache_item;
+	return NULL;
 }
 
-static void _diskio_cache_invalid(struct disk_info *disk, DWORD sector, UINT count)
+static struct  diskio_cache_item *_diskio_find_cache_item(struct disk_info *disk, u32_t line_sector)
+{
+	struct  diskio_cache_item *cache_item = _diskio_find_line(disk, line_sector);
+
+	if (cache_item && cache_item->cache_valid) {
+		cache_item->access_stamp = ++diskio_cache.access_stamp;
+		return cache_item;
+	}
+
+	return NULL;
+}
+
+static int _diskio_write_back(struct  diskio_cache_item *cache_item)
+{
+	struct disk_info *disk = cache_item->disk;
+	u32_t cace_sector_cnt = _diskio_line_count(disk, cache_item->cache_sector);
+	struct  diskio_cache_disk_state *state;
+	int ret;
+
+	os_mutex_lock(&diskio_io_mutex, OS_FOREVER);
+	ret = disk->op->write(disk, cache_item->cache_data, cache_item->cache_sector,
+				cace_sector_cnt);
+	os_mutex_unlock(&diskio_io_mutex);
+
+	if (ret) {
+		SYS_LOG_ERR("sector %d len %d\n", cache_item->cache_sector, cace_sector_cnt);
+		return ret;
+	}
+
+	cache_item->write_valid = 0;
+
+	state = _diskio_disk_state(disk);
+	if (state) {
+		state->stat.write_back++;
+	}
+
+	return 0;
+}
+
+/* must be called with diskio_cache_mutex held, a line failing write back is kept */
+static int _diskio_cache_invalid(struct disk_info *disk, DWORD sector, UINT count, bool drop)
 {
 	struct  diskio_cache_item *cache_item = NULL;
-	u8_t cace_sector_cnt = DISKIO_CACHE_POOL_SIZE / disk->sector_size;
+	u32_t cace_sector_cnt = _diskio_line_sectors(disk);
+	int ret = 0, err;
 
 	for (int i = 0; i < DISKIO_CACHE_POOL_NUM; i++) {
-		if (diskio_cache.cache_pool[i].cache_sector  +  cace_sector_cnt >= sector
-			&& diskio_cache.cache_pool[i].cache_sector < sector + count
-			&& diskio_cache.cache_pool[i].disk == disk
-			&& diskio_cache.cache_pool[i].cache_valid == 1){
-			cache_item = &diskio_cache.cache_pool[i];
-			if (cache_item->write_valid) {
-				if (cache_item->disk->op->write(cache_item->disk, cache_item->cache_data, cache_item->cache_sector,
-							cace_sector_cnt)) {
-					SYS_LOG_ERR("sector %d len %d\n", cache_item->cache_sector, cace_sector_cnt);
-				}
+		cache_item = &diskio_cache.cache_pool[i];
+		if (cache_item->disk != disk
+			|| cache_item->cache_sector + cace_sector_cnt <= sector
+			|| cache_item->cache_sector >= sector + count) {
+			continue;
+		}
+
+		if (cache_item->busy_flag) {
+			if (drop) {
+				cache_item->stale = 1;
 			}
+			continue;
+		}
+
+		if (!cache_item->cache_valid) {
+			continue;
+		}
+
+		if (cache_item->write_valid) {
+			err = _diskio_write_back(cache_item);
+			if (err) {
+				ret = err;
+				continue;
+			}
+		}
+
+		if (drop) {
 			cache_item->cache_valid = 0;
 			cache_item->write_valid = 0;
 		}
 	}
+
+	return ret;
 }
 
-static struct  diskio_cache_item *_diskio_new_cache_item(struct disk_info *disk, DWORD sector)
+/* must be called with diskio_cache_mutex held, *err is set when the victim failed write back */
+static struct  diskio_cache_item *_diskio_new_cache_item(struct disk_info *disk, u32_t line_sector,
+			int *err)
 {
-	struct  diskio_cache_item *cache_item = NULL;
-	u8_t cace_sector_cnt = DISKIO_CACHE_POOL_SIZE / disk->sector_size;
+	struct  diskio_cache_item *cache_item = _diskio_cache_set(disk, line_sector);
+	struct  diskio_cache_item *victim = NULL;
 
-	os_mutex_lock(&diskio_cache_mutex, OS_FOREVER);
-	cache_item = &diskio_cache.cache_pool[diskio_cache.cache_index++];
-	diskio_cache.cache_index = diskio_cache.cache_index % DISKIO_CACHE_POOL_NUM;
+	/* free way first, then least recently used */
+	for (int i = 0; i < DISKIO_CACHE_WAYS; i++, cache_item++) {
+		if (cache_item->busy_flag) {
+			continue;
+		}
+		if (!cache_item->cache_valid) {
+			victim = cache_item;
+			break;
+		}
+		if (!victim
+			|| (s32_t)(cache_item->access_stamp - victim->access_stamp) < 0) {
+			victim = cache_item;
+		}
+	}
 
-	if (cache_item->write_valid && cache_item->cache_valid) {
-		if (cache_item->disk->op->write(cache_item->disk, cache_item->cache_data, cache_item->cache_sector,
-					cace_sector_cnt)) {
-			SYS_LOG_ERR("sector %d len %d\n", cache_item->cache_sector, cace_sector_cnt);
+	if (!victim) {
+		return NULL;
+	}
+
+	if (victim->write_valid && victim->cache_valid) {
+		*err = _diskio_write_back(victim);
+		if (*err) {
+			return NULL;
 		}
+	}
+
+	victim->cache_valid = 0;
+	victim->cache_sector = line_sector;
+	victim->disk = disk;
+	victim->write_valid = 0;
+	victim->err_flag = 0;
+	victim->busy_flag = 0;
+	victim->prefetch = 0;
+	victim->stale = 0;
+	victim->access_stamp = ++diskio_cache.access_stamp;
+
+	return victim;
+}
+
+/*
+ * runs on the cache thread, the disk is read without holding diskio_cache_mutex,
+ * returns the error of writing back the evicted line, read errors stay in the line
+ */
+static int _diskio_load_line(struct disk_info *disk, u32_t line_sector, bool prefetch)
+{
+	struct  diskio_cache_item *cache_item;
+	u32_t cace_sector_cnt = _diskio_line_count(disk, line_sector);
+	int ret = 0;
 
+	os_mutex_lock(&diskio_cache_mutex, OS_FOREVER);
+
+	if (_diskio_find_line(disk, line_sector)) {
+		os_mutex_unlock(&diskio_cache_mutex);
+		return 0;
 	}
 
-	cache_item->cache_valid = 1;
-	cache_item->cache_sector = sector;
-	cache_item->disk = disk;
-	cache_item->write_valid = 0;
-	cache_item->err_flag = 0;
+	cache_item = _diskio_new_cache_item(disk, line_sector, &ret);
+	if (!cache_item) {
+		os_mutex_unlock(&diskio_cache_mutex);
+		return ret;
+	}
+
+	cache_item->busy_flag = 1;
+	os_mutex_unlock(&diskio_cache_mutex);
+
+	os_mutex_lock(&diskio_io_mutex, OS_FOREVER);
+	ret = disk->op->read(disk, cache_item->cache_data, line_sector, cace_sector_cnt);
+	os_mutex_unlock(&diskio_io_mutex);
+
+	os_mutex_lock(&diskio_cache_mutex, OS_FOREVER);
 	cache_item->busy_flag = 0;
+	if (cache_item->stale || (ret && prefetch)) {
+		/* a failed read-ahead is retried by the demand load */
+		cache_item->cache_valid = 0;
+	} else {
+		cache_item->cache_valid = 1;
+		cache_item->err_flag = ret ? 1 : 0;
+		cache_item->prefetch = prefetch;
+	}
+	cache_item->stale = 0;
 	os_mutex_unlock(&diskio_cache_mutex);
-	return cache_item;
+
+	return 0;
 }
 
 static int _diskio_load_to_cache_req(struct disk_info *disk, DWORD sector)
 {
 	struct  diskio_cache_req  *cache_req = mem_malloc(sizeof(struct  diskio_cache_req));
+	int ret;
+
+	if (!cache_req) {
+		return -ENOMEM;
+	}
 
 	os_sem_init(&cache_req->req_sem, 0, 1);
 
@@ -140,13 +357,69 @@ static int _diskio_load_to_cache_req(struct disk_info *disk, DWORD sector)
 		return -EAGAIN;
 	}
 
+	ret = cache_req->req_ret;
 	mem_free(cache_req);
-	return 0;
+	return ret;
+}
+
+/* must be called with diskio_cache_mutex held, request is freed by the cache thread */
+static void _diskio_prefetch_req(struct diskio_cache_disk_state *state, u32_t line_sector)
+{
+	struct  diskio_cache_req  *cache_req;
+
+	if (state->prefetch_pending >= DISKIO_CACHE_READ_AHEAD_LINES
+		|| _diskio_find_line(state->disk, line_sector)) {
+		return;
+	}
+
+	cache_req = mem_malloc(sizeof(struct  diskio_cache_req));
+	if (!cache_req) {
+		return;
+	}
+
+	cache_req->req_disk = state->disk;
+	cache_req->req_sector = line_sector;
+	cache_req->req_type = REQ_PREFETCH;
+
+	state->prefetch_pending++;
+	state->stat.prefetch++;
+
+	os_fifo_put(&diskio_cache.cache_req_fifo, cache_req);
+}
+
+/* must be called with diskio_cache_mutex held */
+static void _diskio_read_ahead(struct disk_info *disk, u32_t line_sector)
+{
+	struct  diskio_cache_disk_state *state = _diskio_disk_state(disk);
+	u32_t cace_sector_cnt = _diskio_line_sectors(disk);
+
+	if (!DISKIO_CACHE_READ_AHEAD_LINES || !state
+		|| state->last_line == line_sector) {
+		return;
+	}
+
+	if (state->last_line + cace_sector_cnt == line_sector) {
+		for (int i = 1; i <= DISKIO_CACHE_READ_AHEAD_LINES; i++) {
+			/* not past the end of the volume */
+			if (disk->sector_cnt && line_sector + i * cace_sector_cnt
+				>= disk->sector_offset + disk->sector_cnt) {
+				break;
+			}
+			_diskio_prefetch_req(state, line_sector + i * cace_sector_cnt);
+		}
+	}
+
+	state->last_line = line_sector;
 }
 
 static int _diskio_flush_cache_req(struct disk_info *disk)
 {
 	struct  diskio_cache_req  *cache_req = mem_malloc(sizeof(struct  diskio_cache_req));
+	int ret;
+
+	if (!cache_req) {
+		return -ENOMEM;
+	}
 
 	os_sem_init(&cache_req->req_sem, 0, 1);
 
@@ -161,104 +434,175 @@ static int _diskio_flush_cache_req(struct disk_info *disk)
 		return -EAGAIN;
 	}
 
+	ret = cache_req->req_ret;
 	mem_free(cache_req);
-	return 0;
+	return ret;
 }
 
-int diskio_cache_read(
-	struct disk_info *disk,
-	/* Physical drive nmuber to identify the drive */
-	BYTE pdrv,
-	BYTE *buff,		/* Data buffer to store read data */
-	DWORD sector,		/* Start sector in LBA */
-	UINT count		/* Number of sectors to read */)
+/* read or write sectors within one cache line */
+static int _diskio_cache_line_rw(struct disk_info *disk, BYTE *buff,
+			DWORD sector, UINT count, bool write)
 {
 	int ret = 0;
+	u32_t line_sector = _diskio_line_start(disk, sector);
+	u32_t cace_sector_cnt = _diskio_line_sectors(disk);
 	struct  diskio_cache_item *cache_item = NULL;
+	struct  diskio_cache_disk_state *state;
+	bool miss = false;
+
+try_to_access:
+	os_mutex_lock(&diskio_cache_mutex, OS_FOREVER);
 
-	if (!diskio_cache.inited
-			|| count * disk->sector_size > DISKIO_CACHE_POOL_SIZE) {
-		if (diskio_cache.inited) {
-			_diskio_cache_invalid(disk, sector, count);
+	state = _diskio_disk_state(disk);
+	cache_item = _diskio_find_cache_item(disk, line_sector);
+
+	/* whole line overwritten, no need to load it first */
+	if (!cache_item && write && count == cace_sector_cnt
+		&& !_diskio_find_line(disk, line_sector)) {
+		cache_item = _diskio_new_cache_item(disk, line_sector, &ret);
+		if (cache_item) {
+			cache_item->cache_valid = 1;
+		} else if (ret) {
+			os_mutex_unlock(&diskio_cache_mutex);
+			return ret;
 		}
-		return disk->op->read(disk, buff, sector, count);
 	}
 
-try_to_read:
-	os_mutex_lock(&diskio_cache_mutex, OS_FOREVER);
-	cache_item = _diskio_find_cache_item(disk, sector, count);
 	/**cache hit */
 	if (cache_item) {
-		cache_item->busy_flag = 1;
 		if (!cache_item->err_flag) {
-			memcpy(buff, cache_item->cache_data
-					+ (sector - cache_item->cache_sector) * disk->sector_size,
-					count * disk->sector_size);
+			if (write) {
+				memcpy(cache_item->cache_data
+						+ (sector - line_sector) * disk->sector_size,
+						buff, count * disk->sector_size);
+				cache_item->write_valid = 1;
+			} else {
+				memcpy(buff, cache_item->cache_data
+						+ (sector - line_sector) * disk->sector_size,
+						count * disk->sector_size);
+			}
 			ret = 0;
 		} else {
 			cache_item->cache_valid = 0;
 			ret = -EIO;
 		}
-		cache_item->busy_flag = 0;
+
+		if (state) {
+			if (write && miss) {
+				state->stat.write_miss++;
+			} else if (write) {
+				state->stat.write_hit++;
+			} else if (miss) {
+				state->stat.read_miss++;
+			} else {
+				state->stat.read_hit++;
+			}
+			if (cache_item->prefetch) {
+				state->stat.prefetch_hit++;
+				cache_item->prefetch = 0;
+			}
+		}
+
+		/* queued after the demand load so it never delays it */
+		if (!write) {
+			_diskio_read_ahead(disk, line_sector);
+		}
 	}
+
 	os_mutex_unlock(&diskio_cache_mutex);
+
 	/**cache miss */
 	if (!cache_item) {
-		_diskio_load_to_cache_req(disk, sector);
-		goto try_to_read;
+		ret = _diskio_load_to_cache_req(disk, line_sector);
+		if (ret) {
+			return ret;
+		}
+		miss = true;
+		goto try_to_access;
 	}
 
 	return ret;
 }
 
-int diskio_cache_write(
-	struct disk_info *disk,
-	/* Physical drive nmuber to identify the drive */
-	BYTE pdrv,
-	const BYTE *buff,	/* Data to be written */
-	DWORD sector,		/* Start sector in LBA */
-	UINT count		/* Number of sectors to write */)
+static int _diskio_cache_rw(struct disk_info *disk, BYTE *buff,
+			DWORD sector, UINT count, bool write)
 {
-	int ret = 0;
-	struct  diskio_cache_item *cache_item = NULL;
+	struct  diskio_cache_disk_state *state;
+	u32_t cace_sector_cnt = _diskio_line_sectors(disk);
+	u32_t n;
+	int ret;
 
-	if (!diskio_cache.inited
-			|| count * disk->sector_size > DISKIO_CACHE_POOL_SIZE) {
-		if (diskio_cache.inited) {
-			_diskio_cache_invalid(disk, sector, count);
+	/* large transfers go straight to the disk */
+	if (count > cace_sector_cnt) {
+		os_mutex_lock(&diskio_cache_mutex, OS_FOREVER);
+		ret = _diskio_cache_invalid(disk, sector, count, write);
+		state = _diskio_disk_state(disk);
+		if (state) {
+			state->stat.bypass++;
 		}
-		return disk->op->write(disk, buff, sector, count);
-	}
+		os_mutex_unlock(&diskio_cache_mutex);
 
-try_to_write:
-	os_mutex_lock(&diskio_cache_mutex, OS_FOREVER);
+		if (ret) {
+			return ret;
+		}
 
-	cache_item = _diskio_find_cache_item(disk, sector, count);
-	/**cache hit */
-	if (cache_item) {
-		cache_item->busy_flag = 1;
-		if (!cache_item->err_flag) {
-			memcpy(cache_item->cache_data
-					+ (sector - cache_item->cache_sector) * disk->sector_size,
-					buff, count * disk->sector_size);
-			cache_item->write_valid = 1;
-			ret = 0;
+		os_mutex_lock(&diskio_io_mutex, OS_FOREVER);
+		if (write) {
+			ret = disk->op->write(disk, buff, sector, count);
 		} else {
-			cache_item->cache_valid = 0;
-			ret = -EIO;
+			ret = disk->op->read(disk, buff, sector, count);
 		}
-		cache_item->busy_flag = 0;
+		os_mutex_unlock(&diskio_io_mutex);
+		return ret;
 	}
 
-	os_mutex_unlock(&diskio_cache_mutex);
+	while (count) {
+		n = cace_sector_cnt - (sector - _diskio_line_start(disk, sector));
+		if (n > count) {
+			n = count;
+		}
 
-	/**cache miss */
-	if (!cache_item) {
-		_diskio_load_to_cache_req(disk, sector);
-		goto try_to_write;
+		ret = _diskio_cache_line_rw(disk, buff, sector, n, write);
+		if (ret) {
+			return ret;
+		}
+
+		buff += n * disk->sector_size;
+		sector += n;
+		count -= n;
 	}
 
-	return ret;
+	return 0;
+}
+
+int diskio_cache_read(
+	struct disk_info *disk,
+	/* Physical drive nmuber to identify the drive */
+	BYTE pdrv,
+	BYTE *buff,		/* Data buffer to store read data */
+	DWORD sector,		/* Start sector in LBA */
+	UINT count		/* Number of sectors to read */)
+{
+	if (!diskio_cache.inited || disk->sector_size > DISKIO_CACHE_POOL_SIZE) {
+		return disk->op->read(disk, buff, sector, count);
+	}
+
+	return _diskio_cache_rw(disk, buff, sector, count, false);
+}
+
+int diskio_cache_write(
+	struct disk_info *disk,
+	/* Physical drive nmuber to identify the drive */
+	BYTE pdrv,
+	const BYTE *buff,	/* Data to be written */
+	DWORD sector,		/* Start sector in LBA */
+	UINT count		/* Number of sectors to write */)
+{
+	if (!diskio_cache.inited || disk->sector_size > DISKIO_CACHE_POOL_SIZE) {
+		return disk->op->write(disk, buff, sector, count);
+	}
+
+	return _diskio_cache_rw(disk, (BYTE *)buff, sector, count, true);
 }
 
 int diskio_cache_flush(struct disk_info *disk)
@@ -269,81 +613,130 @@ int diskio_cache_flush(struct disk_info *disk)
 int diskio_cache_invalid(struct disk_info *disk)
 {
 	struct  diskio_cache_item *cache_item = NULL;
+	struct  diskio_cache_disk_state *state;
+
 	os_mutex_lock(&diskio_cache_mutex, OS_FOREVER);
 	for (int i = 0; i < DISKIO_CACHE_POOL_NUM; i++) {
-		if (diskio_cache.cache_pool[i].disk == disk
-			&& diskio_cache.cache_pool[i].cache_valid == 1) {
-			cache_item = &diskio_cache.cache_pool[i];
-			cache_item->cache_valid = 0;
-			cache_item->write_valid = 0;
+		cache_item = &diskio_cache.cache_pool[i];
+		if (cache_item->disk != disk) {
+			continue;
 		}
+		if (cache_item->busy_flag) {
+			cache_item->stale = 1;
+		}
+		cache_item->cache_valid = 0;
+		cache_item->write_valid = 0;
+	}
+
+	state = _diskio_disk_state(disk);
+	if (state) {
+		state->last_line = (u32_t)-1;
 	}
 	os_mutex_unlock(&diskio_cache_mutex);
 	return 0;
 }
 
+int diskio_cache_get_stat(struct disk_info *disk, struct diskio_cache_stat *stat)
+{
+	struct  diskio_cache_disk_state *state;
+
+	if (!diskio_cache.inited) {
+		return -ENODEV;
+	}
+
+	os_mutex_lock(&diskio_cache_mutex, OS_FOREVER);
+	state = _diskio_disk_state(disk);
+	if (state) {
+		memcpy(stat, &state->stat, sizeof(*stat));
+	}
+	os_mutex_unlock(&diskio_cache_mutex);
+
+	return state ? 0 : -ENOMEM;
+}
+
+void diskio_cache_dump(void)
+{
+	struct  diskio_cache_disk_state *state;
+
+	printk("diskio cache %d sets x %d ways x %d bytes\n",
+		DISKIO_CACHE_SETS, DISKIO_CACHE_WAYS, DISKIO_CACHE_POOL_SIZE);
+
+	os_mutex_lock(&diskio_cache_mutex, OS_FOREVER);
+	for (int i = 0; i < DISKIO_CACHE_MAX_DISK; i++) {
+		state = &diskio_cache.disk_state[i];
+		if (!state->disk) {
+			continue;
+		}
+		printk("%s: read hit %u miss %u, write hit %u miss %u, bypass %u\n",
+			state->disk->name, state->stat.read_hit, state->stat.read_miss,
+			state->stat.write_hit, state->stat.write_miss, state->stat.bypass);
+		printk("%s: read ahead %u hit %u, write back %u\n",
+			state->disk->name, state->stat.prefetch, state->stat.prefetch_hit,
+			state->stat.write_back);
+	}
+	os_mutex_unlock(&diskio_cache_mutex);
+}
+
 static void _diskio_cache_thread_loop(void *p1, void *p2, void *p3)
 {
-	int ret = 0;
 	struct  diskio_cache_context *diskio_cache_ctx = (struct  diskio_cache_context *)p1;
 
 	while (!diskio_cache_ctx->terminal) {
 		struct  diskio_cache_req  *cache_req = NULL;
 		struct  diskio_cache_item *cache_item  = NULL;
-		struct disk_info *disk = NULL;
+		struct  diskio_cache_disk_state *state;
+		int ret;
 
 		cache_req = os_fifo_get(&diskio_cache.cache_req_fifo, OS_FOREVER);
 		if (!cache_req) {
 			continue;
 		}
-		os_mutex_lock(&diskio_cache_mutex, OS_FOREVER);
+
 		switch (cache_req->req_type) {
 		case REQ_LOAD:
-		{
-			cache_item = _diskio_new_cache_item(cache_req->req_disk, cache_req->req_sector);
-			disk = cache_req->req_disk;
-			if (cache_item) {
-				ret = disk->op->read(disk, cache_item->cache_data, cache_req->req_sector,
-									 DISKIO_CACHE_POOL_SIZE / disk->sector_size);
-				if (ret) {
-					cache_item->err_flag = 1;
-				}
-				cache_item->cache_valid = 1;
-			}
-
+			cache_req->req_ret = _diskio_load_line(cache_req->req_disk,
+						cache_req->req_sector, false);
 			break;
-		}
-		case REQ_FLUSH:
-		{
-			for (int i = 0; i < DISKIO_CACHE_POOL_NUM; i++) {
-				if (diskio_cache.cache_pool[i].disk == cache_req->req_disk
-					&& diskio_cache.cache_pool[i].cache_valid == 1
-					&& diskio_cache.cache_pool[i].write_valid == 1) {
 
-					cache_item = &diskio_cache.cache_pool[i];
-					disk = cache_req->req_disk;
+		case REQ_PREFETCH:
+			_diskio_load_line(cache_req->req_disk, cache_req->req_sector, true);
+
+			os_mutex_lock(&diskio_cache_mutex, OS_FOREVER);
+			state = _diskio_disk_state(cache_req->req_disk);
+			if (state && state->prefetch_pending) {
+				state->prefetch_pending--;
+			}
+			os_mutex_unlock(&diskio_cache_mutex);
 
-					ret = disk->op->write(disk, cache_item->cache_data,
-								cache_item->cache_sector,
-								DISKIO_CACHE_POOL_SIZE / disk->sector_size);
+			/* nobody waits for read-ahead */
+			mem_free(cache_req);
+			continue;
 
-					if (ret) {
-						SYS_LOG_ERR("sector %d len %d\n", cache_item->cache_sector, DISKIO_CACHE_POOL_SIZE);
-					} else {
-						cache_item->write_valid = 0;
+		case REQ_FLUSH:
+			cache_req->req_ret = 0;
+			os_mutex_lock(&diskio_cache_mutex, OS_FOREVER);
+			for (int i = 0; i < DISKIO_CACHE_POOL_NUM; i++) {
+				cache_item = &diskio_cache.cache_pool[i];
+				if (cache_item->disk == cache_req->req_disk
+					&& cache_item->cache_valid == 1
+					&& cache_item->write_valid == 1) {
+					ret = _diskio_write_back(cache_item);
+					if (ret && !cache_req->req_ret) {
+						cache_req->req_ret = ret;
 					}
 				}
 			}
-
+			os_mutex_unlock(&diskio_cache_mutex);
 			break;
-		}
+
 		default:
 			break;
 		}
-		os_mutex_unlock(&diskio_cache_mutex);
+
 		os_sem_give(&cache_req->req_sem);
 	}
 }
+
 int diskio_cache_init(struct device *unused)
 {
 	ARG_UNUSED(unused);
@@ -351,7 +744,7 @@ int diskio_cache_init(struct device *unused)
 	memset(&diskio_cache, 0, sizeof(struct diskio_cache_context));
 
 	os_fifo_init(&diskio_cache.cache_req_fifo);
-	
+
 	diskio_cache.thread_id = os_thread_create(diskio_cache_thread_stack,
 											sizeof(diskio_cache_thread_stack),
 											_diskio_cache_thread_loop,
@@ -370,5 +763,3 @@ int diskio_cache_deinit(void)
 }
 
 SYS_INIT(diskio_cache_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
-
-
@@ -51,6 +51,25 @@ int diskio_cache_write(
 
 int diskio_cache_flush(struct disk_info *disk);
 int diskio_cache_invalid(struct disk_info *disk);
+
+/** per disk counters of the disk io cache */
+struct diskio_cache_stat {
+	u32_t read_hit;
+	u32_t read_miss;
+	u32_t write_hit;
+	u32_t write_miss;
+	/** transfers larger than a cache line, sent to the disk directly */
+	u32_t bypass;
+	/** read-ahead lines queued */
+	u32_t prefetch;
+	/** read-ahead lines later accessed */
+	u32_t prefetch_hit;
+	/** dirty lines written to the disk */
+	u32_t write_back;
+};
+
+int diskio_cache_get_stat(struct disk_info *disk, struct diskio_cache_stat *stat);
+void diskio_cache_dump(void);
 /* Disk Status Bits (DSTATUS) */
 
 #define STA_NOINIT		0x01	/* Drive not initialized */
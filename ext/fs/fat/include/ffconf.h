@@ -43,7 +43,11 @@
 /* This option switches f_mkfs() function. (0:Disable or 1:Enable) */
 
 
+#ifdef CONFIG_FAT_FILESYSTEM_FASTSEEK
+#define	_USE_FASTSEEK	1
+#else
 #define	_USE_FASTSEEK	0
+#endif
 /* This option switches fast seek function. (0:Disable or 1:Enable) */
 
 
@@ -51,7 +55,11 @@
 /* This option switches f_expand function. (0:Disable or 1:Enable) */
 
 
+#ifdef CONFIG_FAT_FILESYSTEM_CHMOD
+#define _USE_CHMOD		1
+#else
 #define _USE_CHMOD		0
+#endif
 /* This option switches attribute manipulation functions, f_chmod() and f_utime().
 /  (0:Disable or 1:Enable) Also _FS_READONLY needs to be 0 to enable this option. */
 
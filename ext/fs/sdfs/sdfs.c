@@ -11,11 +11,86 @@
 #include <ctype.h>
 
 
+#if CONFIG_SD_FS_DIR_CACHE_NUM > 0
+/* recently opened entries, replaced round robin */
+static struct sd_dir sd_dir_cache[CONFIG_SD_FS_DIR_CACHE_NUM];
+static u8_t sd_dir_cache_next;
+
+static struct sd_dir * sd_dir_cache_find(const char *filename, void *buf_size_32)
+{
+	struct sd_dir *sd_dir = NULL;
+	unsigned int key;
+	int i;
+
+	key = irq_lock();
+	for (i = 0; i < CONFIG_SD_FS_DIR_CACHE_NUM; i++) {
+		if (sd_dir_cache[i].fname[0]
+			&& strncasecmp(filename, (const char *)sd_dir_cache[i].fname, 12) == 0) {
+			memcpy(buf_size_32, &sd_dir_cache[i], sizeof(*sd_dir));
+			sd_dir = buf_size_32;
+			break;
+		}
+	}
+	irq_unlock(key);
+
+	return sd_dir;
+}
+
+static void sd_dir_cache_add(struct sd_dir *sd_dir)
+{
+	unsigned int key;
+
+	key = irq_lock();
+	memcpy(&sd_dir_cache[sd_dir_cache_next], sd_dir, sizeof(*sd_dir));
+	sd_dir_cache_next = (sd_dir_cache_next + 1) % CONFIG_SD_FS_DIR_CACHE_NUM;
+	irq_unlock(key);
+}
+#endif
+
+/* first entry not less than filename, entries are sorted by build_sdfs.py */
+static struct sd_dir * sd_search_dir(const char *filename, void *buf_size_32, int total)
+{
+	struct sd_dir *sd_dir = buf_size_32;
+	int low = 0, high = total - 1, mid = 0;
+	int found = -1;
+	int cmp;
+
+	while (low <= high)
+	{
+		mid = (low + high) / 2;
+		memcpy_flash_data(buf_size_32,
+			(void *)(CONFIG_SD_FS_VADDR_START + (mid + 1) * sizeof(*sd_dir)), sizeof(*sd_dir));
+
+		cmp = strncasecmp(filename, (const char *)sd_dir->fname, 12);
+		if (cmp > 0) {
+			low = mid + 1;
+		} else {
+			if (cmp == 0)
+				found = mid;
+			high = mid - 1;
+		}
+	}
+
+	if (found < 0)
+		return NULL;
+
+	if (found != mid)
+		memcpy_flash_data(buf_size_32,
+			(void *)(CONFIG_SD_FS_VADDR_START + (found + 1) * sizeof(*sd_dir)), sizeof(*sd_dir));
+
+	return sd_dir;
+}
+
 static struct sd_dir * sd_find_dir(const char *filename, void *buf_size_32)
 {
 	int num, total, offset;
 	struct sd_dir *sd_dir = buf_size_32;
 
+#if CONFIG_SD_FS_DIR_CACHE_NUM > 0
+	if (sd_dir_cache_find(filename, buf_size_32))
+		return sd_dir;
+#endif
+
 	memcpy_flash_data(buf_size_32, (void *)CONFIG_SD_FS_VADDR_START, sizeof(*sd_dir));
 
 	//printk("sd_dir->fname %s CONFIG_SD_FS_START 0x%x \n",sd_dir->fname,CONFIG_SD_FS_VADDR_START);
@@ -25,18 +100,31 @@ static struct sd_dir * sd_find_dir(const char *filename, void *buf_size_32)
 	}
 	total = sd_dir->offset;
 
+	if (sd_dir->reserved[0] == SDFS_DIR_SORTED_MAGIC)
+	{
+		sd_dir = sd_search_dir(filename, buf_size_32, total);
+		goto exit;
+	}
+
+	/* images built without a sorted directory */
 	for(offset = CONFIG_SD_FS_VADDR_START + sizeof(*sd_dir), num = 0; num < total; offset += 32)
 	{
 		memcpy_flash_data(buf_size_32, (void *)offset, 32);
 
 		if(strncasecmp(filename, sd_dir->fname, 12) == 0)
 		{
-			return sd_dir;
+			goto exit;
 		}
 		num++;
 	}
-
-	return NULL;
+	sd_dir = NULL;
+
+exit:
+#if CONFIG_SD_FS_DIR_CACHE_NUM > 0
+	if (sd_dir)
+		sd_dir_cache_add(sd_dir);
+#endif
+	return sd_dir;
 }
 
 struct sd_file * sd_fopen (const char *filename)
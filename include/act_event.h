@@ -66,6 +66,15 @@ extern int act_event_data_clear(void);
 
 extern int act_event_syslog_transfer(int log_type, int (*traverse_cb)(uint8_t *data, uint32_t max_len));
 
+#ifdef CONFIG_ACT_EVENT_PACKED_LOG
+/* log time in ms, power on time counted over reboots */
+extern uint32_t act_event_get_time(void);
+
+/* lines of the events logged in [from, to] of log time, module_name NULL for all */
+extern int act_event_syslog_query(int log_type, uint32_t from, uint32_t to, const char *module_name,
+		int (*traverse_cb)(uint8_t *data, uint32_t max_len));
+#endif
+
 #define ACT_EVENT_SEND2(pack_data, ...) act_event_data_send(pack_data, ##__VA_ARGS__)
 
 #define ACT_EVENT_PACK_ARGS_DATA(id, level, _event, ...) ACTEVENT_PACK(id, level, _event, (FUN_ARG_EVT_NUM_INTEGER(FUN_ARG_EVT_NUM(__VA_ARGS__))))
@@ -28,6 +28,74 @@ unsigned int cpuload_debug_log_mask_or(unsigned int log_mask);
 void thread_block_stat_start(int prio, int block_ms);
 void thread_block_stat_stop(void);
 
+#ifdef CONFIG_CPU_LOAD_PROFILE
+
+/* ready latency histogram bucket i counts latencies below (64us << i),
+ * the last bucket counts everything longer, CPULOAD_PROFILE_HIST_NUM
+ * buckets (kernel.h)
+ */
+#define CPULOAD_PROFILE_HIST_BASE_US	64
+
+/* record types */
+#define CPULOAD_RECORD_THREAD		1
+#define CPULOAD_RECORD_IRQ		2
+#define CPULOAD_RECORD_EVENT		3
+
+/* event ids of CPULOAD_RECORD_EVENT */
+#define CPULOAD_EVENT_PCM_EMPTY		1
+
+/* profile marks */
+#define CPULOAD_MARK_AUDIO_REFILL	0
+#define CPULOAD_MARK_NUM		1
+
+/**
+ * binary profile record, little endian, streamed as is to the pc tool
+ *
+ * THREAD: id = prio, addr = thread, run_us, max1_us = max ready latency,
+ *         max2_us = max blocked interval, cnt1 = switch in, cnt2 = preempted
+ * IRQ:    id = irq number, addr = isr, run_us, max1_us = max isr time,
+ *         cnt1 = irq count
+ * EVENT:  id = event, addr = thread which ran longest since the last mark,
+ *         run_us = its run time, max1_us = interval of the last mark,
+ *         max2_us = max mark interval, cnt1 = event param
+ */
+struct cpuload_profile_record {
+	u8_t type;
+	u8_t reserved;
+	s16_t id;
+	u32_t timestamp;
+	u32_t addr;
+	u32_t run_us;
+	u32_t max1_us;
+	u32_t max2_us;
+	u16_t cnt1;
+	u16_t cnt2;
+	u16_t hist[CPULOAD_PROFILE_HIST_NUM];
+};
+
+void cpuload_profile_start(void);
+void cpuload_profile_stop(void);
+
+/* push one THREAD record per thread and one IRQ record per used vector */
+void cpuload_profile_snapshot(void);
+
+/* print the counters since start, reset them if clear is set */
+void cpuload_profile_dump(bool clear);
+
+/* copy whole records out of the ring, return the number of bytes */
+int cpuload_profile_read(void *buf, int size);
+
+/* mark a periodic deadline, such as a dma refill irq */
+void cpuload_profile_mark(int mark);
+
+/* record an event with the thread which ran longest since the last mark */
+void cpuload_profile_event(int event, int mark, u32_t param);
+
+void _sys_cpuload_profile_ready(struct k_thread *thread);
+void _sys_cpuload_profile_switch(struct k_thread *from, struct k_thread *to, u32_t curr_time);
+
+#endif /* CONFIG_CPU_LOAD_PROFILE */
+
 
 /**
  * @}
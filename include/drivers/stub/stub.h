@@ -99,6 +99,7 @@ typedef enum
     STUB_PC_TOOL_WAVES_ASET_MODE = 7,
     STUB_PC_TOOL_SERIAL_MONITOR = 8,
     STUB_PC_TOOL_DUMP_MODE = 0x0d,
+    STUB_PC_TOOL_PROFILE_MODE = 0x0e,
     STUB_PC_TOOL_BTT_MODE = 0x42,
     STUB_PC_TOOL_COMMON_DAE_MODE = 0x80,
 } PC_stub_mode_e;
@@ -389,8 +389,51 @@ int fs_map(const char *file_name, void** addr);
 
 int fs_opendir_cluster(fs_dir_t *zdp, const char *path, unsigned int cluster, unsigned int blk_ofs);
 
+#ifdef CONFIG_FAT_FILESYSTEM_CHMOD
+/**
+ * @brief Change the attributes of a file or directory
+ *
+ * @param path Path to the file or directory
+ * @param attr FAT attribute bits to set (AM_RDO, AM_HID, AM_SYS, AM_ARC)
+ * @param mask Attribute bits to change
+ *
+ * @retval 0 Success
+ * @retval -ERRNO errno code if error
+ */
+int fs_chmod(const char *path, u8_t attr, u8_t mask);
+#endif
+
 int fs_open_cluster(fs_file_t *zfp, char *dir, u32_t cluster, u32_t blk_ofs);
 
+#ifdef CONFIG_FAT_FILESYSTEM_FASTSEEK
+/**
+ * @brief Enable fast seek
+ *
+ * Builds the cluster link map of an open file into tbl, later seeks
+ * and reads look clusters up in it instead of following the FAT chain.
+ * The file must not be extended while fast seek is enabled, and tbl
+ * must stay valid until fs_fastseek_disable() or fs_close().
+ *
+ * @param zfp Pointer to the file object
+ * @param tbl Link map buffer
+ * @param tbl_size Number of u32_t items of tbl
+ *
+ * @retval 0 Success
+ * @retval -ENOMEM tbl too small, tbl[0] holds the required size
+ * @retval -ERRNO errno code if error
+ */
+int fs_fastseek_enable(fs_file_t *zfp, u32_t *tbl, u32_t tbl_size);
+
+/**
+ * @brief Disable fast seek
+ *
+ * @param zfp Pointer to the file object
+ *
+ * @retval 0 Success
+ */
+int fs_fastseek_disable(fs_file_t *zfp);
+#endif
+
 /**
  * @}
  */
@@ -213,6 +213,31 @@ struct _thread_stack_info {
 typedef struct _thread_stack_info _thread_stack_info_t;
 #endif /* CONFIG_THREAD_STACK_INFO */
 
+#ifdef CONFIG_THREAD_TIMER_WHEEL
+/* 4 levels of 8 slots: 1 ms, 8 ms, 64 ms and 512 ms resolution */
+#define _THREAD_TIMER_WHEEL_LEVELS	4
+#define _THREAD_TIMER_WHEEL_BITS	3
+#define _THREAD_TIMER_WHEEL_SLOTS	(1 << _THREAD_TIMER_WHEEL_BITS)
+
+struct thread_timer;
+
+/* per thread timer wheel, timers beyond the last level wait in overflow */
+struct _thread_timer_wheel {
+	/* time of the level 0 slot being processed */
+	u32_t cur;
+	u16_t count;
+	/* non-empty slot bitmap of each level */
+	u8_t pending[_THREAD_TIMER_WHEEL_LEVELS];
+	struct thread_timer *slot[_THREAD_TIMER_WHEEL_LEVELS][_THREAD_TIMER_WHEEL_SLOTS];
+	struct thread_timer *overflow;
+};
+#endif
+
+#ifdef CONFIG_CPU_LOAD_PROFILE
+/* ready latency histogram buckets, see cpuload_stat.h */
+#define CPULOAD_PROFILE_HIST_NUM	8
+#endif
+
 struct k_thread {
 
 	struct _thread_base base;
@@ -259,7 +284,21 @@ struct k_thread {
     u32_t last_time;
 #endif
 
-#ifdef CONFIG_THREAD_TIMER
+#ifdef CONFIG_CPU_LOAD_PROFILE
+	/* scheduler profile, see cpuload_stat.h */
+	u64_t run_cycles;
+	u32_t ready_stamp;
+	u32_t block_stamp;
+	u32_t max_ready_cycles;
+	u32_t max_block_cycles;
+	u16_t switch_cnt;
+	u16_t preempt_cnt;
+	u16_t ready_hist[CPULOAD_PROFILE_HIST_NUM];
+#endif
+
+#ifdef CONFIG_THREAD_TIMER_WHEEL
+	struct _thread_timer_wheel thread_timer_wheel;
+#elif defined(CONFIG_THREAD_TIMER)
 	sys_dlist_t thread_timer_q;
 #endif
 	/* arch-specifics: must always be at the end */
@@ -42,6 +42,9 @@ struct sd_dir
 	unsigned int reserved[2];
 	unsigned int checksum;
 };
+
+/* reserved[0] of the image head, entries sorted by case insensitive name */
+#define SDFS_DIR_SORTED_MAGIC	0x54524f53	/* "SORT" */
 #ifdef CONFIG_MEMORY
 #define sd_alloc mem_malloc
 #define sd_free mem_free
@@ -36,7 +36,13 @@ struct thread_timer;
 typedef void (*thread_timer_expiry_t)(struct thread_timer *ttimer, void *expiry_fn_arg);
 
 struct thread_timer {
+#ifdef CONFIG_THREAD_TIMER_WHEEL
+	struct thread_timer *next;
+	/* link pointing at this timer, NULL if not running */
+	struct thread_timer **pprev;
+#else
 	sys_dlist_t node;
+#endif
 	s32_t duration;
 	s32_t period;
 	u32_t expiry_time;
@@ -0,0 +1,412 @@
+/*
+ * Copyright (c) 2017 Actions Semiconductor Co., Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief cpu load scheduler profile
+ *
+ * Per thread run time, ready-to-run latency histogram, preemption count and
+ * worst blocked interval, collected from the context switch and ready queue
+ * hooks. Snapshots and events are pushed to a ring of binary records which
+ * the pc tool drains.
+ */
+
+#include <kernel.h>
+#include <kernel_structs.h>
+#include <misc/printk.h>
+#include <ksched.h>
+#include <string.h>
+#include <sw_isr_table.h>
+#include <cpuload_stat.h>
+
+#define RUNNING_CYCLES(end, start)	((uint32_t)((long)(end) - (long)(start)))
+#define CYCLES_TO_US(cycles)		SYS_CLOCK_HW_CYCLES_TO_NS_AVG(cycles, 1000)
+
+struct profile_mark {
+	/* start of the current window */
+	u32_t stamp;
+	u32_t last_interval;
+	u32_t max_interval;
+	/* longest single run in the current and in the last closed window */
+	struct k_thread *hog;
+	u32_t hog_cycles;
+	struct k_thread *last_hog;
+	u32_t last_hog_cycles;
+};
+
+static int profile_started;
+static u32_t profile_start_ms;
+/* start of the current thread run */
+static u32_t profile_switch_stamp;
+static u32_t profile_hist_base_cycles;
+
+static struct profile_mark profile_marks[CPULOAD_MARK_NUM];
+
+static struct cpuload_profile_record profile_records[CONFIG_CPU_LOAD_PROFILE_RECORD_NUM];
+static u16_t profile_rec_head;
+static u16_t profile_rec_count;
+static u32_t profile_rec_dropped;
+
+/* 0 means no pending stamp */
+static inline u32_t profile_stamp(u32_t cycles)
+{
+	return cycles ? cycles : 1;
+}
+
+static void profile_push(struct cpuload_profile_record *rec)
+{
+	unsigned int key;
+	int index;
+
+	key = irq_lock();
+
+	index = profile_rec_head + profile_rec_count;
+	if (index >= CONFIG_CPU_LOAD_PROFILE_RECORD_NUM)
+		index -= CONFIG_CPU_LOAD_PROFILE_RECORD_NUM;
+
+	if (profile_rec_count == CONFIG_CPU_LOAD_PROFILE_RECORD_NUM) {
+		/* overwrite the oldest record */
+		if (++profile_rec_head == CONFIG_CPU_LOAD_PROFILE_RECORD_NUM)
+			profile_rec_head = 0;
+		profile_rec_dropped++;
+	} else {
+		profile_rec_count++;
+	}
+
+	memcpy(&profile_records[index], rec, sizeof(*rec));
+
+	irq_unlock(key);
+}
+
+int cpuload_profile_read(void *buf, int size)
+{
+	unsigned int key;
+	int len = 0;
+
+	key = irq_lock();
+
+	while (profile_rec_count && (size - len) >= sizeof(struct cpuload_profile_record)) {
+		memcpy((u8_t *)buf + len, &profile_records[profile_rec_head],
+		       sizeof(struct cpuload_profile_record));
+		len += sizeof(struct cpuload_profile_record);
+
+		if (++profile_rec_head == CONFIG_CPU_LOAD_PROFILE_RECORD_NUM)
+			profile_rec_head = 0;
+		profile_rec_count--;
+	}
+
+	irq_unlock(key);
+
+	return len;
+}
+
+static void profile_track_run(struct k_thread *thread, u32_t curr_time)
+{
+	struct profile_mark *pm;
+	u32_t start, cycles;
+	int i;
+
+	/* idle is never the one who starves others */
+	if (thread->base.prio >= K_LOWEST_THREAD_PRIO)
+		return;
+
+	for (i = 0; i < CPULOAD_MARK_NUM; i++) {
+		pm = &profile_marks[i];
+
+		start = profile_switch_stamp;
+		if ((s32_t)(pm->stamp - start) > 0)
+			start = pm->stamp;
+
+		cycles = RUNNING_CYCLES(curr_time, start);
+		if (cycles > pm->hog_cycles) {
+			pm->hog = thread;
+			pm->hog_cycles = cycles;
+		}
+	}
+}
+
+__ramfunc void _sys_cpuload_profile_ready(struct k_thread *thread)
+{
+	u32_t curr_time, cycles;
+
+	if (!profile_started || thread == _current || thread->ready_stamp)
+		return;
+
+	curr_time = k_cycle_get_32();
+	thread->ready_stamp = profile_stamp(curr_time);
+
+	if (thread->block_stamp) {
+		cycles = RUNNING_CYCLES(curr_time, thread->block_stamp);
+		if (cycles > thread->max_block_cycles)
+			thread->max_block_cycles = cycles;
+		thread->block_stamp = 0;
+	}
+}
+
+__ramfunc void _sys_cpuload_profile_switch(struct k_thread *from, struct k_thread *to, u32_t curr_time)
+{
+	u32_t cycles, limit;
+	int i;
+
+	if (!profile_started)
+		return;
+
+	from->run_cycles += RUNNING_CYCLES(curr_time, profile_switch_stamp);
+	profile_track_run(from, curr_time);
+	profile_switch_stamp = curr_time;
+
+	if (_is_thread_ready(from)) {
+		/* preempted or yielded, it waits in the ready queue from now */
+		from->preempt_cnt++;
+		from->ready_stamp = profile_stamp(curr_time);
+	} else {
+		from->block_stamp = profile_stamp(curr_time);
+		from->ready_stamp = 0;
+	}
+
+	to->switch_cnt++;
+
+	if (to->block_stamp) {
+		/* made ready without passing the ready queue hook */
+		cycles = RUNNING_CYCLES(curr_time, to->block_stamp);
+		if (cycles > to->max_block_cycles)
+			to->max_block_cycles = cycles;
+		to->block_stamp = 0;
+	}
+
+	if (to->ready_stamp) {
+		cycles = RUNNING_CYCLES(curr_time, to->ready_stamp);
+		if (cycles > to->max_ready_cycles)
+			to->max_ready_cycles = cycles;
+
+		limit = profile_hist_base_cycles;
+		for (i = 0; i < CPULOAD_PROFILE_HIST_NUM - 1; i++) {
+			if (cycles < limit)
+				break;
+			limit <<= 1;
+		}
+		if (to->ready_hist[i] != 0xffff)
+			to->ready_hist[i]++;
+
+		to->ready_stamp = 0;
+	}
+}
+
+void cpuload_profile_mark(int mark)
+{
+	struct profile_mark *pm;
+	unsigned int key;
+	u32_t curr_time;
+
+	if (!profile_started || mark >= CPULOAD_MARK_NUM)
+		return;
+
+	pm = &profile_marks[mark];
+
+	key = irq_lock();
+
+	curr_time = k_cycle_get_32();
+
+	/* count the interrupted run up to now in the closing window */
+	profile_track_run(_current, curr_time);
+
+	if (pm->stamp) {
+		pm->last_interval = RUNNING_CYCLES(curr_time, pm->stamp);
+		if (pm->last_interval > pm->max_interval)
+			pm->max_interval = pm->last_interval;
+	}
+
+	pm->last_hog = pm->hog;
+	pm->last_hog_cycles = pm->hog_cycles;
+	pm->hog = NULL;
+	pm->hog_cycles = 0;
+	pm->stamp = profile_stamp(curr_time);
+
+	irq_unlock(key);
+}
+
+void cpuload_profile_event(int event, int mark, u32_t param)
+{
+	struct cpuload_profile_record rec;
+	struct profile_mark *pm;
+	unsigned int key;
+
+	if (!profile_started || mark >= CPULOAD_MARK_NUM)
+		return;
+
+	pm = &profile_marks[mark];
+
+	memset(&rec, 0, sizeof(rec));
+	rec.type = CPULOAD_RECORD_EVENT;
+	rec.id = event;
+	rec.timestamp = k_uptime_get_32();
+
+	key = irq_lock();
+	rec.addr = (u32_t)pm->last_hog;
+	rec.run_us = CYCLES_TO_US(pm->last_hog_cycles);
+	rec.max1_us = CYCLES_TO_US(pm->last_interval);
+	rec.max2_us = CYCLES_TO_US(pm->max_interval);
+	if (pm->last_hog)
+		rec.cnt2 = (u16_t)pm->last_hog->base.prio;
+	irq_unlock(key);
+
+	rec.cnt1 = (u16_t)param;
+
+	profile_push(&rec);
+}
+
+static void profile_fill_thread(struct cpuload_profile_record *rec, struct k_thread *thread)
+{
+	u64_t run_cycles;
+
+	memset(rec, 0, sizeof(*rec));
+	rec->type = CPULOAD_RECORD_THREAD;
+	rec->id = thread->base.prio;
+	rec->addr = (u32_t)thread;
+
+	run_cycles = thread->run_cycles;
+	if (thread == _current)
+		run_cycles += RUNNING_CYCLES(k_cycle_get_32(), profile_switch_stamp);
+
+	rec->run_us = (u32_t)(SYS_CLOCK_HW_CYCLES_TO_NS64(run_cycles) / 1000);
+	rec->max1_us = CYCLES_TO_US(thread->max_ready_cycles);
+	rec->max2_us = CYCLES_TO_US(thread->max_block_cycles);
+	rec->cnt1 = thread->switch_cnt;
+	rec->cnt2 = thread->preempt_cnt;
+	memcpy(rec->hist, thread->ready_hist, sizeof(rec->hist));
+}
+
+void cpuload_profile_snapshot(void)
+{
+	struct cpuload_profile_record rec;
+	struct k_thread *thread;
+	unsigned int key;
+	u32_t timestamp = k_uptime_get_32();
+
+	key = irq_lock();
+
+	thread = (struct k_thread *)(_kernel.threads);
+	while (thread != NULL) {
+		profile_fill_thread(&rec, thread);
+		rec.timestamp = timestamp;
+		irq_unlock(key);
+
+		profile_push(&rec);
+
+		key = irq_lock();
+		thread = (struct k_thread *)thread->next_thread;
+	}
+
+	irq_unlock(key);
+
+#ifdef CONFIG_IRQ_STAT
+	for (int i = 0; i < IRQ_TABLE_SIZE; i++) {
+		struct _isr_table_entry *ite = &_sw_isr_table[i];
+
+		if (ite->isr == _irq_spurious || !ite->irq_cnt)
+			continue;
+
+		memset(&rec, 0, sizeof(rec));
+		rec.type = CPULOAD_RECORD_IRQ;
+		rec.id = i;
+		rec.timestamp = timestamp;
+		rec.addr = (u32_t)ite->isr;
+		rec.run_us = ite->irq_total_us;
+		rec.max1_us = CYCLES_TO_US(ite->max_irq_cycles);
+		rec.cnt1 = (u16_t)ite->irq_cnt;
+
+		profile_push(&rec);
+	}
+#endif
+}
+
+static void cpuload_profile_clear(void)
+{
+	struct k_thread *thread;
+	unsigned int key;
+
+	key = irq_lock();
+
+	thread = (struct k_thread *)(_kernel.threads);
+	while (thread != NULL) {
+		thread->run_cycles = 0;
+		thread->ready_stamp = 0;
+		thread->block_stamp = 0;
+		thread->max_ready_cycles = 0;
+		thread->max_block_cycles = 0;
+		thread->switch_cnt = 0;
+		thread->preempt_cnt = 0;
+		memset(thread->ready_hist, 0, sizeof(thread->ready_hist));
+		thread = (struct k_thread *)thread->next_thread;
+	}
+
+	memset(profile_marks, 0, sizeof(profile_marks));
+	profile_switch_stamp = k_cycle_get_32();
+	profile_start_ms = k_uptime_get_32();
+
+	irq_unlock(key);
+}
+
+void cpuload_profile_dump(bool clear)
+{
+	struct cpuload_profile_record rec;
+	struct k_thread *thread;
+	unsigned int key;
+	int i;
+
+	printk("profile %u ms, %u records dropped\n",
+	       k_uptime_get_32() - profile_start_ms, profile_rec_dropped);
+	printk(" thread\t\t prio\t run(us)\t sw/pre\t\t rdy_max\t blk_max\t rdy_hist(<64us..)\n");
+
+	key = irq_lock();
+
+	thread = (struct k_thread *)(_kernel.threads);
+	while (thread != NULL) {
+		profile_fill_thread(&rec, thread);
+		irq_unlock(key);
+
+		printk("%s%p:\t %d\t %u\t %u/%u\t %u\t %u\t",
+		       thread == k_current_get() ? "*" : " ",
+		       thread, rec.id, rec.run_us, rec.cnt1, rec.cnt2,
+		       rec.max1_us, rec.max2_us);
+		for (i = 0; i < CPULOAD_PROFILE_HIST_NUM; i++)
+			printk(" %u", rec.hist[i]);
+		printk("\n");
+
+		key = irq_lock();
+		thread = (struct k_thread *)thread->next_thread;
+	}
+
+	irq_unlock(key);
+
+	for (i = 0; i < CPULOAD_MARK_NUM; i++) {
+		printk("mark %d: interval max %u us, last hog %p %u us\n", i,
+		       CYCLES_TO_US(profile_marks[i].max_interval),
+		       profile_marks[i].last_hog,
+		       CYCLES_TO_US(profile_marks[i].last_hog_cycles));
+	}
+
+	if (clear)
+		cpuload_profile_clear();
+}
+
+void cpuload_profile_start(void)
+{
+	profile_hist_base_cycles = (u32_t)(MSEC_TO_HW_CYCLES(CPULOAD_PROFILE_HIST_BASE_US) / 1000);
+
+	cpuload_profile_clear();
+
+	profile_rec_head = 0;
+	profile_rec_count = 0;
+	profile_rec_dropped = 0;
+
+	profile_started = 1;
+}
+
+void cpuload_profile_stop(void)
+{
+	profile_started = 0;
+}
@@ -159,6 +159,10 @@ __ramfunc void _sys_cpuload_context_switch(struct k_thread *from, struct k_threa
 #endif
 
 
+#ifdef CONFIG_CPU_LOAD_PROFILE
+	_sys_cpuload_profile_switch(from, to, k_cycle_get_32());
+#endif
+
 #ifndef CONFIG_CPU_LOAD_DEBUG
 	if (!cpuload_started)
 		return;
@@ -187,7 +187,20 @@ static ALWAYS_INLINE void _new_thread_init(struct k_thread *thread,
 	thread->start_time = 0;
 #endif
 
-#ifdef CONFIG_THREAD_TIMER
+#ifdef CONFIG_CPU_LOAD_PROFILE
+	thread->run_cycles = 0;
+	thread->ready_stamp = 0;
+	thread->block_stamp = 0;
+	thread->max_ready_cycles = 0;
+	thread->max_block_cycles = 0;
+	thread->switch_cnt = 0;
+	thread->preempt_cnt = 0;
+	memset(thread->ready_hist, 0, sizeof(thread->ready_hist));
+#endif
+
+#ifdef CONFIG_THREAD_TIMER_WHEEL
+	memset(&thread->thread_timer_wheel, 0, sizeof(thread->thread_timer_wheel));
+#elif defined(CONFIG_THREAD_TIMER)
 	sys_dlist_init(&thread->thread_timer_q);
 #endif
 }
@@ -10,6 +10,9 @@
 #include <ksched.h>
 #include <wait_q.h>
 #include <misc/util.h>
+#ifdef CONFIG_CPU_LOAD_PROFILE
+#include <cpuload_stat.h>
+#endif
 
 /* the only struct _kernel instance */
 struct _kernel _kernel = {0};
@@ -70,6 +73,10 @@ static struct k_thread *_get_ready_q_head(void)
 
 __ramfunc void _add_thread_to_ready_q(struct k_thread *thread)
 {
+#ifdef CONFIG_CPU_LOAD_PROFILE
+	_sys_cpuload_profile_ready(thread);
+#endif
+
 #ifdef CONFIG_MULTITHREADING
 	int q_index = _get_ready_q_q_index(thread->base.prio);
 	sys_dlist_t *q = &_ready_q.q[q_index];
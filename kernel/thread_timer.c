@@ -27,15 +27,278 @@
 
 #define compare_time(a, b) ((int)((u32_t)(a) - (u32_t)(b)))
 
-#ifdef CONFIG_SOC_SERIES_ANDESC
-#define THREAD_TIMER_ROM_CODE
-#endif
+#ifdef CONFIG_THREAD_TIMER_ROM_CODE
+void rom_thread_timer_init(sys_dlist_t *thread_timer_q, void *tid, struct thread_timer *ttimer, thread_timer_expiry_t expiry_fn,
+               void *expiry_fn_arg);
+void rom_thread_timer_start(sys_dlist_t *thread_timer_q, struct thread_timer *ttimer, s32_t duration, s32_t period,  u32_t cur_time);
+void rom_thread_timer_stop(sys_dlist_t *thread_timer_q, struct thread_timer *ttimer);
+bool rom_thread_timer_is_running(sys_dlist_t *thread_timer_q, struct thread_timer *ttimer);
+int rom_thread_timer_next_timeout(sys_dlist_t *thread_timer_q, u32_t (*get_cur_time)(void));
+void rom_thread_timer_handle_expired(sys_dlist_t *thread_timer_q, u32_t (*get_cur_time)(void));
+#else
+
+#define TW_LEVELS	_THREAD_TIMER_WHEEL_LEVELS
+#define TW_BITS		_THREAD_TIMER_WHEEL_BITS
+#define TW_SLOTS	_THREAD_TIMER_WHEEL_SLOTS
+#define TW_MASK		(TW_SLOTS - 1)
+/* time covered by all levels, later timers wait in the overflow list */
+#define TW_SPAN		(1 << (TW_BITS * TW_LEVELS))
+
+#define TW_SHIFT(level)	(TW_BITS * (level))
+
+/*
+ * Level 0 slots hold the timers expiring in the next TW_SLOTS ms, slot i
+ * of level n holds the timers expiring in the 8^n ms block whose index
+ * ends with i. A slot of level n > 0 is moved down when wheel->cur reaches
+ * the start of its block, the overflow list every TW_SPAN ms. Each step
+ * only links or unlinks one timer with interrupts locked.
+ */
+
+static void _thread_timer_wheel_link(struct _thread_timer_wheel *wheel,
+				     struct thread_timer *ttimer)
+{
+	struct thread_timer **head;
+	u32_t expiry = ttimer->expiry_time;
+	u32_t delta;
+	int level, idx;
+
+	/* already expired, fire on the slot being processed */
+	if (compare_time(expiry, wheel->cur) < 0)
+		expiry = wheel->cur;
+
+	delta = expiry - wheel->cur;
+
+	head = &wheel->overflow;
+	for (level = 0; level < TW_LEVELS; level++) {
+		if (delta < (1 << TW_SHIFT(level + 1))) {
+			idx = (expiry >> TW_SHIFT(level)) & TW_MASK;
+			head = &wheel->slot[level][idx];
+			wheel->pending[level] |= 1 << idx;
+			break;
+		}
+	}
+
+	ttimer->next = *head;
+	if (ttimer->next)
+		ttimer->next->pprev = &ttimer->next;
+	ttimer->pprev = head;
+	*head = ttimer;
+}
+
+static void _thread_timer_wheel_unlink(struct _thread_timer_wheel *wheel,
+				       struct thread_timer *ttimer)
+{
+	struct thread_timer **pprev = ttimer->pprev;
+	int idx;
+
+	*pprev = ttimer->next;
+	if (ttimer->next) {
+		ttimer->next->pprev = pprev;
+	} else if (pprev >= &wheel->slot[0][0] &&
+		   pprev < &wheel->slot[0][0] + TW_LEVELS * TW_SLOTS) {
+		/* it was the only timer of the slot */
+		idx = pprev - &wheel->slot[0][0];
+		wheel->pending[idx / TW_SLOTS] &= ~(1 << (idx % TW_SLOTS));
+	}
+
+	ttimer->next = NULL;
+	ttimer->pprev = NULL;
+}
+
+/* must be called with irq locked */
+static void _thread_timer_add(struct k_thread *thread, struct thread_timer *ttimer)
+{
+	struct _thread_timer_wheel *wheel = &thread->thread_timer_wheel;
+
+	/* idle wheel, no need to catch up with the elapsed time */
+	if (!wheel->count)
+		wheel->cur = k_uptime_get_32();
+
+	wheel->count++;
+	_thread_timer_wheel_link(wheel, ttimer);
+}
+
+/* must be called with irq locked */
+static void _thread_timer_remove(struct k_thread *thread, struct thread_timer *ttimer)
+{
+	if (!ttimer->pprev)
+		return;
+
+	_thread_timer_wheel_unlink(&thread->thread_timer_wheel, ttimer);
+	thread->thread_timer_wheel.count--;
+}
+
+static bool _thread_timer_slot_has(struct thread_timer *head, struct thread_timer *ttimer)
+{
+	for (; head; head = head->next) {
+		if (head == ttimer)
+			return true;
+	}
+
+	return false;
+}
+
+/* used by init only, ttimer may not be initialized yet */
+static bool _thread_timer_is_queued(struct k_thread *thread, struct thread_timer *ttimer)
+{
+	struct _thread_timer_wheel *wheel = &thread->thread_timer_wheel;
+	u32_t expiry = ttimer->expiry_time;
+	int level;
+
+	if (_thread_timer_slot_has(wheel->slot[0][wheel->cur & TW_MASK], ttimer))
+		return true;
+
+	for (level = 0; level < TW_LEVELS; level++) {
+		if (_thread_timer_slot_has(wheel->slot[level][(expiry >> TW_SHIFT(level)) & TW_MASK], ttimer))
+			return true;
+	}
+
+	return _thread_timer_slot_has(wheel->overflow, ttimer);
+}
+
+/* distance from slot 'from' to the next pending slot, -1 if none */
+static int _thread_timer_slot_distance(u8_t pending, int from)
+{
+	u32_t bits = ((u32_t)pending >> from) | ((u32_t)pending << (TW_SLOTS - from));
+
+	return (int)find_lsb_set(bits & ((1 << TW_SLOTS) - 1)) - 1;
+}
+
+/* next time after wheel->cur a level 0 slot expires or a slot moves down */
+static u32_t _thread_timer_wheel_next_event(struct _thread_timer_wheel *wheel)
+{
+	u32_t next = (wheel->cur | (TW_SPAN - 1)) + 1;
+	u32_t block, t;
+	int level, dist;
+
+	for (level = 0; level < TW_LEVELS; level++) {
+		block = (wheel->cur >> TW_SHIFT(level)) + 1;
+		dist = _thread_timer_slot_distance(wheel->pending[level], block & TW_MASK);
+		if (dist >= 0) {
+			t = (block + dist) << TW_SHIFT(level);
+			if (compare_time(t, next) < 0)
+				next = t;
+		}
+	}
+
+	return next;
+}
+
+/* earliest expiry time, the overflow list only bounds it */
+static u32_t _thread_timer_wheel_first_expiry(struct _thread_timer_wheel *wheel)
+{
+	struct thread_timer *ttimer;
+	u32_t first, block;
+	int level, dist;
+
+	if (wheel->overflow)
+		first = (wheel->cur | (TW_SPAN - 1)) + 1;
+	else
+		first = wheel->cur + TW_SPAN;
+
+	dist = _thread_timer_slot_distance(wheel->pending[0], wheel->cur & TW_MASK);
+	if (dist >= 0)
+		first = wheel->cur + dist;
+
+	for (level = 1; level < TW_LEVELS; level++) {
+		block = (wheel->cur >> TW_SHIFT(level)) + 1;
+		dist = _thread_timer_slot_distance(wheel->pending[level], block & TW_MASK);
+		if (dist < 0)
+			continue;
+
+		ttimer = wheel->slot[level][(block + dist) & TW_MASK];
+		for (; ttimer; ttimer = ttimer->next) {
+			if (compare_time(ttimer->expiry_time, first) < 0)
+				first = ttimer->expiry_time;
+		}
+	}
+
+	return first;
+}
+
+/* level == TW_LEVELS moves the overflow list */
+static void _thread_timer_wheel_cascade_slot(struct _thread_timer_wheel *wheel,
+					     int level, int idx)
+{
+	struct thread_timer *list, *ttimer;
+	struct thread_timer **head;
+	int irq_flag;
+
+	if (level < TW_LEVELS)
+		head = &wheel->slot[level][idx];
+	else
+		head = &wheel->overflow;
+
+	irq_flag = irq_lock();
+	list = *head;
+	*head = NULL;
+	if (list)
+		list->pprev = &list;
+	if (level < TW_LEVELS)
+		wheel->pending[level] &= ~(1 << idx);
+	irq_unlock(irq_flag);
+
+	/* timers may still be stopped by other threads meanwhile */
+	do {
+		irq_flag = irq_lock();
+		ttimer = list;
+		if (ttimer) {
+			_thread_timer_wheel_unlink(wheel, ttimer);
+			_thread_timer_wheel_link(wheel, ttimer);
+		}
+		irq_unlock(irq_flag);
+	} while (ttimer);
+}
+
+static void _thread_timer_start(struct k_thread *thread, struct thread_timer *ttimer,
+				s32_t duration, s32_t period)
+{
+	int irq_flag;
+
+	irq_flag = irq_lock();
+
+	_thread_timer_remove(thread, ttimer);
+
+	ttimer->expiry_time = k_uptime_get_32() + duration;
+	ttimer->period = period;
+	ttimer->duration = duration;
+
+	_thread_timer_add(thread, ttimer);
+
+	irq_unlock(irq_flag);
+
+	TT_DEBUG("timer %p: start duration %d period %d, expiry_time %d\n",
+		ttimer, duration, period, ttimer->expiry_time);
+}
+
+static void _thread_timer_wheel_cascade(struct _thread_timer_wheel *wheel)
+{
+	u32_t cur = wheel->cur;
+	int level;
+
+	for (level = 1; level < TW_LEVELS; level++) {
+		if (cur & ((1 << TW_SHIFT(level)) - 1))
+			return;
+
+		_thread_timer_wheel_cascade_slot(wheel, level,
+				(cur >> TW_SHIFT(level)) & TW_MASK);
+	}
+
+	if (!(cur & (TW_SPAN - 1)))
+		_thread_timer_wheel_cascade_slot(wheel, TW_LEVELS, 0);
+}
+#endif /* CONFIG_THREAD_TIMER_ROM_CODE */
 
 #ifdef CONFIG_THREAD_TIMER_DEBUG
 static void _dump_thread_timer(struct thread_timer *ttimer)
 {
+#ifdef CONFIG_THREAD_TIMER_ROM_CODE
 	printk("timer %p, prev: %p, next: %p\n",
 		ttimer, ttimer->node.prev, ttimer->node.next);
+#else
+	printk("timer %p, pprev: %p, next: %p\n",
+		ttimer, ttimer->pprev, ttimer->next);
+#endif
 
 	printk("\tthread: %p, period %d ms, delay %d ms\n",
 		_current, ttimer->period, ttimer->duration);
@@ -47,6 +310,7 @@ static void _dump_thread_timer(struct thread_timer *ttimer)
 
 void _dump_thread_timer_q(void)
 {
+#ifdef CONFIG_THREAD_TIMER_ROM_CODE
 	sys_dlist_t *thread_timer_q = &_current->thread_timer_q;
 	struct thread_timer *ttimer;
 
@@ -57,54 +321,28 @@ void _dump_thread_timer_q(void)
 	SYS_DLIST_FOR_EACH_CONTAINER(thread_timer_q, ttimer, node) {
 		_dump_thread_timer(ttimer);
 	}
-}
-#endif
-
-void rom_thread_timer_init(sys_dlist_t *thread_timer_q, void *tid, struct thread_timer *ttimer, thread_timer_expiry_t expiry_fn,
-               void *expiry_fn_arg);
-void rom_thread_timer_start(sys_dlist_t *thread_timer_q, struct thread_timer *ttimer, s32_t duration, s32_t period,  u32_t cur_time);
-void rom_thread_timer_stop(sys_dlist_t *thread_timer_q, struct thread_timer *ttimer);
-bool rom_thread_timer_is_running(sys_dlist_t *thread_timer_q, struct thread_timer *ttimer);
-int rom_thread_timer_next_timeout(sys_dlist_t *thread_timer_q, u32_t (*get_cur_time)(void));
-void rom_thread_timer_handle_expired(sys_dlist_t *thread_timer_q, u32_t (*get_cur_time)(void));
+#else
+	struct _thread_timer_wheel *wheel = &_current->thread_timer_wheel;
+	struct thread_timer *ttimer;
+	int level, idx;
 
-#ifndef THREAD_TIMER_ROM_CODE
-static void _thread_timer_remove(struct k_thread *thread, struct thread_timer *ttimer)
-{
-	struct thread_timer *in_q, *next;
-	int irq_flag;
+	printk("thread: %p, timers: %d, cur: %u\n",
+		_current, wheel->count, wheel->cur);
 
-	irq_flag = irq_lock();
-	SYS_DLIST_FOR_EACH_CONTAINER_SAFE(&thread->thread_timer_q, in_q, next, node) {
-		if (ttimer == in_q) {
-			sys_dlist_remove(&in_q->node);
-			irq_unlock(irq_flag);
-			return;
+	for (level = 0; level < TW_LEVELS; level++) {
+		for (idx = 0; idx < TW_SLOTS; idx++) {
+			for (ttimer = wheel->slot[level][idx]; ttimer; ttimer = ttimer->next) {
+				printk("level %d slot %d: ", level, idx);
+				_dump_thread_timer(ttimer);
+			}
 		}
 	}
 
-	irq_unlock(irq_flag);
-}
-
-static void _thread_timer_insert(struct k_thread *thread, struct thread_timer *ttimer,
-				 u32_t expiry_time)
-{
-	int irq_flag;
-	sys_dlist_t *thread_timer_q = &thread->thread_timer_q;
-	struct thread_timer *in_q;
-
-	irq_flag = irq_lock();
-	SYS_DLIST_FOR_EACH_CONTAINER(thread_timer_q, in_q, node) {
-		if (compare_time(ttimer->expiry_time, in_q->expiry_time) < 0) {
-			sys_dlist_insert_before(thread_timer_q, &in_q->node,
-						&ttimer->node);
-			irq_unlock(irq_flag);
-			return;
-		}
+	for (ttimer = wheel->overflow; ttimer; ttimer = ttimer->next) {
+		printk("overflow: ");
+		_dump_thread_timer(ttimer);
 	}
-
-	sys_dlist_append(thread_timer_q, &ttimer->node);
-	irq_unlock(irq_flag);
+#endif
 }
 #endif
 
@@ -119,16 +357,20 @@ void thread_timer_init(struct thread_timer *ttimer, thread_timer_expiry_t expiry
 
 	TT_DEBUG("timer %p: init func %p arg 0x%x\n", ttimer,
 		ttimer->expiry_fn, ttimer->expiry_fn_arg);
-#ifndef THREAD_TIMER_ROM_CODE
+#ifndef CONFIG_THREAD_TIMER_ROM_CODE
+	int irq_flag;
+
 	/* remove thread timer if already submited */
-	_thread_timer_remove(_current, ttimer);
+	irq_flag = irq_lock();
+	if (_thread_timer_is_queued(_current, ttimer))
+		_thread_timer_remove(_current, ttimer);
+	irq_unlock(irq_flag);
 
 	memset(ttimer, 0, sizeof(struct thread_timer));
 	ttimer->expiry_time = UINT_MAX;
 	ttimer->expiry_fn = expiry_fn;
 	ttimer->expiry_fn_arg = expiry_fn_arg;
 	ttimer->tid = _current;
-	sys_dlist_init(&ttimer->node);
 #else
 	rom_thread_timer_init(&_current->thread_timer_q, _current, ttimer, expiry_fn, expiry_fn_arg);
 #endif
@@ -148,17 +390,8 @@ void thread_timer_start(struct thread_timer *ttimer, s32_t duration, s32_t perio
 		panic(NULL);
 	}
 
-#ifndef THREAD_TIMER_ROM_CODE
-	_thread_timer_remove(_current, ttimer);
-
-	ttimer->expiry_time = k_uptime_get_32() + duration;
-	ttimer->period = period;
-	ttimer->duration = duration;
-
-	TT_DEBUG("timer %p: start duration %d period %d, expiry_time %d\n",
-		ttimer, duration, period, ttimer->expiry_time);
-
-	_thread_timer_insert(_current, ttimer, ttimer->expiry_time);
+#ifndef CONFIG_THREAD_TIMER_ROM_CODE
+	_thread_timer_start(_current, ttimer, duration, period);
 #else
 	rom_thread_timer_start(&_current->thread_timer_q, ttimer, duration, period, k_uptime_get_32());
 #endif
@@ -201,17 +434,8 @@ void thread_timer_start_prio(struct thread_timer *ttimer, s32_t duration, s32_t
 
 	__ASSERT(thread_list != NULL, "");
 
-#ifndef THREAD_TIMER_ROM_CODE
-	_thread_timer_remove(thread_list, ttimer);
-
-	ttimer->expiry_time = k_uptime_get_32() + duration;
-	ttimer->period = period;
-	ttimer->duration = duration;
-
-	TT_DEBUG("timer %p: start duration %d period %d, expiry_time %d\n",
-		ttimer, duration, period, ttimer->expiry_time);
-
-	_thread_timer_insert(thread_list, ttimer, ttimer->expiry_time);
+#ifndef CONFIG_THREAD_TIMER_ROM_CODE
+	_thread_timer_start(thread_list, ttimer, duration, period);
 #else
 	rom_thread_timer_start(&thread_list->thread_timer_q, ttimer, duration, period, k_uptime_get_32());
 #endif
@@ -232,8 +456,12 @@ void thread_timer_stop(struct thread_timer *ttimer)
 
 	TT_DEBUG("timer %p: stop\n", ttimer);
 
-#ifndef THREAD_TIMER_ROM_CODE
+#ifndef CONFIG_THREAD_TIMER_ROM_CODE
+	int irq_flag;
+
+	irq_flag = irq_lock();
 	_thread_timer_remove(_current, ttimer);
+	irq_unlock(irq_flag);
 #else
 	rom_thread_timer_stop(&_current->thread_timer_q, ttimer);
 #endif
@@ -243,15 +471,8 @@ bool thread_timer_is_running(struct thread_timer *ttimer)
 {
 	__ASSERT(ttimer != NULL, "");
 
-#ifndef THREAD_TIMER_ROM_CODE
-	struct thread_timer *in_q;
-
-	SYS_DLIST_FOR_EACH_CONTAINER(&_current->thread_timer_q, in_q, node) {
-		if (ttimer == in_q)
-			return true;
-	}
-
-	return false;
+#ifndef CONFIG_THREAD_TIMER_ROM_CODE
+	return (ttimer->pprev != NULL);
 #else
 	return rom_thread_timer_is_running(&_current->thread_timer_q, ttimer);
 #endif
@@ -259,17 +480,22 @@ bool thread_timer_is_running(struct thread_timer *ttimer)
 
 int thread_timer_next_timeout(void)
 {
-#ifndef THREAD_TIMER_ROM_CODE
-	struct thread_timer *ttimer;
-	int timeout;
+#ifndef CONFIG_THREAD_TIMER_ROM_CODE
+	struct _thread_timer_wheel *wheel = &_current->thread_timer_wheel;
+	u32_t expiry_time;
+	int timeout, irq_flag;
 
-	ttimer = SYS_DLIST_PEEK_HEAD_CONTAINER(&_current->thread_timer_q, ttimer, node);
-	if (ttimer) {
-		timeout = (int)((u32_t)ttimer->expiry_time - k_uptime_get_32());
-		return (timeout < 0) ? K_NO_WAIT : timeout;
+	irq_flag = irq_lock();
+	if (!wheel->count) {
+		irq_unlock(irq_flag);
+		return K_FOREVER;
 	}
 
-	return K_FOREVER;
+	expiry_time = _thread_timer_wheel_first_expiry(wheel);
+	irq_unlock(irq_flag);
+
+	timeout = (int)(expiry_time - k_uptime_get_32());
+	return (timeout < 0) ? K_NO_WAIT : timeout;
 #else
 	return rom_thread_timer_next_timeout(&_current->thread_timer_q, k_uptime_get_32);
 #endif
@@ -277,25 +503,47 @@ int thread_timer_next_timeout(void)
 
 void thread_timer_handle_expired(void)
 {
-#ifndef THREAD_TIMER_ROM_CODE
+#ifndef CONFIG_THREAD_TIMER_ROM_CODE
+	struct _thread_timer_wheel *wheel = &_current->thread_timer_wheel;
 	struct thread_timer *ttimer;
-	u32_t cur_time;
+	u32_t cur_time, next;
 	int irq_flag;
 
 	cur_time = k_uptime_get_32();
 
 	do {
 		irq_flag = irq_lock();
-		ttimer = SYS_DLIST_PEEK_HEAD_CONTAINER(
-				&_current->thread_timer_q, ttimer, node);
-		if (!ttimer || (compare_time(ttimer->expiry_time, cur_time) > 0)) {
-			/* no expired thread timer */
+		if (!wheel->count) {
+			wheel->cur = cur_time;
 			irq_unlock(irq_flag);
 			break;
 		}
 
+		ttimer = wheel->slot[0][wheel->cur & TW_MASK];
+		if (!ttimer) {
+			/* no expired thread timer */
+			if (compare_time(wheel->cur, cur_time) >= 0) {
+				irq_unlock(irq_flag);
+				break;
+			}
+
+			/* jump to the next slot that expires or moves down */
+			next = _thread_timer_wheel_next_event(wheel);
+			if (compare_time(next, cur_time) > 0) {
+				wheel->cur = cur_time;
+				irq_unlock(irq_flag);
+				break;
+			}
+
+			wheel->cur = next;
+			irq_unlock(irq_flag);
+
+			_thread_timer_wheel_cascade(wheel);
+			continue;
+		}
+
 		/* remove this expiry thread timer */
-		sys_dlist_remove(&ttimer->node);
+		_thread_timer_remove(_current, ttimer);
 
 		irq_unlock(irq_flag);
 
@@ -18,97 +18,43 @@
 
 #define NUM_EQ_BANDS 5
 
-static dolphin_host2dsp_t ats3615_com_host_data_cache = { 0 };
-
 int ats3615_comm_send_volume(float volume_dB)
 {
-    dolphin_com_t comm;
-    memset(&comm, 0, sizeof(comm));
-    comm.host.volume_db = volume_dB;
-    comm.host.change_flags |= FLAG_CHANGE_VOLUME_DB;
-
-    ats3615_com_host_data_cache.volume_db = volume_dB;
-    ats3615_com_host_data_cache.change_flags |= FLAG_CHANGE_VOLUME_DB;
-
-    int ret = dolphin_comm_send_ex(&comm);
-    return ret;
+    return dolphin_comm_update(offsetof(dolphin_host2dsp_t, volume_db), &volume_dB, sizeof(volume_dB),
+                               FLAG_CHANGE_VOLUME_DB, 0);
 }
 
 int ats3615_comm_send_battery_volt(float battery_volt)
 {
-    dolphin_com_t comm;
-    memset(&comm, 0, sizeof(comm));
-    comm.host.battery_level_v = battery_volt;
-    comm.host.change_flags |= FLAG_REPORT_BATTERY_LEVEL_V;
-    
-    ats3615_com_host_data_cache.battery_level_v = battery_volt;
-    ats3615_com_host_data_cache.change_flags |= FLAG_REPORT_BATTERY_LEVEL_V;
-
-    int ret = dolphin_comm_send_ex(&comm);
-    return ret;
+    return dolphin_comm_update(offsetof(dolphin_host2dsp_t, battery_level_v), &battery_volt, sizeof(battery_volt),
+                               FLAG_REPORT_BATTERY_LEVEL_V, 0);
 }
 
 int ats3615_comm_send_user_eq(dolphin_eq_band_t * eq_bands, int bands_count)
 {
-    if (!eq_bands)
+    if (!eq_bands || bands_count <= 0 || bands_count > USER_EQ_MAX_NUM_BANDS)
         return -1;
 
-    dolphin_com_t comm;
-    memset(&comm, 0, sizeof(comm));
-
-    // copy preset to dolphin_com structure
-    memcpy(comm.host.usereq, eq_bands, sizeof(dolphin_eq_band_t) * bands_count);
-
     // update bit mask for bands to be updated (all of them !)
-    comm.host.change_bits_usereq_bands = (1 << bands_count) - 1;
-
-    // update change flags
-    comm.host.change_flags |= FLAG_CHANGE_USER_EQ;
-
-    memcpy(ats3615_com_host_data_cache.usereq, eq_bands, sizeof(dolphin_eq_band_t) * bands_count);
-    ats3615_com_host_data_cache.change_bits_usereq_bands = (1 << bands_count) - 1;
-    ats3615_com_host_data_cache.change_flags |= FLAG_CHANGE_USER_EQ;
-
-    int ret = dolphin_comm_send_ex(&comm);
-    return ret;
+    return dolphin_comm_update(offsetof(dolphin_host2dsp_t, usereq), eq_bands,
+                               sizeof(dolphin_eq_band_t) * bands_count,
+                               FLAG_CHANGE_USER_EQ, (1 << bands_count) - 1);
 }
 
 int ats3615_comm_set_audio_path(int audio_path)
 {
-    dolphin_com_t comm;
-    memset(&comm, 0, sizeof(comm));
-    comm.host.audio_path = audio_path;
-    comm.host.change_flags |= FLAG_CHANGE_AUDIO_PATH;
-
-    ats3615_com_host_data_cache.audio_path = audio_path;
-    ats3615_com_host_data_cache.change_flags |= FLAG_CHANGE_AUDIO_PATH;
-
-    int ret = dolphin_comm_send_ex(&comm);
-    return ret;
+    return dolphin_comm_update(offsetof(dolphin_host2dsp_t, audio_path), &audio_path, sizeof(audio_path),
+                               FLAG_CHANGE_AUDIO_PATH, 0);
 }
 
 int ats3615_comm_set_dsp_run(void)
 {
-    dolphin_com_t comm;
-    memset(&comm, 0, sizeof(comm));
-    comm.host.change_flags |= FLAG_RUN_DSP_CODE;
-
-    // ats3615_com_host_data_cache.change_flags |= FLAG_RUN_DSP_CODE;
-
-    int ret = dolphin_comm_send_ex(&comm);
-    return ret;
+    return dolphin_comm_update(0, NULL, 0, FLAG_RUN_DSP_CODE, 0);
 }
 
-
-
 int ats3615_re_comm_after_reset(void)
 {
-    dolphin_com_t comm;
-    memset(&comm, 0, sizeof(comm));
-    memcpy(&comm.host, &ats3615_com_host_data_cache, sizeof(dolphin_host2dsp_t));
-
-    int ret = dolphin_comm_send_ex(&comm);
-    return ret;
+    return dolphin_comm_resend_all();
 }
 
 
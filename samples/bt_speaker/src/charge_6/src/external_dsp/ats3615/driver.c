@@ -68,9 +68,9 @@ extern int dolphin_send_tuning_info(void);
 extern int get_tuning_info_by_odm(void);
 
 extern int dolphin_comm_init(void);
-extern int dolphin_comm_send_wait_finish(dolphin_com_t * p_comm);
-extern int dolphin_comm_send_ex(dolphin_com_t * p_comm);
 extern int ats3615_re_comm_after_reset(void);
+extern void dolphin_comm_pre_init(void);
+extern int dolphin_comm_reset_requested(void);
 int ext_dsp_send_battery_volt(float battery_volt);
 static int dsp_init_flag = 0;
 static os_mutex dsp_3615_mutex;
@@ -373,6 +373,7 @@ void external_dsp_ats3615_pre_init(void)
 	if(dsp_3615_mutex_ptr == NULL){
 		dsp_3615_mutex_ptr = &dsp_3615_mutex;
 		os_mutex_init(dsp_3615_mutex_ptr);
+		dolphin_comm_pre_init();
 	}else{
 		SYS_LOG_ERR("have init?\n");
 	}
@@ -432,6 +433,11 @@ void spi_switch_polling(void)
 static void external_dsp_ats3615_timer_handle(struct thread_timer *ttimer, void *expiry_fn_arg)
 {
 	static u32_t timer_cnt = 0;
+
+	/* DSP stopped acking commands */
+	if (dolphin_comm_reset_requested())
+		external_dsp_ats3615_reset();
+
 	os_mutex_lock(dsp_3615_mutex_ptr, OS_FOREVER);
 	if(dsp_init_flag == 0){
 
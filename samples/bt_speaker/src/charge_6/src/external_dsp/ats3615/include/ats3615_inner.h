@@ -4,14 +4,24 @@
 #include "ats3615_reg.h"
 #include <wltmcu_manager_supply.h>
 
+/* largest dma transfer of the spi controller */
+#define ATS3615_SPI_XFER_MAX_SIZE	0x8000
+#define ATS3615_SPI_BULK_BUF_NUM	8
+/* largest write done under one chip select and checked by one crc */
+#define ATS3615_SPI_BULK_MAX_SIZE	(ATS3615_SPI_XFER_MAX_SIZE * ATS3615_SPI_BULK_BUF_NUM)
+
 extern int __ram_dsp_start, __ram_dsp_size;
 extern unsigned int MASTER_Read_ATS3615_Reg(unsigned int ATS3615_addr,unsigned int* data_addr);
 extern unsigned int MASTER_Write_ATS3615_Reg(unsigned int ATS3615_addr, unsigned int data_val);
 extern unsigned int MASTER_Write_ATS3615_Mem(unsigned int ATS3615_addr, unsigned int* data_addr,unsigned int byte_count);
+extern unsigned int MASTER_Write_ATS3615_Mem_Nocheck(unsigned int ATS3615_addr, const unsigned int* data_addr, unsigned int byte_count);
+extern unsigned int MASTER_Read_ATS3615_Crc(unsigned int* crc_value);
 
 extern unsigned int ATS3615_SPI_Master_Write_Slave(unsigned int register_addr, unsigned int *r_w_buffer, unsigned int  n/*word count*/);
 extern unsigned int ATS3615_SPI_Master_Read_Slave(unsigned int register_addr, unsigned int *r_w_buffer, unsigned int  n/*word count*/);
+extern unsigned int ATS3615_SPI_Master_Write_Slave_Bulk(unsigned int register_addr, const unsigned int *w_buffer, unsigned int byte_count);
 extern unsigned int chksum_crc32(const unsigned char *block, unsigned int length);
+extern unsigned int chksum_crc32_update(unsigned int crc, const unsigned char *block, unsigned int length);
 extern int dolphin_comm_deinit(void);
 extern os_mutex *dsp_3615_mutex_ptr;
 #endif
@@ -19,8 +19,9 @@
 
 
 
-extern int dolphin_comm_send_wait_finish(dolphin_com_t * p_comm);
-extern int dolphin_comm_send_ex(dolphin_com_t * p_comm);
+extern int dolphin_comm_update(uint32_t offset, const void *data, uint32_t len,
+                               uint32_t flags, int usereq_bands);
+extern int dolphin_comm_resend_all(void);
 
 int ats3615_comm_send_volume(float volume_dB);
 
@@ -50,6 +50,7 @@ typedef struct
 } dolphin_dsp_code_hdr_t;
 
 firmware_prog_status_t Dolphin_Firmware_Send(void* spidev, const void* firmware_data);
+firmware_prog_status_t Dolphin_Firmware_Write_Section(void* spidev, uint32_t dolphin_addr, const void* data, uint32_t byte_count);
 extern void Dolphin_Firmware_Sleep_ms(int ms);
 
 #endif
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include <zephyr.h>
 
 static unsigned int crc_tab1[256];
+static int crc_tab1_ready;
 
 static void chksum_crc32gentab1(void)
 {
@@ -26,20 +27,29 @@ static void chksum_crc32gentab1(void)
 		crc_tab1[i] = crc;
 		
 	}
+
+	crc_tab1_ready = 1;
 }
 
-unsigned int chksum_crc32(const unsigned char *block, unsigned int length)
+/* continue crc of previous blocks, crc is 0 for the first block */
+unsigned int chksum_crc32_update(unsigned int crc, const unsigned char *block, unsigned int length)
 {
-	register unsigned long crc;
 	unsigned long i;
 
-	chksum_crc32gentab1();
-	crc = 0xFFFFFFFF;
-   
+	if (!crc_tab1_ready)
+		chksum_crc32gentab1();
+
+	crc ^= 0xFFFFFFFF;
+
 	for (i = 0; i < length; i++)
 	{
-		crc = ((crc >> 8) & 0x00FFFFFF) ^ crc_tab1[(crc ^ *block++) & 0xFF];
+		crc = (crc >> 8) ^ crc_tab1[(crc ^ *block++) & 0xFF];
 	}
-	
+
 	return (crc ^ 0xFFFFFFFF);
 }
+
+unsigned int chksum_crc32(const unsigned char *block, unsigned int length)
+{
+	return chksum_crc32_update(0, block, length);
+}
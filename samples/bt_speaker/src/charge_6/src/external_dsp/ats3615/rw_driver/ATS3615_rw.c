@@ -179,6 +179,56 @@ unsigned int MASTER_Write_ATS3615_Mem(unsigned int ATS3615_addr, unsigned int* d
 	return 0;
 }
 
+/* write without crc check, the slave crc covers the whole transfer, read it by MASTER_Read_ATS3615_Crc */
+unsigned int MASTER_Write_ATS3615_Mem_Nocheck(unsigned int ATS3615_addr, const unsigned int* data_addr, unsigned int byte_count)
+{
+	unsigned char RAM_REG=0, RAM_ROM=0, I_D=0;
+	unsigned int cmd;
+	unsigned int addr_offset;
+
+	if((byte_count == 0) || (byte_count % 4))
+		return 1;
+
+	addr_offset = ATS3615_addr & (0xfffff); // 20bit address
+
+	switch(ATS3615_addr >> 28)
+	{
+	case 3: // DRAM
+			break;
+	case 4: // IRAM
+		I_D = 1;	
+		if((ATS3615_addr & (1<<20)) == (1<<20))	//IROM
+			RAM_ROM = 1;
+		break;
+		
+	case 5:	// REG or ASRCRAM 
+		RAM_REG = 1;
+		if(byte_count > 4)//continue read/write
+			RAM_ROM = 1;
+		break;
+	default:
+		printk("write mem addr err\n");
+		return 1;
+	}
+
+#if USE_I2C
+	//i2c transfers are split into 128B frames, each one has its own crc
+	return 1;
+#else
+	cmd=(0ul<<31) | (RAM_REG<<30) | (RAM_ROM<<29) | (I_D<<28) | (addr_offset<<8);
+	return ATS3615_SPI_Master_Write_Slave_Bulk(cmd, data_addr, byte_count);
+#endif
+}
+
+unsigned int MASTER_Read_ATS3615_Crc(unsigned int* crc_value)
+{
+#if USE_I2C
+	return ATS3615_I2C_Master_Read_Slave(DEFAULT_I2C_SLV_ADDR0, (1<<23) | (1<<22) | (0<<21) | (0<<20) | (ATS3615_I2CSLV_CRC & 0xfffff), crc_value, 1);
+#else
+	return ATS3615_SPI_Master_Read_Slave((1ul<<31) | (1<<30) | (0<<29) | (0<<28) | ((ATS3615_SPISLV_CRC & 0xfffff) << 8), crc_value, 1);
+#endif
+}
+
 unsigned int MASTER_Read_ATS3615_Mem(unsigned int ATS3615_addr, unsigned int* data_addr, unsigned int byte_count)
 {
 	unsigned char RAM_REG=0, RAM_ROM=0, I_D=0;
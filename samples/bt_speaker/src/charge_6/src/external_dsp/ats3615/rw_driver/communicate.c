@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
 #include <zephyr.h>
 #include <mem_manager.h>
 #include <logging/sys_log.h>
@@ -33,6 +34,40 @@ uint32_t com_addr = 0;
 int dolphin_demo_exit_flag = 1;
 static int comm_init_ok = 0;
 
+/* setters only touch the host copy, changes are flushed after this window */
+#define DOLPHIN_COMM_COALESCE_MS    5
+#define DOLPHIN_COMM_POLL_MS        10
+#define DOLPHIN_COMM_ACK_TIMEOUT_MS 100
+#define DOLPHIN_COMM_RETRY_MS       200
+#define DOLPHIN_COMM_RETRY_MAX      3
+
+/* dirty state is kept per 32 bit word of dolphin_host2dsp_t, at most 64 words */
+#define DOLPHIN_COMM_WORDS          ((int)(sizeof(dolphin_host2dsp_t) / sizeof(uint32_t)))
+#define DOLPHIN_COMM_WORD_MASK(first, end) \
+    ((((uint64_t)1 << (end)) - 1) & ~(((uint64_t)1 << (first)) - 1))
+/* holes up to this many words are sent rather than starting another transfer */
+#define DOLPHIN_COMM_MERGE_GAP      2
+
+/* host copy of dolphin_com_t.host, bit n of comm_dirty: word n differs from the DSP */
+static dolphin_host2dsp_t comm_shadow;
+static uint64_t comm_dirty;
+/* everything ever sent, replayed by dolphin_comm_resend_all */
+static uint32_t comm_state_flags;
+static int comm_state_bands;
+static uint8_t comm_full_sync = 1;
+static uint8_t comm_reset_req;
+
+/* command waiting for the DSP ack, protected by dsp_3615_mutex_ptr */
+static dolphin_host2dsp_t comm_tx;
+static uint64_t comm_tx_words;
+static uint32_t comm_tx_time;
+static uint8_t comm_wait_ack;
+static uint8_t comm_retry_cnt;
+
+static os_delayed_work comm_work;
+
+static void dolphin_comm_requeue_tx(void);
+
 const unsigned char * g_dsp_tuning_info = NULL;
 int g_dsp_tuning_info_valid = 0;
 unsigned int g_tuning_data_address = 0;
@@ -108,25 +143,15 @@ int dolphin_send_tuning_info(void)
     printf("\rtuning size    = %d bytes\n",g_tuning_data_size);
 	
     printk("tuning_info = %08x \n", (unsigned int)tuning_info);
-    int buffer_size = 0x1F0;
-    int * buffer = malloc(buffer_size);
-    if (!buffer)
-    {
-        printk("malloc fail %s:%d\n", __FUNCTION__, __LINE__);
-        return -1;
-    }
+    uint32_t start_time = k_uptime_get_32();
     // write all changes to DSP
     // 1. for simplicity host can transmit the whole structure in one SPI transfer (if not too big)
     // 2. otherwise it can only transmit what members of the structures have changed.
     // Here 1. is used :)
-    for (uint32_t write_num = 0; write_num < g_tuning_data_size;) {
-        uint32_t once_num = ((g_tuning_data_size - write_num) >= buffer_size) ? buffer_size : (g_tuning_data_size - write_num);
-        memcpy(buffer, tuning_info + write_num, once_num);
-
-        Dolphin_Write_Mem(0, g_tuning_data_address + write_num, (unsigned int*)buffer, once_num);//com->tuning_size);
-        write_num += once_num;
+    if (Dolphin_Firmware_Write_Section(0, g_tuning_data_address, tuning_info, g_tuning_data_size)) {
+        SYS_LOG_ERR("tuning write fail\n");
     }
-    free(buffer);
+    printk("tuning loaded in %d ms\n", k_uptime_get_32() - start_time);
     // printk("[pengfei] 1111 \n");
     // finally, host alerts the DSP that it has changed the structure
     // (an interrupt might be triggered on the DSP side or pooling method will be used)
@@ -174,6 +199,12 @@ int dolphin_comm_init(void)
     }
 
     comm_init_ok = 1;
+    /* the DSP was (re)loaded, a command waiting for its ack is lost */
+    dolphin_comm_requeue_tx();
+    comm_retry_cnt = 0;
+    comm_full_sync = 1;
+    if (comm_shadow.change_flags)
+        os_delayed_work_submit(&comm_work, DOLPHIN_COMM_COALESCE_MS);
     os_mutex_unlock(dsp_3615_mutex_ptr);
     
     printk("dolphin_comm_init  exit \n");
@@ -196,87 +227,215 @@ int dolphin_comm_deinit(void)
 }
 
 
-int dolphin_comm_send_wait_finish(dolphin_com_t * p_comm)
+/* mark the words covering bytes [start, end) of the host structure */
+static void dolphin_comm_mark_dirty(uint32_t start, uint32_t end)
 {
-    if (!comm_init_ok)
-    {
-        printk("ATS3615 comm not init \n");
-        return -1;
+    comm_dirty |= DOLPHIN_COMM_WORD_MASK(start / sizeof(uint32_t),
+                                         (end + sizeof(uint32_t) - 1) / sizeof(uint32_t));
+}
+
+/* give an unacknowledged command back to the shadow so it is sent again */
+static void dolphin_comm_requeue_tx(void)
+{
+    unsigned int key;
+
+    if (!comm_wait_ack)
+        return;
+
+    key = irq_lock();
+    comm_dirty |= comm_tx_words;
+    comm_shadow.change_flags |= comm_tx.change_flags;
+    comm_shadow.change_bits_usereq_bands |= comm_tx.change_bits_usereq_bands;
+    irq_unlock(key);
+
+    comm_wait_ack = 0;
+}
+
+static uint64_t dolphin_comm_merge_gaps(uint64_t words)
+{
+    int n, last = -1;
+
+    for (n = 0; n < DOLPHIN_COMM_WORDS; n++) {
+        if (!(words & ((uint64_t)1 << n)))
+            continue;
+        if (last >= 0 && n - last - 1 <= DOLPHIN_COMM_MERGE_GAP)
+            words |= DOLPHIN_COMM_WORD_MASK(last + 1, n);
+        last = n;
     }
 
-    printk("dolphin_comm_send  enter \n");
+    return words;
+}
 
-    if(dsp_3615_mutex_ptr){
-        os_mutex_lock(dsp_3615_mutex_ptr, OS_FOREVER);
-        printk("dolphin_comm_send  get mutex \n");
-	}else{
-        printk("dsp_3615_mutex_ptr == NULL  \n");
-        return -1;
+static void dolphin_comm_flush(void)
+{
+    uint32_t *tx = (uint32_t *)&comm_tx;
+    uint32_t *shadow = (uint32_t *)&comm_shadow;
+    uint64_t words;
+    unsigned int key;
+    int n, start;
+
+    key = irq_lock();
+    words = comm_full_sync ? DOLPHIN_COMM_WORD_MASK(0, DOLPHIN_COMM_WORDS) : comm_dirty;
+    if (!comm_shadow.change_flags && !words) {
+        irq_unlock(key);
+        return;
     }
-	
-    // write all changes to DSP
-    // 1. for simplicity host can transmit the whole structure in one SPI transfer (if not too big)
-    // 2. otherwise it can only transmit what members of the structures have changed.
-    // Here 1. is used :)
-    Dolphin_Write_Mem(0, com_addr + offsetof(dolphin_com_t, host), (uint32_t*)&p_comm->host, sizeof(p_comm->host));
-    
-    // finally, host alerts the DSP that it has changed the structure
-    // (an interrupt might be triggered on the DSP side or pooling method will be used)
+
+    /* change_flags is word 0 and always sent */
+    words = dolphin_comm_merge_gaps(words | 1);
+    for (n = 0; n < DOLPHIN_COMM_WORDS; n++) {
+        if (words & ((uint64_t)1 << n))
+            tx[n] = shadow[n];
+    }
+    comm_tx_words = words;
+
+    comm_shadow.change_flags = 0;
+    comm_shadow.change_bits_usereq_bands = 0;
+    comm_dirty = 0;
+    comm_full_sync = 0;
+    irq_unlock(key);
+
+    for (n = 0; n < DOLPHIN_COMM_WORDS; n++) {
+        if (!(words & ((uint64_t)1 << n)))
+            continue;
+        for (start = n; n + 1 < DOLPHIN_COMM_WORDS && (words & ((uint64_t)1 << (n + 1))); n++)
+            ;
+        Dolphin_Write_Mem(0, com_addr + offsetof(dolphin_com_t, host) + start * sizeof(uint32_t),
+                          tx + start, (n + 1 - start) * sizeof(uint32_t));
+    }
+
     Dolphin_Write_Reg(0, DOLPHIN_SPISLV_SEED, 0xac285555);
 
-#if 1
-    // this is optional : wait for DSP to handle the command (it will clear bit #5 of the DOLPHIN_SLAVE_CTRL)
-    for (int i = 0; ; i++)
-    {
-        uint32_t reg;
-        MASTER_Read_ATS3615_Reg(DOLPHIN_SLAVE_CTRL, &reg);
-        if (!(reg & (1 << 5)))
-            break;
+    comm_wait_ack = 1;
+    comm_tx_time = k_uptime_get_32();
+    os_delayed_work_submit(&comm_work, DOLPHIN_COMM_POLL_MS);
+}
 
-        k_sleep(10);
-        if (i == 10)
-        {
-            printk("timeout : DSP did not handled the change\n");
-            goto _err;
+static void dolphin_comm_work_handler(os_work *work)
+{
+    uint32_t reg;
+
+    /* the loader holds the mutex for a long time and waits on the system workqueue */
+    if (os_mutex_lock(dsp_3615_mutex_ptr, OS_NO_WAIT)) {
+        os_delayed_work_submit(&comm_work, DOLPHIN_COMM_POLL_MS);
+        return;
+    }
+
+    if (!comm_init_ok) {
+        /* flushed again by dolphin_comm_init */
+        dolphin_comm_requeue_tx();
+        goto exit;
+    }
+
+    if (comm_wait_ack) {
+        MASTER_Read_ATS3615_Reg(DOLPHIN_SLAVE_CTRL, &reg);
+        if (reg & (1 << 5)) {
+            if (k_uptime_get_32() - comm_tx_time < DOLPHIN_COMM_ACK_TIMEOUT_MS) {
+                os_delayed_work_submit(&comm_work, DOLPHIN_COMM_POLL_MS);
+                goto exit;
+            }
+
+            SYS_LOG_ERR("timeout : DSP did not handled the change (%d)\n", comm_retry_cnt + 1);
+            dolphin_comm_requeue_tx();
+            if (++comm_retry_cnt < DOLPHIN_COMM_RETRY_MAX) {
+                os_delayed_work_submit(&comm_work, DOLPHIN_COMM_RETRY_MS);
+            } else {
+                /* reloading uses the system workqueue, leave it to the driver timer */
+                comm_retry_cnt = 0;
+                comm_reset_req = 1;
+            }
+            goto exit;
         }
+
+        comm_wait_ack = 0;
+        comm_retry_cnt = 0;
     }
-#endif
 
-    printk("dolphin_comm_send  exit \n");
-    // printk("ats3615_comm  OK \n");
-    os_mutex_unlock(dsp_3615_mutex_ptr);
-    return 0;
+    dolphin_comm_flush();
 
-_err:
-    printk("dolphin_comm_send  exit \n");
-    printk("ats3615_comm  FAIL \n");
+exit:
     os_mutex_unlock(dsp_3615_mutex_ptr);
-    return -1;
 }
 
-int dolphin_comm_send_ex(dolphin_com_t * p_comm)
+/*
+ * Update len bytes at offset of the host structure and raise flags. Only the
+ * bytes that really changed are sent, updates within DOLPHIN_COMM_COALESCE_MS
+ * go out as one command. Returns without waiting for the DSP.
+ */
+int dolphin_comm_update(uint32_t offset, const void *data, uint32_t len,
+                        uint32_t flags, int usereq_bands)
 {
-    int retry_cnt = 3;
-    int i, send_result = -1;
+    const uint8_t *src = data;
+    uint8_t *dst = (uint8_t *)&comm_shadow + offset;
+    uint32_t first, last;
+    unsigned int key;
 
-    if (comm_init_ok)
-    {
+    if (!dsp_3615_mutex_ptr)
+        return -1;
 
-        for (i=0; i<retry_cnt; i++)
-        {
-            send_result = dolphin_comm_send_wait_finish(p_comm);
-            if (!send_result)
-                return send_result;
+    if (offset + len > sizeof(comm_shadow))
+        return -EINVAL;
 
-            SYS_LOG_ERR("Send Fail, wait and retry (%d) ...\n", i+1);
-            k_sleep(200);
-        }
+    key = irq_lock();
 
-        extern int external_dsp_ats3615_reset(void);
-        external_dsp_ats3615_reset();
+    for (first = 0; first < len && dst[first] == src[first]; first++)
+        ;
+    if (first < len) {
+        for (last = len - 1; dst[last] == src[last]; last--)
+            ;
+        memcpy(dst + first, src + first, last + 1 - first);
+        dolphin_comm_mark_dirty(offset + first, offset + last + 1);
     }
 
-    return send_result;
+    if (usereq_bands) {
+        comm_shadow.change_bits_usereq_bands |= usereq_bands;
+        comm_state_bands |= usereq_bands;
+        dolphin_comm_mark_dirty(offsetof(dolphin_host2dsp_t, change_bits_usereq_bands),
+                                offsetof(dolphin_host2dsp_t, usereq));
+    }
+
+    comm_shadow.change_flags |= flags;
+    comm_state_flags |= flags & ~FLAG_RUN_DSP_CODE;
+
+    irq_unlock(key);
+
+    os_delayed_work_submit(&comm_work, DOLPHIN_COMM_COALESCE_MS);
+    return 0;
+}
+
+/* send the whole host structure with every setting raised, e.g. after a DSP reset */
+int dolphin_comm_resend_all(void)
+{
+    unsigned int key;
+
+    if (!dsp_3615_mutex_ptr)
+        return -1;
+
+    key = irq_lock();
+    comm_shadow.change_flags |= comm_state_flags;
+    comm_shadow.change_bits_usereq_bands |= comm_state_bands;
+    comm_full_sync = 1;
+    irq_unlock(key);
+
+    os_delayed_work_submit(&comm_work, DOLPHIN_COMM_COALESCE_MS);
+    return 0;
+}
+
+/* a reload is needed because the DSP stopped acking, cleared when read */
+int dolphin_comm_reset_requested(void)
+{
+    unsigned int key = irq_lock();
+    int req = comm_reset_req;
+
+    comm_reset_req = 0;
+    irq_unlock(key);
+
+    return req;
+}
+
+void dolphin_comm_pre_init(void)
+{
+    os_delayed_work_init(&comm_work, dolphin_comm_work_handler);
 }
 
 #if 0
@@ -12,6 +12,7 @@
 #include "../include/dolphin_firmware.h"
 #include "../include/dolphin_rw.h"
 #include <mem_manager.h>
+#include <os_common_api.h>
 #define dbg_dolphin printk
 //#define dbg_dolphin(...)
 
@@ -20,25 +21,116 @@
 
 extern int __ram_dsp_start, __ram_dsp_size;
 
-firmware_prog_status_t Dolphin_Firmware_Send(void* spidev, const void* firmware_data)
+/* size of the legacy bounce buffer writes, each checked by its own crc */
+#define DOLPHIN_FW_VERIFY_CHUNK_SIZE	0x1F0
+
+struct dolphin_fw_crc_work {
+    os_work work;
+    os_sem done;
+    const unsigned char *data;
+    unsigned int len;
+    unsigned int crc;
+};
+
+/* cleared once the slave reads garbage from the mapped image */
+static bool dolphin_fw_direct_ok = true;
+
+static void dolphin_fw_crc_handler(os_work *work)
 {
-    const uint32_t* firmware = (const uint32_t*)firmware_data;
-    int write_size,one_write_size,max_size = 0x1F0;
-    int ret = FIRMWARE_PROG_STATUS_OK;
+    struct dolphin_fw_crc_work *crc_work = CONTAINER_OF(work, struct dolphin_fw_crc_work, work);
+
+    crc_work->crc = chksum_crc32(crc_work->data, crc_work->len);
+    os_sem_give(&crc_work->done);
+}
+
+static firmware_prog_status_t Dolphin_Firmware_Write_Verified(uint32_t dolphin_addr, const void* data, uint32_t byte_count)
+{
+    uint32_t write_size, one_write_size;
+    int * buffer = malloc(DOLPHIN_FW_VERIFY_CHUNK_SIZE);
 
-    int * buffer = malloc(max_size);
     if (!buffer)
     {
-        printk("malloc(%d) fail %s:%d\n", max_size, __FUNCTION__, __LINE__);
-        ret = FIRMWARE_PROG_STATUS_MALLOC_FAIL;
-        goto exit;
+        printk("malloc(%d) fail %s:%d\n", DOLPHIN_FW_VERIFY_CHUNK_SIZE, __FUNCTION__, __LINE__);
+        return FIRMWARE_PROG_STATUS_MALLOC_FAIL;
     }
-    
-    if(max_size > 0x8000)
-    {
-        max_size = 0X8000;
+
+    for(write_size = 0;write_size < byte_count;){
+        one_write_size = ((byte_count - write_size) >= DOLPHIN_FW_VERIFY_CHUNK_SIZE)?DOLPHIN_FW_VERIFY_CHUNK_SIZE:(byte_count - write_size);
+        memcpy(buffer, (const uint8_t *)data + write_size, one_write_size);
+
+        if(MASTER_Write_ATS3615_Mem(dolphin_addr + write_size, (unsigned int*)buffer, one_write_size)){
+            free(buffer);
+            return FIRMWARE_PROG_STATUS_DSP_WRONG_CRC;
+        }
+        write_size += one_write_size;
+    }
+
+    free(buffer);
+    return FIRMWARE_PROG_STATUS_OK;
+}
+
+/*
+ * Write a memory section straight from the mapped image, one chip select
+ * transfer and one crc check for up to ATS3615_SPI_BULK_MAX_SIZE bytes.
+ * The host crc is computed by the system work queue while this thread
+ * waits for the spi dma. On crc mismatch the section is written again
+ * through a ram buffer with a crc check every DOLPHIN_FW_VERIFY_CHUNK_SIZE.
+ */
+firmware_prog_status_t Dolphin_Firmware_Write_Section(void* spidev, uint32_t dolphin_addr, const void* data, uint32_t byte_count)
+{
+    struct dolphin_fw_crc_work crc_work;
+    uint32_t write_size, one_write_size;
+    unsigned int crc_value_reg = 0, err;
+    firmware_prog_status_t ret;
+
+    if (byte_count % 4) {
+        printk("section @ %08x: drop %d unaligned bytes\n", dolphin_addr, byte_count % 4);
+        byte_count &= ~3;
     }
 
+    os_work_init(&crc_work.work, dolphin_fw_crc_handler);
+    os_sem_init(&crc_work.done, 0, 1);
+
+    for (write_size = 0; write_size < byte_count; write_size += one_write_size) {
+        one_write_size = ((byte_count - write_size) >= ATS3615_SPI_BULK_MAX_SIZE) ? ATS3615_SPI_BULK_MAX_SIZE : (byte_count - write_size);
+
+        /* spi words are read straight from the image, it must be word aligned */
+        if (dolphin_fw_direct_ok && !((uint32_t)data & 3)) {
+            crc_work.data = (const unsigned char *)data + write_size;
+            crc_work.len = one_write_size;
+            os_work_submit(&crc_work.work);
+
+            err = MASTER_Write_ATS3615_Mem_Nocheck(dolphin_addr + write_size,
+                    (const unsigned int *)crc_work.data, one_write_size);
+            if (!err)
+                err = MASTER_Read_ATS3615_Crc(&crc_value_reg);
+
+            os_sem_take(&crc_work.done, OS_FOREVER);
+
+            if (!err && crc_work.crc == crc_value_reg)
+                continue;
+
+            printk("section @ %08x: crc %x slave %x, verify per chunk\n",
+                    dolphin_addr + write_size, crc_work.crc, crc_value_reg);
+            dolphin_fw_direct_ok = false;
+        }
+
+        ret = Dolphin_Firmware_Write_Verified(dolphin_addr + write_size,
+                (const uint8_t *)data + write_size, one_write_size);
+        if (ret)
+            return ret;
+    }
+
+    return FIRMWARE_PROG_STATUS_OK;
+}
+
+firmware_prog_status_t Dolphin_Firmware_Send(void* spidev, const void* firmware_data)
+{
+    const uint32_t* firmware = (const uint32_t*)firmware_data;
+    int ret = FIRMWARE_PROG_STATUS_OK;
+    uint32_t start_time = k_uptime_get_32();
+    uint32_t total_bytes = 0;
+
     for (int i = 0;;)
     {
         uint32_t cmd = firmware[i++];
@@ -66,16 +158,10 @@ firmware_prog_status_t Dolphin_Firmware_Send(void* spidev, const void* firmware_
             uint32_t num_w32 = firmware[i++];
             uint32_t num_bytes = num_w32 * 4;
             dbg_dolphin("Write Dolphin Mem @ %08x : [%d bytes]\n", cmd, num_bytes);
-            for(write_size = 0;write_size < num_bytes;){
-                one_write_size = ((num_bytes - write_size) >= max_size)?max_size:(num_bytes - write_size);
-                memcpy(buffer, &firmware[i] + write_size/4, one_write_size);
-                
-                if(MASTER_Write_ATS3615_Mem(cmd + write_size, (unsigned int*)buffer, one_write_size)){
-                    ret = FIRMWARE_PROG_STATUS_DSP_WRONG_CRC;
-                    goto exit;
-                }
-                write_size += one_write_size;
-	        }
+            ret = Dolphin_Firmware_Write_Section(spidev, cmd, &firmware[i], num_bytes);
+            if (ret)
+                goto exit;
+            total_bytes += num_bytes;
             i += num_w32;
         }
         else{
@@ -84,9 +170,8 @@ firmware_prog_status_t Dolphin_Firmware_Send(void* spidev, const void* firmware_
             goto exit;
         }
     }
+
+    dbg_dolphin("firmware %d bytes loaded in %d ms\n", total_bytes, k_uptime_get_32() - start_time);
 exit:
-    if (buffer){
-        free(buffer);
-    }
     return ret;
 }
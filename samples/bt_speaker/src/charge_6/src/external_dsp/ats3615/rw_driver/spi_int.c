@@ -1,5 +1,6 @@
 #include <zephyr.h>
 #include "../include/ats3615_reg.h"
+#include "../include/ats3615_inner.h"
 #include <device.h>
 #include <spi.h>
 #include <logging/sys_log.h>
@@ -33,6 +34,36 @@ unsigned int ATS3615_SPI_Master_Write_Slave(unsigned int register_addr,unsigned
     return ret?1:0;
 }
 
+/* one chip select transfer, data is split into dma sized buffers */
+unsigned int ATS3615_SPI_Master_Write_Slave_Bulk(unsigned int register_addr, const unsigned int *w_buffer, unsigned int byte_count)
+{
+    struct device *spi_device = device_get_binding(CONFIG_SPI_1_NAME);
+    u32_t addr[1];
+    struct spi_buf spi_bufs[1 + ATS3615_SPI_BULK_BUF_NUM];
+    unsigned int n, len;
+    int ret;
+
+    if (byte_count > ATS3615_SPI_BULK_MAX_SIZE)
+        return 1;
+
+    addr[0] = register_addr;
+    spi_bufs[0].buf = addr;
+    spi_bufs[0].len = 4;
+
+    for (n = 1; byte_count; n++) {
+        len = (byte_count > ATS3615_SPI_XFER_MAX_SIZE) ? ATS3615_SPI_XFER_MAX_SIZE : byte_count;
+        spi_bufs[n].buf = (void *)w_buffer;
+        spi_bufs[n].len = len;
+        w_buffer += len / 4;
+        byte_count -= len;
+    }
+
+    dsp_3615_config.dev = spi_device;
+    ret = spi_transceive(&dsp_3615_config,spi_bufs,n,NULL,0);
+
+    return ret?1:0;
+}
+
 unsigned int ATS3615_SPI_Master_Read_Slave(unsigned int register_addr, unsigned int *r_w_buffer, unsigned int  n/*word count*/)
 {
     struct device *spi_device = device_get_binding(CONFIG_SPI_1_NAME);
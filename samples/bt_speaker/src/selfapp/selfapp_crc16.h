@@ -14,14 +14,13 @@
 #define __CRC16_H
 
 #include <zephyr/types.h>
-
-extern u16_t const crc16_table[256];
+#include <crc.h>
 
 extern u16_t self_crc16(u16_t crc, const u8_t * buffer, unsigned int len);
 
 static inline u16_t crc16_byte(u16_t crc, const u8_t data)
 {
-	return (crc >> 8) ^ crc16_table[(crc ^ data) & 0xff];
+	return utils_crc16_ibm_rev_update(crc, &data, 1);
 }
 
 #endif				/* __CRC16_H */
@@ -67,6 +67,7 @@ static inline int tool_is_quitting(void)
 void tool_aset_loop(void);
 void tool_asqt_loop(void);
 void tool_dump_loop(void);
+void tool_profile_loop(void);
 void tool_ectt_loop(void);
 void tool_att_loop(void);
 void tool_rett_loop(void);
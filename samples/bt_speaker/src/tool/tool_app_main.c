@@ -141,6 +141,16 @@ static void tool_process_deal(void *p1, void *p2, void *p3)
 			break;
 #endif
 
+#ifdef CONFIG_TOOL_PROFILE
+		case STUB_PC_TOOL_PROFILE_MODE:
+			SYS_LOG_INF("PROFILE");
+#if TOOL_INIT_SYNC
+			os_sem_give(&g_tool_data.init_sem);
+#endif
+			tool_profile_loop();
+			break;
+#endif
+
 #ifdef CONFIG_TOOL_ASET
 		case STUB_PC_TOOL_ASET_EQ_MODE:
 			SYS_LOG_INF("ASET");
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2023 Actions Semiconductor Co., Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file pc tool cpu profile
+ *
+ * Streams the kernel scheduler profile records (see cpuload_stat.h) to the
+ * pc tool while the tool is in the started state.
+ */
+
+#include "tool_app_inner.h"
+#include <cpuload_stat.h>
+
+#define  STUB_CMD_PROFILE_READ_PC_TOOL_STATUS (0x0100)
+#define  STUB_CMD_PROFILE_UPLOAD_DATA         (0xd200)
+
+#define LAZY_DELAY 100
+#define WORK_DELAY 50
+/* one THREAD/IRQ record per thread and vector every period */
+#define SNAPSHOT_PERIOD_MS 1000
+
+#define PROFILE_UPLOAD_RECORDS 16
+
+static struct cpuload_profile_record profile_upload_buf[PROFILE_UPLOAD_RECORDS];
+
+static int profile_stub_get_status(void)
+{
+	int32_t status = -1;
+
+	if (stub_get_data(tool_stub_dev_get(), STUB_CMD_PROFILE_READ_PC_TOOL_STATUS, &status, 4))
+		return -1;
+
+	return status;
+}
+
+static int profile_upload_data(void)
+{
+	int len;
+
+	while ((len = cpuload_profile_read(profile_upload_buf, sizeof(profile_upload_buf))) > 0) {
+		if (stub_set_data(tool_stub_dev_get(), STUB_CMD_PROFILE_UPLOAD_DATA,
+				profile_upload_buf, len)) {
+			SYS_LOG_WRN("upload failed");
+			return -EIO;
+		}
+	}
+
+	return 0;
+}
+
+void tool_profile_loop(void)
+{
+	u32_t snapshot_time = 0;
+	bool running = false;
+	int status;
+
+	SYS_LOG_INF("Enter");
+
+	while (!tool_is_quitting()) {
+		status = profile_stub_get_status();
+		if (status < 0) {
+			os_sleep(LAZY_DELAY);
+			continue;
+		}
+
+		if (status == sUserStart && !running) {
+			SYS_LOG_INF("profile start");
+			cpuload_profile_start();
+			snapshot_time = os_uptime_get_32();
+			running = true;
+		} else if ((status == sUserStop || status == sReady) && running) {
+			SYS_LOG_INF("profile stop");
+			cpuload_profile_snapshot();
+			profile_upload_data();
+			cpuload_profile_stop();
+			running = false;
+		}
+
+		if (!running) {
+			os_sleep(LAZY_DELAY);
+			continue;
+		}
+
+		if (os_uptime_get_32() - snapshot_time >= SNAPSHOT_PERIOD_MS) {
+			snapshot_time = os_uptime_get_32();
+			cpuload_profile_snapshot();
+		}
+
+		/* events are pushed from irq context, drain them often */
+		profile_upload_data();
+		os_sleep(WORK_DELAY);
+	}
+
+	if (running)
+		cpuload_profile_stop();
+
+	SYS_LOG_INF("Exit");
+}
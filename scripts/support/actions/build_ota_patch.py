@@ -20,6 +20,7 @@ import shutil
 import zipfile
 import xml.etree.ElementTree as ET
 import zlib
+import lzma
 
 script_path = os.path.split(os.path.realpath(__file__))[0]
 
@@ -173,6 +174,142 @@ def generate_diff_patch(old_file, new_file, patch_file):
         print(outmsg)
         sys.exit(1)
 
+STREAM_PATCH_MAGIC = 0x48435053
+STREAM_PATCH_VERSION = 1
+STREAM_PATCH_HEADER_SIZE = 40
+# bytes hashed to find a match, old file positions are indexed every 4 bytes
+STREAM_PATCH_KEY = 8
+STREAM_PATCH_MIN_MATCH = 16
+# an add region ends once its mismatches outweigh its matches by this much
+STREAM_PATCH_MAX_DROP = 32
+
+def stream_patch_varint(val):
+    out = bytearray()
+    while val >= 0x80:
+        out.append((val & 0x7f) | 0x80)
+        val >>= 7
+    out.append(val)
+    return out
+
+def stream_patch_zigzag(val):
+    return (val << 1) if val >= 0 else ((-val) << 1) - 1
+
+def stream_patch_extend(old, new, o, p, end):
+    """length of the add region at new[p] against old[o], at least half matches"""
+    n = min(end - p, len(old) - o)
+    i = score = best = best_score = 0
+    while i < n:
+        if i + 32 <= n and old[o + i:o + i + 32] == new[p + i:p + i + 32]:
+            i += 32
+            score += 32
+        else:
+            score += 1 if old[o + i] == new[p + i] else -1
+            i += 1
+        if score > best_score:
+            best = i
+            best_score = score
+        elif score < best_score - STREAM_PATCH_MAX_DROP:
+            break
+    return best
+
+def stream_patch_segment(old, new, index, start, end, last):
+    """(old pos, new pos, add len, insert end) ops of new[start:end]"""
+    ops = []
+    p = lit = start
+    while p < end:
+        best, best_o = 0, None
+        cands = []
+        if last is not None:
+            cands.append(last[0] + p - last[1])
+        o = index.get(bytes(new[p:p + STREAM_PATCH_KEY]))
+        if o is not None:
+            cands.append(o)
+        for o in cands:
+            if 0 <= o < len(old):
+                n = stream_patch_extend(old, new, o, p, end)
+                if n > best:
+                    best, best_o = n, o
+        if best < STREAM_PATCH_MIN_MATCH:
+            p += 1
+            continue
+        if ops:
+            ops[-1][3] = p
+        elif p > start:
+            ops.append([None, start, 0, p])
+        ops.append([best_o, p, best, p + best])
+        p += best
+        last = (best_o + best, p)
+    if not ops:
+        ops.append([None, start, 0, end])
+    ops[-1][3] = end
+    return ops, last
+
+def stream_patch_diff(old, new, ops):
+    diff = bytearray()
+    old_pos = 0
+    for o, p, n, ins_end in ops:
+        if o is None:
+            o = old_pos
+        ins = new[p + n:ins_end]
+        diff += stream_patch_varint(stream_patch_zigzag(o - old_pos))
+        diff += stream_patch_varint(n)
+        diff += stream_patch_varint(len(ins))
+        diff += bytes((new[p + i] - old[o + i]) & 0xff for i in range(n))
+        diff += ins
+        old_pos = o + n
+    return diff
+
+def generate_stream_patch(old_file, new_file, patch_file, window, seg_size):
+    """segmented add/insert diff, each segment a raw LZMA2 stream, see ota_stream_patch.h"""
+    with open(old_file, 'rb') as f:
+        old = f.read()
+    with open(new_file, 'rb') as f:
+        new = f.read()
+
+    index = {}
+    for i in range(0, len(old) - STREAM_PATCH_KEY + 1, 4):
+        index.setdefault(old[i:i + STREAM_PATCH_KEY], i)
+
+    filters = [{'id': lzma.FILTER_LZMA2, 'preset': 9 | lzma.PRESET_EXTREME,
+                'dict_size': max(window, 4096)}]
+    seg_num = (len(new) + seg_size - 1) // seg_size
+    records = []
+    max_diff = max_lzma = 0
+    last = None
+    for seg in range(seg_num):
+        start = seg * seg_size
+        end = min(start + seg_size, len(new))
+        ops, last = stream_patch_segment(old, new, index, start, end, last)
+        diff = stream_patch_diff(old, new, ops)
+        if len(diff) > window:
+            panic('segment %d diff 0x%x exceeds window 0x%x, use a smaller segment' \
+                  %(seg, len(diff), window))
+        data = lzma.compress(bytes(diff), format = lzma.FORMAT_RAW, filters = filters)
+        records.append(data)
+        max_diff = max(max_diff, len(diff))
+        max_lzma = max(max_lzma, len(data))
+
+    offs = STREAM_PATCH_HEADER_SIZE + 4 * seg_num
+    table = bytearray()
+    for data in records:
+        table += struct.pack('<I', offs)
+        offs += 4 + len(data)
+
+    header = struct.pack('<IHHIIIIIII', STREAM_PATCH_MAGIC, STREAM_PATCH_VERSION,
+                         STREAM_PATCH_HEADER_SIZE, len(old), zlib.crc32(old) & 0xffffffff,
+                         len(new), seg_size, seg_num, max_diff, max_lzma)
+    header += struct.pack('<I', zlib.crc32(header) & 0xffffffff)
+
+    with open(patch_file, 'wb') as f:
+        f.write(header)
+        f.write(table)
+        for data in records:
+            f.write(struct.pack('<I', len(data)))
+            f.write(data)
+
+    print('OTA: stream patch %s: %d -> %d bytes, %d segments, window 0x%x lzma 0x%x' \
+          %(os.path.basename(new_file), len(new), offs, seg_num, max_diff, max_lzma))
+
 class ota_file(object):
     def __init__(self, ota_xml_file):
         self.version = 0
@@ -279,7 +416,8 @@ def update_patch_ota_xml(old_ota, new_ota, patch_ota):
     patch_ota_root.insert(0, old_ota_ver)
 
 
-def generate_ota_patch_image(patch_ota_file, old_ota_file, new_ota_file, temp_dir):
+def generate_ota_patch_image(patch_ota_file, old_ota_file, new_ota_file, temp_dir, \
+                             stream = False, window = 0x4000, seg_size = 0x2000):
     temp_old_ota_dir = os.path.join(temp_dir, 'old_ota')
     temp_new_ota_dir = os.path.join(temp_dir, 'new_ota')
     temp_patch_dir = os.path.join(temp_dir, 'new_ota_patch')
@@ -305,7 +443,10 @@ def generate_ota_patch_image(patch_ota_file, old_ota_file, new_ota_file, temp_di
             new_file = os.path.join(temp_new_ota_dir, file_name);
             patch_file = os.path.join(temp_patch_dir, file_name);
 
-            generate_diff_patch(old_file, new_file, patch_file)
+            if stream:
+                generate_stream_patch(old_file, new_file, patch_file, window, seg_size)
+            else:
+                generate_diff_patch(old_file, new_file, patch_file)
 
             #file_size = os.path.getsize(patch_file)
             #checksum = crc32_file(patch_file)
@@ -325,6 +466,12 @@ def main(argv):
     parser.add_argument('-o', dest = 'old_ota_file', required=True)
     parser.add_argument('-n', dest = 'new_ota_file', required=True)
     parser.add_argument('-p', dest = 'patch_ota_file', required=True)
+    parser.add_argument('-s', dest = 'stream', action = 'store_true',
+                        help = 'stream patch, applied while received (CONFIG_OTA_STREAM_PATCH)')
+    parser.add_argument('-w', dest = 'window', type = lambda x: int(x, 0), default = 0x4000,
+                        help = 'stream patch window, CONFIG_OTA_STREAM_PATCH_WINDOW of the device')
+    parser.add_argument('-g', dest = 'seg_size', type = lambda x: int(x, 0), default = 0x2000,
+                        help = 'stream patch new file bytes per segment')
     args = parser.parse_args();
 
     old_ota_file = args.old_ota_file
@@ -339,7 +486,10 @@ def main(argv):
 
     try:
         temp_dir = os.path.dirname(patch_ota_file)
-        generate_ota_patch_image(patch_ota_file, old_ota_file, new_ota_file, temp_dir)
+        if args.seg_size <= 0 or args.seg_size % 0x20:
+            panic('segment size shall be a multiple of 32')
+        generate_ota_patch_image(patch_ota_file, old_ota_file, new_ota_file, temp_dir, \
+                                 args.stream, args.window, args.seg_size)
 
     except Exception as e:
         print('\033[1;31;40m')
@@ -33,6 +33,37 @@ def is_windows():
     else:
         return 0
 
+SDFS_HEAD_NAME = b'sdfs.bin'
+SDFS_DIR_ENTRY_SIZE = 32
+SDFS_DIR_SORTED_MAGIC = 0x54524f53
+
+def sort_sdfs_dir(sdfs_file):
+    """
+    Sort directory entries by case insensitive name so that the runtime
+    can binary search them, and mark the head with SDFS_DIR_SORTED_MAGIC.
+    Data offsets are absolute and the head entry checksum is a word sum,
+    so reordering entries keeps the image valid.
+    """
+    with open(sdfs_file, 'rb') as f:
+        data = bytearray(f.read())
+
+    if len(data) < SDFS_DIR_ENTRY_SIZE or data[0:8] != SDFS_HEAD_NAME:
+        print('SDFS: invalid image head, skip sorting')
+        return
+
+    total = struct.unpack_from('<i', data, 12)[0]
+    dir_end = SDFS_DIR_ENTRY_SIZE * (total + 1)
+    entries = [bytes(data[i:i + SDFS_DIR_ENTRY_SIZE])
+        for i in range(SDFS_DIR_ENTRY_SIZE, dir_end, SDFS_DIR_ENTRY_SIZE)]
+
+    # same order as strncasecmp(name, fname, 12), stable for duplicates
+    entries.sort(key = lambda e: e[0:12].lower())
+    data[SDFS_DIR_ENTRY_SIZE:dir_end] = b''.join(entries)
+    struct.pack_into('<I', data, 20, SDFS_DIR_SORTED_MAGIC)
+
+    with open(sdfs_file, 'wb') as f:
+        f.write(data)
+
 def main(argv):
     parser = argparse.ArgumentParser(
         description='Build sdfs image (sdfs)',
@@ -62,6 +93,8 @@ def main(argv):
         print(outmsg)
         sys.exit(1)
 
+    sort_sdfs_dir(args.output_file)
+
     print('SDFS: Generate sdfs file: %s.' %args.output_file)
 
 if __name__ == "__main__":
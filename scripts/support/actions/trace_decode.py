@@ -0,0 +1,282 @@
+#!/usr/bin/env python3
+#
+# Decode the binary trace (CONFIG_TRACE_BINARY) of Actions SoC
+#
+# Copyright (c) 2020 Actions Semiconductor Co., Ltd
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+
+import sys
+import struct
+import argparse
+from elftools.elf.elffile import ELFFile
+
+TRACE_BINARY_SYNC = 0xA5
+TRACE_BINARY_MAX_ARGS = 16
+
+# conversion types, as bin_next() of trace_binary.c
+BIN_NONE, BIN_INT, BIN_SINT, BIN_LL, BIN_PTR, BIN_DBL, BIN_STR = range(7)
+
+
+class Image(object):
+    def __init__(self, elf_file):
+        self.sections = []
+        self.strings = {}
+
+        with open(elf_file, 'rb') as f:
+            elf = ELFFile(f)
+            for sec in elf.iter_sections():
+                if sec['sh_type'] == 'SHT_PROGBITS' and sec['sh_addr'] and sec['sh_size']:
+                    self.sections.append((sec['sh_addr'], sec.data()))
+
+    def string(self, addr):
+        if addr in self.strings:
+            return self.strings[addr]
+
+        for start, data in self.sections:
+            if start <= addr < start + len(data):
+                end = data.find(b'\0', addr - start)
+                if end < 0:
+                    end = len(data)
+                s = data[addr - start:end].decode('latin-1')
+                self.strings[addr] = s
+                return s
+
+        return None
+
+
+def conversions(fmt):
+    """yield (start, end, type, stars) for each conversion of fmt"""
+    pos = 0
+    while True:
+        start = fmt.find('%', pos)
+        if start < 0:
+            return
+
+        p = start + 1
+        stars = longs = 0
+        while p < len(fmt):
+            c = fmt[p]
+            if c in '-+ #.0123456789h':
+                p += 1
+                continue
+            if c == '*':
+                stars += 1
+                p += 1
+                continue
+            if c in 'lz':
+                longs += 1
+                p += 1
+                continue
+            break
+        else:
+            return
+
+        c = fmt[p]
+        # long is 32 bit on the SoC
+        if c in 'di':
+            conv = BIN_LL if longs > 1 else BIN_SINT
+        elif c in 'uxXo':
+            conv = BIN_LL if longs > 1 else BIN_INT
+        elif c == 'c':
+            conv = BIN_INT
+        elif c == 'p':
+            conv = BIN_PTR
+        elif c == 's':
+            conv = BIN_STR
+        elif c in 'feEgG':
+            conv = BIN_DBL
+        else:
+            conv = BIN_NONE
+
+        pos = p + 1
+        yield start, pos, conv, stars
+
+
+def conv_words(conv, stars):
+    if conv == BIN_NONE:
+        return stars
+    if conv in (BIN_LL, BIN_DBL):
+        return stars + 2
+    return stars + 1
+
+
+def varint(data, pos):
+    val = shift = 0
+    while pos < len(data):
+        b = data[pos]
+        pos += 1
+        val |= (b & 0x7f) << shift
+        if not b & 0x80:
+            return val & 0xffffffff, pos
+        shift += 7
+    raise ValueError('truncated varint')
+
+
+def zigzag(val):
+    return ((val >> 1) ^ -(val & 1)) & 0xffffffff
+
+
+def signed(val, bits):
+    if val & (1 << (bits - 1)):
+        return val - (1 << bits)
+    return val
+
+
+def python_spec(spec, stars):
+    """C conversion to python %, '*' replaced by its values"""
+    out = ''
+    for c in spec[:-1]:
+        if c == '*':
+            out += '%d' % stars.pop(0)
+        elif c not in 'hlz':
+            out += c
+    return out + spec[-1]
+
+
+def render(image, fmt, payload):
+    """text of a message, payload is what follows the timestamp"""
+    pos = 0
+    out = ''
+    last = 0
+    nargs = 0
+    convs = []
+
+    # argument words first, string copies follow the last one
+    for start, end, conv, stars in conversions(fmt):
+        if conv == BIN_NONE and fmt[start:end] == '%%':
+            convs.append((start, end, conv, None))
+            continue
+        # the encoder stops where the arguments overflow
+        if nargs + conv_words(conv, stars) > TRACE_BINARY_MAX_ARGS:
+            break
+
+        nargs += conv_words(conv, stars)
+        words = []
+        for i in range(conv_words(conv, stars)):
+            val, pos = varint(payload, pos)
+            words.append(val)
+        convs.append((start, end, conv, words))
+
+    strings = payload[pos:].split(b'\0')
+
+    for start, end, conv, words in convs:
+        out += fmt[last:start]
+        last = end
+        spec = fmt[start:end]
+
+        if words is None:
+            out += '%'
+            continue
+
+        stars = [signed(zigzag(w), 32) for w in words[:spec.count('*')]]
+        words = words[len(stars):]
+
+        if conv == BIN_NONE:
+            out += spec
+            continue
+
+        if conv == BIN_SINT:
+            arg = signed(zigzag(words[0]), 32)
+        elif conv == BIN_LL:
+            arg = words[0] | (words[1] << 32)
+            if spec[-1] in 'di':
+                arg = signed(arg, 64)
+        elif conv == BIN_DBL:
+            arg = struct.unpack('<d', struct.pack('<II', words[0], words[1]))[0]
+        elif conv == BIN_PTR:
+            spec = spec[:-1] + 'x'
+            out += '0x'
+            arg = words[0]
+        elif conv == BIN_STR:
+            if words[0]:
+                arg = image.string(words[0])
+                if arg is None:
+                    arg = '<0x%08x>' % words[0]
+            else:
+                arg = strings.pop(0).decode('latin-1') if strings else ''
+        elif spec[-1] == 'c':
+            arg = chr(words[0] & 0xff)
+        else:
+            arg = words[0]
+
+        if spec[-1] in 'ui':
+            spec = spec[:-1] + 'd'
+
+        try:
+            out += python_spec(spec, stars) % arg
+        except (TypeError, ValueError):
+            out += spec
+
+    return out + fmt[last:]
+
+
+def decode(image, data, out, clock, show_time):
+    """frames to text, plain bytes in between pass through"""
+    cycles = 0
+    pos = 0
+
+    while pos < len(data):
+        b = data[pos]
+        if b != TRACE_BINARY_SYNC or pos + 2 > len(data):
+            if b < 0x80:
+                out.write(chr(b))
+            pos += 1
+            continue
+
+        size = data[pos + 1]
+        payload = data[pos + 2:pos + 2 + size]
+        try:
+            if len(payload) < size or size < 5:
+                raise ValueError('truncated frame')
+
+            addr = struct.unpack('<I', payload[:4])[0]
+            delta, offs = varint(payload, 4)
+
+            if addr == 0:
+                drops = varint(payload, offs)[0]
+                text = '<%d logs dropped>\n' % drops
+            else:
+                fmt = image.string(addr)
+                if fmt is None:
+                    raise ValueError('format 0x%08x not in image' % addr)
+                text = render(image, fmt, payload[offs:])
+        except (ValueError, IndexError):
+            # not a frame after all
+            pos += 1
+            continue
+
+        cycles += signed(delta, 32)
+        if show_time and addr:
+            usec = cycles * 1000000 // clock
+            out.write('[%7d.%03d] ' % (usec // 1000, usec % 1000))
+
+        out.write(text)
+        pos += 2 + size
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description='Decode Actions binary trace output')
+    parser.add_argument('-e', dest='elf_file', required=True, help='ELF file of the running image')
+    parser.add_argument('-i', dest='log_file', help='raw trace capture, stdin if not given')
+    parser.add_argument('-c', '--clock', type=int, default=24000000,
+                        help='timestamp clock in Hz, default 24000000')
+    parser.add_argument('-n', '--no-time', action='store_true', help='no time prefix')
+    args = parser.parse_args(argv)
+
+    image = Image(args.elf_file)
+
+    if args.log_file:
+        with open(args.log_file, 'rb') as f:
+            data = f.read()
+    else:
+        data = sys.stdin.buffer.read()
+
+    decode(image, data, sys.stdout, args.clock, not args.no_time)
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -254,6 +254,30 @@ int fs_trunc_quick(fs_file_t *zfp, off_t length)
 	return translate_error(res);
 }
 
+#if _USE_FASTSEEK
+int fs_fastseek_enable(fs_file_t *zfp, u32_t *tbl, u32_t tbl_size)
+{
+	FRESULT res;
+
+	tbl[0] = tbl_size;
+	zfp->fp.cltbl = (DWORD *)tbl;
+
+	res = f_lseek(&zfp->fp, CREATE_LINKMAP);
+	if (res != FR_OK) {
+		/* tbl[0] holds the required size on FR_NOT_ENOUGH_CORE */
+		zfp->fp.cltbl = NULL;
+	}
+
+	return translate_error(res);
+}
+
+int fs_fastseek_disable(fs_file_t *zfp)
+{
+	zfp->fp.cltbl = NULL;
+	return 0;
+}
+#endif
+
 int fs_sync(fs_file_t *zfp)
 {
 	FRESULT res = FR_OK;
@@ -280,6 +304,17 @@ int fs_rename(const char *path_old, const char *path_new)
 	return translate_error(res);
 }
 
+#ifdef CONFIG_FAT_FILESYSTEM_CHMOD
+int fs_chmod(const char *path, u8_t attr, u8_t mask)
+{
+	FRESULT res;
+
+	res = f_chmod(path, attr, mask);
+
+	return translate_error(res);
+}
+#endif
+
 int fs_opendir_cluster(fs_dir_t *zdp, const char *path, unsigned int cluster, unsigned int blk_ofs)
 {
 	FRESULT res;
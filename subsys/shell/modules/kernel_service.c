@@ -532,6 +532,48 @@ static int shell_cmd_threadblock(int argc, char *argv[])
 
 #endif
 
+#ifdef CONFIG_CPU_LOAD_PROFILE
+#include <cpuload_stat.h>
+
+/*
+ * cmd: cpuprof
+ *   start
+ *   stop
+ *   show [clear]
+ */
+static int shell_cmd_cpuprof(int argc, char *argv[])
+{
+	int len;
+
+	if (argc < 2)
+		goto usage;
+
+	len = strlen(argv[1]);
+
+	if (!strncmp(argv[1], "start", len)) {
+		printk("Start cpu profile\n");
+		cpuload_profile_start();
+	} else if (!strncmp(argv[1], "stop", len)) {
+		printk("Stop cpu profile\n");
+		cpuload_profile_stop();
+	} else if (!strncmp(argv[1], "show", len)) {
+		cpuload_profile_dump(argc > 2 && !strcmp(argv[2], "clear"));
+	} else {
+		goto usage;
+	}
+
+	return 0;
+
+usage:
+	printk("usage:\n");
+	printk("  cpuprof start\n");
+	printk("  cpuprof stop\n");
+	printk("  cpuprof show [clear]\n");
+
+	return -EINVAL;
+}
+#endif
+
 #ifdef CONFIG_CPU_TASK_SWITCH_STAT
 static int shell_cmd_task_switch_stat(int argc, char *argv[])
 {
@@ -1108,6 +1150,10 @@ const struct shell_cmd kernel_commands[] = {
     { "threadblock", shell_cmd_threadblock, "thread block time statistic" },
 #endif
 
+#if defined(CONFIG_CPU_LOAD_PROFILE)
+    { "cpuprof", shell_cmd_cpuprof, "thread latency profile: cpuprof start/stop/show [clear]" },
+#endif
+
 #if defined(CONFIG_CPU_TASK_SWITCH_STAT)
     { "taskswitchstat", shell_cmd_task_switch_stat, "task switch time statistic" },
 #endif
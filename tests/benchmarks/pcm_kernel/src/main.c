@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2019 Actions Semiconductor Co., Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief Measure the PCM kernels on 1 ms blocks of 48 kHz stereo
+ */
+
+#include <zephyr.h>
+#include <tc_util.h>
+#include <pcm_kernel.h>
+
+#define BLOCK_FRAMES	48
+#define BLOCK_SAMPLES	(BLOCK_FRAMES * 2)
+#define NUM_LOOPS	1000
+
+static s16_t pcm[BLOCK_SAMPLES] __aligned(4);
+static s16_t mix_l[BLOCK_FRAMES] __aligned(4);
+static s16_t mix_r[BLOCK_FRAMES] __aligned(4);
+static s32_t pcm32[BLOCK_SAMPLES] __aligned(4);
+
+static u32_t sink;
+
+static void print_result(const char *name, u32_t cycles)
+{
+	TC_PRINT("%-24s %6u cycles per block\n", name, cycles / NUM_LOOPS);
+}
+
+/* per sample loops replaced by the kernels in audio_track.c */
+static void ref_mix_avg_stereo(s16_t *dest_buff, s16_t *src_buff, s16_t *mix_buff[2], int mix_samples)
+{
+	for (int i = 0; i < mix_samples; i++) {
+		*dest_buff++ = (*src_buff++) / 2 + mix_buff[0][i] / 2;
+		*dest_buff++ = (*src_buff++) / 2 + mix_buff[1][i] / 2;
+	}
+}
+
+static void ref_unpack_24(unsigned char *buf, int l32)
+{
+	uint32_t *dst = (uint32_t *)buf;
+	uint8_t *src = (uint8_t *)buf;
+
+	for (int i = l32 * 3 / 4 - 1, j = l32 / 4 - 1; i >= 0;) {
+		uint32_t v = ((uint32_t)src[i-2])<<8;
+		v |= ((uint32_t)src[i-1])<<16;
+		v |= ((uint32_t)src[i])<<24;
+		i -= 3;
+		dst[j--] = v;
+	}
+}
+
+static void ref_upmix_32(unsigned char *buf, int l32)
+{
+	int32_t *dst = (int32_t *)buf;
+	int32_t *src = (int32_t *)buf;
+
+	for (int i = l32 / 4 - 1, j = l32 * 2 / 4 - 1; i >= 0;) {
+		dst[j--] = src[i];
+		dst[j--] = src[i];
+		i--;
+	}
+}
+
+#define MEASURE(name, stmt)						\
+	do {								\
+		u32_t start = k_cycle_get_32();				\
+		for (i = 0; i < NUM_LOOPS; i++) {			\
+			stmt;						\
+		}							\
+		print_result(name, k_cycle_get_32() - start);		\
+		sink += pcm[i % BLOCK_SAMPLES] + pcm32[i % BLOCK_SAMPLES]; \
+	} while (0)
+
+void main(void)
+{
+	s16_t *mix_buff[2] = { mix_l, mix_r };
+	int i;
+
+	TC_START("PCM kernel benchmark");
+
+	for (i = 0; i < BLOCK_SAMPLES; i++) {
+		pcm[i] = i * 331;
+		pcm32[i] = i * 0x10101;
+	}
+	for (i = 0; i < BLOCK_FRAMES; i++) {
+		mix_l[i] = i * 577;
+		mix_r[i] = -i * 577;
+	}
+
+	MEASURE("mix avg (scalar)", ref_mix_avg_stereo(pcm, pcm, mix_buff, BLOCK_FRAMES));
+	MEASURE("mix avg", pcm_mix_avg_stereo_s16(pcm, pcm, mix_l, mix_r, BLOCK_FRAMES));
+	MEASURE("mix sat", pcm_mix_sat_s16(pcm, pcm, pcm, BLOCK_SAMPLES));
+	MEASURE("gain ramp", pcm_gain_ramp_s16(pcm, BLOCK_FRAMES, 2, 0, 0x8000 / BLOCK_FRAMES));
+	MEASURE("unpack 24 (scalar)", ref_unpack_24((unsigned char *)pcm32, BLOCK_SAMPLES * 4));
+	MEASURE("unpack 24", pcm_unpack_24_32(pcm32, (u8_t *)pcm32, BLOCK_SAMPLES));
+	MEASURE("widen 16", pcm_widen_16_32(pcm32, (s16_t *)pcm32, BLOCK_SAMPLES));
+	MEASURE("upmix 32 (scalar)", ref_upmix_32((unsigned char *)pcm32, BLOCK_FRAMES * 4));
+	MEASURE("upmix 32", pcm_upmix_s32(pcm32, pcm32, BLOCK_FRAMES));
+	MEASURE("interleave", pcm_interleave_s16(pcm, mix_l, mix_r, BLOCK_FRAMES));
+	MEASURE("deinterleave", pcm_deinterleave_s16(mix_l, mix_r, pcm, BLOCK_FRAMES));
+	MEASURE("upmix 16", pcm_upmix_s16(pcm, pcm, BLOCK_FRAMES));
+
+	TC_PRINT("checksum %u\n", sink);
+
+	TC_END_RESULT(TC_PASS);
+	TC_END_REPORT(TC_PASS);
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2018 Actions Semiconductor Co., Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief Measure thread timer operations with 64 timers in one thread
+ */
+
+#include <zephyr.h>
+#include <tc_util.h>
+#include <thread_timer.h>
+
+#define NUM_TIMERS	64
+#define NUM_LOOPS	2048
+
+static struct thread_timer timers[NUM_TIMERS];
+static int expired_cnt;
+
+static void timer_expiry(struct thread_timer *ttimer, void *arg)
+{
+	expired_cnt++;
+}
+
+/* spread the durations over all wheel levels */
+static s32_t timer_duration(int i)
+{
+	return 10 + (i * 7919) % 5000;
+}
+
+static void print_result(const char *name, u32_t cycles)
+{
+	TC_PRINT("%-24s %6u cycles %6u ns\n", name, cycles / NUM_LOOPS,
+		 SYS_CLOCK_HW_CYCLES_TO_NS(cycles) / NUM_LOOPS);
+}
+
+void main(void)
+{
+	u32_t start, cycles;
+	int i, sum = 0;
+
+	TC_START("Thread timer benchmark");
+
+	for (i = 0; i < NUM_TIMERS; i++) {
+		thread_timer_init(&timers[i], timer_expiry, NULL);
+		thread_timer_start(&timers[i], timer_duration(i), 0);
+	}
+
+	start = k_cycle_get_32();
+	for (i = 0; i < NUM_LOOPS; i++) {
+		thread_timer_start(&timers[i % NUM_TIMERS],
+				   timer_duration(i), 0);
+	}
+	cycles = k_cycle_get_32() - start;
+	print_result("restart", cycles);
+
+	start = k_cycle_get_32();
+	for (i = 0; i < NUM_LOOPS; i++) {
+		thread_timer_stop(&timers[i % NUM_TIMERS]);
+		thread_timer_start(&timers[i % NUM_TIMERS],
+				   timer_duration(i), 0);
+	}
+	cycles = k_cycle_get_32() - start;
+	print_result("stop + start", cycles);
+
+	start = k_cycle_get_32();
+	for (i = 0; i < NUM_LOOPS; i++) {
+		sum += thread_timer_next_timeout();
+	}
+	cycles = k_cycle_get_32() - start;
+	print_result("next_timeout", cycles);
+
+	/* short periodic timers, expire a few per millisecond */
+	for (i = 0; i < NUM_TIMERS; i++) {
+		thread_timer_start(&timers[i], 1 + i % 16, 16 + i);
+	}
+
+	cycles = 0;
+	for (i = 0; i < NUM_LOOPS; i++) {
+		k_busy_wait(1000);
+		start = k_cycle_get_32();
+		thread_timer_handle_expired();
+		cycles += k_cycle_get_32() - start;
+	}
+	print_result("handle_expired (1 ms)", cycles);
+
+	TC_PRINT("%d timers expired, timeout sum %d\n", expired_cnt, sum);
+
+	for (i = 0; i < NUM_TIMERS; i++) {
+		thread_timer_stop(&timers[i]);
+	}
+
+	TC_END_RESULT(TC_PASS);
+	TC_END_REPORT(TC_PASS);
+}
@@ -0,0 +1,371 @@
+/*
+ * Copyright (c) 2020 Actions Semi Co., Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Runs the packed act_event log on easyflash over a ram nor flash and
+ * checks queries against a plain list of the records written, across
+ * sector ends, wrap around and power loss.
+ */
+
+#include <ztest.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+unsigned int irq_lock(void)
+{
+	return 0;
+}
+
+void irq_unlock(unsigned int key)
+{
+}
+
+#include <ext/actions/base/utils/cbuf/src/cbuf.c>
+#include <ext/actions/system/act_event/easyflash/ef_log.c>
+#include <ext/actions/system/act_event/act_event_pack.c>
+
+#define FLASH_BASE	0x10000
+#define FLASH_SECTORS	8
+#define FLASH_SIZE	(FLASH_SECTORS * EF_ERASE_MIN_SIZE)
+#define MAX_RECORDS	8000
+
+static u8_t flash[FLASH_SIZE];
+static u32_t flash_erases;
+
+static u8_t rbuf_data[256];
+static cbuf_t rbuf;
+static struct flash_buffer_ctx ctx;
+static struct act_event_pack pack;
+
+static act_event_record_t ref[MAX_RECORDS];
+static act_event_record_t found[MAX_RECORDS];
+static int found_num;
+
+static unsigned int seed = 1;
+
+EfErrCode ef_port_read(struct device *storage_dev, uint32_t addr, uint32_t *buf, size_t size)
+{
+	memcpy(buf, flash + addr - FLASH_BASE, size);
+	return EF_NO_ERR;
+}
+
+EfErrCode ef_port_write(struct device *storage_dev, uint32_t addr, const uint32_t *buf, size_t size)
+{
+	const u8_t *data = (const u8_t *)buf;
+	size_t i;
+
+	/* nor flash only clears bits */
+	for (i = 0; i < size; i++)
+		flash[addr - FLASH_BASE + i] &= data[i];
+
+	return EF_NO_ERR;
+}
+
+EfErrCode ef_port_erase(struct device *storage_dev, uint32_t addr, size_t size)
+{
+	memset(flash + addr - FLASH_BASE, 0xff, size);
+	flash_erases++;
+	return EF_NO_ERR;
+}
+
+void ef_log_debug(const char *file, const long line, const char *format, ...)
+{
+}
+
+void ef_log_info(const char *format, ...)
+{
+}
+
+static u32_t rnd(u32_t n)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 8) % n;
+}
+
+/* a reboot, what was not on flash is lost */
+static void boot(void)
+{
+	ctx.base_addr = FLASH_BASE;
+	ctx.total_size = FLASH_SIZE;
+	ctx.erase_enable = 1;
+	ctx.flush_enable = 1;
+	ctx.init_flag = 0;
+	ctx.rbuf = &rbuf;
+
+	cbuf_init(&rbuf, rbuf_data, sizeof(rbuf_data));
+	ef_log_init(&ctx);
+	zassert_equal(act_event_pack_init(&pack, &ctx, &rbuf), 0, "init");
+}
+
+static void format(void)
+{
+	memset(flash, 0xff, sizeof(flash));
+	boot();
+	zassert_equal(ef_log_get_used_size(&ctx), 0, "not empty");
+}
+
+static void gen(act_event_record_t *record, u32_t time, int modules)
+{
+	int i;
+
+	memset(record, 0, sizeof(*record));
+	record->time = time;
+	record->module_id = rnd(modules);
+	record->event_id = rnd(256);
+	record->level = 1 + rnd(4);
+	record->arg_num = rnd(MAX_EVENT_ARG_NUM + 1);
+
+	for (i = 0; i < record->arg_num; i++) {
+		switch (rnd(3)) {
+		case 0:
+			record->args[i] = rnd(0x100);
+			break;
+		case 1:
+			record->args[i] = rnd(0x10000);
+			break;
+		default:
+			record->args[i] = seed;
+			break;
+		}
+	}
+}
+
+/* write n records from time on, a few ms apart, returns the bytes written */
+static u32_t write(int first, int n, u32_t time, int modules)
+{
+	u32_t len = 0;
+	int i;
+
+	for (i = first; i < first + n; i++) {
+		time += rnd(8) ? rnd(300) : rnd(100000);
+		gen(&ref[i], time, modules);
+		len += act_event_pack_write(&pack, &ref[i]);
+	}
+
+	return len;
+}
+
+static int collect(const act_event_record_t *record, void *user_data)
+{
+	zassert_true(found_num < MAX_RECORDS, "too many");
+	found[found_num++] = *record;
+	return 0;
+}
+
+static int query(u32_t from, u32_t to, int module_id)
+{
+	int ret;
+
+	found_num = 0;
+	ret = act_event_pack_query(&pack, from, to, module_id, collect, NULL);
+	zassert_equal(ret, found_num, "query count");
+
+	return ret;
+}
+
+static bool same(const act_event_record_t *a, const act_event_record_t *b)
+{
+	return a->time == b->time && a->module_id == b->module_id &&
+		a->event_id == b->event_id && a->level == b->level &&
+		a->arg_num == b->arg_num &&
+		!memcmp(a->args, b->args, sizeof(a->args[0]) * a->arg_num);
+}
+
+/* query and compare with the matching records of ref[first, last) */
+static void check(int first, int last, u32_t from, u32_t to, int module_id)
+{
+	int i, n = 0;
+
+	query(from, to, module_id);
+
+	for (i = first; i < last; i++) {
+		if (ref[i].time < from || ref[i].time > to)
+			continue;
+		if (module_id >= 0 && ref[i].module_id != module_id)
+			continue;
+
+		zassert_true(n < found_num, "record missing");
+		zassert_true(same(&ref[i], &found[n]), "record differs");
+		n++;
+	}
+
+	zassert_equal(n, found_num, "extra records");
+}
+
+void test_roundtrip(void)
+{
+	u32_t len, end, sectors, from, span;
+	int i, n = 2500;
+
+	format();
+	len = write(0, n, 0, 31);
+
+	/* no padding, only the sector indexes */
+	end = ef_log_get_used_size(&ctx) + cbuf_get_used_space(&rbuf);
+	sectors = (end + ACT_EVENT_PACK_SECTOR_SIZE - 1) / ACT_EVENT_PACK_SECTOR_SIZE;
+	zassert_true(sectors > 3, "too short");
+	zassert_equal(end, len + sectors * sizeof(act_event_pack_index_t), "padded");
+	printf("%d records in %u bytes, %u sectors\n", n, end, sectors);
+
+	check(0, n, 0, UINT32_MAX, -1);
+
+	for (i = 0; i < 200; i++) {
+		from = rnd(ref[n - 1].time + 1000);
+		span = rnd(8) ? rnd(20000) : rnd(ref[n - 1].time);
+		check(0, n, from, from + span, rnd(4) ? -1 : rnd(32));
+	}
+
+	/* a window of the middle decodes only its sectors */
+	pack.sectors_read = pack.sectors_skipped = 0;
+	check(0, n, ref[n / 2].time, ref[n / 2 + 10].time, -1);
+	zassert_true(pack.sectors_read <= 2, "decoded out of the window");
+
+	/* a rare module is found by the sector masks */
+	ref[n].time = ref[n - 1].time + 1;
+	ref[n].module_id = 63;
+	ref[n].level = 2;
+	ref[n].event_id = 7;
+	ref[n].arg_num = 0;
+	act_event_pack_write(&pack, &ref[n]);
+	n++;
+
+	pack.sectors_read = pack.sectors_skipped = 0;
+	check(0, n, 0, UINT32_MAX, 63);
+	zassert_equal(found_num, 1, "rare module");
+	printf("rare module: %u sectors read, %u skipped\n", pack.sectors_read, pack.sectors_skipped);
+	zassert_true(pack.sectors_skipped >= sectors - 2, "masks not used");
+
+	/* stop early */
+	zassert_equal(act_event_pack_query(&pack, 0, UINT32_MAX, -1, NULL, NULL), n, "count");
+}
+
+void test_wrap(void)
+{
+	int i, n = 7000, first, kept;
+
+	format();
+	write(0, n, 1000, 20);
+
+	query(0, UINT32_MAX, -1);
+	printf("%d of %d records after wrap, %u erases\n", found_num, n, flash_erases);
+	zassert_true(found_num > 1000 && found_num < n, "wrap");
+
+	/* the newest records, in order */
+	kept = found_num;
+	first = n - kept;
+	for (i = 0; i < kept; i++)
+		zassert_true(same(&ref[first + i], &found[i]), "not the newest records");
+
+	for (i = 0; i < 50; i++)
+		check(first, n, ref[first + rnd(kept)].time, ref[first + rnd(kept)].time + rnd(50000),
+		      rnd(2) ? -1 : rnd(20));
+}
+
+void test_power_loss(void)
+{
+	u32_t time_base, len;
+	int cut, i, n, flashed, extra;
+
+	/* cut at all kinds of record bytes, short of a wrap */
+	for (cut = 0; cut < 100; cut++) {
+		format();
+		n = 200 + cut * 23;
+		len = write(0, n, 0, 32);
+		zassert_true(len > 0, "write");
+
+		/* the buffered bytes are lost */
+		boot();
+		time_base = pack.time_base;
+
+		query(0, UINT32_MAX, -1);
+		flashed = found_num;
+		for (i = 0; i < flashed; i++) {
+			if (!same(&ref[i], &found[i]))
+				break;
+		}
+
+		/* a record cut short comes back completed with zeros */
+		extra = flashed - i;
+		zassert_true(extra <= 1, "records lost");
+		zassert_true(i >= n - (int)sizeof(rbuf_data) / 4 - 1, "too many lost");
+		if (extra)
+			zassert_true(found[i].time == time_base, "cut record time");
+		flashed = i;
+
+		/* logging goes on in this boot's time */
+		for (i = n; i < n + 200; i++) {
+			gen(&ref[i], act_event_pack_time(&pack, 10 * (i - n)), 32);
+			act_event_pack_write(&pack, &ref[i]);
+		}
+
+		query(0, UINT32_MAX, -1);
+		zassert_equal(found_num, flashed + extra + 200, "records after reboot");
+		for (i = 0; i < 200; i++)
+			zassert_true(same(&ref[n + i], &found[flashed + extra + i]), "record after reboot");
+
+		check(n, n + 200, time_base + 1, UINT32_MAX, rnd(32));
+	}
+}
+
+void test_legacy(void)
+{
+	static const char line[] = "[E] evt: 0x12 0x34 0x56\n";
+	u32_t buf[8];
+	int n;
+
+	format();
+	memset(buf, 0, sizeof(buf));
+	memcpy(buf, line, sizeof(line));
+	ef_log_write(&ctx, buf, sizeof(buf));
+
+	boot();
+	zassert_equal(ef_log_get_used_size(&ctx), 0, "legacy log kept");
+
+	write(0, 100, 0, 8);
+	check(0, 100, 0, UINT32_MAX, -1);
+
+	/* cleared with bytes still buffered */
+	for (n = 100; !cbuf_get_used_space(&rbuf); n++)
+		write(n, 1, ref[n - 1].time, 8);
+	act_event_pack_clear(&pack);
+	write(n, 100, ref[n - 1].time, 8);
+	check(n, n + 100, 0, UINT32_MAX, -1);
+	zassert_equal(found_num, 100, "after clear");
+}
+
+void test_long_gap(void)
+{
+	u32_t gap_time;
+	int i, n = 300;
+
+	format();
+	write(0, 100, 0, 8);
+
+	/* longer than a record can encode, the gap record is moved back */
+	gap_time = ref[99].time + ACT_EVENT_PACK_MAX_DELTA + 5000;
+	gen(&ref[100], gap_time, 8);
+	act_event_pack_write(&pack, &ref[100]);
+	ref[100].time = ref[99].time + ACT_EVENT_PACK_MAX_DELTA;
+
+	/* the records after it keep their own time */
+	write(101, n - 101, gap_time, 8);
+
+	check(0, n, 0, UINT32_MAX, -1);
+	zassert_equal(found_num, n, "long gap");
+	for (i = 0; i < 20; i++)
+		check(0, n, ref[101 + rnd(n - 101)].time, ref[101 + rnd(n - 101)].time + rnd(20000), -1);
+}
+
+void test_main(void)
+{
+	ztest_test_suite(test_act_event_pack,
+			 ztest_unit_test(test_roundtrip),
+			 ztest_unit_test(test_wrap),
+			 ztest_unit_test(test_power_loss),
+			 ztest_unit_test(test_legacy),
+			 ztest_unit_test(test_long_gap));
+	ztest_run_test_suite(test_act_event_pack);
+}
@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2020 Actions Semiconductor Co., Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <ztest.h>
+/* C11 threads, the tree has its own pthread.h on the include path */
+#include <threads.h>
+
+#include <ext/actions/base/utils/acts_ringbuf/acts_ringbuf_spsc.c>
+
+#define TORTURE_BYTES	(4 * 1024 * 1024)
+
+static uint8_t ring_data[257];
+static struct acts_ringbuf ring;
+
+struct torture_arg {
+	struct acts_ringbuf *buf;
+	uint32_t bytes;
+	int batch;
+	int errors;
+};
+
+static void ring_setup(uint32_t size, uint64_t start)
+{
+	ring.head = ring.tail = start;
+	ring.size = size;
+	ring.mask = IS_POWER_OF_TWO(size) ? size - 1 : 0;
+	ring.cpu_ptr = (uint32_t)(uintptr_t)ring_data;
+	ring.dsp_ptr = UINT32_MAX;
+}
+
+static uint32_t next_len(uint32_t *seed, uint32_t max)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return 1 + (*seed >> 16) % max;
+}
+
+static int producer(void *p)
+{
+	struct torture_arg *arg = p;
+	struct acts_ringbuf_span span;
+	uint32_t seed = 1, sent = 0, len, i, n;
+	uint8_t chunk[64];
+
+	while (sent < arg->bytes) {
+		len = min_t(uint32_t, next_len(&seed, sizeof(chunk)), arg->bytes - sent);
+
+		if (!arg->batch) {
+			for (i = 0; i < len; i++)
+				chunk[i] = (uint8_t)(sent + i);
+			if (!acts_ringbuf_spsc_put(arg->buf, chunk, len)) {
+				thrd_yield();
+				continue;
+			}
+			sent += len;
+			continue;
+		}
+
+		n = acts_ringbuf_spsc_put_claim(arg->buf, &span, len);
+		for (i = 0; i < n; i++) {
+			uint8_t *dst = (i < span.len[0]) ? (uint8_t *)span.data[0] + i :
+				(uint8_t *)span.data[1] + i - span.len[0];
+			*dst = (uint8_t)(sent + i);
+		}
+		if (acts_ringbuf_spsc_put_commit(arg->buf, n))
+			arg->errors++;
+		if (!n)
+			thrd_yield();
+		sent += n;
+	}
+
+	return 0;
+}
+
+static int consumer(void *p)
+{
+	struct torture_arg *arg = p;
+	struct acts_ringbuf_span span;
+	uint32_t seed = 2, recv = 0, len, i, n;
+	uint8_t chunk[64];
+
+	while (recv < arg->bytes) {
+		len = min_t(uint32_t, next_len(&seed, sizeof(chunk)), arg->bytes - recv);
+
+		if (!arg->batch) {
+			if (!acts_ringbuf_spsc_get(arg->buf, chunk, len)) {
+				thrd_yield();
+				continue;
+			}
+			for (i = 0; i < len; i++) {
+				if (chunk[i] != (uint8_t)(recv + i))
+					arg->errors++;
+			}
+			recv += len;
+			continue;
+		}
+
+		n = acts_ringbuf_spsc_get_claim(arg->buf, &span, len);
+		for (i = 0; i < n; i++) {
+			uint8_t *src = (i < span.len[0]) ? (uint8_t *)span.data[0] + i :
+				(uint8_t *)span.data[1] + i - span.len[0];
+			if (*src != (uint8_t)(recv + i))
+				arg->errors++;
+		}
+		if (acts_ringbuf_spsc_get_commit(arg->buf, n))
+			arg->errors++;
+		if (!n)
+			thrd_yield();
+		recv += n;
+	}
+
+	return 0;
+}
+
+static void torture(uint32_t size, uint64_t start, int batch)
+{
+	struct torture_arg prod = { &ring, TORTURE_BYTES, batch, 0 };
+	struct torture_arg cons = { &ring, TORTURE_BYTES, !batch, 0 };
+	thrd_t tp, tc;
+
+	ring_setup(size, start);
+
+	zassert_equal(thrd_create(&tp, producer, &prod), thrd_success, NULL);
+	zassert_equal(thrd_create(&tc, consumer, &cons), thrd_success, NULL);
+	thrd_join(tp, NULL);
+	thrd_join(tc, NULL);
+
+	zassert_equal(prod.errors, 0, "producer errors");
+	zassert_equal(cons.errors, 0, "consumer errors");
+	zassert_equal(ring.tail - ring.head, 0, NULL);
+	zassert_true(ring.tail == start + TORTURE_BYTES, "tail lost elements");
+}
+
+static void test_spsc_basic(void)
+{
+	struct acts_ringbuf_span span;
+	uint8_t in[200], out[200];
+	int i;
+
+	for (i = 0; i < sizeof(in); i++)
+		in[i] = i;
+
+	ring_setup(257, 0);
+	zassert_equal(acts_ringbuf_spsc_space(&ring), 257, NULL);
+	zassert_equal(acts_ringbuf_spsc_put(&ring, in, 200), 200, NULL);
+	zassert_equal(acts_ringbuf_spsc_put(&ring, in, 100), 0, "overfill");
+	zassert_equal(acts_ringbuf_spsc_length(&ring), 200, NULL);
+	zassert_equal(acts_ringbuf_spsc_get(&ring, out, 150), 150, NULL);
+	zassert_true(!memcmp(in, out, 150), NULL);
+
+	/* wrapped claim is split in two areas */
+	zassert_equal(acts_ringbuf_spsc_put_claim(&ring, &span, 150), 150, NULL);
+	zassert_equal(span.len[0], 57, NULL);
+	zassert_equal(span.len[1], 93, NULL);
+	zassert_true(span.data[1] == ring_data, NULL);
+	zassert_equal(acts_ringbuf_spsc_put_commit(&ring, 300), -EINVAL, NULL);
+	zassert_equal(acts_ringbuf_spsc_put_commit(&ring, 150), 0, NULL);
+	zassert_equal(acts_ringbuf_spsc_length(&ring), 200, NULL);
+
+	zassert_equal(acts_ringbuf_spsc_get_claim(&ring, &span, 300), 200, NULL);
+	zassert_equal(acts_ringbuf_spsc_get_commit(&ring, 201), -EINVAL, NULL);
+	zassert_equal(acts_ringbuf_spsc_get_commit(&ring, 200), 0, NULL);
+	zassert_equal(acts_ringbuf_spsc_length(&ring), 0, NULL);
+	zassert_equal(acts_ringbuf_spsc_get(&ring, out, 1), 0, "underrun");
+}
+
+static void test_spsc_wrap32(void)
+{
+	uint8_t in[100], out[100];
+	int i;
+
+	for (i = 0; i < sizeof(in); i++)
+		in[i] = i;
+
+	/* counters cross 2^32 */
+	ring_setup(256, 0xffffffc0ULL);
+	zassert_equal(acts_ringbuf_spsc_put(&ring, in, 100), 100, NULL);
+	zassert_true(ring.tail == 0x100000024ULL, NULL);
+	zassert_equal(acts_ringbuf_spsc_length(&ring), 100, NULL);
+	zassert_equal(acts_ringbuf_spsc_space(&ring), 156, NULL);
+	zassert_equal(acts_ringbuf_spsc_get(&ring, out, 100), 100, NULL);
+	zassert_true(!memcmp(in, out, 100), NULL);
+	zassert_equal(acts_ringbuf_spsc_length(&ring), 0, NULL);
+}
+
+static void test_spsc_torture(void)
+{
+	torture(257, 0, 0);
+	torture(257, 0, 1);
+	torture(256, 0xfffff000ULL, 0);
+	torture(256, 0xfffff000ULL, 1);
+	torture(255, 0x1fffff000ULL, 1);
+}
+
+void test_main(void)
+{
+	ztest_test_suite(test_acts_ringbuf,
+			 ztest_unit_test(test_spsc_basic),
+			 ztest_unit_test(test_spsc_wrap32),
+			 ztest_unit_test(test_spsc_torture));
+	ztest_run_test_suite(test_acts_ringbuf);
+}
@@ -0,0 +1,242 @@
+/*
+ * Copyright (c) 2020 Actions Semi Co., Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Replays packet arrival traces through a simulated a2dp sink and reports
+ * underruns against latency for the jitter controller and for the fixed
+ * sbc water marks of audio_aps_monitor_normal. A recorded trace, one
+ * "arrival_ms payload_ms" pair per line, can be replayed as well:
+ *
+ *   APS_JITTER_TRACE=trace.txt outdir/testbinary
+ */
+
+#include <ztest.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <ext/actions/audio/audio_jitter.c>
+
+#define SIM_MS			(600 * 1000)
+#define SIM_SETTLE_MS		(120 * 1000)
+#define SIM_MAX_PKTS		(SIM_MS / 10)
+/* sink rate change per aps level */
+#define SIM_LEVEL_PPM		500
+
+/* sbc, not low latency */
+#define SIM_REDUCE		128
+#define SIM_INCREASE		228
+#define SIM_FLOOR		20
+#define SIM_INTERVAL		30
+#define SIM_MIN_LEVEL		1
+#define SIM_MAX_LEVEL		8
+#define SIM_DEFAULT_LEVEL	5
+
+struct sim_pkt {
+	u32_t arrival;
+	u16_t payload;
+};
+
+struct sim_result {
+	u32_t underrun_ms;
+	u32_t underruns;
+	double mean_fill;
+	double settled_fill;
+	int min_settled;
+};
+
+static struct sim_pkt trace[SIM_MAX_PKTS];
+static u32_t seed;
+
+static u32_t sim_rand(u32_t max)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 8) % max;
+}
+
+/* legacy hardware aps: jump to a limit past a water mark, back at mid */
+static u8_t legacy_level(u8_t *status, int fill)
+{
+	int mid = SIM_INCREASE - (SIM_INCREASE - SIM_REDUCE) / 2;
+
+	if (fill > SIM_INCREASE)
+		*status = SIM_MAX_LEVEL;
+	else if (fill < SIM_REDUCE)
+		*status = SIM_MIN_LEVEL;
+	else if ((*status == SIM_MAX_LEVEL && fill <= mid) ||
+		 (*status == SIM_MIN_LEVEL && fill >= mid))
+		*status = SIM_DEFAULT_LEVEL;
+
+	return *status;
+}
+
+static void simulate(const struct sim_pkt *pkts, int num, int drift_ppm,
+		bool adaptive, struct sim_result *res)
+{
+	audio_jitter_t jit;
+	u8_t status = SIM_DEFAULT_LEVEL, dest, level = SIM_DEFAULT_LEVEL;
+	double fill = 0, rate, sum = 0, settled = 0;
+	int start = SIM_REDUCE + (SIM_INCREASE - SIM_REDUCE) / 2;
+	int i = 0, playing = 0, dry = 0;
+	u32_t t, end = pkts[num - 1].arrival;
+
+	audio_jitter_init(&jit, SIM_INTERVAL, SIM_FLOOR, start, SIM_INCREASE,
+			SIM_MIN_LEVEL, SIM_MAX_LEVEL, SIM_DEFAULT_LEVEL, false);
+	memset(res, 0, sizeof(*res));
+	res->min_settled = INT16_MAX;
+
+	for (t = 0; t < end; t++) {
+		while (i < num && pkts[i].arrival <= t)
+			fill += pkts[i++].payload;
+
+		if (!playing) {
+			playing = (fill >= start);
+			continue;
+		}
+
+		if (!(t % SIM_INTERVAL)) {
+			dest = adaptive ? audio_jitter_update(&jit, (int)fill) :
+				legacy_level(&status, (int)fill);
+			/* audio_aps_monitor_set_aps moves one level per tick */
+			if (level < dest)
+				level++;
+			else if (level > dest)
+				level--;
+		}
+
+		rate = 1 + (drift_ppm + (level - SIM_DEFAULT_LEVEL) * SIM_LEVEL_PPM) / 1e6;
+		if (fill >= rate) {
+			fill -= rate;
+			dry = 0;
+		} else {
+			fill = 0;
+			res->underrun_ms++;
+			if (!dry++)
+				res->underruns++;
+		}
+
+		sum += fill;
+		if (t >= SIM_SETTLE_MS) {
+			settled += fill;
+			if ((int)fill < res->min_settled)
+				res->min_settled = (int)fill;
+		}
+	}
+
+	res->mean_fill = sum / end;
+	res->settled_fill = settled / (end - SIM_SETTLE_MS);
+
+	if (adaptive)
+		printf("  jitter %d ms target %d ms drift %d/256 levels\n",
+		       jit.jitter >> Q, jit.target >> Q, jit.drift >> Q);
+}
+
+static void report(const char *name, const struct sim_pkt *pkts, int num,
+		int drift_ppm, struct sim_result *adaptive, struct sim_result *fixed)
+{
+	printf("%s:\n", name);
+	simulate(pkts, num, drift_ppm, true, adaptive);
+	simulate(pkts, num, drift_ppm, false, fixed);
+	printf("  adaptive: underruns %u (%u ms) mean %d ms settled %d ms min %d ms\n",
+	       adaptive->underruns, adaptive->underrun_ms, (int)adaptive->mean_fill,
+	       (int)adaptive->settled_fill, adaptive->min_settled);
+	printf("  fixed:    underruns %u (%u ms) mean %d ms settled %d ms min %d ms\n",
+	       fixed->underruns, fixed->underrun_ms, (int)fixed->mean_fill,
+	       (int)fixed->settled_fill, fixed->min_settled);
+}
+
+/* sbc packets every 20 ms with a few ms of scheduling jitter */
+static int trace_steady(void)
+{
+	int i;
+
+	seed = 1;
+	for (i = 0; i < SIM_MS / 20; i++) {
+		trace[i].arrival = 100 + i * 20 + sim_rand(8);
+		trace[i].payload = 20;
+	}
+
+	return i;
+}
+
+/* same stream with wifi coexistence stalls, the backlog comes at once */
+static int trace_bursty(void)
+{
+	u32_t stall_start = 3000, stall_end = 3000;
+	int i;
+
+	seed = 2;
+	for (i = 0; i < SIM_MS / 20; i++) {
+		u32_t t = 100 + i * 20 + sim_rand(8);
+
+		if (t >= stall_end) {
+			stall_start = stall_end + 2000 + sim_rand(4000);
+			stall_end = stall_start + 40 + sim_rand(80);
+		}
+		if (t >= stall_start)
+			t = stall_end;
+
+		trace[i].arrival = (i && t < trace[i - 1].arrival) ? trace[i - 1].arrival : t;
+		trace[i].payload = 20;
+	}
+
+	return i;
+}
+
+static void test_steady(void)
+{
+	struct sim_result adaptive, fixed;
+
+	report("steady +80 ppm", trace, trace_steady(), 80, &adaptive, &fixed);
+	zassert_equal(adaptive.underruns, 0, NULL);
+	zassert_true(adaptive.settled_fill * 2 < fixed.settled_fill, "latency not reduced");
+
+	report("steady -300 ppm", trace, trace_steady(), -300, &adaptive, &fixed);
+	zassert_equal(adaptive.underruns, 0, NULL);
+	zassert_true(adaptive.settled_fill * 2 < fixed.settled_fill, "latency not reduced");
+}
+
+static void test_bursty(void)
+{
+	struct sim_result adaptive, fixed;
+
+	report("bursty -150 ppm", trace, trace_bursty(), -150, &adaptive, &fixed);
+	zassert_equal(adaptive.underruns, 0, NULL);
+	zassert_true(adaptive.settled_fill < fixed.settled_fill, "latency not reduced");
+}
+
+static void test_recorded(void)
+{
+	struct sim_result adaptive, fixed;
+	const char *path = getenv("APS_JITTER_TRACE");
+	unsigned int arrival, payload;
+	FILE *fp;
+	int num = 0;
+
+	if (!path)
+		return;
+
+	fp = fopen(path, "r");
+	zassert_not_null(fp, "cannot open trace");
+
+	while (num < SIM_MAX_PKTS && fscanf(fp, "%u %u", &arrival, &payload) == 2) {
+		trace[num].arrival = arrival;
+		trace[num].payload = payload;
+		num++;
+	}
+	fclose(fp);
+
+	zassert_true(num > 0 && trace[num - 1].arrival > SIM_SETTLE_MS, "trace too short");
+	report(path, trace, num, 0, &adaptive, &fixed);
+}
+
+void test_main(void)
+{
+	ztest_test_suite(test_audio_jitter,
+			 ztest_unit_test(test_steady),
+			 ztest_unit_test(test_bursty),
+			 ztest_unit_test(test_recorded));
+	ztest_run_test_suite(test_audio_jitter);
+}
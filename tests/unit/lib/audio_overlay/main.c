@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) 2020 Actions Semi Co., Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Plays an 8 KHz key tone clip over 48 KHz stereo music written to a track
+ * in periods of random length, as the stream writer does, and checks the
+ * tone lands on the frame it was started at, does not depend on where the
+ * periods split and has no step in it beyond those of the clip.
+ */
+
+#include <ztest.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CONFIG_AUDIO_TRACK_OVERLAY_CLIPS	4
+#define CONFIG_AUDIO_TRACK_OVERLAY_VOICES	2
+
+#include <ext/actions/audio/audio_overlay.c>
+
+#define TRACK_RATE	48
+#define FRAMES		(TRACK_RATE * 1000)
+#define MUSIC_AMP	8000
+
+#define CLIP_RATE	8
+#define CLIP_SAMPLES	400
+#define CLIP_AMP	12000
+/* track frames the clip plays for */
+#define CLIP_FRAMES	(CLIP_SAMPLES * TRACK_RATE / CLIP_RATE)
+
+static s16_t clip_pcm[CLIP_SAMPLES];
+static s16_t music[FRAMES * 2];
+static s16_t ref[FRAMES * 2];
+static s16_t out[FRAMES * 2];
+
+static const u32_t starts[] = { 1000, 9001, 17777, 30000 };
+
+static audio_overlay_t overlay;
+
+/* sin of 2 pi cycles, no libm in unit tests */
+static double sin_cycles(double cycles)
+{
+	double x = (cycles - (long)cycles) * 2 * 3.14159265358979;
+	double term = x, sum = x;
+	int n;
+
+	for (n = 1; n < 20; n++) {
+		term *= -x * x / ((2 * n) * (2 * n + 1));
+		sum += term;
+	}
+
+	return sum;
+}
+
+static void gen(void)
+{
+	double decay = CLIP_AMP;
+	int i;
+
+	/* 2 KHz tone decaying to silence */
+	for (i = 0; i < CLIP_SAMPLES; i++) {
+		clip_pcm[i] = decay * sin_cycles(2000.0 * i / 8000 + 0.05);
+		decay *= 0.9876;
+	}
+	clip_pcm[0] = 0;
+
+	for (i = 0; i < FRAMES; i++) {
+		music[2 * i] = MUSIC_AMP * sin_cycles(1000.0 * i / 48000);
+		music[2 * i + 1] = MUSIC_AMP * sin_cycles(440.0 * i / 48000 + 0.25);
+	}
+}
+
+static int setup(u8_t channels)
+{
+	int clip;
+
+	audio_overlay_init(&overlay);
+	audio_overlay_attach(&overlay, TRACK_RATE, channels);
+
+	clip = audio_overlay_register(&overlay, clip_pcm, CLIP_SAMPLES, CLIP_RATE,
+			AUDIO_OVERLAY_GAIN_UNITY);
+	zassert_equal(clip, 0, "register");
+
+	return clip;
+}
+
+/* write music in periods from 1 to max_period frames, starting the clip on time */
+static void play(s16_t *dst, int max_period)
+{
+	int clip = setup(2);
+	u32_t pos = 0, period;
+	unsigned int next = 0, seed = 1;
+
+	memcpy(dst, music, sizeof(music));
+
+	while (pos < FRAMES) {
+		seed = seed * 1103515245 + 12345;
+		period = 1 + (seed >> 8) % max_period;
+		if (period > FRAMES - pos)
+			period = FRAMES - pos;
+
+		/* key presses are handled between periods */
+		while (next < ARRAY_SIZE(starts) && starts[next] < pos + period) {
+			zassert_equal(audio_overlay_trigger(&overlay, clip, starts[next] - pos), 0, "trigger");
+			next++;
+		}
+
+		audio_overlay_mix(&overlay, dst + pos * 2, period);
+		pos += period;
+	}
+
+	zassert_equal(overlay.clock, FRAMES, "clock");
+	zassert_false(audio_overlay_is_active(&overlay), "still playing");
+}
+
+void test_glitch_free(void)
+{
+	s32_t tone, prev, step, max_step = 0, bound = 0;
+	int i, n;
+
+	gen();
+
+	/* frame by frame, then in periods up to longer than the clip */
+	play(ref, 1);
+	for (n = 8; n <= 8192; n *= 4) {
+		play(out, n);
+		zassert_true(!memcmp(ref, out, sizeof(out)), "mix depends on periods");
+	}
+
+	/* the clip interpolated six times, its steps shrink as much */
+	for (i = 1; i < CLIP_SAMPLES; i++)
+		bound = MAX(bound, abs(clip_pcm[i] - clip_pcm[i - 1]));
+	bound = MAX(bound, abs(clip_pcm[CLIP_SAMPLES - 1])) * CLIP_RATE / TRACK_RATE + 2;
+
+	prev = 0;
+	for (i = 0; i < FRAMES; i++) {
+		tone = ref[2 * i] - music[2 * i];
+		zassert_equal(tone, ref[2 * i + 1] - music[2 * i + 1], "channels differ");
+
+		step = abs(tone - prev);
+		max_step = MAX(max_step, step);
+		prev = tone;
+
+		/* nothing outside the clips */
+		for (n = 0; n < ARRAY_SIZE(starts); n++) {
+			if (i >= starts[n] && i <= starts[n] + CLIP_FRAMES)
+				break;
+		}
+		if (n == ARRAY_SIZE(starts))
+			zassert_equal(tone, 0, "tone outside of the clip");
+	}
+
+	printf("largest step %d, bound %d\n", max_step, bound);
+	zassert_true(max_step <= bound, "glitch");
+	zassert_equal(overlay.triggers, ARRAY_SIZE(starts), "triggers");
+	zassert_equal(overlay.steals, 0, "steals");
+}
+
+void test_start(void)
+{
+	s16_t buf[512];
+	int clip, i;
+
+	clip_pcm[0] = 1000;
+	clip = setup(1);
+
+	/* started in the middle of the next period */
+	memset(buf, 0, sizeof(buf));
+	audio_overlay_mix(&overlay, buf, 100);
+	audio_overlay_trigger(&overlay, clip, 237);
+	audio_overlay_mix(&overlay, buf, 200);
+	for (i = 0; i < 200; i++)
+		zassert_equal(buf[i], 0, "early");
+
+	audio_overlay_mix(&overlay, buf, 512);
+	for (i = 0; i < 37; i++)
+		zassert_equal(buf[i], 0, "early");
+	zassert_equal(buf[37], 1000, "not on the frame");
+
+	/* half gain */
+	audio_overlay_attach(&overlay, TRACK_RATE, 1);
+	audio_overlay_set_gain(&overlay, clip, AUDIO_OVERLAY_GAIN_UNITY / 2);
+	memset(buf, 0, sizeof(buf));
+	audio_overlay_trigger(&overlay, clip, 0);
+	audio_overlay_mix(&overlay, buf, 1);
+	zassert_equal(buf[0], 500, "gain");
+
+	clip_pcm[0] = 0;
+}
+
+void test_saturate(void)
+{
+	s16_t buf[2 * 64];
+	s16_t loud[4] = { 30000, 30000, -30000, -30000 };
+	int clip, i;
+
+	audio_overlay_init(&overlay);
+	audio_overlay_attach(&overlay, 16, 2);
+	clip = audio_overlay_register(&overlay, loud, 4, 16, AUDIO_OVERLAY_GAIN_UNITY);
+
+	for (i = 0; i < 64; i++) {
+		buf[2 * i] = 20000;
+		buf[2 * i + 1] = -20000;
+	}
+
+	audio_overlay_trigger(&overlay, clip, 0);
+	audio_overlay_mix(&overlay, buf, 64);
+
+	zassert_equal(buf[0], INT16_MAX, "no clamp");
+	zassert_equal(buf[1], 10000, "right");
+	zassert_equal(buf[4], -10000, "left");
+	zassert_equal(buf[5], INT16_MIN, "no clamp");
+	zassert_equal(buf[8], 20000, "after the clip");
+}
+
+void test_voices(void)
+{
+	s16_t pcm[4] = { 1, 2, 3, 4 };
+	s16_t buf[16];
+	int clip, i;
+
+	audio_overlay_init(&overlay);
+	audio_overlay_attach(&overlay, 44, 1);
+	zassert_equal(audio_overlay_register(&overlay, NULL, 4, 8, 0), -EINVAL, "no pcm");
+	for (i = 0; i < CONFIG_AUDIO_TRACK_OVERLAY_CLIPS; i++)
+		zassert_equal(audio_overlay_register(&overlay, pcm, 4, 8, AUDIO_OVERLAY_GAIN_UNITY), i, "register");
+	zassert_equal(audio_overlay_register(&overlay, pcm, 4, 8, 0), -ENOSPC, "full");
+	zassert_equal(overlay.clip[0].step, (8000 << 16) / 44100, "44.1 KHz step");
+
+	/* the voice started first goes */
+	audio_overlay_trigger(&overlay, 0, 10);
+	audio_overlay_trigger(&overlay, 1, 5);
+	audio_overlay_trigger(&overlay, 2, 0);
+	zassert_equal(overlay.steals, 1, "steals");
+	zassert_true(overlay.voice[0].clip == 1 && overlay.voice[1].clip == 3, "stole the wrong voice");
+
+	zassert_equal(audio_overlay_unregister(&overlay, 1), 0, "unregister");
+	zassert_equal(audio_overlay_trigger(&overlay, 1, 0), -EINVAL, "trigger unregistered");
+	zassert_equal(audio_overlay_set_gain(&overlay, 1, 0), -EINVAL, "gain unregistered");
+
+	clip = audio_overlay_register(&overlay, pcm, 4, 44, AUDIO_OVERLAY_GAIN_UNITY);
+	zassert_equal(clip, 1, "slot reused");
+	audio_overlay_unregister(&overlay, 2);
+	zassert_equal(overlay.voice[1].clip, 0, "voice of unregistered clip");
+
+	/* same rate plays the clip as is */
+	audio_overlay_attach(&overlay, 44, 1);
+	zassert_false(audio_overlay_is_active(&overlay), "attach stops voices");
+	memset(buf, 0, sizeof(buf));
+	audio_overlay_trigger(&overlay, clip, 0);
+	audio_overlay_mix(&overlay, buf, 16);
+	zassert_true(buf[0] == 1 && buf[3] == 4 && buf[4] == 0, "same rate");
+	zassert_false(audio_overlay_is_active(&overlay), "ended");
+}
+
+void test_main(void)
+{
+	ztest_test_suite(test_audio_overlay,
+			 ztest_unit_test(test_glitch_free),
+			 ztest_unit_test(test_start),
+			 ztest_unit_test(test_saturate),
+			 ztest_unit_test(test_voices));
+	ztest_run_test_suite(test_audio_overlay);
+}
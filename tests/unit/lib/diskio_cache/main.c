@@ -0,0 +1,585 @@
+/*
+ * Copyright (c) 2020 Actions Semiconductor Co., Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Runs the disk io cache over a ram disk, the cache thread runs whenever
+ * someone waits for it. Random reads and writes are checked against a
+ * plain copy of the disk, with a short last line and failing writes. Then
+ * FatFs reads and seeks a FLAC sized file with and without the cache and
+ * fast seek, counting disk commands as an SD card would see them.
+ */
+
+#include <ztest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define CONFIG_DISKIO_CACHE			1
+#define CONFIG_DISKIO_CACHE_LINE_SIZE		2048
+#define CONFIG_DISKIO_CACHE_WAYS		2
+#define CONFIG_DISKIO_CACHE_SETS		2
+#define CONFIG_DISKIO_CACHE_READ_AHEAD		1
+#define CONFIG_DISKIO_CACHE_READ_AHEAD_LINES	1
+#define CONFIG_FAT_FILESYSTEM_FASTSEEK		1
+#define CONFIG_FAT_FILESYSTEM_FASTSEEK_TBL_SIZE	64
+#define CONFIG_LONG_FILE_NAME			1
+#define CONFIG_RTC_0_NAME			"RTC_0"
+
+/* os_common_api.h and mem_manager.h need the kernel */
+#define __OS_COMMON_API_H__
+#define __MEM_MANAGER_H__
+
+#define OS_FOREVER		(-1)
+#define OS_NO_WAIT		0
+#define STACK_ALIGN		4
+#define OS_MUTEX_DEFINE(name)	int name
+
+#define os_mutex_lock(mutex, timeout)	((void)(mutex))
+#define os_mutex_unlock(mutex)		((void)(mutex))
+
+typedef struct {
+	int count;
+} os_sem;
+
+typedef struct {
+	void *head;
+	void *tail;
+} os_fifo;
+
+void *mem_malloc(unsigned int num_bytes);
+void mem_free(void *ptr);
+void os_sem_init(os_sem *sem, int initial_count, int limit);
+void os_sem_give(os_sem *sem);
+int os_sem_take(os_sem *sem, s32_t timeout);
+void os_fifo_init(os_fifo *fifo);
+void os_fifo_put(os_fifo *fifo, void *data);
+void *os_fifo_get(os_fifo *fifo, s32_t timeout);
+int os_thread_create(char *stack, size_t size, void (*entry)(void *, void *, void *),
+		void *p1, void *p2, void *p3, int prio, u32_t options, int delay);
+
+#include <ext/fs/fat/ff.c>
+#include <ext/fs/fat/option/unicode.c>
+#undef SYS_LOG_LEVEL
+#include <ext/fs/fat/diskio.c>
+#undef SYS_LOG_DOMAIN
+#undef SYS_LOG_LEVEL
+#include <ext/fs/fat/diskio_cache.c>
+
+#define SECTOR_SIZE	512
+#define LINE_SECTORS	(CONFIG_DISKIO_CACHE_LINE_SIZE / SECTOR_SIZE)
+
+/* SD card cost model: a command and the sectors it moves */
+#define CMD_US		150
+#define SECTOR_US	25
+
+#define FLAC_SIZE	(100 * 1024 * 1024)
+#define FAT_SECTORS	(128 * 1024 * 1024 / SECTOR_SIZE)
+#define FLAC_FRAGMENTS	24
+#define SEEKS		2000
+
+struct ram_disk {
+	struct disk_info info;
+	u8_t *data;
+	/* sectors of the device, past the end of the volume as well */
+	u32_t sectors;
+	u32_t cmds;
+	u32_t cmd_sectors;
+	u32_t overrun;
+	bool fail_write;
+};
+
+static struct ram_disk ram;
+static u8_t *ref;
+
+static void (*cache_thread)(void *, void *, void *);
+static void *cache_thread_arg;
+
+static unsigned int seed = 1;
+
+void *mem_malloc(unsigned int num_bytes)
+{
+	return malloc(num_bytes);
+}
+
+void mem_free(void *ptr)
+{
+	free(ptr);
+}
+
+void *ff_memalloc(UINT msize)
+{
+	return malloc(msize);
+}
+
+void ff_memfree(void *mblock)
+{
+	free(mblock);
+}
+
+int ff_cre_syncobj(BYTE vol, _SYNC_t *sobj)
+{
+	*sobj = NULL;
+	return 1;
+}
+
+int ff_req_grant(_SYNC_t sobj)
+{
+	return 1;
+}
+
+void ff_rel_grant(_SYNC_t sobj)
+{
+}
+
+int ff_del_syncobj(_SYNC_t sobj)
+{
+	return 1;
+}
+
+/* file times from a fixed date */
+static int rtc_get(struct device *dev, struct rtc_time *tm)
+{
+	memset(tm, 0, sizeof(*tm));
+	tm->tm_year = 120;
+	tm->tm_mday = 1;
+	return 0;
+}
+
+static const struct rtc_driver_api rtc_api = {
+	.get_time = rtc_get,
+};
+
+static struct device rtc_dev = {
+	.driver_api = &rtc_api,
+};
+
+struct device *device_get_binding(const char *name)
+{
+	return &rtc_dev;
+}
+
+/* the cache thread runs the queued requests */
+static void cache_thread_run(void)
+{
+	diskio_cache.terminal = 0;
+	cache_thread(cache_thread_arg, NULL, NULL);
+}
+
+void os_sem_init(os_sem *sem, int initial_count, int limit)
+{
+	sem->count = initial_count;
+}
+
+void os_sem_give(os_sem *sem)
+{
+	sem->count++;
+}
+
+int os_sem_take(os_sem *sem, s32_t timeout)
+{
+	if (!sem->count)
+		cache_thread_run();
+
+	if (!sem->count)
+		return -EAGAIN;
+
+	sem->count--;
+	return 0;
+}
+
+void os_fifo_init(os_fifo *fifo)
+{
+	fifo->head = fifo->tail = NULL;
+}
+
+void os_fifo_put(os_fifo *fifo, void *data)
+{
+	*(void **)data = NULL;
+	if (fifo->tail)
+		*(void **)fifo->tail = data;
+	else
+		fifo->head = data;
+	fifo->tail = data;
+}
+
+/* an empty fifo ends the thread loop */
+void *os_fifo_get(os_fifo *fifo, s32_t timeout)
+{
+	void *data = fifo->head;
+
+	if (!data) {
+		diskio_cache.terminal = 1;
+		return NULL;
+	}
+
+	fifo->head = *(void **)data;
+	if (!fifo->head)
+		fifo->tail = NULL;
+
+	return data;
+}
+
+int os_thread_create(char *stack, size_t size, void (*entry)(void *, void *, void *),
+		void *p1, void *p2, void *p3, int prio, u32_t options, int delay)
+{
+	cache_thread = entry;
+	cache_thread_arg = p1;
+	return 1;
+}
+
+static int ram_init(struct disk_info *disk)
+{
+	return 0;
+}
+
+static int ram_status(struct disk_info *disk)
+{
+	return DISK_STATUS_OK;
+}
+
+static bool ram_access(u32_t sector, u32_t count)
+{
+	ram.cmds++;
+	ram.cmd_sectors += count;
+
+	if (sector + count > ram.sectors) {
+		ram.overrun++;
+		return false;
+	}
+
+	return true;
+}
+
+static int ram_read(struct disk_info *disk, u8_t *buf, u32_t sector, u32_t count)
+{
+	if (!ram_access(sector, count))
+		return -EIO;
+
+	memcpy(buf, ram.data + sector * SECTOR_SIZE, count * SECTOR_SIZE);
+	return 0;
+}
+
+static int ram_write(struct disk_info *disk, const u8_t *buf, u32_t sector, u32_t count)
+{
+	if (!ram_access(sector, count) || ram.fail_write)
+		return -EIO;
+
+	memcpy(ram.data + sector * SECTOR_SIZE, buf, count * SECTOR_SIZE);
+	return 0;
+}
+
+static int ram_ioctl(struct disk_info *disk, u8_t cmd, void *buf)
+{
+	switch (cmd) {
+	case DISK_IOCTL_CTRL_SYNC:
+		break;
+	/* the FatFs types, DWORD is 64 bit on the host */
+	case DISK_IOCTL_GET_SECTOR_COUNT:
+		*(DWORD *)buf = disk->sector_cnt;
+		break;
+	case DISK_IOCTL_GET_SECTOR_SIZE:
+		*(WORD *)buf = SECTOR_SIZE;
+		break;
+	case DISK_IOCTL_GET_ERASE_BLOCK_SZ:
+		*(DWORD *)buf = 1;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static const struct disk_operation ram_op = {
+	.init		= ram_init,
+	.get_status	= ram_status,
+	.read		= ram_read,
+	.write		= ram_write,
+	.ioctl		= ram_ioctl,
+};
+
+static u32_t rnd(u32_t n)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 8) % n;
+}
+
+static u64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* a volume of sector_cnt sectors from sector_offset on, the device ends with it */
+static void ram_setup(u32_t sector_offset, u32_t sector_cnt)
+{
+	free(ram.data);
+	free(ref);
+
+	memset(&ram, 0, sizeof(ram));
+	ram.sectors = sector_offset + sector_cnt;
+	ram.data = malloc(ram.sectors * SECTOR_SIZE);
+	ref = malloc(ram.sectors * SECTOR_SIZE);
+	zassert_not_null(ram.data, "no memory");
+	zassert_not_null(ref, "no memory");
+
+	for (u32_t i = 0; i < ram.sectors * SECTOR_SIZE; i++)
+		ram.data[i] = rnd(256);
+	memcpy(ref, ram.data, ram.sectors * SECTOR_SIZE);
+
+	ram.info.name = "SD";
+	ram.info.sector_size = SECTOR_SIZE;
+	ram.info.sector_offset = sector_offset;
+	ram.info.sector_cnt = sector_cnt;
+	ram.info.op = &ram_op;
+
+	diskio_cache_init(NULL);
+}
+
+static void cache_rw(u32_t sector, u32_t count, bool write)
+{
+	static u8_t buf[16 * SECTOR_SIZE];
+	u32_t i;
+
+	if (write) {
+		for (i = 0; i < count * SECTOR_SIZE; i++)
+			buf[i] = rnd(256);
+		memcpy(ref + sector * SECTOR_SIZE, buf, count * SECTOR_SIZE);
+		zassert_equal(diskio_cache_write(&ram.info, 0, buf, sector, count), 0, "write");
+	} else {
+		zassert_equal(diskio_cache_read(&ram.info, 0, buf, sector, count), 0, "read");
+		zassert_true(!memcmp(buf, ref + sector * SECTOR_SIZE, count * SECTOR_SIZE),
+			     "read differs");
+	}
+}
+
+void test_random(void)
+{
+	u32_t offset = 3, cnt = 1000 * LINE_SECTORS, sector, count, n;
+
+	/* the last line of the volume has only offset sectors */
+	ram_setup(offset, cnt);
+
+	for (n = 0; n < 200000; n++) {
+		count = rnd(8) ? 1 + rnd(LINE_SECTORS) : 1 + rnd(16);
+		if (rnd(8))
+			sector = offset + rnd(cnt - count + 1);
+		else
+			sector = offset + cnt - count - rnd(LINE_SECTORS);
+
+		cache_rw(sector, count, rnd(3) == 0);
+
+		if (!rnd(1000)) {
+			zassert_equal(diskio_cache_flush(&ram.info), 0, "flush");
+			zassert_true(!memcmp(ram.data, ref, ram.sectors * SECTOR_SIZE), "disk differs");
+		}
+	}
+
+	zassert_equal(diskio_cache_flush(&ram.info), 0, "flush");
+	zassert_true(!memcmp(ram.data, ref, ram.sectors * SECTOR_SIZE), "disk differs");
+	zassert_equal(ram.overrun, 0, "past the end of the volume");
+}
+
+void test_write_back_error(void)
+{
+	static u8_t big[2 * CONFIG_DISKIO_CACHE_LINE_SIZE];
+	u8_t buf[SECTOR_SIZE];
+	u32_t set_lines = LINE_SECTORS * CONFIG_DISKIO_CACHE_SETS;
+	u32_t i;
+
+	ram_setup(0, 64 * LINE_SECTORS);
+
+	/* fill a set with dirty lines */
+	for (i = 0; i < CONFIG_DISKIO_CACHE_WAYS; i++)
+		cache_rw(i * set_lines, 1, true);
+
+	/* evicting one of them fails, the line is kept */
+	ram.fail_write = true;
+	zassert_not_equal(diskio_cache_read(&ram.info, 0, buf, i * set_lines, 1), 0,
+			  "eviction error lost");
+	zassert_not_equal(diskio_cache_flush(&ram.info), 0, "flush error lost");
+
+	/* a direct read over a dirty line that can not be written back */
+	zassert_not_equal(diskio_cache_read(&ram.info, 0, big, 0, 2 * LINE_SECTORS), 0,
+			  "bypass error lost");
+
+	/* nothing was lost */
+	ram.fail_write = false;
+	zassert_equal(diskio_cache_flush(&ram.info), 0, "flush");
+	zassert_true(!memcmp(ram.data, ref, ram.sectors * SECTOR_SIZE), "dirty data lost");
+	cache_rw(i * set_lines, 1, false);
+}
+
+void test_read_ahead(void)
+{
+	struct diskio_cache_stat stat;
+	u32_t sector;
+
+	ram_setup(0, 1024 * LINE_SECTORS);
+
+	/* single sectors in order, the cache thread runs while they are used */
+	for (sector = 0; sector < ram.sectors; sector++) {
+		cache_rw(sector, 1, false);
+		cache_thread_run();
+	}
+
+	zassert_equal(diskio_cache_get_stat(&ram.info, &stat), 0, "stat");
+	printf("read ahead %u lines, %u hit, %u misses, %u disk commands\n",
+	       stat.prefetch, stat.prefetch_hit, stat.read_miss, ram.cmds);
+	zassert_true(stat.prefetch_hit + 1 >= stat.prefetch, "read ahead not used");
+	zassert_true(stat.read_miss <= 2, "read ahead late");
+}
+
+/* FatFs over the ram disk */
+
+static FATFS fs;
+static FIL flac;
+static DWORD clmt[CONFIG_FAT_FILESYSTEM_FASTSEEK_TBL_SIZE];
+static u8_t block[32 * 1024];
+
+static u32_t flac_byte(u32_t pos)
+{
+	return (pos * 2654435761u) >> 24;
+}
+
+/* the FLAC written in fragments between the clusters of another file */
+static void fat_setup(void)
+{
+	FIL other;
+	UINT bw;
+	u32_t pos, i, end;
+
+	ram_setup(0, FAT_SECTORS);
+	zassert_equal(disk_register(&ram.info), 0, "register");
+
+	zassert_equal(f_mkfs("SD:", FM_FAT32, 1024, block, sizeof(block)), FR_OK, "mkfs");
+	zassert_equal(f_mount(&fs, "SD:", 1), FR_OK, "mount");
+	zassert_equal(f_open(&flac, "SD:/music.flac", FA_CREATE_ALWAYS | FA_WRITE), FR_OK, "open");
+	zassert_equal(f_open(&other, "SD:/other.bin", FA_CREATE_ALWAYS | FA_WRITE), FR_OK, "open");
+
+	for (pos = 0; pos < FLAC_SIZE; ) {
+		end = MIN(pos + FLAC_SIZE / FLAC_FRAGMENTS, FLAC_SIZE);
+		for (; pos < end; pos += sizeof(block)) {
+			for (i = 0; i < sizeof(block); i++)
+				block[i] = flac_byte(pos + i);
+			zassert_equal(f_write(&flac, block, MIN(sizeof(block), end - pos), &bw), FR_OK,
+				      "write");
+		}
+		pos = end;
+
+		zassert_equal(f_write(&other, block, sizeof(block), &bw), FR_OK, "write");
+		zassert_equal(f_sync(&other), FR_OK, "sync");
+		zassert_equal(f_sync(&flac), FR_OK, "sync");
+	}
+
+	zassert_equal(f_close(&other), FR_OK, "close");
+	zassert_equal(f_close(&flac), FR_OK, "close");
+	zassert_equal(f_open(&flac, "SD:/music.flac", FA_READ), FR_OK, "open");
+}
+
+static u32_t model_us(u32_t cmds, u32_t sectors)
+{
+	return cmds * CMD_US + sectors * SECTOR_US;
+}
+
+static void bench_read(u32_t chunk, bool cache)
+{
+	u32_t pos, cmds, sectors;
+	u64_t start, ns;
+	UINT br;
+
+	diskio_cache_flush(&ram.info);
+	diskio_cache_invalid(&ram.info);
+	diskio_cache.inited = cache;
+
+	zassert_equal(f_lseek(&flac, 0), FR_OK, "seek");
+	ram.cmds = ram.cmd_sectors = 0;
+	start = now_ns();
+
+	for (pos = 0; pos < FLAC_SIZE; pos += br) {
+		zassert_equal(f_read(&flac, block, chunk, &br), FR_OK, "read");
+		zassert_true(br > 0, "short file");
+		zassert_equal(block[0], flac_byte(pos), "read differs");
+		/* decoding, the cache thread reads ahead */
+		cache_thread_run();
+	}
+
+	ns = now_ns() - start;
+	cmds = ram.cmds;
+	sectors = ram.cmd_sectors;
+
+	printf("read %5u B %-8s %4u MB/s, %6u disk commands, SD model %5u ms\n",
+	       chunk, cache ? "cache" : "no cache", (u32_t)((u64_t)FLAC_SIZE * 1000 / ns),
+	       cmds, model_us(cmds, sectors) / 1000);
+}
+
+static void bench_seek(bool fastseek)
+{
+	u32_t n, pos, cmds, sectors;
+	u64_t start, ns;
+	UINT br;
+
+	diskio_cache_invalid(&ram.info);
+	diskio_cache.inited = 1;
+
+	flac.cltbl = NULL;
+	if (fastseek) {
+		clmt[0] = ARRAY_SIZE(clmt);
+		flac.cltbl = clmt;
+		zassert_equal(f_lseek(&flac, CREATE_LINKMAP), FR_OK, "link map");
+	}
+
+	seed = 7;
+	ram.cmds = ram.cmd_sectors = 0;
+	start = now_ns();
+
+	for (n = 0; n < SEEKS; n++) {
+		pos = rnd(FLAC_SIZE - 4096);
+		zassert_equal(f_lseek(&flac, pos), FR_OK, "seek");
+		zassert_equal(f_read(&flac, block, 1024, &br), FR_OK, "read");
+		zassert_equal(block[0], flac_byte(pos), "seek read differs");
+	}
+
+	ns = now_ns() - start;
+	cmds = ram.cmds;
+	sectors = ram.cmd_sectors;
+
+	printf("seek %-9s %6u ns, %3u.%02u disk commands, SD model %5u us per seek\n",
+	       fastseek ? "fast" : "fat chain", (u32_t)(ns / SEEKS), cmds / SEEKS,
+	       cmds % SEEKS * 100 / SEEKS, model_us(cmds, sectors) / SEEKS);
+
+	flac.cltbl = NULL;
+}
+
+void test_fatfs_benchmark(void)
+{
+	fat_setup();
+	printf("%u MB FLAC in %u fragments, link map of %u items\n",
+	       FLAC_SIZE >> 20, FLAC_FRAGMENTS, CONFIG_FAT_FILESYSTEM_FASTSEEK_TBL_SIZE);
+
+	bench_read(512, false);
+	bench_read(512, true);
+	bench_read(2048, false);
+	bench_read(2048, true);
+
+	bench_seek(false);
+	bench_seek(true);
+
+	zassert_equal(f_close(&flac), FR_OK, "close");
+	zassert_equal(ram.overrun, 0, "past the end of the volume");
+}
+
+void test_main(void)
+{
+	ztest_test_suite(test_diskio_cache,
+			 ztest_unit_test(test_random),
+			 ztest_unit_test(test_write_back_error),
+			 ztest_unit_test(test_read_ahead),
+			 ztest_unit_test(test_fatfs_benchmark));
+	ztest_run_test_suite(test_diskio_cache);
+}
@@ -0,0 +1,393 @@
+/*
+ * Copyright (c) 2020 Actions Semiconductor Co., Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Runs the play list iterator on FatFs over a ram disk with 5000 tracks
+ * in 200 folders. A cold start scans the disk and saves the index, a warm
+ * start loads it. Both have to play the same tracks, and changes to the
+ * disk have to show up in the play list. Disk commands are counted as an
+ * SD card would see them.
+ */
+
+#include <ztest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define CONFIG_FILE_SYSTEM_FAT			1
+#define CONFIG_FAT_FILESYSTEM_ELM		1
+#define CONFIG_FAT_FILESYSTEM_CHMOD		1
+#define CONFIG_LONG_FILE_NAME			1
+#define CONFIG_FILE_ITERATOR			1
+#define CONFIG_PLIST_INDEX			1
+#define CONFIG_PLIST_SUPPORT_FOLDER_CNT		255
+#define CONFIG_RTC_0_NAME			"RTC_0"
+
+/* os_common_api.h, mem_manager.h and init.h need the kernel */
+#define __OS_COMMON_API_H__
+#define __MEM_MANAGER_H__
+#define _INIT_H_
+#define SYS_INIT(init_fn, level, prio)
+
+void *mem_malloc(unsigned int num_bytes);
+void mem_free(void *ptr);
+
+#include <ext/fs/fat/ff.c>
+#include <ext/fs/fat/option/unicode.c>
+#undef SYS_LOG_LEVEL
+#include <ext/fs/fat/diskio.c>
+/* both have their own */
+#define translate_error fs_translate_error
+#include <subsys/fs/fat_fs.c>
+#undef translate_error
+#include <ext/actions/base/utils/crc/crc.c>
+#undef SYS_LOG_DOMAIN
+#undef SYS_LOG_LEVEL
+#include <ext/actions/base/utils/iterator/iterator.c>
+#include <ext/actions/base/utils/iterator/file_plist_iterator.c>
+
+#define SECTOR_SIZE	512
+#define DISK_SECTORS	(128 * 1024 * 1024 / SECTOR_SIZE)
+#define FOLDERS		200
+#define FOLDER_TRACKS	25
+#define TRACKS		(FOLDERS * FOLDER_TRACKS)
+
+/* SD card cost model: a command and the sectors it moves */
+#define CMD_US		150
+#define SECTOR_US	25
+
+struct ram_disk {
+	struct disk_info info;
+	u8_t *data;
+	u32_t cmds;
+	u32_t cmd_sectors;
+};
+
+static struct ram_disk ram;
+static FATFS fs;
+
+static char tracks[2][TRACKS + 1][64];
+
+void *mem_malloc(unsigned int num_bytes)
+{
+	return calloc(1, num_bytes);
+}
+
+void mem_free(void *ptr)
+{
+	free(ptr);
+}
+
+void *ff_memalloc(UINT msize)
+{
+	return malloc(msize);
+}
+
+void ff_memfree(void *mblock)
+{
+	free(mblock);
+}
+
+int ff_cre_syncobj(BYTE vol, _SYNC_t *sobj)
+{
+	*sobj = NULL;
+	return 1;
+}
+
+int ff_req_grant(_SYNC_t sobj)
+{
+	return 1;
+}
+
+void ff_rel_grant(_SYNC_t sobj)
+{
+}
+
+int ff_del_syncobj(_SYNC_t sobj)
+{
+	return 1;
+}
+
+/* file times from a fixed date */
+static int rtc_get(struct device *dev, struct rtc_time *tm)
+{
+	memset(tm, 0, sizeof(*tm));
+	tm->tm_year = 120;
+	tm->tm_mday = 1;
+	return 0;
+}
+
+static const struct rtc_driver_api rtc_api = {
+	.get_time = rtc_get,
+};
+
+static struct device rtc_dev = {
+	.driver_api = &rtc_api,
+};
+
+struct device *device_get_binding(const char *name)
+{
+	return &rtc_dev;
+}
+
+/* for flash file systems only */
+FRESULT f_map(FIL *fp, void **addr)
+{
+	return FR_INT_ERR;
+}
+
+static int ram_init(struct disk_info *disk)
+{
+	return 0;
+}
+
+static int ram_status(struct disk_info *disk)
+{
+	return DISK_STATUS_OK;
+}
+
+static int ram_read(struct disk_info *disk, u8_t *buf, u32_t sector, u32_t count)
+{
+	ram.cmds++;
+	ram.cmd_sectors += count;
+	memcpy(buf, ram.data + sector * SECTOR_SIZE, count * SECTOR_SIZE);
+	return 0;
+}
+
+static int ram_write(struct disk_info *disk, const u8_t *buf, u32_t sector, u32_t count)
+{
+	ram.cmds++;
+	ram.cmd_sectors += count;
+	memcpy(ram.data + sector * SECTOR_SIZE, buf, count * SECTOR_SIZE);
+	return 0;
+}
+
+static int ram_ioctl(struct disk_info *disk, u8_t cmd, void *buf)
+{
+	switch (cmd) {
+	case DISK_IOCTL_CTRL_SYNC:
+		break;
+	case DISK_IOCTL_GET_SECTOR_COUNT:
+		*(u32_t *)buf = disk->sector_cnt;
+		break;
+	case DISK_IOCTL_GET_SECTOR_SIZE:
+		*(u32_t *)buf = SECTOR_SIZE;
+		break;
+	case DISK_IOCTL_GET_ERASE_BLOCK_SZ:
+		*(u32_t *)buf = 1;
+		break;
+	case DISK_IOCTL_HW_DETECT:
+		*(u8_t *)buf = STA_DISK_OK;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static const struct disk_operation ram_op = {
+	.init		= ram_init,
+	.get_status	= ram_status,
+	.read		= ram_read,
+	.write		= ram_write,
+	.ioctl		= ram_ioctl,
+};
+
+static u64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int match_mp3(const char *path, int is_dir)
+{
+	const char *ext = strrchr(path, '.');
+
+	return is_dir || (ext && !strcmp(ext, ".MP3"));
+}
+
+static void write_file(const char *path, int size)
+{
+	static u8_t buf[SECTOR_SIZE];
+	FIL fp;
+	UINT bw;
+
+	zassert_equal(f_open(&fp, path, FA_CREATE_ALWAYS | FA_WRITE), FR_OK, "open");
+	zassert_equal(f_write(&fp, buf, size, &bw), FR_OK, "write");
+	zassert_equal(f_close(&fp), FR_OK, "close");
+}
+
+/* a cover and the tracks in each album folder, a cluster each */
+static void disk_setup(void)
+{
+	static u8_t work[32 * 1024];
+	char path[32];
+	int i, j;
+
+	free(ram.data);
+	memset(&ram, 0, sizeof(ram));
+	ram.data = calloc(DISK_SECTORS, SECTOR_SIZE);
+	zassert_not_null(ram.data, "no memory");
+
+	ram.info.name = "SD";
+	ram.info.sector_size = SECTOR_SIZE;
+	ram.info.sector_cnt = DISK_SECTORS;
+	ram.info.op = &ram_op;
+	disk_register(&ram.info);
+
+	zassert_equal(f_mkfs("SD:", FM_FAT32, 1024, work, sizeof(work)), FR_OK, "mkfs");
+	zassert_equal(f_mount(&fs, "SD:", 1), FR_OK, "mount");
+
+	for (i = 0; i < FOLDERS; i++) {
+		sprintf(path, "SD:/ALBUM%03d", i);
+		zassert_equal(f_mkdir(path), FR_OK, "mkdir");
+		sprintf(path, "SD:/ALBUM%03d/COVER.JPG", i);
+		write_file(path, 100);
+		for (j = 0; j < FOLDER_TRACKS; j++) {
+			sprintf(path, "SD:/ALBUM%03d/T%02d.MP3", i, j);
+			write_file(path, 100);
+		}
+	}
+}
+
+/* as the music app starts, without a breakpoint */
+static struct iterator *start(void)
+{
+	static const struct file_iterator_cursor cursor;
+	file_iterator_param_t param = {
+		.max_level = 9,
+		.topdir = "SD:",
+		.cursor = &cursor,
+		.match_fn = match_mp3,
+	};
+	struct iterator *iter;
+
+	iter = file_iterator_create(&param);
+	zassert_not_null(iter, "create");
+
+	return iter;
+}
+
+/* all tracks once round, returns the count */
+static int play_all(struct iterator *iter, char list[][64])
+{
+	const char *path;
+	u16_t track_no;
+	int n;
+
+	for (n = 0; n < TRACKS + 1; n++) {
+		path = iterator_next(iter, false, &track_no);
+		zassert_not_null(path, "next");
+		zassert_equal(track_no, n % play_list->sum_file_count + 1, "track no");
+		if (n && track_no == 1)
+			break;
+		strcpy(list[n], path);
+	}
+
+	return n;
+}
+
+void test_index(void)
+{
+	struct iterator *iter;
+	FILINFO fno;
+	u32_t cmds[2], sectors[2];
+	u64_t ns[2], begin;
+	int i, n[2];
+
+	disk_setup();
+	f_unlink("SD:/" PLIST_INDEX_FILE);
+
+	for (i = 0; i < 2; i++) {
+		ram.cmds = ram.cmd_sectors = 0;
+		begin = now_ns();
+		iter = start();
+		ns[i] = now_ns() - begin;
+		cmds[i] = ram.cmds;
+		sectors[i] = ram.cmd_sectors;
+
+		zassert_equal(play_list->from_index, i, "index not used");
+		zassert_equal(play_list->sum_file_count, TRACKS, "track count");
+		zassert_equal(play_list->sum_folder_count, FOLDERS, "folder count");
+
+		n[i] = play_all(iter, tracks[i]);
+		iterator_destroy(iter);
+	}
+
+	printf("%d tracks in %d folders\n", TRACKS, FOLDERS);
+	for (i = 0; i < 2; i++) {
+		printf("%s start: %6llu us, %5u disk commands, %6u sectors, SD model %5u ms\n",
+		       i ? "warm" : "cold", ns[i] / 1000, cmds[i], sectors[i],
+		       (cmds[i] * CMD_US + sectors[i] * SECTOR_US) / 1000);
+	}
+
+	/* the same tracks in the same order */
+	zassert_equal(n[0], TRACKS, "cold tracks");
+	zassert_equal(n[1], TRACKS, "warm tracks");
+	for (i = 0; i < TRACKS; i++)
+		zassert_true(!strcmp(tracks[0][i], tracks[1][i]), "track differs");
+
+	zassert_true(cmds[1] * 20 < cmds[0], "warm start not faster");
+
+	/* hidden on a PC */
+	zassert_equal(f_stat("SD:/" PLIST_INDEX_FILE, &fno), FR_OK, "no index");
+	zassert_true(fno.fattrib & AM_HID, "index not hidden");
+}
+
+void test_changes(void)
+{
+	struct iterator *iter;
+	char path[32];
+	int i;
+
+	disk_setup();
+	iterator_destroy(start());
+
+	/* a new track takes a cluster, the disk is scanned again */
+	write_file("SD:/ALBUM007/NEW.MP3", 100);
+	iter = start();
+	zassert_false(play_list->from_index, "index of another disk");
+	zassert_equal(play_list->sum_file_count, TRACKS + 1, "new track");
+	zassert_equal(play_all(iter, tracks[0]), TRACKS + 1, "new track not played");
+	iterator_destroy(iter);
+
+	/* a rename keeps the free clusters, the folder is counted when played */
+	zassert_equal(f_rename("SD:/ALBUM003/T05.MP3", "SD:/ALBUM003/T05.TXT"), FR_OK, "rename");
+	iter = start();
+	zassert_true(play_list->from_index, "index not used");
+	zassert_equal(play_all(iter, tracks[0]), TRACKS, "renamed track played");
+	zassert_equal(play_list->sum_file_count, TRACKS, "count not fixed");
+	zassert_true(play_list->index_dirty, "fixed count not saved");
+	iterator_destroy(iter);
+
+	/* the fixed count was written back */
+	iter = start();
+	zassert_true(play_list->from_index, "index not used");
+	zassert_equal(play_list->sum_file_count, TRACKS, "count not saved");
+	iterator_destroy(iter);
+
+	/* a folder with all its tracks gone */
+	zassert_equal(f_unlink("SD:/ALBUM009/COVER.JPG"), FR_OK, "unlink");
+	for (i = 0; i < FOLDER_TRACKS; i++) {
+		sprintf(path, "SD:/ALBUM009/T%02d.MP3", i);
+		zassert_equal(f_unlink(path), FR_OK, "unlink");
+	}
+	iter = start();
+	zassert_false(play_list->from_index, "index of another disk");
+	zassert_equal(play_all(iter, tracks[0]), TRACKS - FOLDER_TRACKS, "removed tracks played");
+	iterator_destroy(iter);
+}
+
+void test_main(void)
+{
+	ztest_test_suite(test_file_plist_iterator,
+			 ztest_unit_test(test_index),
+			 ztest_unit_test(test_changes));
+	ztest_run_test_suite(test_file_plist_iterator);
+}
@@ -0,0 +1,320 @@
+/*
+ * Copyright (c) 2020 Actions Semi Co., Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Replays scripted key presses as the adc key driver reports them, down
+ * again every scan period while held, through the gesture engine driven
+ * by one timer that runs late by a random work queue latency. The events
+ * must be the same, with the same stamps, whatever the latency, and come
+ * out no later than the latency after they happened.
+ */
+
+#include <ztest.h>
+#include <stdio.h>
+
+unsigned int irq_lock(void)
+{
+	return 0;
+}
+
+void irq_unlock(unsigned int key)
+{
+}
+
+#include <ext/actions/system/input/key_gesture.c>
+
+/* adc key driver period of reporting a held key */
+#define SCAN_MS		60
+#define LAT_MAX		250
+#define MAX_EDGES	256
+#define MAX_EVENTS	32
+
+#define KEY_COMBO	KEY_POWER
+
+struct press {
+	u16_t code;
+	u32_t down;
+	u32_t up;
+};
+
+struct event {
+	u32_t value;
+	u32_t stamp;
+	/* time it is due */
+	u32_t at;
+};
+
+static const key_gesture_cfg_t cfg[] = {
+	{ .code = 0, .stage_ms = { 180, 2000, 5000, 10000 } },
+	{ .code = KEY_PAUSE, .click_ms = 500, .max_clicks = 3, .stage_ms = { 180, 2000, 5000, 10000 } },
+	{ .code = KEY_VOLUMEUP, .hold_ms = 980, .repeat_ms = 200, .stage_ms = { 180, 2000, 5000, 10000 } },
+};
+
+static const key_gesture_combo_t combo[] = {
+	{ .member = { KEY_NEXTSONG, KEY_PREVIOUSSONG }, .code = KEY_COMBO, .window_ms = 100 },
+};
+
+static key_gesture_t gesture;
+static key_gesture_edge_t edges[MAX_EDGES];
+static int edge_num;
+
+static struct event out[MAX_EVENTS];
+static int out_num;
+static u32_t sim_now;
+
+static unsigned int seed = 1;
+
+static u32_t rnd(u32_t n)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 8) % n;
+}
+
+static void emit(void *user_data, u32_t key_value, u32_t stamp)
+{
+	zassert_true(out_num < MAX_EVENTS, "too many events");
+	out[out_num].value = key_value;
+	out[out_num].stamp = stamp;
+	out[out_num].at = sim_now;
+	out_num++;
+}
+
+/* driver edges: down, down again each scan period, up */
+static void script(const struct press *press, int num)
+{
+	key_gesture_edge_t edge;
+	u32_t t;
+	int i, j;
+
+	edge_num = 0;
+	for (i = 0; i < num; i++) {
+		for (t = press[i].down; t < press[i].up; t += SCAN_MS) {
+			edges[edge_num].stamp = t;
+			edges[edge_num].code = press[i].code;
+			edges[edge_num].down = 1;
+			edge_num++;
+		}
+
+		edges[edge_num].stamp = press[i].up;
+		edges[edge_num].code = press[i].code;
+		edges[edge_num].down = 0;
+		edge_num++;
+	}
+
+	/* in time order, a release before a press at the same time */
+	for (i = 1; i < edge_num; i++) {
+		edge = edges[i];
+		for (j = i; j > 0 && (edges[j - 1].stamp > edge.stamp ||
+			(edges[j - 1].stamp == edge.stamp && edges[j - 1].down > edge.down)); j--)
+			edges[j] = edges[j - 1];
+		edges[j] = edge;
+	}
+}
+
+/* the driver callback queues edges and submits the work, which runs lat ms later */
+static void run(int lat_max)
+{
+	u32_t work = 0, at;
+	bool work_pending = false;
+	s32_t delay;
+	int i = 0;
+
+	key_gesture_init(&gesture, cfg, ARRAY_SIZE(cfg), combo, ARRAY_SIZE(combo), emit, NULL);
+	out_num = 0;
+
+	while (i < edge_num || work_pending) {
+		if (i < edge_num && (!work_pending || edges[i].stamp < work)) {
+			sim_now = edges[i].stamp;
+			i++;
+			if (!key_gesture_input(&gesture, edges[i - 1].code, edges[i - 1].down, sim_now))
+				continue;
+
+			/* submitting a pending work does not delay it */
+			at = sim_now + (lat_max ? rnd(lat_max + 1) : 0);
+			if (!work_pending || time_before(at, work))
+				work = at;
+			work_pending = true;
+			continue;
+		}
+
+		sim_now = work;
+		delay = key_gesture_process(&gesture, sim_now);
+		work_pending = (delay >= 0);
+		work = sim_now + delay + (lat_max ? rnd(lat_max + 1) : 0);
+	}
+
+	zassert_equal(gesture.edge_drops, 0, "edges dropped");
+}
+
+static void check(const struct press *press, int num, const struct event *expect, int expect_num)
+{
+	int i, n;
+
+	script(press, num);
+
+	/* on time */
+	run(0);
+	for (i = 0; i < out_num; i++)
+		printf("  %08x at %u stamp %u\n", out[i].value, out[i].at, out[i].stamp);
+	zassert_equal(out_num, expect_num, "event count");
+	for (i = 0; i < expect_num; i++) {
+		zassert_equal(out[i].value, expect[i].value, "event");
+		zassert_equal(out[i].stamp, expect[i].stamp, "stamp");
+		zassert_equal(out[i].at, expect[i].at, "late");
+	}
+
+	/* late by up to LAT_MAX */
+	for (n = 0; n < 200; n++) {
+		run(LAT_MAX);
+		zassert_equal(out_num, expect_num, "event count with latency");
+		for (i = 0; i < expect_num; i++) {
+			zassert_equal(out[i].value, expect[i].value, "event with latency");
+			zassert_equal(out[i].stamp, expect[i].stamp, "stamp with latency");
+			zassert_true(out[i].at >= expect[i].at && out[i].at <= expect[i].at + LAT_MAX,
+				     "latency");
+		}
+	}
+}
+
+void test_click(void)
+{
+	static const struct press press[] = {
+		{ KEY_VOLUMEDOWN, 1000, 1100 },
+	};
+	static const struct event expect[] = {
+		{ KEY_TYPE_SHORT_UP | KEY_VOLUMEDOWN, 1100, 1100 },
+	};
+
+	check(press, ARRAY_SIZE(press), expect, ARRAY_SIZE(expect));
+}
+
+void test_multi_click(void)
+{
+	static const struct press double_press[] = {
+		{ KEY_PAUSE, 1000, 1100 },
+		{ KEY_PAUSE, 1300, 1400 },
+	};
+	static const struct event double_expect[] = {
+		{ KEY_TYPE_DOUBLE_CLICK | KEY_PAUSE, 1400, 1900 },
+	};
+	static const struct press triple_press[] = {
+		{ KEY_PAUSE, 1000, 1080 },
+		{ KEY_PAUSE, 1200, 1280 },
+		{ KEY_PAUSE, 1400, 1480 },
+	};
+	static const struct event triple_expect[] = {
+		{ KEY_TYPE_TRIPLE_CLICK | KEY_PAUSE, 1480, 1480 },
+	};
+	static const struct press slow_press[] = {
+		{ KEY_PAUSE, 1000, 1100 },
+		{ KEY_PAUSE, 1700, 1800 },
+	};
+	static const struct event slow_expect[] = {
+		{ KEY_TYPE_SHORT_UP | KEY_PAUSE, 1100, 1600 },
+		{ KEY_TYPE_SHORT_UP | KEY_PAUSE, 1800, 2300 },
+	};
+	static const struct press click_long_press[] = {
+		{ KEY_PAUSE, 1000, 1100 },
+		{ KEY_PAUSE, 1300, 2000 },
+	};
+	static const struct event click_long_expect[] = {
+		{ KEY_TYPE_SHORT_UP | KEY_PAUSE, 1100, 1480 },
+		{ KEY_TYPE_LONG_DOWN | KEY_PAUSE, 1480, 1480 },
+		{ KEY_TYPE_SHORT_LONG_UP | KEY_PAUSE, 2000, 2000 },
+	};
+
+	check(double_press, ARRAY_SIZE(double_press), double_expect, ARRAY_SIZE(double_expect));
+	check(triple_press, ARRAY_SIZE(triple_press), triple_expect, ARRAY_SIZE(triple_expect));
+	check(slow_press, ARRAY_SIZE(slow_press), slow_expect, ARRAY_SIZE(slow_expect));
+	check(click_long_press, ARRAY_SIZE(click_long_press), click_long_expect,
+	      ARRAY_SIZE(click_long_expect));
+}
+
+void test_long(void)
+{
+	static const struct press long_press[] = {
+		{ KEY_VOLUMEDOWN, 1000, 6500 },
+	};
+	static const struct event long_expect[] = {
+		{ KEY_TYPE_LONG_DOWN | KEY_VOLUMEDOWN, 1180, 1180 },
+		{ KEY_TYPE_LONG | KEY_VOLUMEDOWN, 3000, 3000 },
+		{ KEY_TYPE_LONG5S | KEY_VOLUMEDOWN, 6000, 6000 },
+		{ KEY_TYPE_LONG_UP | KEY_VOLUMEDOWN, 6500, 6500 },
+	};
+	static const struct press short_long_press[] = {
+		{ KEY_VOLUMEDOWN, 1000, 2000 },
+	};
+	static const struct event short_long_expect[] = {
+		{ KEY_TYPE_LONG_DOWN | KEY_VOLUMEDOWN, 1180, 1180 },
+		{ KEY_TYPE_SHORT_LONG_UP | KEY_VOLUMEDOWN, 2000, 2000 },
+	};
+
+	check(long_press, ARRAY_SIZE(long_press), long_expect, ARRAY_SIZE(long_expect));
+	check(short_long_press, ARRAY_SIZE(short_long_press), short_long_expect,
+	      ARRAY_SIZE(short_long_expect));
+}
+
+void test_hold(void)
+{
+	static const struct press press[] = {
+		{ KEY_VOLUMEUP, 1000, 2500 },
+	};
+	static const struct event expect[] = {
+		{ KEY_TYPE_LONG_DOWN | KEY_VOLUMEUP, 1180, 1180 },
+		{ KEY_TYPE_HOLD | KEY_VOLUMEUP, 1980, 1980 },
+		{ KEY_TYPE_HOLD | KEY_VOLUMEUP, 2180, 2180 },
+		{ KEY_TYPE_HOLD | KEY_VOLUMEUP, 2380, 2380 },
+		{ KEY_TYPE_SHORT_LONG_UP | KEY_VOLUMEUP, 2500, 2500 },
+		{ KEY_TYPE_HOLD_UP | KEY_VOLUMEUP, 2500, 2500 },
+	};
+
+	check(press, ARRAY_SIZE(press), expect, ARRAY_SIZE(expect));
+}
+
+void test_combo(void)
+{
+	static const struct press press[] = {
+		{ KEY_NEXTSONG, 1000, 1200 },
+		{ KEY_PREVIOUSSONG, 1050, 1210 },
+		/* too far apart */
+		{ KEY_NEXTSONG, 2000, 2100 },
+		{ KEY_PREVIOUSSONG, 2150, 2250 },
+	};
+	static const struct event expect[] = {
+		{ KEY_TYPE_SHORT_UP | KEY_COMBO, 1200, 1200 },
+		{ KEY_TYPE_SHORT_UP | KEY_NEXTSONG, 2100, 2100 },
+		{ KEY_TYPE_SHORT_UP | KEY_PREVIOUSSONG, 2250, 2250 },
+	};
+
+	check(press, ARRAY_SIZE(press), expect, ARRAY_SIZE(expect));
+}
+
+void test_overlap(void)
+{
+	static const struct press press[] = {
+		{ KEY_VOLUMEDOWN, 1000, 2000 },
+		{ KEY_PAUSE, 1300, 1400 },
+	};
+	static const struct event expect[] = {
+		{ KEY_TYPE_LONG_DOWN | KEY_VOLUMEDOWN, 1180, 1180 },
+		{ KEY_TYPE_SHORT_UP | KEY_PAUSE, 1400, 1900 },
+		{ KEY_TYPE_SHORT_LONG_UP | KEY_VOLUMEDOWN, 2000, 2000 },
+	};
+
+	check(press, ARRAY_SIZE(press), expect, ARRAY_SIZE(expect));
+}
+
+void test_main(void)
+{
+	ztest_test_suite(test_key_gesture,
+			 ztest_unit_test(test_click),
+			 ztest_unit_test(test_multi_click),
+			 ztest_unit_test(test_long),
+			 ztest_unit_test(test_hold),
+			 ztest_unit_test(test_combo),
+			 ztest_unit_test(test_overlap));
+	ztest_run_test_suite(test_key_gesture);
+}
@@ -0,0 +1,398 @@
+/*
+ * Copyright (c) 2020 Actions Semiconductor Co., Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Replays a trace built after the allocations of an A2DP session on the
+ * system slabs with the default Kconfig sizes, once as the allocator was
+ * (linear scans, blocks cleared in the irq lock) and once with the lookup
+ * tables, and compares the cycles of each call and of each irq locked
+ * section.
+ */
+
+#include <ztest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <logging/sys_log.h>
+#include <misc/slist.h>
+
+#define CONFIG_APP_USED_MEM_SLAB	1
+#define CONFIG_SLAB_TOTAL_NUM		9
+#define CONFIG_SLAB0_BLOCK_SIZE		8
+#define CONFIG_SLAB0_NUM_BLOCKS		32
+#define CONFIG_SLAB1_BLOCK_SIZE		16
+#define CONFIG_SLAB1_NUM_BLOCKS		11
+#define CONFIG_SLAB2_BLOCK_SIZE		32
+#define CONFIG_SLAB2_NUM_BLOCKS		60
+#define CONFIG_SLAB3_BLOCK_SIZE		64
+#define CONFIG_SLAB3_NUM_BLOCKS		12
+#define CONFIG_SLAB4_BLOCK_SIZE		128
+#define CONFIG_SLAB4_NUM_BLOCKS		4
+#define CONFIG_SLAB5_BLOCK_SIZE		256
+#define CONFIG_SLAB5_NUM_BLOCKS		9
+#define CONFIG_SLAB6_BLOCK_SIZE		512
+#define CONFIG_SLAB6_NUM_BLOCKS		7
+#define CONFIG_SLAB7_BLOCK_SIZE		1024
+#define CONFIG_SLAB7_NUM_BLOCKS		7
+#define CONFIG_SLAB8_BLOCK_SIZE		1536
+#define CONFIG_SLAB8_NUM_BLOCKS		2
+/* only the system slabs */
+#define APP_USED_SYSTEM_SLAB		1
+
+/* os_common_api.h, mem_manager.h and init.h need the kernel */
+#define _kernel_structs__h_
+#define __OS_COMMON_API_H__
+#define __MEM_MANAGER_H__
+#define _INIT_H_
+
+u32_t _arch_k_cycle_get_32(void);
+unsigned int irq_lock(void);
+void irq_unlock(unsigned int key);
+
+#include <ext/actions/base/memory/mem_slab.c>
+
+/* a media packet of 5 sbc frames, bitpool 53, 48 kHz joint stereo */
+#define PKT_MIN		560
+#define PKT_MAX		700
+/* packets waiting for the decoder */
+#define PKT_QUEUED	5
+#define PKT_NUM		20000
+/* messages are freed once handled, a few packets later */
+#define MSG_QUEUED	8
+
+enum {
+	OP_ALLOC,
+	OP_FREE,
+};
+
+struct trace_op {
+	u8_t op;
+	/* slot of the pointer, the allocation size */
+	u16_t slot;
+	u16_t size;
+};
+
+#define MAX_OPS		(PKT_NUM * 12)
+#define ROUNDS		5
+#define MAX_SLOTS	64
+
+static struct trace_op trace[MAX_OPS];
+static int trace_num;
+static void *slot_ptr[MAX_SLOTS];
+
+/* cycles of each call and of each irq locked section of one replay */
+struct replay_stat {
+	u32_t alloc[MAX_OPS / 2];
+	u32_t free[MAX_OPS / 2];
+	u32_t irq_off[MAX_OPS];
+	int alloc_num;
+	int free_num;
+	int irq_off_num;
+	u32_t fails;
+	/* bytes cleared with irq locked, the host timing is too noisy to compare */
+	u32_t irq_off_clear;
+};
+
+static struct replay_stat before, after;
+
+/*
+ * the allocator before the lookup tables also cleared the whole block
+ * next to k_mem_slab_alloc() and k_mem_slab_free(), with irq locked
+ */
+static bool block_clear;
+static struct replay_stat *cur;
+static u32_t lock_start;
+static int lock_depth;
+
+static unsigned int seed = 1;
+
+static u32_t rnd(u32_t n)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 8) % n;
+}
+
+/* the replay is timed by the tsc */
+static u32_t now_cycles(void)
+{
+	return __builtin_ia32_rdtsc();
+}
+
+/*
+ * k_cycle_get_32() of the allocator's stats: the target reads a timer
+ * register, the tsc of a virtual host costs more than the lookups timed.
+ */
+static u32_t ticks;
+
+u32_t _arch_k_cycle_get_32(void)
+{
+	return ++ticks;
+}
+
+unsigned int irq_lock(void)
+{
+	lock_depth++;
+	lock_start = now_cycles();
+	return 0;
+}
+
+void irq_unlock(unsigned int key)
+{
+	u32_t cycles = now_cycles() - lock_start;
+
+	lock_depth--;
+
+	if (cur)
+		cur->irq_off[cur->irq_off_num++] = cycles;
+}
+
+void k_mem_slab_init(struct k_mem_slab *slab, void *buffer, size_t block_size, u32_t num_blocks)
+{
+	char *p = buffer;
+	u32_t i;
+
+	slab->num_blocks = num_blocks;
+	slab->block_size = block_size;
+	slab->buffer = buffer;
+	slab->num_used = 0;
+	slab->free_list = NULL;
+
+	for (i = 0; i < num_blocks; i++) {
+		*(char **)p = slab->free_list;
+		slab->free_list = p;
+		p += block_size;
+	}
+}
+
+static void block_zero(void *mem, size_t size)
+{
+	memset(mem, 0, size);
+	if (cur && lock_depth)
+		cur->irq_off_clear += size;
+}
+
+int k_mem_slab_alloc(struct k_mem_slab *slab, void **mem, s32_t timeout)
+{
+	if (!slab->free_list) {
+		*mem = NULL;
+		return -ENOMEM;
+	}
+
+	*mem = slab->free_list;
+	slab->free_list = *(char **)slab->free_list;
+	slab->num_used++;
+
+	if (block_clear)
+		block_zero(*mem, slab->block_size);
+	return 0;
+}
+
+void k_mem_slab_free(struct k_mem_slab *slab, void **mem)
+{
+	if (block_clear)
+		block_zero(*mem, slab->block_size);
+
+	**(char ***)mem = slab->free_list;
+	slab->free_list = *(char **)mem;
+	slab->num_used--;
+}
+
+static int trace_alloc(int slot, u32_t size)
+{
+	trace[trace_num].op = OP_ALLOC;
+	trace[trace_num].slot = slot;
+	trace[trace_num].size = size;
+	trace_num++;
+	return slot;
+}
+
+static void trace_free(int slot)
+{
+	trace[trace_num].op = OP_FREE;
+	trace[trace_num].slot = slot;
+	trace_num++;
+}
+
+/*
+ * per media packet: the l2cap packet, its a2dp message and the decoder
+ * message, freed when the decoder takes it; now and then an avrcp or hci
+ * event, a timer and a bigger sdp / avdtp signal.
+ */
+static void trace_build(void)
+{
+	int pkt[PKT_QUEUED], msg[MSG_QUEUED];
+	int pkt_head = 0, msg_head = 0, slot = 0, i, k;
+
+	/* slots of the pointers alive at a time */
+	for (i = 0; i < PKT_QUEUED; i++)
+		pkt[i] = trace_alloc(slot++, PKT_MIN + rnd(PKT_MAX - PKT_MIN));
+	for (i = 0; i < MSG_QUEUED; i++)
+		msg[i] = trace_alloc(slot++, 24 + rnd(24));
+
+	for (i = 0; i < PKT_NUM; i++) {
+		trace_free(pkt[pkt_head]);
+		trace_alloc(pkt[pkt_head], PKT_MIN + rnd(PKT_MAX - PKT_MIN));
+		pkt_head = (pkt_head + 1) % PKT_QUEUED;
+
+		for (k = 0; k < 2; k++) {
+			trace_free(msg[msg_head]);
+			trace_alloc(msg[msg_head], k ? 20 : 40);
+			msg_head = (msg_head + 1) % MSG_QUEUED;
+		}
+
+		if (!rnd(10)) {
+			trace_alloc(slot, 8);
+			trace_free(slot);
+		}
+
+		if (!rnd(50)) {
+			trace_alloc(slot, 60 + rnd(60));
+			trace_alloc(slot + 1, 12);
+			trace_free(slot + 1);
+			trace_free(slot);
+		}
+
+		if (!rnd(500)) {
+			trace_alloc(slot, 200 + rnd(1000));
+			trace_free(slot);
+		}
+	}
+}
+
+static void replay(struct slabs_info *slabs, struct replay_stat *stat)
+{
+	struct trace_op *op;
+	u32_t start, cycles;
+	int i;
+
+	memset(stat, 0, sizeof(*stat));
+	memset(slot_ptr, 0, sizeof(slot_ptr));
+	slabs_mem_init(slabs);
+	cur = stat;
+
+	for (i = 0; i < trace_num; i++) {
+		op = &trace[i];
+
+		if (op->op == OP_ALLOC) {
+			start = now_cycles();
+			slot_ptr[op->slot] = mem_slabs_malloc(slabs, op->size);
+			cycles = now_cycles() - start;
+			stat->alloc[stat->alloc_num++] = cycles;
+			if (!slot_ptr[op->slot])
+				stat->fails++;
+			else
+				memset(slot_ptr[op->slot], op->slot, op->size);
+		} else if (slot_ptr[op->slot]) {
+			start = now_cycles();
+			mem_slabs_free(slabs, slot_ptr[op->slot]);
+			cycles = now_cycles() - start;
+			stat->free[stat->free_num++] = cycles;
+			slot_ptr[op->slot] = NULL;
+		}
+	}
+
+	cur = NULL;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+	u32_t x = *(const u32_t *)a, y = *(const u32_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ * mean of the samples up to the 99th percentile, the host preempts us now
+ * and then; and the 99th percentile itself
+ */
+static u32_t mean99(u32_t *samples, int num, u32_t *p99)
+{
+	u64_t sum = 0;
+	int i, n = num * 99 / 100;
+
+	qsort(samples, num, sizeof(samples[0]), cmp_u32);
+	for (i = 0; i < n; i++)
+		sum += samples[i];
+
+	*p99 = samples[n];
+	return sum / n;
+}
+
+static void report(const char *name, struct replay_stat *stat)
+{
+	u32_t alloc, free, irq_off, alloc99, free99, irq_off99;
+
+	alloc = mean99(stat->alloc, stat->alloc_num, &alloc99);
+	free = mean99(stat->free, stat->free_num, &free99);
+	irq_off = mean99(stat->irq_off, stat->irq_off_num, &irq_off99);
+
+	printf("%-8s alloc %4u / %4u, free %4u / %4u, irq off %4u / %4u cycles\n", name,
+		alloc, alloc99, free, free99, irq_off, irq_off99);
+}
+
+void test_a2dp_replay(void)
+{
+	struct slabs_info *slabs = (struct slabs_info *)&sys_slab;
+	struct slabs_index *index = slabs->index;
+	struct slabs_info no_index = sys_slab;
+	u32_t stat_alloc = 0, stat_irq_off = 0, floor, p99;
+	u32_t before_best = UINT32_MAX, after_best = UINT32_MAX;
+	int i, round, allocs = 0;
+
+	trace_build();
+	for (i = 0; i < trace_num; i++)
+		allocs += (trace[i].op == OP_ALLOC);
+
+	/* an empty irq locked section, the cost of timing it */
+	cur = &before;
+	before.irq_off_num = 0;
+	for (i = 0; i < 10000; i++)
+		irq_unlock(irq_lock());
+	floor = mean99(before.irq_off, before.irq_off_num, &p99);
+
+	/* best of the rounds, the host is noisy */
+	no_index.index = NULL;
+	for (round = 0; round < ROUNDS; round++) {
+		block_clear = true;
+		replay(&no_index, &before);
+		before_best = min(before_best, mean99(before.irq_off, before.irq_off_num, &p99));
+
+		block_clear = false;
+		replay(slabs, &after);
+		after_best = min(after_best, mean99(after.irq_off, after.irq_off_num, &p99));
+	}
+
+	zassert_equal(before.fails, 0, "allocation failed before");
+	zassert_equal(after.fails, 0, "allocation failed after");
+
+	printf("a2dp trace: %d allocs of %d ops, mean / 99th percentile:\n",
+		allocs, trace_num);
+	report("before", &before);
+	report("after", &after);
+	printf("irq off of the best round, less the %u cycles of timing: before %u, after %u\n",
+		floor, before_best - floor, after_best - floor);
+	printf("cleared with irq locked: before %u, after %u bytes\n",
+		before.irq_off_clear, after.irq_off_clear);
+	zassert_true(before.irq_off_clear > 0, "nothing cleared before");
+	zassert_equal(after.irq_off_clear, 0, "block cleared with irq locked");
+
+	/* the allocator's stats of the last round: a tick per alloc and free */
+	for (i = 0; i < slabs->slab_num; i++) {
+		stat_alloc += index->stat[i].alloc_cnt;
+		stat_irq_off += index->stat[i].irq_off_cycles;
+	}
+	zassert_equal(stat_alloc, allocs, "alloc count");
+	zassert_equal(stat_irq_off, after.alloc_num + after.free_num, "irq off stats");
+
+	mem_slabs_dump(slabs, -1);
+}
+
+void test_main(void)
+{
+	ztest_test_suite(test_mem_slab,
+			 ztest_unit_test(test_a2dp_replay));
+	ztest_run_test_suite(test_mem_slab);
+}
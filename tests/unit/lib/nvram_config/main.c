@@ -0,0 +1,345 @@
+/*
+ * Copyright (c) 2020 Actions Semiconductor Co., Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Runs nvram config over a ram nor flash. Random sets, deletes, purges
+ * and reboots are checked against a plain list of the properties, then
+ * boots with 50, 200 and 500 properties are timed and their flash reads
+ * counted, once walking the segment and once with the ram index.
+ */
+
+#include <ztest.h>
+#include <stdio.h>
+#include <time.h>
+
+#define CONFIG_NVRAM_FACTORY_REGION_BASE_ADDR		0x3f0000
+#define CONFIG_NVRAM_FACTORY_REGION_SIZE		0x2000
+#define CONFIG_NVRAM_FACTORY_REGION_SEGMENT_SIZE	0x1000
+#define CONFIG_NVRAM_USER_REGION_BASE_ADDR		0x3f4000
+/* room for 500 properties and their older copies in one segment */
+#define CONFIG_NVRAM_USER_REGION_SIZE			0x20000
+#define CONFIG_NVRAM_USER_REGION_SEGMENT_SIZE		0x8000
+#define CONFIG_NVRAM_FAST_INDEX				1
+#define CONFIG_NVRAM_FAST_INDEX_ENTRIES			512
+
+/* init.h needs the kernel */
+#define _INIT_H_
+#define SYS_INIT(init_fn, level, prio)
+
+int k_sem_take(struct k_sem *sem, s32_t timeout)
+{
+	return 0;
+}
+
+void k_sem_give(struct k_sem *sem)
+{
+}
+
+void k_busy_wait(u32_t usec_to_wait)
+{
+}
+
+/* from the arch headers */
+static inline unsigned int find_lsb_set(u32_t op)
+{
+	return __builtin_ffs(op);
+}
+
+#include <drivers/nvram/nvram_config.c>
+
+#define FLASH_BASE	CONFIG_NVRAM_FACTORY_REGION_BASE_ADDR
+#define FLASH_SIZE	(CONFIG_NVRAM_USER_REGION_BASE_ADDR + CONFIG_NVRAM_USER_REGION_SIZE - FLASH_BASE)
+#define MAX_PROPS	500
+#define MAX_DATA	32
+
+struct prop {
+	char name[24];
+	u8_t data[MAX_DATA];
+	int len;
+};
+
+static u8_t flash[FLASH_SIZE];
+static u32_t flash_reads, flash_read_bytes;
+static struct device flash_dev;
+
+static struct prop ref[MAX_PROPS];
+static int ref_num;
+
+static unsigned int seed = 1;
+
+struct device *nvram_storage_init(void)
+{
+	return &flash_dev;
+}
+
+int nvram_storage_read(struct device *dev, uint32_t addr, void *buf, int32_t size)
+{
+	zassert_true(addr >= FLASH_BASE && addr + size <= FLASH_BASE + FLASH_SIZE, "read out of flash");
+
+	memcpy(buf, flash + addr - FLASH_BASE, size);
+	flash_reads++;
+	flash_read_bytes += size;
+
+	return 0;
+}
+
+int nvram_storage_write(struct device *dev, uint32_t addr, const void *buf, int32_t size)
+{
+	const u8_t *data = buf;
+	int i;
+
+	zassert_true(addr >= FLASH_BASE && addr + size <= FLASH_BASE + FLASH_SIZE, "write out of flash");
+
+	/* nor flash only clears bits */
+	for (i = 0; i < size; i++)
+		flash[addr - FLASH_BASE + i] &= data[i];
+
+	return 0;
+}
+
+int nvram_storage_erase(struct device *dev, uint32_t addr, int32_t size)
+{
+	zassert_true(addr >= FLASH_BASE && addr + size <= FLASH_BASE + FLASH_SIZE, "erase out of flash");
+	zassert_true(!(addr & (NVRAM_ERASE_ALIGN_SIZE - 1)), "erase not aligned");
+
+	memset(flash + addr - FLASH_BASE, 0xff, size);
+
+	return 0;
+}
+
+static u32_t rnd(u32_t n)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 8) % n;
+}
+
+static u32_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void boot(int indexed)
+{
+	user_nvram_region.item_index = indexed ? &user_region_index : NULL;
+	zassert_equal(nvram_config_init(NULL), 0, "init");
+
+	if (indexed)
+		zassert_false(user_region_index.overflow, "index overflow");
+}
+
+static void format(void)
+{
+	memset(flash, 0xff, sizeof(flash));
+	ref_num = 0;
+	boot(1);
+}
+
+/* names like the ones of the apps, of different sizes and sums */
+static void gen_name(char *name)
+{
+	static const char * const prefix[] = { "BT_", "APP_", "AUDIO_", "SYS_", "" };
+	int i, n;
+
+	n = sprintf(name, "%s", prefix[rnd(ARRAY_SIZE(prefix))]);
+	for (i = rnd(10) + 3; i > 0; i--)
+		name[n++] = rnd(3) ? 'A' + rnd(26) : '0' + rnd(10);
+	name[n] = '\0';
+}
+
+static struct prop *find(const char *name)
+{
+	int i;
+
+	for (i = 0; i < ref_num; i++) {
+		if (!strcmp(ref[i].name, name))
+			return &ref[i];
+	}
+
+	return NULL;
+}
+
+static void gen_data(struct prop *p)
+{
+	int i;
+
+	p->len = 1 + rnd(MAX_DATA);
+	for (i = 0; i < p->len; i++)
+		p->data[i] = rnd(256);
+}
+
+static void set(struct prop *p)
+{
+	gen_data(p);
+	zassert_equal(nvram_config_set(p->name, p->data, p->len), 0, "set");
+}
+
+static void add(void)
+{
+	struct prop *p = &ref[ref_num];
+
+	do {
+		gen_name(p->name);
+	} while (find(p->name));
+
+	ref_num++;
+	set(p);
+}
+
+static void delete(int i)
+{
+	zassert_equal(nvram_config_set(ref[i].name, NULL, 0), 0, "delete");
+	zassert_equal(nvram_config_get(ref[i].name, ref[i].data, MAX_DATA), -ENOENT, "deleted");
+	ref[i] = ref[--ref_num];
+}
+
+static void check_all(void)
+{
+	u8_t data[MAX_DATA];
+	int i;
+
+	for (i = 0; i < ref_num; i++) {
+		zassert_equal(nvram_config_get(ref[i].name, data, sizeof(data)), ref[i].len, "get len");
+		zassert_true(!memcmp(data, ref[i].data, ref[i].len), "get data");
+	}
+
+	zassert_equal(nvram_config_get("NOT_SET", data, sizeof(data)), -ENOENT, "not set");
+}
+
+void test_random(void)
+{
+	int i, op, purges = 0;
+	u32_t seg_offset;
+
+	format();
+
+	for (i = 0; i < 20000; i++) {
+		seg_offset = user_nvram_region.seg_offset;
+
+		op = rnd(100);
+		if (ref_num < 100 && op < 40)
+			add();
+		else if (ref_num > 0 && op < 95)
+			set(&ref[rnd(ref_num)]);
+		else if (ref_num > 0)
+			delete(rnd(ref_num));
+
+		if (user_nvram_region.seg_offset != seg_offset)
+			purges++;
+
+		if (!rnd(500)) {
+			boot(rnd(2));
+			check_all();
+		}
+	}
+
+	boot(1);
+	check_all();
+	boot(0);
+	check_all();
+
+	printf("%d properties after %d purges\n", ref_num, purges);
+	zassert_true(purges > 5, "no purge");
+}
+
+void test_overflow(void)
+{
+	int i;
+
+	format();
+	for (i = 0; i < 200; i++)
+		add();
+
+	/* more items than entries, lookups walk the segment */
+	user_region_index.max_cnt = 100;
+	user_nvram_region.item_index = &user_region_index;
+	zassert_equal(nvram_config_init(NULL), 0, "init");
+	zassert_true(user_region_index.overflow, "no overflow");
+	check_all();
+
+	/* a purge of fewer items brings the index back */
+	for (i = 150; i > 0; i--)
+		delete(rnd(ref_num));
+	region_purge_seg(&user_nvram_region, 0);
+	zassert_false(user_region_index.overflow, "still overflow");
+	for (i = 0; i < 20; i++)
+		set(&ref[rnd(ref_num)]);
+	check_all();
+
+	user_region_index.max_cnt = CONFIG_NVRAM_FAST_INDEX_ENTRIES;
+	boot(1);
+	check_all();
+}
+
+static void bench(int num)
+{
+	u32_t reads[2], bytes[2], boot_us[2], get_reads[2], get_us[2];
+	u32_t start, us;
+	u8_t data[MAX_DATA];
+	int i, j, indexed;
+
+	format();
+	for (i = 0; i < num; i++)
+		add();
+	/* a quarter were set again, their older copies are obsolete */
+	for (i = 0; i < num / 4; i++)
+		set(&ref[rnd(num)]);
+
+	for (indexed = 0; indexed < 2; indexed++) {
+		boot_us[indexed] = UINT32_MAX;
+		get_us[indexed] = UINT32_MAX;
+
+		for (j = 0; j < 3; j++) {
+			flash_reads = flash_read_bytes = 0;
+			start = now_us();
+			boot(indexed);
+			us = now_us() - start;
+			reads[indexed] = flash_reads;
+			bytes[indexed] = flash_read_bytes;
+			boot_us[indexed] = min(boot_us[indexed], us);
+
+			flash_reads = 0;
+			start = now_us();
+			for (i = 0; i < num; i++)
+				nvram_config_get(ref[i].name, data, sizeof(data));
+			us = now_us() - start;
+			get_reads[indexed] = flash_reads;
+			get_us[indexed] = min(get_us[indexed], us);
+		}
+
+		check_all();
+	}
+
+	printf("%3d properties, boot: walk %7u reads %8u bytes %6u us, index %5u reads %6u bytes %4u us\n",
+	       num, reads[0], bytes[0], boot_us[0], reads[1], bytes[1], boot_us[1]);
+	printf("%3d properties, get:  walk %5u reads/100 gets %6u us, index %3u reads/100 gets %4u us\n",
+	       num, get_reads[0] * 100 / num, get_us[0], get_reads[1] * 100 / num, get_us[1]);
+
+	/* the walk reads every item before the one looked for */
+	zassert_true(reads[1] * (num / 25) < reads[0], "boot not faster");
+	zassert_true(bytes[1] <= bytes[0], "boot reads more");
+	zassert_true(get_reads[1] * 4 < get_reads[0], "get not faster");
+	/* a header with the name and the data, now and then a collision */
+	zassert_true(get_reads[1] <= 3 * num, "too many index reads");
+}
+
+void test_boot_bench(void)
+{
+	bench(50);
+	bench(200);
+	bench(500);
+}
+
+void test_main(void)
+{
+	ztest_test_suite(test_nvram_config,
+			 ztest_unit_test(test_random),
+			 ztest_unit_test(test_overflow),
+			 ztest_unit_test(test_boot_bench));
+	ztest_run_test_suite(test_nvram_config);
+}
@@ -0,0 +1,324 @@
+/*
+ * Copyright (c) 2020 Actions Semiconductor Co., Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Producer threads flood two receiver threads with async messages, now
+ * and then a sync one, through a pool smaller than what is in flight.
+ * Every message has to arrive once and in the order of its sender, and
+ * the time from send to receive goes to a histogram.
+ */
+
+/* atomic.h comes with ztest.h */
+#define CONFIG_ATOMIC_OPERATIONS_BUILTIN	1
+
+#include <ztest.h>
+#include <stdio.h>
+#include <time.h>
+/* C11 threads, the tree has its own pthread.h on the include path */
+#include <threads.h>
+
+#define CONFIG_NUM_MBOX_ASYNC_MSGS		20
+#define CONFIG_MSG_RECEIVER_QUEUE_NUM		16
+
+unsigned int irq_lock(void);
+void irq_unlock(unsigned int key);
+
+#include <ext/actions/porting/os_wrapper/os_msg_queue.c>
+
+#define PRODUCERS	6
+#define RECEIVERS	2
+#define MSGS		50000
+/* one message in SYNC_EVERY waits for its receiver */
+#define SYNC_EVERY	64
+#define BUCKETS		24
+
+enum {
+	MSG_ASYNC = 1,
+	MSG_SYNC,
+	MSG_QUIT,
+};
+
+/* ids of the simulated threads, only their address is used */
+static char thread_ids[PRODUCERS + RECEIVERS + 1];
+static _Thread_local k_tid_t current;
+
+static mtx_t irq_mtx, sem_mtx;
+static cnd_t sem_cnd;
+
+static u64_t send_ns[PRODUCERS][MSGS];
+/* latency histogram, bucket n holds [2^n, 2^(n+1)) ns */
+static u32_t hist[RECEIVERS][BUCKETS];
+static u32_t received[RECEIVERS][PRODUCERS];
+static u32_t pool_full[PRODUCERS];
+static int order_errors;
+
+#define TID(i)		((k_tid_t)&thread_ids[i])
+#define RECEIVER(r)	TID(PRODUCERS + (r))
+
+static u64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+k_tid_t k_current_get(void)
+{
+	return current;
+}
+
+void k_sched_lock(void)
+{
+}
+
+void k_sched_unlock(void)
+{
+}
+
+unsigned int irq_lock(void)
+{
+	mtx_lock(&irq_mtx);
+	return 0;
+}
+
+void irq_unlock(unsigned int key)
+{
+	mtx_unlock(&irq_mtx);
+}
+
+/* one lock for all semaphores, only count and limit are used */
+void k_sem_init(struct k_sem *sem, unsigned int initial_count, unsigned int limit)
+{
+	sem->count = initial_count;
+	sem->limit = limit;
+}
+
+void k_sem_give(struct k_sem *sem)
+{
+	mtx_lock(&sem_mtx);
+	if (sem->count < sem->limit)
+		sem->count++;
+	cnd_broadcast(&sem_cnd);
+	mtx_unlock(&sem_mtx);
+}
+
+int k_sem_take(struct k_sem *sem, s32_t timeout)
+{
+	struct timespec ts;
+	int ret = 0;
+
+	timespec_get(&ts, TIME_UTC);
+	if (timeout > 0) {
+		ts.tv_sec += timeout / 1000;
+		ts.tv_nsec += (timeout % 1000) * 1000000L;
+		if (ts.tv_nsec >= 1000000000L) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000L;
+		}
+	}
+
+	mtx_lock(&sem_mtx);
+	while (!sem->count && !ret) {
+		if (timeout == K_NO_WAIT)
+			ret = -EBUSY;
+		else if (timeout == K_FOREVER)
+			cnd_wait(&sem_cnd, &sem_mtx);
+		else if (cnd_timedwait(&sem_cnd, &sem_mtx, &ts) == thrd_timedout)
+			ret = -EAGAIN;
+	}
+	if (!ret)
+		sem->count--;
+	mtx_unlock(&sem_mtx);
+
+	return ret;
+}
+
+static void sim_init(void)
+{
+	mtx_init(&irq_mtx, mtx_plain);
+	mtx_init(&sem_mtx, mtx_plain);
+	cnd_init(&sem_cnd);
+	current = TID(PRODUCERS + RECEIVERS);
+	os_msg_init();
+}
+
+static void send(int receiver, u8_t type, u8_t cmd, int value)
+{
+	struct app_msg msg = {0};
+
+	msg.type = type;
+	msg.cmd = cmd;
+	msg.value = value;
+
+	if (type == MSG_SYNC) {
+		zassert_equal(os_send_sync_msg(RECEIVER(receiver), &msg, sizeof(msg)), 0, "sync send");
+		return;
+	}
+
+	/* a full pool is retried, as the apps do */
+	while (os_send_async_msg(RECEIVER(receiver), &msg, sizeof(msg)) == -ENOMEM) {
+		pool_full[cmd]++;
+		thrd_yield();
+	}
+}
+
+static int producer(void *arg)
+{
+	int p = (int)(intptr_t)arg;
+	int i;
+
+	current = TID(p);
+
+	for (i = 0; i < MSGS; i++) {
+		send_ns[p][i] = now_ns();
+		send(i % RECEIVERS, (i % SYNC_EVERY) ? MSG_ASYNC : MSG_SYNC, p, i);
+	}
+
+	return 0;
+}
+
+static int receiver(void *arg)
+{
+	int r = (int)(intptr_t)arg;
+	int next[PRODUCERS];
+	struct app_msg msg;
+	u64_t ns;
+	int bucket;
+
+	current = RECEIVER(r);
+	for (bucket = 0; bucket < PRODUCERS; bucket++)
+		next[bucket] = r;
+
+	for (;;) {
+		zassert_equal(os_receive_msg(&msg, sizeof(msg), OS_FOREVER), 0, "receive");
+		if (msg.type == MSG_QUIT)
+			break;
+
+		ns = now_ns() - send_ns[msg.cmd][msg.value];
+		for (bucket = 0; bucket < BUCKETS - 1 && (ns >> (bucket + 1)); bucket++)
+			;
+		hist[r][bucket]++;
+
+		/* each producer sends to the receivers in turn */
+		if (msg.value != next[msg.cmd])
+			order_errors++;
+		next[msg.cmd] = msg.value + RECEIVERS;
+		received[r][msg.cmd]++;
+
+		if (msg.callback)
+			msg.callback(&msg, 0, NULL);
+	}
+
+	return 0;
+}
+
+/* bucket where the share of the messages reaches per_mille */
+static int percentile(u32_t *sum, u32_t total, u32_t per_mille)
+{
+	u32_t count = 0;
+	int i;
+
+	for (i = 0; i < BUCKETS; i++) {
+		count += sum[i];
+		if ((u64_t)count * 1000 >= (u64_t)total * per_mille)
+			break;
+	}
+
+	return i;
+}
+
+void test_stress(void)
+{
+	thrd_t producers[PRODUCERS], receivers[RECEIVERS];
+	u32_t sum[BUCKETS] = {0}, total = 0, full = 0;
+	u64_t start, ns;
+	int i, r;
+
+	sim_init();
+
+	start = now_ns();
+	for (r = 0; r < RECEIVERS; r++)
+		thrd_create(&receivers[r], receiver, (void *)(intptr_t)r);
+	for (i = 0; i < PRODUCERS; i++)
+		thrd_create(&producers[i], producer, (void *)(intptr_t)i);
+	for (i = 0; i < PRODUCERS; i++)
+		thrd_join(producers[i], NULL);
+	for (r = 0; r < RECEIVERS; r++)
+		send(r, MSG_QUIT, 0, 0);
+	for (r = 0; r < RECEIVERS; r++)
+		thrd_join(receivers[r], NULL);
+	ns = now_ns() - start;
+
+	for (r = 0; r < RECEIVERS; r++) {
+		for (i = 0; i < BUCKETS; i++)
+			sum[i] += hist[r][i];
+		for (i = 0; i < PRODUCERS; i++) {
+			zassert_equal(received[r][i], MSGS / RECEIVERS, "messages lost");
+			total += received[r][i];
+		}
+	}
+	for (i = 0; i < PRODUCERS; i++)
+		full += pool_full[i];
+
+	printf("%d producers, %d receivers, %u messages in %llu ms, pool full %u times\n",
+	       PRODUCERS, RECEIVERS, total, ns / 1000000, full);
+	printf("send to receive latency:\n");
+	for (i = 0; i < BUCKETS; i++) {
+		if (sum[i])
+			printf("  %8llu ns - %8llu ns: %7u\n", 1ull << i, (2ull << i) - 1, sum[i]);
+	}
+	printf("p50 < %llu ns, p99 < %llu ns\n", 2ull << percentile(sum, total, 500),
+	       2ull << percentile(sum, total, 990));
+
+	zassert_equal(order_errors, 0, "out of order");
+	zassert_equal(msg_pool_get_free_msg_num(), CONFIG_NUM_MBOX_ASYNC_MSGS, "pool leak");
+	for (r = 0; r < RECEIVERS; r++) {
+		current = RECEIVER(r);
+		zassert_equal(os_get_pending_msg_cnt(), 0, "pending left");
+	}
+}
+
+static int match_odd(void *msg, k_tid_t target_thread, k_tid_t source_thread)
+{
+	return ((struct app_msg *)msg)->value & 1;
+}
+
+void test_delete(void)
+{
+	struct app_msg msg;
+	int i;
+
+	sim_init();
+
+	for (i = 0; i < 10; i++)
+		send(0, MSG_ASYNC, 0, i);
+	zassert_equal(msg_pool_get_free_msg_num(), CONFIG_NUM_MBOX_ASYNC_MSGS - 10, "pool");
+
+	zassert_equal(os_msg_delete(match_odd), 5, "deleted");
+	zassert_equal(msg_pool_get_free_msg_num(), CONFIG_NUM_MBOX_ASYNC_MSGS - 5, "pool");
+
+	current = RECEIVER(0);
+	zassert_equal(os_get_pending_msg_cnt(), 5, "pending");
+	for (i = 0; i < 10; i += 2) {
+		zassert_equal(os_receive_msg(&msg, sizeof(msg), OS_NO_WAIT), 0, "receive");
+		zassert_equal(msg.value, i, "order");
+	}
+	zassert_equal(os_receive_msg(&msg, sizeof(msg), OS_NO_WAIT), -ETIMEDOUT, "empty");
+
+	/* a released receiver gives its messages back to the pool */
+	send(1, MSG_ASYNC, 0, 0);
+	os_msg_queue_release(RECEIVER(1));
+	zassert_equal(msg_pool_get_free_msg_num(), CONFIG_NUM_MBOX_ASYNC_MSGS, "pool leak");
+}
+
+void test_main(void)
+{
+	ztest_test_suite(test_os_msg_queue,
+			 ztest_unit_test(test_delete),
+			 ztest_unit_test(test_stress));
+	ztest_run_test_suite(test_os_msg_queue);
+}
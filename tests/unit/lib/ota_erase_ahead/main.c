@@ -0,0 +1,449 @@
+/*
+ * Copyright (c) 2020 Actions Semiconductor Co., Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Writes a file into a RAM NOR partition through the recovery writer with
+ * the partition erased ahead of the write cursor, from the start and from
+ * a breakpoint, with the rx thread fast and slow. Every byte has to be
+ * programmed on an erased sector, the breakpoint may never run ahead of
+ * the flash, each sector from the breakpoint on is erased once and the
+ * ones before it are kept.
+ */
+
+#define CONFIG_OTA_ERASE_AHEAD		1
+
+#include <ztest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+/* C11 threads, the tree has its own pthread.h on the include path */
+#include <threads.h>
+
+/* soc.h needs the arch */
+#define _ACTIONS_SOC_H_
+#define STACK_ALIGN				4
+#define SOC_BOOT_FIRMWARE_VERSION_OFFSET	0
+
+#include <ext/actions/base/utils/crc/crc.c>
+#include <ext/actions/base/utils/acts_ringbuf/acts_ringbuf.c>
+#include <ext/actions/ota/libota/ota_upgrade.c>
+
+/* neither sector nor block aligned at either end */
+#define PART_OFFSET	0x103000
+#define PART_SIZE	0x32000
+#define SECTORS		(PART_SIZE / OTA_ERASE_ALIGN_SIZE)
+#define FILE_SIZE	(150 * 1024 + 123)
+#define IMG_FILE_OFFSET	0x200
+#define DIRTY		0x5a
+
+static struct ota_upgrade_info ota_info;
+static struct partition_entry part;
+static struct ota_file file;
+/* no ioctl, default unit and request sizes */
+static struct ota_backend_api backend_api;
+static struct ota_backend backend = {
+	.api = &backend_api,
+	.type = OTA_BACKEND_TYPE_CARD,
+};
+
+static u8_t flash[PART_SIZE];
+static u8_t img[FILE_SIZE];
+static u8_t data_buf[OTA_ERASE_ALIGN_SIZE];
+
+static u8_t erase_cnt[SECTORS];
+static u32_t erases, last_erase_size;
+static bool erase_fail;
+/* the last rx_get_sem poll of the writer found nothing */
+static bool writer_idle;
+static int bp_file_state;
+static int read_delay_us;
+static u32_t uptime;
+
+static mtx_t sem_mtx;
+static cnd_t sem_cnd;
+
+static struct {
+	thrd_t thrd;
+	void (*entry)(void *, void *, void *);
+	void *p1;
+} rx;
+
+/* a ms per call, the writer divides by its run time */
+u32_t k_uptime_get_32(void)
+{
+	return __atomic_fetch_add(&uptime, 1, __ATOMIC_RELAXED);
+}
+
+/* only polled on, ota_rx_stop() sleeps until the rx thread is out */
+void k_sleep(s32_t duration)
+{
+	thrd_sleep(&(struct timespec){ .tv_nsec = 100000 }, NULL);
+}
+
+static int rx_entry(void *arg)
+{
+	rx.entry(rx.p1, NULL, NULL);
+	return 0;
+}
+
+k_tid_t k_thread_create(struct k_thread *new_thread, k_thread_stack_t stack,
+			size_t stack_size, void (*entry)(void *, void *, void *),
+			void *p1, void *p2, void *p3, int prio, u32_t options, s32_t delay)
+{
+	rx.entry = entry;
+	rx.p1 = p1;
+	zassert_equal(thrd_create(&rx.thrd, rx_entry, NULL), thrd_success, "rx thread");
+
+	return new_thread;
+}
+
+/* one lock for all semaphores, only count and limit are used */
+void k_sem_init(struct k_sem *sem, unsigned int initial_count, unsigned int limit)
+{
+	sem->count = initial_count;
+	sem->limit = limit;
+}
+
+void k_sem_give(struct k_sem *sem)
+{
+	mtx_lock(&sem_mtx);
+	if (sem->count < sem->limit)
+		sem->count++;
+	cnd_broadcast(&sem_cnd);
+	mtx_unlock(&sem_mtx);
+}
+
+int k_sem_take(struct k_sem *sem, s32_t timeout)
+{
+	int ret = 0;
+
+	mtx_lock(&sem_mtx);
+	while (!sem->count && !ret) {
+		if (timeout == K_NO_WAIT)
+			ret = -EBUSY;
+		else
+			cnd_wait(&sem_cnd, &sem_mtx);
+	}
+	if (!ret)
+		sem->count--;
+	mtx_unlock(&sem_mtx);
+
+	if (sem == &ota_info.rx_info.rx_get_sem)
+		writer_idle = ret;
+
+	return ret;
+}
+
+struct ota_backend *ota_image_get_backend(struct ota_image *img)
+{
+	return &backend;
+}
+
+int ota_image_get_file_offset(struct ota_image *img, const char *filename)
+{
+	return IMG_FILE_OFFSET;
+}
+
+int ota_image_read(struct ota_image *ota_img, int offset, u8_t *buf, int size)
+{
+	if (read_delay_us)
+		thrd_sleep(&(struct timespec){ .tv_nsec = read_delay_us * 1000 }, NULL);
+
+	zassert_true(offset >= IMG_FILE_OFFSET && offset + size <= IMG_FILE_OFFSET + FILE_SIZE,
+		     "image read out of file");
+	memcpy(buf, &img[offset - IMG_FILE_OFFSET], size);
+
+	return 0;
+}
+
+/* bluetooth and local image reads are not taken */
+int ota_image_read_prepare(struct ota_image *img, int offset, uint8_t *buf, int size)
+{
+	return -EIO;
+}
+
+int ota_image_read_complete(struct ota_image *img, int offset, uint8_t *buf, int size)
+{
+	return -EIO;
+}
+
+int ota_storage_read(struct ota_storage *storage, int offs, uint8_t *buf, int size)
+{
+	return -EIO;
+}
+
+const struct partition_entry *partition_get_part(u8_t file_id)
+{
+	return &part;
+}
+
+int partition_is_boot_part(const struct partition_entry *part)
+{
+	return 0;
+}
+
+int partition_is_param_part(const struct partition_entry *part)
+{
+	return 0;
+}
+
+int ota_storage_get_storage_id(struct ota_storage *storage)
+{
+	return 0;
+}
+
+int ota_storage_erase(struct ota_storage *storage, int offs, int size)
+{
+	int i;
+
+	zassert_true(size > 0 && !(offs % OTA_ERASE_ALIGN_SIZE) && !(size % OTA_ERASE_ALIGN_SIZE),
+		     "erase not sector aligned");
+	zassert_true(offs >= PART_OFFSET && offs + size <= PART_OFFSET + PART_SIZE,
+		     "erase out of partition");
+	/* a block erase would hold the ring buffer up */
+	zassert_false(writer_idle && size > OTA_ERASE_ALIGN_SIZE, "idle erase of a block");
+
+	if (erase_fail)
+		return -EIO;
+
+	/* 100 us and 10 us per KB, so the writer does not outrun the link */
+	thrd_sleep(&(struct timespec){ .tv_nsec = 100000 + size / 1024 * 10000 }, NULL);
+
+	memset(&flash[offs - PART_OFFSET], 0xff, size);
+	for (i = 0; i < size / OTA_ERASE_ALIGN_SIZE; i++)
+		erase_cnt[(offs - PART_OFFSET) / OTA_ERASE_ALIGN_SIZE + i]++;
+
+	erases++;
+	last_erase_size = size;
+
+	return 0;
+}
+
+int ota_storage_write(struct ota_storage *storage, int offs, uint8_t *buf, int size)
+{
+	int i;
+
+	zassert_true(offs >= PART_OFFSET && offs + size <= PART_OFFSET + PART_SIZE,
+		     "write out of partition");
+
+	for (i = 0; i < size; i++)
+		zassert_equal(flash[offs - PART_OFFSET + i], 0xff, "programmed before erase");
+
+	memcpy(&flash[offs - PART_OFFSET], buf, size);
+
+	return 0;
+}
+
+int ota_storage_calc_crc(struct ota_storage *storage, uint32_t addr, uint32_t size,
+			 uint8_t *buf, int buf_size)
+{
+	return utils_crc32(0, &flash[addr - PART_OFFSET], size);
+}
+
+int ota_breakpoint_get_file_state(struct ota_breakpoint *bp, int file_id)
+{
+	return bp_file_state;
+}
+
+int ota_breakpoint_update_file_state(struct ota_breakpoint *bp, struct ota_file *file,
+				     int state, int cur_offset, int force)
+{
+	/* a resume from here has to find the data before it on flash */
+	if (state == OTA_BP_FILE_STATE_WRITING)
+		zassert_equal(memcmp(flash, img, cur_offset), 0, "breakpoint ahead of flash");
+
+	bp_file_state = state;
+
+	return 0;
+}
+
+/* secure boot, encrypted and temp image checks are not taken */
+int ota_storage_image_check(struct ota_storage *storage, uint32_t file_offset, uint8_t *buf, int buf_size)
+{
+	return -EIO;
+}
+
+int ota_storage_check_image_sig_data(struct ota_storage *storage, const char *public_key,
+				     uint32_t addr, uint32_t size, uint32_t sig_addr, uint32_t sig_size,
+				     uint8_t *buf, int buf_size)
+{
+	return -EIO;
+}
+
+int soc_memctrl_mapping(u32_t cpu_addr, u32_t nor_phy_addr, int enable_crc)
+{
+	return -EIO;
+}
+
+void soc_memctrl_clear_temp_mapping(void *cpu_addr)
+{
+}
+
+k_tid_t k_current_get(void)
+{
+	return NULL;
+}
+
+int k_thread_priority_get(k_tid_t thread)
+{
+	return 0;
+}
+
+void k_thread_priority_set(k_tid_t thread, int prio)
+{
+}
+
+/* bp_offset bytes of the file are on flash already, the rest is dirty */
+static void setup(u32_t bp_offset, int state)
+{
+	int i;
+
+	mtx_init(&sem_mtx, mtx_plain);
+	cnd_init(&sem_cnd);
+
+	for (i = 0; i < FILE_SIZE; i++)
+		img[i] = rand();
+
+	memset(&ota_info, 0, sizeof(ota_info));
+	ota_info.flags = OTA_FLAG_USE_RECOVERY;
+	ota_info.data_buf = data_buf;
+	ota_info.data_buf_size = sizeof(data_buf);
+	ota_rx_init(&ota_info);
+
+	memcpy(part.name, "SYSTEM", 6);
+	part.file_id = PARTITION_FILE_ID_SYSTEM;
+	part.offset = PART_OFFSET;
+	part.size = PART_SIZE;
+
+	strcpy((char *)file.name, "app.bin");
+	file.file_id = PARTITION_FILE_ID_SYSTEM;
+	file.offset = PART_OFFSET;
+	file.size = FILE_SIZE;
+	file.checksum = utils_crc32(0, img, FILE_SIZE);
+
+	memset(flash, DIRTY, sizeof(flash));
+	memcpy(flash, img, bp_offset);
+	memset(erase_cnt, 0, sizeof(erase_cnt));
+	erases = 0;
+	erase_fail = false;
+	writer_idle = false;
+
+	ota_info.bp.cur_file_write_offset = bp_offset;
+	bp_file_state = state;
+}
+
+/* each sector from the one of the breakpoint on erased once */
+static void check_erased_from(u32_t bp_offset)
+{
+	int i;
+
+	for (i = 0; i < SECTORS; i++)
+		zassert_equal(erase_cnt[i], i >= bp_offset / OTA_ERASE_ALIGN_SIZE, "erase count");
+}
+
+void test_bookkeeping(void)
+{
+	setup(0, OTA_BP_FILE_STATE_UNKOWN);
+
+	ota_erase_ahead_init(&ota_info, &part, 0x1234);
+	zassert_equal(ota_info.erase_offset, PART_OFFSET + 0x1000, "erase_offset");
+	zassert_equal(ota_info.erase_end, PART_OFFSET + PART_SIZE, "erase_end");
+
+	/* idle steps are one sector */
+	writer_idle = true;
+	zassert_equal(ota_erase_ahead_idle(&ota_info), 0, NULL);
+	zassert_equal(ota_erase_ahead_idle(&ota_info), 0, NULL);
+	writer_idle = false;
+	zassert_equal(erases, 2, NULL);
+	zassert_equal(last_erase_size, OTA_ERASE_ALIGN_SIZE, NULL);
+	zassert_equal(ota_info.erase_offset, PART_OFFSET + 0x3000, "erase_offset");
+	zassert_equal(ota_info.erase_idle_cnt, 2, NULL);
+
+	/* covered already */
+	zassert_equal(ota_erase_ahead(&ota_info, PART_OFFSET + 0x3000), 0, NULL);
+	zassert_equal(erases, 2, NULL);
+
+	/* up to the next block boundary */
+	zassert_equal(ota_erase_ahead(&ota_info, PART_OFFSET + 0x3001), 0, NULL);
+	zassert_equal(erases, 3, NULL);
+	zassert_equal(last_erase_size, 0x110000 - (PART_OFFSET + 0x3000), NULL);
+	zassert_equal(ota_info.erase_offset, 0x110000, "erase_offset");
+
+	/* whole blocks */
+	zassert_equal(ota_erase_ahead(&ota_info, 0x120001), 0, NULL);
+	zassert_equal(erases, 5, NULL);
+	zassert_equal(last_erase_size, OTA_ERASE_AHEAD_BLOCK_SIZE, NULL);
+	zassert_equal(ota_info.erase_offset, 0x130000, "erase_offset");
+
+	/* a failed erase is not skipped */
+	erase_fail = true;
+	zassert_equal(ota_erase_ahead(&ota_info, ota_info.erase_end), -EIO, NULL);
+	zassert_equal(ota_erase_ahead_idle(&ota_info), -EIO, NULL);
+	zassert_equal(ota_info.erase_offset, 0x130000, "erase_offset");
+	erase_fail = false;
+
+	/* the tail stops at the partition end */
+	zassert_equal(ota_erase_ahead(&ota_info, 0xffffffff), 0, NULL);
+	zassert_equal(erases, 6, NULL);
+	zassert_equal(last_erase_size, PART_OFFSET + PART_SIZE - 0x130000, NULL);
+	zassert_equal(ota_info.erase_offset, ota_info.erase_end, "erase_offset");
+
+	zassert_equal(ota_erase_ahead(&ota_info, 0xffffffff), 0, NULL);
+	zassert_equal(erases, 6, NULL);
+
+	check_erased_from(0x1000);
+}
+
+static void write_file(u32_t bp_offset, int state, int delay_us)
+{
+	u32_t aligned = ROUND_DOWN(bp_offset, OTA_ERASE_ALIGN_SIZE);
+	int i;
+
+	setup(bp_offset, state);
+	read_delay_us = delay_us;
+
+	zassert_equal(ota_write_and_verify_file(&ota_info, &part, &file, true), 0, "write");
+	thrd_join(rx.thrd, NULL);
+
+	zassert_equal(bp_file_state, OTA_BP_FILE_STATE_VERIFY_PASS, "verify");
+	zassert_equal(ota_info.bp.cur_file_write_offset, aligned, "resumed offset");
+	zassert_equal(ota_info.erase_offset, PART_OFFSET + PART_SIZE, "erase_offset");
+	zassert_equal(ota_info.erase_end, PART_OFFSET + PART_SIZE, "erase_end");
+
+	zassert_equal(memcmp(flash, img, FILE_SIZE), 0, "file");
+	for (i = FILE_SIZE; i < PART_SIZE; i++)
+		zassert_equal(flash[i], 0xff, "tail not erased");
+	check_erased_from(bp_offset);
+
+	printf("from 0x%x, reads %d us: %u erases, %u of them idle\n",
+	       bp_offset, delay_us, erases, ota_info.erase_idle_cnt);
+}
+
+void test_write(void)
+{
+	srand(1);
+	write_file(0, OTA_BP_FILE_STATE_UNKOWN, 0);
+	write_file(0, OTA_BP_FILE_STATE_UNKOWN, 500);
+}
+
+void test_resume(void)
+{
+	srand(2);
+	write_file(0x12345, OTA_BP_FILE_STATE_WRITING, 0);
+	write_file(0x12345, OTA_BP_FILE_STATE_WRITING, 500);
+	zassert_true(ota_info.erase_idle_cnt > 0, "no idle erase");
+	/* the breakpoint on a sector boundary */
+	write_file(0x20000, OTA_BP_FILE_STATE_WRITING, 0);
+}
+
+void test_main(void)
+{
+	ztest_test_suite(test_ota_erase_ahead,
+			 ztest_unit_test(test_bookkeeping),
+			 ztest_unit_test(test_write),
+			 ztest_unit_test(test_resume));
+	ztest_run_test_suite(test_ota_erase_ahead);
+}
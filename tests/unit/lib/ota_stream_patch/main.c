@@ -0,0 +1,587 @@
+/*
+ * Copyright (c) 2020 Actions Semiconductor Co., Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Makes stream patches between synthetic firmware images, with the LZMA2
+ * records in stored chunks, and applies them to a RAM NOR flash image in
+ * odd sized pieces, whole and across simulated power losses. A patch made
+ * by build_ota_patch.py -s covers the compressed LZMA2 path.
+ */
+
+#include <ztest.h>
+#include <stdbool.h>
+
+#include <ext/actions/base/utils/crc/crc.c>
+#include <ext/actions/ota/minlzma/dictbuf.c>
+#include <ext/actions/ota/minlzma/inputbuf.c>
+#include <ext/actions/ota/minlzma/rangedec.c>
+#include <ext/actions/ota/minlzma/lzmadec.c>
+#include <ext/actions/ota/minlzma/lzma2dec.c>
+#include <ext/actions/ota/minlzma/xzstream.c>
+#include <ext/actions/ota/libota/ota_stream_patch.c>
+
+#define OLD_SIZE	(96 * 1024)
+#define NEW_SIZE_MAX	(112 * 1024)
+#define PATCH_SIZE_MAX	(256 * 1024)
+#define FLASH_SIZE	(128 * 1024)
+#define ERASE_SIZE	4096
+
+#define WINDOW		0x4000
+#define SEG_SIZE	0x2000
+/* stored LZMA2 chunk, small enough for several per record */
+#define LZMA2_CHUNK	0x1000
+
+#define KEY		8
+#define HASH_BITS	16
+#define MIN_MATCH	16
+#define MAX_DROP	32
+
+struct patch_src {
+	const u8_t *data;
+	u32_t size;
+};
+
+static u8_t old_img[OLD_SIZE];
+static u32_t old_size;
+static u8_t new_img[NEW_SIZE_MAX];
+static u32_t new_size;
+
+static u8_t patch[PATCH_SIZE_MAX];
+static u8_t diff[WINDOW * 2];
+static s32_t hash_tab[1 << HASH_BITS];
+
+static u8_t flash[FLASH_SIZE];
+static u32_t flash_written;
+static u8_t expect[FLASH_SIZE];
+static u32_t expect_size;
+
+static u8_t in_buf[WINDOW + 64];
+static u8_t window[WINDOW];
+static struct ota_stream_patch sp;
+static u32_t seed;
+
+static u32_t rnd(void)
+{
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+/* rom_crc16() of ota_file_patch.c */
+static unsigned short reflect16(unsigned short b)
+{
+	unsigned short v = 0;
+	int i;
+
+	for (i = 0; i < 16; i++)
+		v |= ((b >> i) & 0x1) << (15 - i);
+
+	return v;
+}
+
+static unsigned short rom_crc16(const unsigned char *buf, int len, unsigned short initial_crc)
+{
+	unsigned short crc = initial_crc;
+
+	crc = utils_crc16_ccitt_rev_update(reflect16(crc), buf, len);
+	crc = reflect16(crc);
+	crc = ((crc >> 8) & 0xff) | ((crc & 0xff) << 8);
+
+	return crc;
+}
+
+static void gen_expect(bool use_crc)
+{
+	u16_t crc;
+	u32_t i;
+
+	expect_size = 0;
+	for (i = 0; i < new_size; i += OTA_STREAM_PATCH_UNIT) {
+		memset(expect + expect_size, 0, OTA_STREAM_PATCH_UNIT);
+		memcpy(expect + expect_size, new_img + i, min(OTA_STREAM_PATCH_UNIT, new_size - i));
+
+		if (use_crc) {
+			crc = rom_crc16(expect + expect_size, OTA_STREAM_PATCH_UNIT, 0xffff);
+			expect[expect_size + OTA_STREAM_PATCH_UNIT] = crc & 0xff;
+			expect[expect_size + OTA_STREAM_PATCH_UNIT + 1] = crc >> 8;
+			expect_size += OTA_STREAM_PATCH_CRC_UNIT;
+		} else {
+			expect_size += OTA_STREAM_PATCH_UNIT;
+		}
+	}
+}
+
+/* code like: words from a small vocabulary, now and then a random one */
+static void gen_images(void)
+{
+	static u32_t vocab[64];
+	u32_t i, w, n = 0;
+
+	seed = 1;
+	for (i = 0; i < ARRAY_SIZE(vocab); i++)
+		vocab[i] = rnd();
+
+	old_size = OLD_SIZE;
+	for (i = 0; i < old_size; i += 4) {
+		w = (rnd() % 4) ? vocab[rnd() % ARRAY_SIZE(vocab)] : rnd();
+		memcpy(old_img + i, &w, 4);
+	}
+
+	/* inserted code */
+	memcpy(new_img, old_img, 20000);
+	n = 20000;
+	for (i = 0; i < 700; i++)
+		new_img[n++] = rnd();
+
+	/* shifted code, every 16th word relocated */
+	memcpy(new_img + n, old_img + 20000, 30000);
+	for (i = 10000; i < 20000; i += 64)
+		new_img[n + i + 1] += 0x04;
+	n += 30000;
+
+	/* a deleted function, a moved one, a new tail */
+	memcpy(new_img + n, old_img + 52000, 38000);
+	n += 38000;
+	memcpy(new_img + n, old_img + 10000, 4000);
+	n += 4000;
+	for (i = 0; i < 3001; i++)
+		new_img[n++] = rnd();
+
+	new_size = n;
+}
+
+static u32_t key_hash(const u8_t *p)
+{
+	u32_t a = p[0] | (p[1] << 8) | (p[2] << 16) | ((u32_t)p[3] << 24);
+	u32_t b = p[4] | (p[5] << 8) | (p[6] << 16) | ((u32_t)p[7] << 24);
+
+	return ((a * 0x9e3779b1) ^ (b * 0x85ebca6b)) >> (32 - HASH_BITS);
+}
+
+static void gen_index(void)
+{
+	u32_t i, h;
+
+	for (i = 0; i < ARRAY_SIZE(hash_tab); i++)
+		hash_tab[i] = -1;
+
+	for (i = 0; i + KEY <= old_size; i += 4) {
+		h = key_hash(old_img + i);
+		if (hash_tab[h] < 0)
+			hash_tab[h] = i;
+	}
+}
+
+/* add region of new at p against old at o, at least half of it matching */
+static u32_t gen_extend(u32_t o, u32_t p, u32_t end)
+{
+	u32_t n = min(end - p, old_size - o);
+	u32_t i, best = 0;
+	int score = 0, best_score = 0;
+
+	for (i = 0; i < n; ) {
+		score += (old_img[o + i] == new_img[p + i]) ? 1 : -1;
+		i++;
+
+		if (score > best_score) {
+			best = i;
+			best_score = score;
+		} else if (score < best_score - MAX_DROP) {
+			break;
+		}
+	}
+
+	return best;
+}
+
+static u8_t *put_varint(u8_t *d, u32_t v)
+{
+	while (v >= 0x80) {
+		*d++ = (v & 0x7f) | 0x80;
+		v >>= 7;
+	}
+	*d++ = v;
+
+	return d;
+}
+
+static u8_t *put_le32(u8_t *d, u32_t v)
+{
+	*d++ = v;
+	*d++ = v >> 8;
+	*d++ = v >> 16;
+	*d++ = v >> 24;
+
+	return d;
+}
+
+/* o < 0 keeps the old position, for a leading insert */
+static u8_t *gen_op(u8_t *d, u32_t *old_pos, s32_t o, u32_t p, u32_t n, u32_t ins_end)
+{
+	s32_t seek;
+	u32_t i;
+
+	if (o < 0)
+		o = *old_pos;
+
+	seek = o - (s32_t)*old_pos;
+	d = put_varint(d, ((u32_t)seek << 1) ^ (u32_t)(seek >> 31));
+	d = put_varint(d, n);
+	d = put_varint(d, ins_end - p - n);
+
+	for (i = 0; i < n; i++)
+		*d++ = new_img[p + i] - old_img[o + i];
+
+	memcpy(d, new_img + p + n, ins_end - p - n);
+	d += ins_end - p - n;
+
+	*old_pos = o + n;
+	return d;
+}
+
+/* greedy diff, continuing the last match or one found by hash */
+static u32_t gen_segment(u32_t start, u32_t end, s32_t *last_o, u32_t *last_p)
+{
+	u8_t *d = diff;
+	u32_t old_pos = 0, p = start;
+	s32_t op_o = -1, cand[2], best_o = 0;
+	u32_t op_p = start, op_n = 0;
+	u32_t i, n, best;
+
+	while (p < end) {
+		cand[0] = (*last_o >= 0) ? *last_o + (s32_t)(p - *last_p) : -1;
+		cand[1] = (p + KEY <= new_size) ? hash_tab[key_hash(new_img + p)] : -1;
+
+		best = 0;
+		for (i = 0; i < ARRAY_SIZE(cand); i++) {
+			if (cand[i] < 0 || cand[i] >= (s32_t)old_size)
+				continue;
+
+			n = gen_extend(cand[i], p, end);
+			if (n > best) {
+				best = n;
+				best_o = cand[i];
+			}
+		}
+
+		if (best < MIN_MATCH) {
+			p++;
+			continue;
+		}
+
+		if (op_o >= 0 || p > op_p)
+			d = gen_op(d, &old_pos, op_o, op_p, op_n, p);
+
+		op_o = best_o;
+		op_p = p;
+		op_n = best;
+		p += best;
+		*last_o = best_o + best;
+		*last_p = p;
+	}
+
+	d = gen_op(d, &old_pos, op_o, op_p, op_n, end);
+
+	zassert_true(d - diff <= sizeof(diff), "diff overflow");
+	return d - diff;
+}
+
+static u8_t *gen_lzma2_stored(u8_t *d, const u8_t *src, u32_t size)
+{
+	u32_t len;
+	u8_t ctrl = 0x01;
+
+	while (size > 0) {
+		len = min(size, LZMA2_CHUNK);
+
+		/* the first one resets the dictionary */
+		*d++ = ctrl;
+		*d++ = (len - 1) >> 8;
+		*d++ = (len - 1) & 0xff;
+		memcpy(d, src, len);
+
+		d += len;
+		src += len;
+		size -= len;
+		ctrl = 0x02;
+	}
+	*d++ = 0x00;
+
+	return d;
+}
+
+static u32_t gen_patch(u32_t seg_size)
+{
+	u32_t seg_num = (new_size + seg_size - 1) / seg_size;
+	u32_t seg, len, max_diff = 0, max_lzma = 0, last_p = 0;
+	u8_t *table = patch + sizeof(struct ota_stream_patch_header);
+	u8_t *d = table + seg_num * 4, *rec;
+	s32_t last_o = -1;
+
+	gen_index();
+
+	for (seg = 0; seg < seg_num; seg++) {
+		len = gen_segment(seg * seg_size, min((seg + 1) * seg_size, new_size),
+				&last_o, &last_p);
+		max_diff = max(max_diff, len);
+
+		table = put_le32(table, d - patch);
+		rec = d + 4;
+		d = gen_lzma2_stored(rec, diff, len);
+		put_le32(rec - 4, d - rec);
+		max_lzma = max(max_lzma, (u32_t)(d - rec));
+
+		zassert_true(d - patch < PATCH_SIZE_MAX - WINDOW, "patch too big");
+	}
+
+	len = d - patch;
+
+	d = put_le32(patch, OTA_STREAM_PATCH_MAGIC);
+	*d++ = OTA_STREAM_PATCH_VERSION;
+	*d++ = 0;
+	*d++ = sizeof(struct ota_stream_patch_header);
+	*d++ = 0;
+	d = put_le32(d, old_size);
+	d = put_le32(d, utils_crc32(0, old_img, old_size));
+	d = put_le32(d, new_size);
+	d = put_le32(d, seg_size);
+	d = put_le32(d, seg_num);
+	d = put_le32(d, max_diff);
+	d = put_le32(d, max_lzma);
+	put_le32(d, utils_crc32(0, patch, d - patch));
+
+	return len;
+}
+
+static int patch_read(void *ctx, u32_t offs, u8_t *buf, u32_t size)
+{
+	const struct patch_src *src = ctx;
+
+	if (offs + size > src->size)
+		return -EIO;
+
+	memcpy(buf, src->data + offs, size);
+	return 0;
+}
+
+/* NOR: programming only clears bits */
+static int flash_write(void *ctx, u32_t offs, const u8_t *buf, u32_t size)
+{
+	u32_t i;
+
+	zassert_true(offs + size <= FLASH_SIZE, "write past flash");
+
+	for (i = 0; i < size; i++)
+		flash[offs + i] &= buf[i];
+
+	flash_written += size;
+	return 0;
+}
+
+static void flash_erase(u32_t offs)
+{
+	memset(flash + offs, 0xff, FLASH_SIZE - offs);
+	flash_written = 0;
+}
+
+static void check_flash(void)
+{
+	u32_t i;
+
+	zassert_true(!memcmp(flash, expect, expect_size), "new file mismatch");
+	for (i = expect_size; i < FLASH_SIZE; i++)
+		zassert_equal(flash[i], 0xff, "write past new file");
+}
+
+/* stops once stop_offs is written, as a power loss would */
+static int apply(struct patch_src *src, bool use_crc, u32_t start_offs, u32_t stop_offs)
+{
+	u32_t offs, len;
+	int err;
+
+	memset(&sp, 0, sizeof(sp));
+	sp.ctx = src;
+	sp.read = patch_read;
+	sp.write = flash_write;
+	sp.old_data = old_img;
+	sp.old_size = old_size;
+	sp.in_buf = in_buf;
+	sp.in_buf_size = sizeof(in_buf);
+	sp.window = window;
+	sp.window_size = sizeof(window);
+	sp.flag_use_crc = use_crc;
+
+	err = ota_stream_patch_open(&sp, start_offs);
+	if (err)
+		return err;
+
+	for (offs = sp.patch_offs; offs < src->size && !ota_stream_patch_is_done(&sp); offs += len) {
+		len = 1 + rnd() % 3000;
+		if (len > src->size - offs)
+			len = src->size - offs;
+
+		err = ota_stream_patch_feed(&sp, src->data + offs, len);
+		if (err)
+			return err;
+
+		zassert_equal(sp.patch_offs, offs + len, "patch offset");
+		if (stop_offs && sp.done_offs >= stop_offs)
+			return 1;
+	}
+
+	return ota_stream_patch_is_done(&sp) ? 0 : -EINVAL;
+}
+
+static void test_apply(void)
+{
+	struct patch_src src = { patch, 0 };
+	int use_crc;
+
+	gen_images();
+	src.size = gen_patch(SEG_SIZE);
+
+	for (use_crc = 0; use_crc < 2; use_crc++) {
+		gen_expect(use_crc);
+		flash_erase(0);
+
+		zassert_equal(apply(&src, use_crc, 0, 0), 0, "apply failed");
+		zassert_equal(flash_written, expect_size, "written size");
+		check_flash();
+	}
+}
+
+static void test_resume(void)
+{
+	struct patch_src src = { patch, 0 };
+	u32_t bp, start, total;
+	int use_crc, i;
+
+	gen_images();
+	src.size = gen_patch(SEG_SIZE);
+
+	for (use_crc = 0; use_crc < 2; use_crc++) {
+		gen_expect(use_crc);
+
+		for (i = 0; i < 8; i++) {
+			flash_erase(0);
+			zassert_equal(apply(&src, use_crc, 0, 1 + rnd() % expect_size), 1,
+					"no power loss");
+
+			/* breakpoint offset, then the partition erased from its sector on */
+			bp = sp.done_offs;
+			start = ROUND_DOWN(bp, ERASE_SIZE);
+			flash_erase(start);
+
+			zassert_equal(apply(&src, use_crc, start, 0), 0, "resume failed");
+			total = flash_written;
+			check_flash();
+
+			/* only the segment holding the resume point is redone */
+			zassert_true(total <= expect_size - start + SEG_SIZE * 2, "resumed from start");
+		}
+
+		/* a breakpoint past the file leaves nothing to do */
+		zassert_equal(apply(&src, use_crc, expect_size, 0), 0, "resume at end");
+	}
+}
+
+static void test_reject(void)
+{
+	struct patch_src src = { patch, 0 };
+	u32_t rec;
+
+	gen_images();
+	src.size = gen_patch(SEG_SIZE);
+	gen_expect(false);
+
+	/* not the old file the patch was made from */
+	old_img[1000] ^= 0x1;
+	zassert_equal(apply(&src, false, 0, 0), -EINVAL, "old file mismatch");
+	old_img[1000] ^= 0x1;
+
+	/* window too small for the patch */
+	src.size = gen_patch(SEG_SIZE * 2);
+	zassert_equal(apply(&src, false, 0, 0), -ENOMEM, "window");
+
+	/* corrupted header */
+	patch[sizeof(struct ota_stream_patch_header) - 8] = 0xff;
+	zassert_equal(apply(&src, false, 0, 0), -EINVAL, "header crc");
+
+	/* broken record */
+	src.size = gen_patch(SEG_SIZE);
+	rec = patch[sizeof(struct ota_stream_patch_header) + 4] |
+		(patch[sizeof(struct ota_stream_patch_header) + 5] << 8);
+	patch[rec + 3] = 0x10;
+	flash_erase(0);
+	zassert_equal(apply(&src, false, 0, 0), -EINVAL, "record length");
+
+	src.size = gen_patch(SEG_SIZE);
+	patch[rec + 4] = 0x80;
+	flash_erase(0);
+	zassert_equal(apply(&src, false, 0, 0), -EINVAL, "lzma2 control");
+}
+
+/* build_ota_patch.py -s -w 0x800 -g 0x400 */
+static const u8_t py_patch[] = {
+	0x53, 0x50, 0x43, 0x48, 0x01, 0x00, 0x28, 0x00, 0xb8, 0x0b, 0x00, 0x00,
+	0x29, 0x30, 0x00, 0x23, 0xc0, 0x0b, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00,
+	0x03, 0x00, 0x00, 0x00, 0x10, 0x04, 0x00, 0x00, 0x5a, 0x00, 0x00, 0x00,
+	0x6f, 0x5b, 0xd3, 0xf5, 0x34, 0x00, 0x00, 0x00, 0x69, 0x00, 0x00, 0x00,
+	0xc7, 0x00, 0x00, 0x00, 0x31, 0x00, 0x00, 0x00, 0xe0, 0x04, 0x03, 0x00,
+	0x29, 0x5d, 0x00, 0x00, 0x3a, 0x2f, 0xee, 0x8b, 0xd7, 0x1b, 0x3d, 0x86,
+	0x23, 0x8f, 0x5c, 0x03, 0x6e, 0xa8, 0x90, 0xf3, 0xf1, 0x61, 0xec, 0xb3,
+	0x25, 0xda, 0x28, 0x3a, 0xae, 0x68, 0x8e, 0xbe, 0xbe, 0xa4, 0xad, 0x5f,
+	0xea, 0x88, 0x21, 0x23, 0xe3, 0xf0, 0xb7, 0x00, 0x00, 0x5a, 0x00, 0x00,
+	0x00, 0xe0, 0x04, 0x0f, 0x00, 0x52, 0x5d, 0x00, 0x00, 0x61, 0x4f, 0x6b,
+	0x30, 0x4d, 0xc7, 0xc1, 0x33, 0x13, 0xaf, 0x4c, 0x8b, 0x2f, 0xf1, 0x0a,
+	0x2f, 0xaa, 0x78, 0xde, 0x52, 0x9a, 0xe8, 0x16, 0x81, 0x11, 0x75, 0x13,
+	0xf1, 0xa6, 0x33, 0xb5, 0xf9, 0x41, 0xa8, 0x3d, 0x22, 0x91, 0xa9, 0xff,
+	0xad, 0x27, 0xa3, 0xcc, 0x38, 0xd9, 0x19, 0x5d, 0x35, 0x34, 0xc5, 0x80,
+	0xed, 0x5f, 0x32, 0x31, 0x80, 0x90, 0x11, 0xef, 0xd4, 0x52, 0xc7, 0xc3,
+	0x35, 0x16, 0x9a, 0x0d, 0x7f, 0xd9, 0x34, 0x3d, 0xe3, 0x2e, 0xf8, 0x15,
+	0xeb, 0x49, 0x0e, 0xf4, 0x78, 0x00, 0x00, 0x2a, 0x00, 0x00, 0x00, 0xe0,
+	0x03, 0xcc, 0x00, 0x22, 0x5d, 0x00, 0x54, 0x07, 0x83, 0x44, 0x0d, 0x6d,
+	0x63, 0x17, 0x9d, 0xa9, 0x29, 0xb2, 0x1d, 0xa7, 0x5b, 0xc1, 0xaa, 0x76,
+	0x30, 0x92, 0x19, 0x38, 0xe5, 0xf4, 0xdc, 0x08, 0x08, 0x48, 0x75, 0x5b,
+	0x02, 0xe7, 0xde, 0x00, 0x00,
+};
+
+static void test_lzma2(void)
+{
+	static const char text[] = "stream patch inserted text ";
+	struct patch_src src = { py_patch, sizeof(py_patch) };
+	u32_t i, n = 0;
+
+	old_size = 3000;
+	for (i = 0; i < old_size; i++)
+		old_img[i] = i * 7 + (i >> 5);
+
+	memcpy(new_img, old_img, 1000);
+	n = 1000;
+	for (i = 0; i < 4; i++, n += sizeof(text) - 1)
+		memcpy(new_img + n, text, sizeof(text) - 1);
+	memcpy(new_img + n, old_img + 1000, 1000);
+	n += 1000;
+	for (i = 1200; i < 1300; i++)
+		new_img[i]++;
+	memcpy(new_img + n, old_img + 2100, 900);
+	new_size = n + 900;
+
+	gen_expect(true);
+	flash_erase(0);
+	zassert_equal(apply(&src, true, 0, 0), 0, "apply failed");
+	check_flash();
+}
+
+void test_main(void)
+{
+	ztest_test_suite(ota_stream_patch,
+			 ztest_unit_test(test_apply),
+			 ztest_unit_test(test_resume),
+			 ztest_unit_test(test_reject),
+			 ztest_unit_test(test_lzma2));
+
+	ztest_run_test_suite(ota_stream_patch);
+}
@@ -0,0 +1,268 @@
+/*
+ * Copyright (c) 2019 Actions Semiconductor Co., Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <ztest.h>
+
+#include <ext/actions/base/utils/pcm_kernel/pcm_kernel.c>
+
+#define MAX_SAMPLES	200
+
+/* word aligned pools, tests slide over the first samples for alignment */
+static union { u32_t align; s16_t s[MAX_SAMPLES * 2 + 8]; } a, b, c, out, ref;
+static union { u32_t align; s32_t s[MAX_SAMPLES * 2 + 8]; } w_out, w_ref;
+
+static void fill(s16_t *buf, int len, u32_t seed)
+{
+	int i;
+
+	for (i = 0; i < len; i++) {
+		seed = seed * 1103515245 + 12345;
+		buf[i] = seed >> 16;
+	}
+
+	/* extremes exercise rounding and saturation */
+	buf[0] = INT16_MIN;
+	buf[1] = INT16_MAX;
+	buf[2] = -1;
+	buf[3] = 1;
+}
+
+/* previous per sample loops of audio_track.c */
+static void ref_mix_avg(s16_t *dest_buff, s16_t *src_buff, s16_t *mix_buff, int mix_samples)
+{
+	for (int i = 0; i < mix_samples; i++) {
+		*dest_buff++ = (*src_buff++) / 2 + mix_buff[i] / 2;
+	}
+}
+
+static void ref_mix_avg_stereo(s16_t *dest_buff, s16_t *src_buff, s16_t *mix_buff[2], int mix_samples)
+{
+	for (int i = 0; i < mix_samples; i++) {
+		*dest_buff++ = (*src_buff++) / 2 + mix_buff[0][i] / 2;
+		*dest_buff++ = (*src_buff++) / 2 + mix_buff[1][i] / 2;
+	}
+}
+
+static void ref_unpack_24(unsigned char *buf, int l32)
+{
+	uint32_t *dst = (uint32_t *)buf;
+	uint8_t *src = (uint8_t *)buf;
+
+	for (int i = l32 * 3 / 4 - 1, j = l32 / 4 - 1; i >= 0;) {
+		uint32_t v = ((uint32_t)src[i-2])<<8;
+		v |= ((uint32_t)src[i-1])<<16;
+		v |= ((uint32_t)src[i])<<24;
+		i -= 3;
+		dst[j--] = v;
+	}
+}
+
+static void ref_upmix_32(unsigned char *buf, int l32)
+{
+	int32_t *dst = (int32_t *)buf;
+	int32_t *src = (int32_t *)buf;
+
+	for (int i = l32 / 4 - 1, j = l32 * 2 / 4 - 1; i >= 0;) {
+		dst[j--] = src[i];
+		dst[j--] = src[i];
+		i--;
+	}
+}
+
+static s32_t ref_gain_ramp(s16_t *buf, int frames, int channels, s32_t gain, s32_t step)
+{
+	while (frames-- > 0) {
+		for (int ch = 0; ch < channels; ch++, buf++)
+			*buf = ((s32_t)*buf * gain + 0x4000) >> 15;
+		gain += step;
+		gain = gain < 0 ? 0 : (gain > 0x8000 ? 0x8000 : gain);
+	}
+
+	return gain;
+}
+
+void test_pcm_mix(void)
+{
+	int oa, ob, len;
+
+	fill(a.s, ARRAY_SIZE(a.s), 1);
+	fill(b.s, ARRAY_SIZE(b.s), 2);
+	fill(c.s, ARRAY_SIZE(c.s), 11);
+
+	for (oa = 0; oa < 4; oa++) {
+		for (ob = 0; ob < 4; ob++) {
+			for (len = 0; len < MAX_SAMPLES; len += 7) {
+				ref_mix_avg(ref.s, a.s + oa, b.s + ob, len);
+				pcm_mix_avg_s16(out.s + oa, a.s + oa, b.s + ob, len);
+				zassert_true(!memcmp(out.s + oa, ref.s, len * 2), NULL);
+
+				ref_mix_avg_stereo(ref.s, a.s + oa, (s16_t *[]){ b.s + ob, c.s + ob }, len / 2);
+				pcm_mix_avg_stereo_s16(out.s + oa, a.s + oa, b.s + ob, c.s + ob, len / 2);
+				zassert_true(!memcmp(out.s + oa, ref.s, len / 2 * 4), NULL);
+
+				for (int i = 0; i < len; i++) {
+					int32_t v = a.s[oa + i] + b.s[ob + i];
+
+					ref.s[i] = v > INT16_MAX ? INT16_MAX : (v < INT16_MIN ? INT16_MIN : v);
+				}
+				pcm_mix_sat_s16(out.s + oa, a.s + oa, b.s + ob, len);
+				zassert_true(!memcmp(out.s + oa, ref.s, len * 2), NULL);
+			}
+		}
+	}
+}
+
+void test_pcm_mix_in_place(void)
+{
+	int offs;
+
+	fill(a.s, ARRAY_SIZE(a.s), 3);
+	fill(b.s, ARRAY_SIZE(b.s), 4);
+	fill(c.s, ARRAY_SIZE(c.s), 5);
+
+	/* audio track mixes into the stream buffer it reads from */
+	for (offs = 0; offs < 4; offs++) {
+		memcpy(out.s, a.s, sizeof(a.s));
+		ref_mix_avg_stereo(ref.s, a.s + offs, (s16_t *[]){ b.s + 1, c.s + 1 }, 61);
+		pcm_mix_avg_stereo_s16(out.s + offs, out.s + offs, b.s + 1, c.s + 1, 61);
+		zassert_true(!memcmp(out.s + offs, ref.s, 61 * 4), NULL);
+
+		memcpy(out.s, a.s, sizeof(a.s));
+		ref_mix_avg(ref.s, a.s + offs, b.s + offs, 93);
+		pcm_mix_avg_s16(out.s + offs, out.s + offs, b.s + offs, 93);
+		zassert_true(!memcmp(out.s + offs, ref.s, 93 * 2), NULL);
+	}
+}
+
+void test_pcm_gain_ramp(void)
+{
+	static const s32_t ramps[][2] = {
+		{ 0, 0x8000 / 48 }, { 0x8000, -0x8000 / 48 }, { 0x4000, 0 },
+		{ 0x8000, 0 }, { 0x1234, 1 }, { 0x7000, 0x300 },
+	};
+	int i, offs, ch, frames;
+	s32_t g_ref, g;
+
+	fill(a.s, ARRAY_SIZE(a.s), 6);
+
+	for (i = 0; i < ARRAY_SIZE(ramps); i++) {
+		for (offs = 0; offs < 2; offs++) {
+			for (ch = 1; ch <= 2; ch++) {
+				for (frames = 0; frames < MAX_SAMPLES / 2; frames += 5) {
+					memcpy(ref.s, a.s, sizeof(a.s));
+					memcpy(out.s, a.s, sizeof(a.s));
+					g_ref = ref_gain_ramp(ref.s + offs, frames, ch, ramps[i][0], ramps[i][1]);
+					g = pcm_gain_ramp_s16(out.s + offs, frames, ch, ramps[i][0], ramps[i][1]);
+					zassert_equal(g, g_ref, NULL);
+					zassert_true(!memcmp(out.s, ref.s, sizeof(ref.s)), NULL);
+				}
+			}
+		}
+	}
+}
+
+void test_pcm_unpack_24(void)
+{
+	int len;
+
+	fill(a.s, ARRAY_SIZE(a.s), 7);
+
+	/* in place, as _stream_read() does with the bytes read from the stream */
+	for (len = 0; len < MAX_SAMPLES; len++) {
+		memcpy(w_ref.s, a.s, len * 3);
+		memcpy(w_out.s, a.s, len * 3);
+		ref_unpack_24((unsigned char *)w_ref.s, len * 4);
+		pcm_unpack_24_32(w_out.s, (u8_t *)w_out.s, len);
+		zassert_true(!memcmp(w_out.s, w_ref.s, len * 4), NULL);
+
+		ref_upmix_32((unsigned char *)w_ref.s, len * 4);
+		pcm_upmix_s32(w_out.s, w_out.s, len);
+		zassert_true(!memcmp(w_out.s, w_ref.s, len * 8), NULL);
+	}
+
+	/* unaligned source */
+	memcpy((u8_t *)a.s + 1, w_ref.s, 3);
+	pcm_unpack_24_32(w_out.s, (u8_t *)a.s + 1, 40);
+	ref_unpack_24((unsigned char *)memcpy(w_ref.s, (u8_t *)a.s + 1, 120), 160);
+	zassert_true(!memcmp(w_out.s, w_ref.s, 160), NULL);
+}
+
+void test_pcm_widen_16(void)
+{
+	int offs, len, i;
+
+	fill(a.s, ARRAY_SIZE(a.s), 11);
+
+	/* in place, as the usb audio OUT path does in the stream ring */
+	for (len = 0; len < MAX_SAMPLES; len++) {
+		memcpy(w_out.s, a.s, len * 2);
+		pcm_widen_16_32(w_out.s, (s16_t *)w_out.s, len);
+		for (i = 0; i < len; i++)
+			zassert_equal(w_out.s[i], (s32_t)a.s[i] * 65536, NULL);
+	}
+
+	/* unaligned source */
+	for (offs = 0; offs < 2; offs++) {
+		pcm_widen_16_32(w_out.s, a.s + 1 + offs, 41);
+		for (i = 0; i < 41; i++)
+			zassert_equal(w_out.s[i], (s32_t)a.s[1 + offs + i] * 65536, NULL);
+	}
+}
+
+void test_pcm_interleave(void)
+{
+	int oa, ob, len, i;
+
+	fill(a.s, ARRAY_SIZE(a.s), 8);
+	fill(b.s, ARRAY_SIZE(b.s), 9);
+
+	for (oa = 0; oa < 2; oa++) {
+		for (ob = 0; ob < 2; ob++) {
+			for (len = 0; len < MAX_SAMPLES; len += 3) {
+				pcm_interleave_s16(out.s + ob, a.s + oa, b.s + oa, len);
+				for (i = 0; i < len; i++) {
+					zassert_equal(out.s[ob + i * 2], a.s[oa + i], NULL);
+					zassert_equal(out.s[ob + i * 2 + 1], b.s[oa + i], NULL);
+				}
+
+				pcm_deinterleave_s16(c.s + oa, ref.s + oa, out.s + ob, len);
+				zassert_true(!memcmp(c.s + oa, a.s + oa, len * 2), NULL);
+				zassert_true(!memcmp(ref.s + oa, b.s + oa, len * 2), NULL);
+			}
+		}
+	}
+}
+
+void test_pcm_upmix(void)
+{
+	int offs, len, i;
+
+	fill(a.s, ARRAY_SIZE(a.s), 10);
+
+	for (offs = 0; offs < 2; offs++) {
+		for (len = 0; len < MAX_SAMPLES; len++) {
+			memcpy(out.s, a.s, sizeof(a.s));
+			pcm_upmix_s16(out.s + offs, out.s + offs, len);
+			for (i = 0; i < len; i++) {
+				zassert_equal(out.s[offs + i * 2], a.s[offs + i], NULL);
+				zassert_equal(out.s[offs + i * 2 + 1], a.s[offs + i], NULL);
+			}
+		}
+	}
+}
+
+void test_main(void)
+{
+	ztest_test_suite(test_pcm_kernel,
+			 ztest_unit_test(test_pcm_mix),
+			 ztest_unit_test(test_pcm_mix_in_place),
+			 ztest_unit_test(test_pcm_gain_ramp),
+			 ztest_unit_test(test_pcm_unpack_24),
+			 ztest_unit_test(test_pcm_widen_16),
+			 ztest_unit_test(test_pcm_interleave),
+			 ztest_unit_test(test_pcm_upmix));
+	ztest_run_test_suite(test_pcm_kernel);
+}
@@ -0,0 +1,235 @@
+/*
+ * Copyright (c) 2020 Actions Semiconductor Co., Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Opens the files of a 300 entry sdfs image mapped in ram, once as
+ * make_sdfs writes it and once sorted as build_sdfs.py leaves it. Every
+ * name has to open the same file in both, and the opens are timed with
+ * the directory entries read counted.
+ */
+
+#include <ztest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define CONFIG_MEMORY			1
+#define CONFIG_SD_FS_DIR_CACHE_NUM	4
+
+/* mem_manager.h, kernel_structs.h and init.h need the kernel */
+#define __MEM_MANAGER_H__
+#define _kernel_structs__h_
+#define _INIT_H_
+#define SYS_INIT(init_fn, level, prio)
+
+#define ENTRIES		300
+#define FILE_SIZE	64
+#define IMAGE_SIZE	((ENTRIES + 1) * 32 + ENTRIES * FILE_SIZE)
+
+static u8_t image[IMAGE_SIZE] __aligned(4);
+static u32_t flash_reads;
+
+#define CONFIG_SD_FS_VADDR_START	((int)(uintptr_t)image)
+
+void *mem_malloc(unsigned int num_bytes);
+void mem_free(void *ptr);
+
+#include <sdfs.h>
+
+/* the directory sits in xip flash, count what is read of it */
+#undef memcpy_flash_data
+#define memcpy_flash_data(dst, src, len)	\
+	(flash_reads++, memcpy(dst, src, len))
+
+int partition_file_mapping(u8_t file_id, u32_t vaddr)
+{
+	return 0;
+}
+
+unsigned int irq_lock(void)
+{
+	return 0;
+}
+
+void irq_unlock(unsigned int key)
+{
+}
+
+#include <ext/fs/sdfs/sdfs.c>
+
+#define OPENS		600000
+
+static char names[ENTRIES][13];
+
+void *mem_malloc(unsigned int num_bytes)
+{
+	return malloc(num_bytes);
+}
+
+void mem_free(void *ptr)
+{
+	free(ptr);
+}
+
+static u64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* stable like the sort of build_sdfs.py, the head is not moved */
+static void image_sort(void)
+{
+	struct sd_dir *dir = (struct sd_dir *)image, tmp;
+	int i, j;
+
+	for (i = 2; i <= ENTRIES; i++) {
+		memcpy(&tmp, &dir[i], sizeof(tmp));
+		for (j = i; j > 1 && strncasecmp((const char *)tmp.fname,
+						 (const char *)dir[j - 1].fname, 12) < 0; j--)
+			memcpy(&dir[j], &dir[j - 1], sizeof(tmp));
+		memcpy(&dir[j], &tmp, sizeof(tmp));
+	}
+
+	dir[0].reserved[0] = SDFS_DIR_SORTED_MAGIC;
+}
+
+/* prompts, key tones and tts words of a speaker, in make_sdfs order */
+static void image_build(bool sorted)
+{
+	static const char * const fmt[] = { "TTS%04d.ACT", "KEY%d.PCM", "Tone%d.mp3" };
+	struct sd_dir *dir = (struct sd_dir *)image;
+	int i, j;
+
+	memset(image, 0, sizeof(image));
+	memset(sd_dir_cache, 0, sizeof(sd_dir_cache));
+
+	memcpy((void *)dir[0].fname, "sdfs.bin", 8);
+	dir[0].offset = ENTRIES;
+
+	for (i = 0; i < ENTRIES; i++) {
+		snprintf(names[i], sizeof(names[i]), fmt[i % 3], (i * 7919) % 1000);
+		memcpy((void *)dir[i + 1].fname, names[i], strlen(names[i]));
+		dir[i + 1].offset = (ENTRIES + 1) * 32 + i * FILE_SIZE;
+		dir[i + 1].size = FILE_SIZE - i % 8;
+		for (j = 0; j < FILE_SIZE; j++)
+			image[dir[i + 1].offset + j] = i + j;
+	}
+
+	if (sorted)
+		image_sort();
+}
+
+static void check_open(int i, const char *name)
+{
+	struct sd_file *fd;
+	u8_t buf[FILE_SIZE];
+	int j;
+
+	fd = sd_fopen(name);
+	zassert_not_null(fd, name);
+	zassert_equal(fd->size, FILE_SIZE - i % 8, "size");
+	zassert_equal(sd_fread(fd, buf, sizeof(buf)), FILE_SIZE - i % 8, "read");
+	for (j = 0; j < fd->size; j++)
+		zassert_equal(buf[j], (u8_t)(i + j), "data");
+	sd_fclose(fd);
+}
+
+static void check_all(void)
+{
+	char lower[13];
+	int i, j;
+
+	for (i = 0; i < ENTRIES; i++) {
+		check_open(i, names[i]);
+
+		for (j = 0; names[i][j]; j++)
+			lower[j] = tolower((int)names[i][j]);
+		lower[j] = '\0';
+		check_open(i, lower);
+	}
+
+	zassert_is_null(sd_fopen("NOFILE.MP3"), "missing file");
+	zassert_is_null(sd_fopen("A"), "before the first");
+	zassert_is_null(sd_fopen("ZZZZZZZZ.ZZZ"), "after the last");
+	zassert_equal(sd_fsize(names[7]), FILE_SIZE - 7 % 8, "fsize");
+}
+
+void test_lookup(void)
+{
+	struct sd_dir *dir = (struct sd_dir *)image;
+
+	image_build(false);
+	check_all();
+
+	image_build(true);
+	check_all();
+
+	/* case insensitive duplicates, the first one as the linear scan finds it */
+	image_build(false);
+	memcpy((void *)dir[ENTRIES - 1].fname, "DUP.PCM\0", 8);
+	memcpy((void *)dir[ENTRIES].fname, "dup.pcm\0", 8);
+	check_open(ENTRIES - 2, "Dup.Pcm");
+	image_sort();
+	memset(sd_dir_cache, 0, sizeof(sd_dir_cache));
+	check_open(ENTRIES - 2, "Dup.Pcm");
+
+	/* not an sdfs image */
+	memset(sd_dir_cache, 0, sizeof(sd_dir_cache));
+	((u8_t *)dir[0].fname)[0] ^= 1;
+	zassert_is_null(sd_fopen(names[0]), "no image");
+}
+
+/* ns and directory entries read per open */
+static void bench(const char *what, bool sorted, bool same)
+{
+	struct sd_file *fd;
+	u64_t begin, ns;
+	int i;
+
+	image_build(sorted);
+	flash_reads = 0;
+
+	begin = now_ns();
+	for (i = 0; i < OPENS; i++) {
+		fd = sd_fopen(names[same ? ENTRIES / 2 : i % ENTRIES]);
+		sd_fclose(fd);
+	}
+	ns = now_ns() - begin;
+
+	printf("%-22s %5llu ns/open, %6.1f entries read/open\n", what, ns / OPENS,
+	       (double)flash_reads / OPENS);
+}
+
+void test_benchmark(void)
+{
+	u32_t linear, search;
+
+	printf("%d entries, %d opens\n", ENTRIES, OPENS);
+
+	/* cycling through more names than the cache holds */
+	bench("all names, linear", false, false);
+	linear = flash_reads;
+	bench("all names, sorted", true, false);
+	search = flash_reads;
+
+	/* a key tone pressed again and again */
+	bench("one name, with cache", true, true);
+	zassert_true(flash_reads < 20, "cache not used");
+
+	zassert_true(search * 10 < linear, "binary search not used");
+	zassert_true(search / OPENS <= 10, "too many entries read");
+}
+
+void test_main(void)
+{
+	ztest_test_suite(test_sdfs,
+			 ztest_unit_test(test_lookup),
+			 ztest_unit_test(test_benchmark));
+	ztest_run_test_suite(test_sdfs);
+}
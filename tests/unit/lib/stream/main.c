@@ -0,0 +1,290 @@
+/*
+ * Copyright (c) 2020 Actions Semiconductor Co., Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * A blocked reader and a blocked seek of an in/out stream, with the
+ * writer in another thread. Both have to wake up as soon as the data is
+ * written, well before the STREAM_BLOCK_POLL_MS slice.
+ */
+
+#include <ztest.h>
+#include <stdio.h>
+#include <time.h>
+/* C11 threads, the tree has its own pthread.h on the include path */
+#include <threads.h>
+
+/* os_common_api.h and the managers need the kernel */
+#define _kernel__h_
+#define _kernel_structs__h_
+#define __OS_COMMON_API_H__
+#define __MEM_MANAGER_H__
+#define __MSG_MANAGER_H__
+
+#define OS_FOREVER		(-1)
+
+typedef struct {
+	mtx_t lock;
+	cnd_t cond;
+	int count;
+	int limit;
+} os_sem;
+
+typedef struct {
+	int unused;
+} os_mutex;
+
+#define os_mutex_init(mutex)		((void)(mutex))
+#define os_mutex_lock(mutex, timeout)	((void)(mutex))
+#define os_mutex_unlock(mutex)		((void)(mutex))
+#define os_is_in_isr()			false
+
+void *mem_malloc(unsigned int num_bytes);
+void mem_free(void *ptr);
+void os_sem_init(os_sem *sem, int initial_count, int limit);
+void os_sem_give(os_sem *sem);
+int os_sem_take(os_sem *sem, s32_t timeout);
+u32_t os_uptime_get_32(void);
+
+#include <ext/actions/base/utils/stream/stream.c>
+
+#define MEM_SIZE	(64 * 1024)
+#define CHUNK		512
+#define ROUNDS		20
+#define WRITE_GAP_MS	5
+/* far below the poll slice, with room for a loaded host */
+#define MAX_AVG_US	(STREAM_BLOCK_POLL_MS * 1000 / 5)
+
+static u8_t mem[MEM_SIZE];
+static io_stream_t stream;
+
+void *mem_malloc(unsigned int num_bytes)
+{
+	return calloc(1, num_bytes);
+}
+
+void mem_free(void *ptr)
+{
+	free(ptr);
+}
+
+void acts_ringbuf_dump(struct acts_ringbuf *buf, const char *name, const char *line_prefix)
+{
+}
+
+void os_sem_init(os_sem *sem, int initial_count, int limit)
+{
+	mtx_init(&sem->lock, mtx_plain);
+	cnd_init(&sem->cond);
+	sem->count = initial_count;
+	sem->limit = limit;
+}
+
+void os_sem_give(os_sem *sem)
+{
+	mtx_lock(&sem->lock);
+	if (sem->count < sem->limit)
+		sem->count++;
+	cnd_signal(&sem->cond);
+	mtx_unlock(&sem->lock);
+}
+
+int os_sem_take(os_sem *sem, s32_t timeout)
+{
+	struct timespec ts;
+	int ret = 0;
+
+	timespec_get(&ts, TIME_UTC);
+	ts.tv_sec += timeout / 1000;
+	ts.tv_nsec += (timeout % 1000) * 1000000L;
+	if (ts.tv_nsec >= 1000000000L) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
+	}
+
+	mtx_lock(&sem->lock);
+	while (!sem->count && ret == 0) {
+		if (cnd_timedwait(&sem->cond, &sem->lock, &ts) == thrd_timedout)
+			ret = -EAGAIN;
+	}
+	if (sem->count)
+		sem->count--;
+	mtx_unlock(&sem->lock);
+
+	return ret;
+}
+
+static u64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+
+u32_t os_uptime_get_32(void)
+{
+	return now_us() / 1000;
+}
+
+static void sleep_ms(int ms)
+{
+	struct timespec ts = { .tv_sec = 0, .tv_nsec = ms * 1000000L };
+
+	thrd_sleep(&ts, NULL);
+}
+
+/* a linear buffer, as a psram cache of a download */
+static int mem_open(io_stream_t handle, stream_mode mode)
+{
+	handle->rofs = handle->wofs = 0;
+	handle->total_size = MEM_SIZE;
+	return 0;
+}
+
+static int mem_read(io_stream_t handle, unsigned char *buf, int num)
+{
+	num = MIN(num, handle->wofs - handle->rofs);
+	memcpy(buf, mem + handle->rofs, num);
+	handle->rofs += num;
+	return num;
+}
+
+static int mem_write(io_stream_t handle, unsigned char *buf, int num)
+{
+	num = MIN(num, MEM_SIZE - handle->wofs);
+	memcpy(mem + handle->wofs, buf, num);
+	handle->wofs += num;
+	return num;
+}
+
+static int mem_seek(io_stream_t handle, int offset, seek_dir origin)
+{
+	handle->rofs = offset;
+	return 0;
+}
+
+static int mem_tell(io_stream_t handle)
+{
+	return handle->rofs;
+}
+
+static int mem_get_space(io_stream_t handle)
+{
+	return MEM_SIZE - handle->wofs;
+}
+
+static int mem_close(io_stream_t handle)
+{
+	return 0;
+}
+
+static const stream_ops_t mem_ops = {
+	.open = mem_open,
+	.read = mem_read,
+	.write = mem_write,
+	.seek = mem_seek,
+	.tell = mem_tell,
+	.get_space = mem_get_space,
+	.close = mem_close,
+};
+
+/* time each chunk was handed to stream_write */
+static u64_t write_time[ROUNDS];
+
+static int writer(void *p)
+{
+	u8_t chunk[CHUNK];
+	int i;
+
+	for (i = 0; i < ROUNDS; i++) {
+		sleep_ms(WRITE_GAP_MS);
+		memset(chunk, i, sizeof(chunk));
+		write_time[i] = now_us();
+		stream_write(stream, chunk, sizeof(chunk));
+	}
+
+	return 0;
+}
+
+static void open_stream(void)
+{
+	stream = stream_create(&mem_ops, NULL);
+	zassert_not_null(stream, "create");
+	zassert_equal(stream_open(stream, MODE_IN_OUT | MODE_READ_BLOCK), 0, "open");
+}
+
+static void close_stream(void)
+{
+	stream_close(stream);
+	stream_destroy(stream);
+}
+
+/* ready latency of each round, the average and the worst */
+static void report(const char *name, u64_t *wake_time)
+{
+	u64_t sum = 0, worst = 0, lat;
+	int i;
+
+	for (i = 0; i < ROUNDS; i++) {
+		lat = wake_time[i] - write_time[i];
+		sum += lat;
+		worst = MAX(worst, lat);
+	}
+
+	printf("%s wakeup latency: avg %llu us, max %llu us\n", name,
+		(unsigned long long)(sum / ROUNDS), (unsigned long long)worst);
+	zassert_true(sum / ROUNDS < MAX_AVG_US, "woken by the poll slice");
+}
+
+void test_read_wakeup(void)
+{
+	u64_t wake_time[ROUNDS];
+	u8_t buf[CHUNK];
+	thrd_t thread;
+	int i;
+
+	open_stream();
+	thrd_create(&thread, writer, NULL);
+
+	for (i = 0; i < ROUNDS; i++) {
+		zassert_equal(stream_read(stream, buf, sizeof(buf)), sizeof(buf), "read");
+		wake_time[i] = now_us();
+		zassert_equal(buf[0], i, "data");
+	}
+
+	thrd_join(thread, NULL);
+	close_stream();
+	report("read", wake_time);
+}
+
+void test_seek_wakeup(void)
+{
+	u64_t wake_time[ROUNDS];
+	thrd_t thread;
+	int i;
+
+	open_stream();
+	thrd_create(&thread, writer, NULL);
+
+	/* skip ahead to the end of each chunk before it is written */
+	for (i = 0; i < ROUNDS; i++) {
+		zassert_equal(stream_seek(stream, (i + 1) * CHUNK, SEEK_DIR_BEG), 0, "seek");
+		wake_time[i] = now_us();
+		zassert_true(stream->wofs >= (i + 1) * CHUNK, "seek before the data");
+	}
+
+	thrd_join(thread, NULL);
+	close_stream();
+	report("seek", wake_time);
+}
+
+void test_main(void)
+{
+	ztest_test_suite(test_stream,
+			 ztest_unit_test(test_read_wakeup),
+			 ztest_unit_test(test_seek_wakeup));
+	ztest_run_test_suite(test_stream);
+}
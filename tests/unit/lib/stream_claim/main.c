@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2020 Actions Semiconductor Co., Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Plays 1 s of 48 kHz stereo through a ring buffer stream the way the
+ * audio_track DMA irq refills the DAC, once by stream_read() into
+ * pcm_frame_buff and once by stream_read_claim()/stream_read_commit(),
+ * and counts the bytes copied by the cpu and moved by the DMA.
+ */
+
+#include <ztest.h>
+#include <stdio.h>
+#include <string.h>
+
+/* os_common_api.h, the managers and soc_dsp.h need the kernel */
+#define _kernel__h_
+#define _kernel_structs__h_
+#define __OS_COMMON_API_H__
+#define __MEM_MANAGER_H__
+#define __MSG_MANAGER_H__
+#define SOC_DSP_H_
+
+#define OS_FOREVER		(-1)
+
+typedef struct {
+	int count;
+} os_sem;
+
+typedef struct {
+	int unused;
+} os_mutex;
+
+#define os_mutex_init(mutex)		((void)(mutex))
+#define os_mutex_lock(mutex, timeout)	((void)(mutex))
+#define os_mutex_unlock(mutex)		((void)(mutex))
+#define os_is_in_isr()			true
+#define os_sem_init(sem, count, limit)	((void)(sem))
+#define os_sem_give(sem)		((void)(sem))
+#define os_uptime_get_32()		0
+#define mcu_to_dsp_data_address(addr)	(addr)
+
+void *mem_malloc(unsigned int num_bytes);
+void mem_free(void *ptr);
+
+static inline int os_sem_take(os_sem *sem, s32_t timeout)
+{
+	return 0;
+}
+
+/* every copy of the stream and ring code is counted */
+static u32_t cpu_copied;
+
+static void *counted_memcpy(void *dst, const void *src, size_t n)
+{
+	cpu_copied += n;
+	return memcpy(dst, src, n);
+}
+
+#define memcpy(dst, src, n)	counted_memcpy(dst, src, n)
+
+#include <ext/actions/base/utils/acts_ringbuf/acts_ringbuf.c>
+#include <ext/actions/base/utils/stream/stream.c>
+#undef SYS_LOG_DOMAIN
+#include <ext/actions/base/utils/stream/ringbuff_stream.c>
+
+#undef memcpy
+
+#define SAMPLE_RATE	48000
+#define FRAME_BYTES	4
+#define SECOND_BYTES	(SAMPLE_RATE * FRAME_BYTES)
+/* audio_policy_get_track_pcm_buff_size() of a 48 kHz a2dp track */
+#define PCM_FRAME_SIZE	1024
+#define READ_LEN	(PCM_FRAME_SIZE / 2)
+/* one sbc frame of 128 samples from the decoder */
+#define DEC_FRAME	(128 * FRAME_BYTES)
+#define MAX_RING	8192
+
+static u8_t ring_data[MAX_RING];
+static u8_t pcm_frame_buff[PCM_FRAME_SIZE];
+static u8_t dac_fifo[READ_LEN];
+static u8_t dec_frame[DEC_FRAME];
+
+struct copy_count {
+	/* by the cpu in the irq */
+	u32_t cpu;
+	/* by the dac DMA, out of memory into the fifo */
+	u32_t dma;
+	/* refills that fell back to the copy */
+	u32_t fallback;
+	u32_t played;
+};
+
+void *mem_malloc(unsigned int num_bytes)
+{
+	return calloc(1, num_bytes);
+}
+
+void mem_free(void *ptr)
+{
+	free(ptr);
+}
+
+/* hal_aout_channel_write_data(): the DMA moves the buffer into the fifo */
+static void dac_write(const u8_t *buf, int len, struct copy_count *count)
+{
+	memcpy(dac_fifo, buf, len);
+	count->dma += len;
+}
+
+static void decode(io_stream_t stream)
+{
+	while (stream_get_space(stream) >= DEC_FRAME)
+		stream_write(stream, dec_frame, DEC_FRAME);
+}
+
+static void play(u32_t ring_size, bool zero_copy, struct copy_count *count)
+{
+	struct acts_ringbuf ring;
+	io_stream_t stream;
+	u32_t claimed = 0;
+	u8_t *buf;
+	int ret;
+
+	memset(count, 0, sizeof(*count));
+	acts_ringbuf_init(&ring, ring_data, ring_size);
+	stream = ringbuff_stream_create(&ring);
+	zassert_not_null(stream, "create");
+	zassert_equal(stream_open(stream, MODE_IN_OUT), 0, "open");
+
+	while (count->played < SECOND_BYTES) {
+		decode(stream);
+
+		/* _audio_track_request_more_data() */
+		cpu_copied = 0;
+		buf = pcm_frame_buff;
+
+		if (zero_copy) {
+			if (claimed)
+				stream_read_commit(stream, claimed);
+			claimed = 0;
+
+			if (stream_read_claim(stream, &buf, READ_LEN) == READ_LEN) {
+				claimed = READ_LEN;
+				ret = READ_LEN;
+			} else {
+				buf = pcm_frame_buff;
+				ret = stream_read(stream, buf, READ_LEN);
+				count->fallback++;
+			}
+		} else {
+			ret = stream_read(stream, buf, READ_LEN);
+		}
+
+		zassert_equal(ret, READ_LEN, "underrun");
+		count->cpu += cpu_copied;
+		dac_write(buf, READ_LEN, count);
+		count->played += READ_LEN;
+	}
+
+	stream_close(stream);
+	stream_destroy(stream);
+}
+
+static void compare(u32_t ring_size)
+{
+	struct copy_count copy, claim;
+
+	play(ring_size, false, &copy);
+	play(ring_size, true, &claim);
+
+	printf("ring %u bytes, per 1 s of 48 kHz stereo:\n", ring_size);
+	printf("  copy:       cpu %7u, dma %7u, memory traffic %7u\n",
+		copy.cpu, copy.dma, 2 * copy.cpu + copy.dma);
+	printf("  claim:      cpu %7u, dma %7u, memory traffic %7u, %u of %u refills copied\n",
+		claim.cpu, claim.dma, 2 * claim.cpu + claim.dma,
+		claim.fallback, SECOND_BYTES / READ_LEN);
+
+	zassert_equal(copy.cpu, SECOND_BYTES, "copy mode count");
+	zassert_equal(claim.dma, copy.dma, "dma count");
+	zassert_equal(claim.cpu, claim.fallback * READ_LEN, "claimed data copied");
+}
+
+void test_ring_aligned(void)
+{
+	/* the refill never wraps, nothing goes through pcm_frame_buff */
+	compare(4096);
+}
+
+void test_ring_unaligned(void)
+{
+	/* 15 ms ring, a refill wraps now and then and is copied */
+	compare(2880);
+}
+
+void test_main(void)
+{
+	ztest_test_suite(test_stream_claim,
+			 ztest_unit_test(test_ring_aligned),
+			 ztest_unit_test(test_ring_unaligned));
+	ztest_run_test_suite(test_stream_claim);
+}
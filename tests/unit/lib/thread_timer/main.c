@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2020 Actions Semiconductor Co., Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Random starts, stops and restarts of 64 timers of one thread, checked
+ * against a plain list of their expiry times across the 32 bit uptime
+ * wrap. Expired timers are handled every ms, then with gaps of up to 5 s
+ * as a busy thread does.
+ */
+
+#define CONFIG_THREAD_TIMER		1
+#define CONFIG_THREAD_TIMER_WHEEL	1
+
+#include <ztest.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* kernel_structs.h needs the arch */
+#define _kernel_structs__h_
+
+static struct k_thread thread;
+#define _current	(&thread)
+
+void panic(const char *err_msg);
+unsigned int irq_lock(void);
+void irq_unlock(unsigned int key);
+
+/* from the arch headers */
+static inline unsigned int find_lsb_set(u32_t op)
+{
+	return __builtin_ffs(op);
+}
+
+#include <kernel/thread_timer.c>
+
+#define TIMERS		64
+#define STEPS		400000
+
+static u32_t now;
+static struct thread_timer timers[TIMERS];
+static u32_t expect[TIMERS];
+static s32_t period[TIMERS];
+static bool armed[TIMERS];
+static u32_t fired;
+static bool lag;
+
+u32_t k_uptime_get_32(void)
+{
+	return now;
+}
+
+unsigned int irq_lock(void)
+{
+	return 0;
+}
+
+void irq_unlock(unsigned int key)
+{
+}
+
+int k_thread_priority_get(k_tid_t thread)
+{
+	return 0;
+}
+
+void panic(const char *err_msg)
+{
+	ztest_test_fail();
+}
+
+static void expired(struct thread_timer *ttimer, void *arg)
+{
+	int i = (int)(intptr_t)arg;
+
+	fired++;
+	zassert_true(armed[i], "stopped timer fired");
+	zassert_true((int)(now - expect[i]) >= 0, "fired early");
+	if (!lag)
+		zassert_equal(now, expect[i], "fired late");
+
+	if (period[i])
+		expect[i] = now + period[i];
+	else
+		armed[i] = false;
+
+	/* stopped from its own callback now and then */
+	if (!(rand() % 8)) {
+		thread_timer_stop(ttimer);
+		armed[i] = false;
+	}
+}
+
+static int model_next_timeout(void)
+{
+	int next = K_FOREVER, left, i;
+
+	for (i = 0; i < TIMERS; i++) {
+		if (!armed[i])
+			continue;
+
+		left = max((int)(expect[i] - now), 0);
+		if (next == K_FOREVER || left < next)
+			next = left;
+	}
+
+	return next;
+}
+
+static void run(unsigned int seed)
+{
+	int i, op, next, model_next;
+	s32_t duration;
+
+	srand(seed);
+	/* start right before the uptime wraps */
+	now = 0xfffff000u - rand() % 100000;
+	fired = 0;
+	memset(armed, 0, sizeof(armed));
+	memset(&thread.thread_timer_wheel, 0, sizeof(thread.thread_timer_wheel));
+
+	for (i = 0; i < TIMERS; i++)
+		thread_timer_init(&timers[i], expired, (void *)(intptr_t)i);
+
+	for (op = 0; op < STEPS; op++) {
+		i = rand() % TIMERS;
+
+		switch (rand() % 100) {
+		case 0 ... 2:
+			/* a quarter of the timers beyond the wheel span */
+			duration = (rand() % 4) ? rand() % 300 : rand() % 20000;
+			period[i] = (rand() % 2) ? rand() % 3000 + 1 : 0;
+			thread_timer_start(&timers[i], duration, period[i]);
+			expect[i] = now + duration;
+			armed[i] = true;
+			break;
+		case 3:
+			thread_timer_stop(&timers[i]);
+			armed[i] = false;
+			break;
+		case 4:
+			zassert_equal(thread_timer_is_running(&timers[i]), armed[i], "is_running");
+			break;
+		default:
+			/* overflow timers may wake the thread earlier, never later */
+			next = thread_timer_next_timeout();
+			model_next = model_next_timeout();
+			zassert_equal(next == K_FOREVER, model_next == K_FOREVER, "next_timeout");
+			zassert_true(next <= model_next, "next_timeout too late");
+
+			if (!next)
+				thread_timer_handle_expired();
+
+			if (lag && !(rand() % 4))
+				now += rand() % 5000;
+			else
+				now++;
+			thread_timer_handle_expired();
+
+			for (i = 0; i < TIMERS; i++)
+				zassert_false(armed[i] && (int)(expect[i] - now) <= 0, "missed");
+			break;
+		}
+	}
+
+	printf("seed %u%s: %u timers fired\n", seed, lag ? " with gaps" : "", fired);
+	zassert_true(fired > STEPS / 100, "too few timers fired");
+}
+
+void test_exact(void)
+{
+	lag = false;
+	run(1);
+	run(2);
+}
+
+void test_lag(void)
+{
+	lag = true;
+	run(3);
+	run(4);
+}
+
+void test_main(void)
+{
+	ztest_test_suite(test_thread_timer,
+			 ztest_unit_test(test_exact),
+			 ztest_unit_test(test_lag));
+	ztest_run_test_suite(test_thread_timer);
+}
@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) 2020 Actions Semiconductor Co., Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Messages go through encode, the ring and render and have to come out
+ * as vsnprintf makes them, and the wire frames have to be the bytes
+ * trace_decode.py expects.
+ */
+
+#define CONFIG_PRINTK 1
+#define CONFIG_TRACE_BINARY 1
+
+#include <ztest.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+int snprintk(char *str, size_t size, const char *fmt, ...)
+{
+	va_list ap;
+	int ret;
+
+	va_start(ap, fmt);
+	ret = vsnprintf(str, size, fmt, ap);
+	va_end(ap);
+
+	return ret;
+}
+
+#include <ext/actions/base/utils/trace/src/trace_binary.c>
+
+#define RING_WORDS	256
+
+/* the image rom: code and read only data, up to the data of the binary */
+extern const char __executable_start[], __data_start[];
+
+static u32_t ring_buf[RING_WORDS];
+static struct trace_binary tb;
+static const char rom_str[] = "kept by address";
+
+static void ring_reset(void)
+{
+	trace_binary_init(&tb, ring_buf, RING_WORDS, (u32_t)(uintptr_t)__executable_start,
+			(u32_t)(uintptr_t)__data_start);
+}
+
+static void same_text(const char *text, const char *expect)
+{
+	if (strcmp(text, expect))
+		printf("'%s' != '%s'\n", text, expect);
+	zassert_true(!strcmp(text, expect), "text differs");
+}
+
+static int encode(u32_t *rec, u32_t timestamp, const char *fmt, ...)
+{
+	va_list ap;
+	int words;
+
+	va_start(ap, fmt);
+	words = trace_binary_encode(&tb, rec, timestamp, fmt, ap);
+	va_end(ap);
+
+	return words;
+}
+
+/* through the ring and back to text, compared with vsnprintf */
+static void check(const char *fmt, ...)
+{
+	u32_t rec[TRACE_BINARY_REC_WORDS], out[TRACE_BINARY_REC_WORDS];
+	char expect[256], text[256];
+	va_list ap, aq;
+	int words, len;
+
+	va_start(ap, fmt);
+	va_copy(aq, ap);
+	vsnprintf(expect, sizeof(expect), fmt, ap);
+	words = trace_binary_encode(&tb, rec, 0, fmt, aq);
+	va_end(aq);
+	va_end(ap);
+
+	zassert_true(words <= TRACE_BINARY_REC_WORDS, "record too long");
+	zassert_equal(trace_binary_put(&tb, rec), 0, "put failed");
+	zassert_equal(trace_binary_get(&tb, out), words, "get failed");
+
+	len = trace_binary_render(out, text, sizeof(text));
+	if (strcmp(text, expect))
+		printf("%s: '%s' != '%s'\n", fmt, text, expect);
+	zassert_equal(len, strlen(expect), "length");
+	zassert_true(!strcmp(text, expect), fmt);
+}
+
+void test_render(void)
+{
+	char ram_str[] = "copied in";
+	const char *null_str = NULL;
+
+	ring_reset();
+
+	check("no arguments\n");
+	check("%d %i %u %x %X %c|\n", -5, 7, 3000000000u, 0xbeef, 0xcafe, 'q');
+	check("%08x|%-6d|%6d|%+d|%05d\n", 0x1234, -12, 34, 5, -6);
+	check("%*d|%-*d|%.*s|\n", 5, 42, 4, 7, 3, "abcdef");
+	check("%lld %llx %llu\n", -1234567890123ll, 0x123456789abcdefull, 18446744073709551615ull);
+	check("%ld %lx %zu %hd %hhx\n", -7l, 0x7fffffffl, (size_t)99, (short)-3, 0x1ff);
+	check("%s, %s, %s|%10s|%-4s|\n", rom_str, ram_str, null_str, "right", "l");
+	check("%f %.2f %e\n", 1.5, -2.25, 1e10);
+	check("100%% %d%%\n", 5);
+}
+
+void test_limits(void)
+{
+	u32_t rec[TRACE_BINARY_REC_WORDS];
+	char text[256], expect[256], long_str[200], x_str[] = "x";
+	int i;
+
+	ring_reset();
+
+	/* more argument words than a record holds, the rest stays as it is */
+	encode(rec, 0, "%d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %lld %d\n",
+		1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16ll, 17);
+	trace_binary_render(rec, text, sizeof(text));
+	same_text(text, "1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 %lld %d\n");
+
+	/* unknown conversions are left as they are */
+	encode(rec, 0, "%y unknown %d\n", 3);
+	trace_binary_render(rec, text, sizeof(text));
+	same_text(text, "%y unknown 3\n");
+
+	/* copied strings share TRACE_BINARY_MAX_STR bytes */
+	memset(long_str, 'a', sizeof(long_str) - 1);
+	long_str[sizeof(long_str) - 1] = '\0';
+	encode(rec, 0, "[%s][%s][%s]", long_str, x_str, rom_str);
+	trace_binary_render(rec, text, sizeof(text));
+	snprintf(expect, sizeof(expect), "[%.*s][][%s]", TRACE_BINARY_MAX_STR - 1, long_str, rom_str);
+	same_text(text, expect);
+
+	/* output truncated to the buffer, still terminated */
+	encode(rec, 0, "%s %d", "0123456789", 12345);
+	zassert_equal(trace_binary_render(rec, text, 8), 7, "length");
+	same_text(text, "0123456");
+	zassert_equal(trace_binary_render(rec, text, 14), 13, "length");
+	same_text(text, "0123456789 12");
+
+	for (i = 0; i < 2; i++)
+		zassert_equal(trace_binary_render(rec, text, 1), 0, "length");
+
+	/* a format built at run time is not stored */
+	snprintf(expect, sizeof(expect), "built %s\n", "at run time");
+	zassert_equal(encode(rec, 0, expect, 5), -EINVAL, "ram format stored");
+	zassert_true(trace_binary_in_rom(&tb, "literal"), "literal not in rom");
+}
+
+void test_ring(void)
+{
+	u32_t rec[TRACE_BINARY_REC_WORDS], out[TRACE_BINARY_REC_WORDS];
+	u32_t put = 0, got = 0, drops = 0;
+	int i, n, words;
+
+	ring_reset();
+
+	srand(1);
+	for (i = 0; i < 20000; i++) {
+		/* records of 4 to 19 words, wrapping around the ring */
+		n = rand() % 16;
+		words = encode(rec, put, "%d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d", 1, 2,
+				3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16);
+		rec[0] = (words - 16 + n) | (n << 8);
+
+		if (trace_binary_put(&tb, rec) == 0)
+			put++;
+		else
+			drops++;
+
+		/* as fast as the writer on average, falling behind now and then */
+		while ((rand() % 2) && (words = trace_binary_get(&tb, out)) > 0) {
+			zassert_equal(out[1], got, "out of order");
+			zassert_equal((out[0] >> 8) & 0xff, (out[0] & 0xff) - TRACE_BINARY_HEAD_WORDS,
+				"record damaged");
+			got++;
+		}
+	}
+
+	while (trace_binary_get(&tb, out) > 0) {
+		zassert_equal(out[1], got, "out of order");
+		got++;
+	}
+
+	zassert_equal(got, put, "records lost");
+	zassert_equal(tb.drops, drops, "drop count");
+	zassert_true(drops > 0 && put > drops, "ring never filled");
+}
+
+static u8_t *put_varint(u8_t *d, u32_t val)
+{
+	for (; val >= 0x80; val >>= 7)
+		*d++ = val | 0x80;
+	*d++ = val;
+
+	return d;
+}
+
+static u8_t *put_head(u8_t *d, const char *fmt, u32_t delta)
+{
+	u32_t addr = (u32_t)(uintptr_t)fmt;
+
+	*d++ = TRACE_BINARY_SYNC;
+	*d++ = 0;
+	*d++ = addr;
+	*d++ = addr >> 8;
+	*d++ = addr >> 16;
+	*d++ = addr >> 24;
+
+	return put_varint(d, delta);
+}
+
+static void check_frame(u8_t *frame, int len, u8_t *expect, u8_t *end)
+{
+	expect[1] = end - expect - 2;
+
+	zassert_equal(len, end - expect, "frame length");
+	zassert_true(!memcmp(frame, expect, len), "frame bytes");
+}
+
+void test_frame(void)
+{
+	u32_t rec[TRACE_BINARY_REC_WORDS];
+	u8_t frame[TRACE_BINARY_FRAME_SIZE], expect[TRACE_BINARY_FRAME_SIZE], *d;
+	const char *fmt = "vol %d, %u %s %s %c %*d\n";
+	const char *typical = "a2dp start: codec %d, sample rate %d, bitpool %d\n";
+	char text[256], ram_str[] = "ab";
+	int len, text_len;
+
+	ring_reset();
+
+	encode(rec, 1000, fmt, -1, 300, rom_str, ram_str, 'z', -3, 7);
+	len = trace_binary_frame(&tb, rec, frame);
+
+	d = put_head(expect, fmt, 1000);
+	/* zigzag for %d and widths, rom strings by address, 0 for copied */
+	d = put_varint(d, 1);
+	d = put_varint(d, 300);
+	d = put_varint(d, (u32_t)(uintptr_t)rom_str);
+	d = put_varint(d, 0);
+	d = put_varint(d, 'z');
+	d = put_varint(d, 5);
+	d = put_varint(d, 14);
+	memcpy(d, "ab", 3);
+	d += 3;
+	check_frame(frame, len, expect, d);
+
+	/* timestamps are deltas from the last frame, a step back wraps */
+	encode(rec, 900, "back\n");
+	len = trace_binary_frame(&tb, rec, frame);
+	d = put_head(expect, "back\n", (u32_t)-100);
+	check_frame(frame, len, expect, d);
+	zassert_equal(len, 2 + 4 + 5, "frame length");
+
+	len = trace_binary_drop_frame(300, frame);
+	d = put_head(expect, NULL, 0);
+	d = put_varint(d, 300);
+	check_frame(frame, len, expect, d);
+
+	/* a typical message 1 ms later, against its text with the time prefix */
+	encode(rec, 900 + 24000, typical, 0, 44100, 53);
+	len = trace_binary_frame(&tb, rec, frame);
+	text_len = 14 + trace_binary_render(rec, text, sizeof(text));
+	zassert_true(len <= 14 && text_len >= 4 * len, "frame too long");
+}
+
+void test_main(void)
+{
+	ztest_test_suite(test_trace_binary,
+			 ztest_unit_test(test_render),
+			 ztest_unit_test(test_limits),
+			 ztest_unit_test(test_ring),
+			 ztest_unit_test(test_frame));
+	ztest_run_test_suite(test_trace_binary);
+}
@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2020 Actions Semiconductor Co., Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Prompts played by a simulated tts manager go through the cache: the
+ * first play decodes into a reserved entry, later ones hit. The heap is
+ * tracked to check the cache keeps within its budget and frees all it
+ * evicts.
+ */
+
+#include <ztest.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CONFIG_TTS_PCM_CACHE_ENTRIES	4
+
+/* mem_manager.h needs the kernel */
+#define __MEM_MANAGER_H__
+
+static int heap_blocks;
+
+void *mem_malloc(unsigned int num_bytes)
+{
+	heap_blocks++;
+	return malloc(num_bytes);
+}
+
+void mem_free(void *ptr)
+{
+	if (ptr)
+		heap_blocks--;
+	free(ptr);
+}
+
+#include <ext/actions/system/tts/tts_pcm_cache.c>
+
+#define BUDGET		(64 * 1024)
+#define MAX_PROMPT	(32 * 1024)
+
+static struct tts_pcm_cache cache;
+
+static void reset(void)
+{
+	int i;
+
+	for (i = 0; i < CONFIG_TTS_PCM_CACHE_ENTRIES; i++) {
+		if (cache.entry[i].state != TTS_PCM_CACHE_FREE)
+			tts_pcm_cache_remove(&cache, &cache.entry[i]);
+	}
+
+	tts_pcm_cache_init(&cache, BUDGET);
+}
+
+/* decode a prompt of len bytes into the cache as the manager does */
+static struct tts_pcm_cache_entry *fill(const char *name, u32_t len)
+{
+	struct tts_pcm_cache_entry *entry;
+
+	entry = tts_pcm_cache_reserve(&cache, name, MAX_PROMPT, 16);
+	if (!entry)
+		return NULL;
+
+	zassert_equal(entry->state, TTS_PCM_CACHE_FILLING, "state");
+	memset(entry->pcm, name[0], len);
+	tts_pcm_cache_commit(&cache, entry, len);
+
+	return entry;
+}
+
+static void check_used(void)
+{
+	u32_t used = 0;
+	int i, blocks = 0;
+
+	for (i = 0; i < CONFIG_TTS_PCM_CACHE_ENTRIES; i++) {
+		if (cache.entry[i].state != TTS_PCM_CACHE_FREE) {
+			used += cache.entry[i].size;
+			blocks++;
+		}
+	}
+
+	zassert_equal(used, cache.used, "used bytes");
+	zassert_true(used <= BUDGET, "over budget");
+	zassert_equal(blocks, heap_blocks, "heap blocks");
+}
+
+void test_hit_miss(void)
+{
+	struct tts_pcm_cache_entry *entry;
+
+	reset();
+
+	zassert_is_null(tts_pcm_cache_get(&cache, "vol_max.mp3"), "empty cache");
+	zassert_not_null(fill("vol_max.mp3", 8000), "fill");
+	check_used();
+	zassert_equal(cache.used, 8000, "shrunk to the pcm");
+
+	entry = tts_pcm_cache_get(&cache, "vol_max.mp3");
+	zassert_not_null(entry, "miss after fill");
+	zassert_equal(entry->len, 8000, "len");
+	zassert_equal(entry->sample_rate, 16, "sample rate");
+	zassert_equal(entry->pcm[7999], 'v', "pcm");
+	tts_pcm_cache_put(&cache, entry);
+
+	/* a second fill of a cached prompt is refused */
+	zassert_is_null(tts_pcm_cache_reserve(&cache, "vol_max.mp3", MAX_PROMPT, 16), "refill");
+
+	/* interrupted fill, longer than a decode buffer, too long a name */
+	entry = tts_pcm_cache_reserve(&cache, "bat_low.mp3", MAX_PROMPT, 16);
+	zassert_not_null(entry, "reserve");
+	zassert_is_null(tts_pcm_cache_get(&cache, "bat_low.mp3"), "hit while filling");
+	tts_pcm_cache_remove(&cache, entry);
+	zassert_is_null(tts_pcm_cache_reserve(&cache, "huge.mp3", BUDGET + 1, 16), "over budget");
+	zassert_is_null(tts_pcm_cache_reserve(&cache, "a_very_long_prompt_name.mp3", MAX_PROMPT, 16),
+		"long name");
+	check_used();
+
+	zassert_equal(cache.hits, 1, "hits");
+	zassert_equal(cache.misses, 2, "misses");
+}
+
+static bool cached(const char *name)
+{
+	struct tts_pcm_cache_entry *entry = pcm_cache_find(&cache, name);
+
+	return entry && entry->state == TTS_PCM_CACHE_READY;
+}
+
+void test_lru(void)
+{
+	struct tts_pcm_cache_entry *playing;
+
+	reset();
+
+	/* each fill reserves a whole decode buffer first */
+	fill("a.mp3", 15000);
+	playing = tts_pcm_cache_get(&cache, "a.mp3");
+	fill("b.mp3", 15000);
+	fill("c.mp3", 15000);
+	check_used();
+
+	/* a is the oldest but plays */
+	zassert_not_null(fill("d.mp3", 15000), "fill d");
+	zassert_true(cached("a.mp3") && !cached("b.mp3") && cached("c.mp3"), "evicted b");
+	zassert_equal(cache.evictions, 1, "evictions");
+	check_used();
+
+	tts_pcm_cache_put(&cache, playing);
+	zassert_not_null(fill("e.mp3", 15000), "fill e");
+	zassert_true(!cached("a.mp3") && cached("c.mp3"), "evicted a");
+
+	/* c is used again, d is the oldest now */
+	zassert_equal(tts_pcm_cache_touch(&cache, "c.mp3"), 0, "touch");
+	zassert_equal(tts_pcm_cache_touch(&cache, "x.mp3"), -ENOENT, "touch missing");
+	zassert_not_null(fill("f.mp3", 15000), "fill f");
+	zassert_true(cached("c.mp3") && !cached("d.mp3") && cached("e.mp3"), "evicted d");
+	zassert_equal(cache.evictions, 3, "evictions");
+	check_used();
+
+	/* everything playing, no room */
+	tts_pcm_cache_get(&cache, "c.mp3");
+	tts_pcm_cache_get(&cache, "e.mp3");
+	tts_pcm_cache_get(&cache, "f.mp3");
+	zassert_is_null(fill("g.mp3", 100), "fill while all play");
+	check_used();
+}
+
+void test_entries(void)
+{
+	char name[16];
+	int i;
+
+	reset();
+
+	/* more small prompts than entries, the oldest go */
+	for (i = 0; i < 10; i++) {
+		sprintf(name, "p%d.mp3", i);
+		zassert_not_null(fill(name, 1000), "fill");
+		check_used();
+	}
+
+	for (i = 0; i < 10; i++) {
+		sprintf(name, "p%d.mp3", i);
+		if (i < 10 - CONFIG_TTS_PCM_CACHE_ENTRIES)
+			zassert_is_null(tts_pcm_cache_get(&cache, name), "old kept");
+		else
+			zassert_not_null(tts_pcm_cache_get(&cache, name), "new evicted");
+	}
+}
+
+void test_main(void)
+{
+	ztest_test_suite(test_tts_pcm_cache,
+			 ztest_unit_test(test_hit_miss),
+			 ztest_unit_test(test_lru),
+			 ztest_unit_test(test_entries));
+	ztest_run_test_suite(test_tts_pcm_cache);
+}
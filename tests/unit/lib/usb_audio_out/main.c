@@ -0,0 +1,330 @@
+/*
+ * Copyright (c) 2020 Actions Semi Co., Ltd.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Feeds synthetic isochronous packet streams through the usb audio OUT
+ * path into a ring stream with the claim rules of acts_ringbuf, checks
+ * the reader gets the same 32 bit samples as with the previous three copy
+ * path, and reports the time per packet of both.
+ */
+
+#include <ztest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* the stream and usb class headers need the kernel */
+#define __IOSTREAM_H__
+#define __USB_AUDIO_H__
+
+typedef struct __stream *io_stream_t;
+
+int stream_write_claim(io_stream_t handle, unsigned char **buf, int num);
+int stream_write_commit(io_stream_t handle, unsigned char *buf, int num);
+int stream_write(io_stream_t handle, unsigned char *buf, int num);
+int usb_audio_device_ep_read(u8_t *data, u32_t data_len, u32_t *bytes_ret);
+
+#include <ext/actions/base/utils/pcm_kernel/pcm_kernel.c>
+#include <ext/actions/porting/hal/usb_audio/usb_audio_out.c>
+
+/* 96 kHz 24 bit stereo */
+#define MAX_PACKET	(96 * 3 * 2)
+#define RING_SIZE	(8 * 1024 + 4)
+#define BENCH_PACKETS	100000
+
+struct __stream {
+	u8_t data[RING_SIZE] __aligned(4);
+	u32_t head;
+	u32_t tail;
+};
+
+struct packet_stream {
+	const char *name;
+	u32_t rate;
+	u8_t bit_depth;
+};
+
+static const struct packet_stream streams[] = {
+	{ "48 kHz 24 bit", 48000, 24 },
+	{ "96 kHz 24 bit", 96000, 24 },
+	{ "44.1 kHz 24 bit", 44100, 24 },
+	{ "48 kHz 16 bit", 48000, 16 },
+};
+
+static struct __stream ring;
+
+/* the packet in the endpoint fifo */
+static u8_t fifo[MAX_PACKET];
+static u32_t fifo_len;
+
+static u8_t bounce[MAX_PACKET * 2] __aligned(4);
+
+/* samples the reader should get */
+static u8_t expect[MAX_PACKET * 2];
+static u32_t expect_len;
+
+static unsigned int seed = 1;
+
+static u32_t rnd(u32_t n)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 8) % n;
+}
+
+static u32_t ring_space(void)
+{
+	return RING_SIZE - (ring.tail - ring.head);
+}
+
+int stream_write_claim(io_stream_t handle, unsigned char **buf, int num)
+{
+	u32_t offset = handle->tail % RING_SIZE;
+	u32_t max_size = MIN(RING_SIZE - offset, ring_space());
+
+	*buf = handle->data + offset;
+	return MIN((u32_t)num, max_size);
+}
+
+int stream_write_commit(io_stream_t handle, unsigned char *buf, int num)
+{
+	zassert_true(buf == handle->data + handle->tail % RING_SIZE, "commit address");
+	handle->tail += num;
+	return 0;
+}
+
+int stream_write(io_stream_t handle, unsigned char *buf, int num)
+{
+	u32_t offset = handle->tail % RING_SIZE, len;
+
+	if (num > ring_space())
+		return 0;
+
+	len = MIN((u32_t)num, RING_SIZE - offset);
+	memcpy(handle->data + offset, buf, len);
+	memcpy(handle->data, buf + len, num - len);
+	handle->tail += num;
+
+	return num;
+}
+
+int usb_audio_device_ep_read(u8_t *data, u32_t data_len, u32_t *bytes_ret)
+{
+	*bytes_ret = MIN(fifo_len, data_len);
+	memcpy(data, fifo, *bytes_ret);
+	return 0;
+}
+
+/* previous _usb_audio_out_ep_complete: fifo to stack, widen, stream_write */
+static void old_packet(io_stream_t stream, u8_t bit_depth)
+{
+	u8_t isoc_buf[MAX_PACKET];
+	int32_t *buffer = (int32_t *)bounce;
+	int16_t *pbuf = (int16_t *)isoc_buf;
+	u32_t read_byte;
+	int j = 0, num;
+
+	usb_audio_device_ep_read(isoc_buf, sizeof(isoc_buf), &read_byte);
+	num = read_byte;
+
+	if (bit_depth == 24) {
+		for (int i = 0; i + 3 <= num; ) {
+			int32_t v = ((int32_t)isoc_buf[i++]) << 8;
+			v |= ((int32_t)isoc_buf[i++]) << 16;
+			v |= ((int32_t)isoc_buf[i++]) << 24;
+			buffer[j++] = v;
+		}
+
+		stream_write(stream, (unsigned char *)buffer, num * 4 / 3);
+	} else {
+		for (int i = 0; i < num / 2; i++)
+			buffer[i] = (int32_t)pbuf[i] << 16;
+
+		stream_write(stream, (unsigned char *)buffer, num * 2);
+	}
+}
+
+/* packets of 1 ms, 44.1 kHz alternates 44 and 45 frames */
+static u32_t next_packet(const struct packet_stream *s, u32_t n, bool check)
+{
+	u32_t frames = (s->rate * (n + 1)) / 1000 - (s->rate * n) / 1000;
+	u32_t bytes = s->bit_depth / 8;
+	u32_t i;
+
+	fifo_len = frames * 2 * bytes;
+	for (i = 0; i < fifo_len; i++)
+		fifo[i] = rnd(256);
+
+	if (!check)
+		return fifo_len;
+
+	/* left aligned 32 bit samples */
+	expect_len = 0;
+	for (i = 0; i < fifo_len; i += bytes) {
+		expect[expect_len++] = 0;
+		if (bytes == 3)
+			expect[expect_len++] = fifo[i];
+		else
+			expect[expect_len++] = 0;
+		expect[expect_len++] = fifo[i + bytes - 2];
+		expect[expect_len++] = fifo[i + bytes - 1];
+	}
+
+	return fifo_len;
+}
+
+static void ring_check_read(const u8_t *data, u32_t len)
+{
+	u32_t i;
+
+	zassert_true(ring.tail - ring.head >= len, "samples missing");
+	for (i = 0; i < len; i++) {
+		if (ring.data[(ring.head + i) % RING_SIZE] != data[i])
+			break;
+	}
+	zassert_equal(i, len, "samples differ");
+	ring.head += len;
+}
+
+static void reset(void)
+{
+	memset(&ring, 0, sizeof(ring));
+	/* start off the ring base, packets straddle the end */
+	ring.head = ring.tail = rnd(RING_SIZE) & ~3;
+}
+
+void test_samples(void)
+{
+	struct usb_audio_out_stats stats;
+	const struct packet_stream *s;
+	u32_t n, len;
+	int k;
+
+	for (k = 0; k < ARRAY_SIZE(streams); k++) {
+		s = &streams[k];
+		reset();
+		memset(&stats, 0, sizeof(stats));
+
+		for (n = 0; n < 5000; n++) {
+			len = next_packet(s, n, true);
+			zassert_equal(usb_audio_out_packet(&ring, s->bit_depth, bounce, MAX_PACKET, &stats),
+				      len, "read");
+			ring_check_read(expect, expect_len);
+			zassert_equal(ring.tail, ring.head, "extra samples");
+		}
+
+		printf("%-16s %u in place, %u bounced\n", s->name, stats.in_place, stats.bounced);
+		zassert_equal(stats.in_place + stats.bounced, n, "packets");
+		zassert_equal(stats.dropped, 0, "dropped");
+		zassert_true(stats.in_place > stats.bounced * 4, "mostly in place");
+	}
+}
+
+void test_reader_late(void)
+{
+	struct usb_audio_out_stats stats;
+	const struct packet_stream *s = &streams[1];
+	u8_t *out;
+	u32_t n, len, sent = 0, got = 0, i;
+
+	reset();
+	memset(&stats, 0, sizeof(stats));
+	out = malloc(MAX_PACKET * 2 * 1000);
+
+	/* the reader takes a random amount now and then, full packets are dropped */
+	for (n = 0; n < 1000; n++) {
+		len = next_packet(s, n, true);
+		i = ring.tail;
+		usb_audio_out_packet(&ring, s->bit_depth, bounce, MAX_PACKET, &stats);
+		if (ring.tail != i) {
+			memcpy(out + sent, expect, expect_len);
+			sent += expect_len;
+		}
+
+		if (!rnd(4)) {
+			len = MIN(rnd(4096), ring.tail - ring.head);
+			ring_check_read(out + got, len);
+			got += len;
+		}
+	}
+
+	ring_check_read(out + got, sent - got);
+	free(out);
+
+	printf("reader late: %u in place, %u bounced, %u dropped\n",
+	       stats.in_place, stats.bounced, stats.dropped);
+	zassert_true(stats.dropped > 0, "no drop");
+	zassert_equal(stats.in_place + stats.bounced + stats.dropped, n, "packets");
+
+	/* no stream, the endpoint is still drained */
+	fifo_len = 100;
+	zassert_equal(usb_audio_out_packet(NULL, 24, bounce, MAX_PACKET, &stats), 100, "drain");
+}
+
+static u64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void test_benchmark(void)
+{
+	struct usb_audio_out_stats stats;
+	const struct packet_stream *s;
+	u64_t start, old_ns, new_ns;
+	u32_t n, t;
+	int k;
+
+	for (k = 0; k < 2; k++) {
+		s = &streams[k];
+		next_packet(s, 0, false);
+
+		reset();
+		start = now_ns();
+		for (n = 0; n < BENCH_PACKETS; n++) {
+			old_packet(&ring, s->bit_depth);
+			ring.head = ring.tail;
+		}
+		old_ns = now_ns() - start;
+
+		reset();
+		memset(&stats, 0, sizeof(stats));
+		start = now_ns();
+		for (n = 0; n < BENCH_PACKETS; n++) {
+			usb_audio_out_packet(&ring, s->bit_depth, bounce, MAX_PACKET, &stats);
+			ring.head = ring.tail;
+		}
+		new_ns = now_ns() - start;
+
+		/* per packet, as the endpoint irq accounts it */
+		memset(&stats, 0, sizeof(stats));
+		for (n = 0; n < BENCH_PACKETS / 10; n++) {
+			t = now_ns();
+			usb_audio_out_packet(&ring, s->bit_depth, bounce, MAX_PACKET, &stats);
+			ring.head = ring.tail;
+			usb_audio_out_isr_time(&stats, now_ns() - t);
+		}
+
+		printf("%-16s %4u bytes: three copies %5u ns, in place %5u ns per packet\n",
+		       s->name, fifo_len, (u32_t)(old_ns / BENCH_PACKETS),
+		       (u32_t)(new_ns / BENCH_PACKETS));
+		printf("%-16s isr time avg %u ns, max %u ns\n", "",
+		       (u32_t)(stats.isr_cycles_sum / stats.isr_packets), stats.isr_cycles_max);
+
+		zassert_equal(stats.isr_packets, BENCH_PACKETS / 10, "isr packets");
+		zassert_true(stats.isr_cycles_max >= stats.isr_cycles_last, "isr max");
+	}
+}
+
+void test_main(void)
+{
+	ztest_test_suite(test_usb_audio_out,
+			 ztest_unit_test(test_samples),
+			 ztest_unit_test(test_reader_late),
+			 ztest_unit_test(test_benchmark));
+	ztest_run_test_suite(test_usb_audio_out);
+}
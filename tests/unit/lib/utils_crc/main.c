@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2019 Actions Semiconductor Co., Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <ztest.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <ext/actions/base/utils/crc/crc.c>
+
+static u8_t check[] = { '1', '2', '3', '4', '5', '6', '7', '8', '9' };
+static u8_t data[1031];
+
+/* reference bitwise implementations of the previous crc routines */
+static u16_t ref_crc16_lsb(u16_t poly, u16_t crc, const u8_t *src, int len)
+{
+	int b;
+
+	while (len-- > 0) {
+		crc ^= *src++;
+		for (b = 0; b < 8; b++)
+			crc = (crc & 0x1) ? ((crc >> 1) ^ poly) : (crc >> 1);
+	}
+
+	return crc;
+}
+
+static u32_t ref_crc32(u32_t crc, const u8_t *src, int len)
+{
+	int b;
+
+	crc = ~crc;
+	while (len-- > 0) {
+		crc ^= *src++;
+		for (b = 0; b < 8; b++)
+			crc = (crc & 0x1) ? ((crc >> 1) ^ 0xedb88320) : (crc >> 1);
+	}
+
+	return ~crc;
+}
+
+/* the nibble table crc32 the module replaced */
+static const u32_t nibble_crc32[16] = {
+	0, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+	0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+};
+
+static u32_t nibble_crc32_update(u32_t crc, const u8_t *src, int len)
+{
+	crc = ~crc;
+	while (len-- > 0) {
+		crc = (crc >> 4) ^ nibble_crc32[(crc & 0xf) ^ (*src & 0xf)];
+		crc = (crc >> 4) ^ nibble_crc32[(crc & 0xf) ^ (*src++ >> 4)];
+	}
+
+	return ~crc;
+}
+
+static void fill_data(void)
+{
+	u32_t seed = 0x12345678;
+	int i;
+
+	for (i = 0; i < sizeof(data); i++) {
+		seed = seed * 1103515245 + 12345;
+		data[i] = seed >> 16;
+	}
+}
+
+void test_crc_check_value(void)
+{
+	zassert_equal(utils_crc32(0, check, sizeof(check)), 0xcbf43926, NULL);
+	zassert_equal(utils_crc16_ccitt_update(0, check, sizeof(check)), 0x31c3, NULL);
+	zassert_equal(utils_crc16_ccitt_rev_update(0, check, sizeof(check)), 0x2189, NULL);
+	zassert_equal(utils_crc16_ibm_rev_update(0, check, sizeof(check)), 0xbb3d, NULL);
+	zassert_equal(utils_crc16(check, sizeof(check), 0x1021, 0xffff, 1), 0xe5cc, NULL);
+	zassert_equal(utils_crc16(NULL, 0, 0x1021, 0xffff, 1), 0x1d0f, NULL);
+}
+
+void test_crc_conformance(void)
+{
+	int offs, len;
+
+	fill_data();
+
+	/* every alignment and tail length of the word loop */
+	for (offs = 0; offs < 8; offs++) {
+		for (len = 0; len < sizeof(data) - offs; len += 13) {
+			zassert_equal(utils_crc32(0x5a5a5a5a, data + offs, len),
+				      ref_crc32(0x5a5a5a5a, data + offs, len), NULL);
+			zassert_equal(utils_crc16_ccitt_rev_update(0xffff, data + offs, len),
+				      ref_crc16_lsb(0x8408, 0xffff, data + offs, len), NULL);
+			zassert_equal(utils_crc16_ibm_rev_update(0, data + offs, len),
+				      ref_crc16_lsb(0xa001, 0, data + offs, len), NULL);
+			zassert_equal(utils_crc16(data + offs, len, 0x1021, 0x1234, 1),
+				      crc16_bitwise(data + offs, len, 0x1021, 0x1234, 1), NULL);
+		}
+	}
+}
+
+void test_crc_streaming(void)
+{
+	u32_t crc32 = 0;
+	u16_t crc16 = 0;
+	int offs, len;
+
+	fill_data();
+
+	for (offs = 0; offs < sizeof(data); offs += len) {
+		len = min(sizeof(data) - offs, 1 + offs % 61);
+		crc32 = utils_crc32(crc32, data + offs, len);
+		crc16 = utils_crc16_ccitt_update(crc16, data + offs, len);
+	}
+
+	zassert_equal(crc32, utils_crc32(0, data, sizeof(data)), NULL);
+	zassert_equal(crc16, utils_crc16_ccitt_update(0, data, sizeof(data)), NULL);
+}
+
+#define BENCH_BYTES	(4 * 1024 * 1024)
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* MB/s over BENCH_BYTES in data sized blocks, as an OTA segment is fed */
+#define BENCH(name, expr)							\
+	({								\
+		volatile u32_t sink = 0;					\
+		double start = now(), mbs;				\
+		int done;							\
+		for (done = 0; done < BENCH_BYTES; done += sizeof(data))	\
+			sink += (expr);						\
+		mbs = BENCH_BYTES / (now() - start) / 1e6;		\
+		printf("%-24s %8.1f MB/s\n", name, mbs);		\
+		(void)sink;							\
+		mbs;								\
+	})
+
+void test_crc_benchmark(void)
+{
+	double table, bitwise;
+
+	fill_data();
+
+	BENCH("crc32 nibble table", nibble_crc32_update(0, data, sizeof(data)));
+	BENCH("crc32", utils_crc32(0, data, sizeof(data)));
+	BENCH("crc16 ccitt", utils_crc16_ccitt_update(0, data, sizeof(data)));
+	BENCH("crc16 ibm rev", utils_crc16_ibm_rev_update(0, data, sizeof(data)));
+	bitwise = BENCH("crc16 bitwise", crc16_bitwise(data, sizeof(data), 0x1021, 0xffff, 1));
+	table = BENCH("crc16 0x1021 table", utils_crc16(data, sizeof(data), 0x1021, 0xffff, 1));
+
+	zassert_true(table > bitwise, "table crc16 slower than bitwise");
+}
+
+void test_main(void)
+{
+	ztest_test_suite(test_utils_crc,
+			 ztest_unit_test(test_crc_check_value),
+			 ztest_unit_test(test_crc_conformance),
+			 ztest_unit_test(test_crc_streaming),
+			 ztest_unit_test(test_crc_benchmark));
+	ztest_run_test_suite(test_utils_crc);
+}